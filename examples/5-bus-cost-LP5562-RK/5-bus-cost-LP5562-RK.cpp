@@ -0,0 +1,31 @@
+#include "LP5562-RK.h"
+#include "LP5562-RK-Bench.h"
+
+// This example doesn't need an LP5562 connected. It runs each API call against the simulator
+// and prints a CSV table of the I2C bus cost over USB serial, once without and once with the
+// register shadow enabled.
+
+SYSTEM_THREAD(ENABLED);
+
+bool printed = false;
+
+void printResult(const LP5562BusBenchmark::Result &result, void *context) {
+	char buf[128];
+	LP5562BusBenchmark::formatCsv(result, buf, sizeof(buf));
+	Serial.println(buf);
+}
+
+void setup() {
+	// Wait for a USB serial connection for up to 10  seconds
+	waitFor(Serial.isConnected, 10000);
+}
+
+void loop() {
+	if (!printed && Serial.isConnected()) {
+		printed = true;
+
+		Serial.println(LP5562BusBenchmark::getCsvHeader());
+		LP5562BusBenchmark::run(false, printResult, NULL);
+		LP5562BusBenchmark::run(true, printResult, NULL);
+	}
+}
@@ -0,0 +1,37 @@
+#include "LP5562-RK.h"
+#include "LP5562-RK-Async.h"
+
+// Changes the color from loop() without waiting for I2C. The worker thread in LP5562Async does the
+// I2C writes, and if loop() changes the color faster than the bus can keep up, only the latest color
+// is sent.
+
+SYSTEM_THREAD(ENABLED);
+
+LP5562 ledDriver;
+LP5562Async ledAsync(ledDriver);
+
+uint8_t hue = 0;
+
+void setup() {
+	ledDriver.withLEDCurrent(5.0).withShadowRegisters().begin();
+	ledAsync.start();
+}
+
+void loop() {
+	// Simple color wheel: red -> green -> blue -> red
+	uint8_t pos = hue++;
+	if (pos < 85) {
+		ledAsync.setRGB(255 - pos * 3, pos * 3, 0);
+	}
+	else
+	if (pos < 170) {
+		pos -= 85;
+		ledAsync.setRGB(0, 255 - pos * 3, pos * 3);
+	}
+	else {
+		pos -= 170;
+		ledAsync.setRGB(pos * 3, 0, 255 - pos * 3);
+	}
+
+	delay(10);
+}
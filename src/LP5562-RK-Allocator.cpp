@@ -0,0 +1,250 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Allocator.h"
+
+LP5562EngineAllocator::LP5562EngineAllocator(LP5562 &driver) : driver(driver) {
+	for(size_t ii = 0; ii < NUM_CHANNELS; ii++) {
+		requests[ii].hasEffect = false;
+		requests[ii].priority = 0;
+		requests[ii].level = 0;
+		requests[ii].program.numInstructions = 0;
+
+		channelEngine[ii] = 0;
+		channelDegraded[ii] = false;
+		channelLevel[ii] = 0;
+	}
+	for(size_t ii = 0; ii < 3; ii++) {
+		engines[ii].numInstructions = 0;
+	}
+}
+
+LP5562EngineAllocator::~LP5562EngineAllocator() {
+
+}
+
+bool LP5562EngineAllocator::setEffect(size_t channel, const uint16_t *instructions, size_t numInstructions, uint8_t priority, uint8_t fallbackLevel) {
+	if (channel >= NUM_CHANNELS || numInstructions == 0 || numInstructions > 16) {
+		return false;
+	}
+	for(size_t ii = 0; ii < numInstructions; ii++) {
+		if ((instructions[ii] & 0xe000) == 0xe000) {
+			// Triggers depend on which engine the program runs on
+			return false;
+		}
+	}
+
+	Request &request = requests[channel];
+	request.hasEffect = true;
+	request.priority = priority;
+	request.level = fallbackLevel;
+	for(size_t ii = 0; ii < 16; ii++) {
+		request.program.instructions[ii] = (ii < numInstructions) ? instructions[ii] : 0;
+	}
+	request.program.numInstructions = (uint8_t) numInstructions;
+
+	return true;
+}
+
+bool LP5562EngineAllocator::setLevel(size_t channel, uint8_t level) {
+	if (channel >= NUM_CHANNELS) {
+		return false;
+	}
+
+	Request &request = requests[channel];
+	request.hasEffect = false;
+	request.priority = 0;
+	request.level = level;
+	request.program.numInstructions = 0;
+
+	return true;
+}
+
+bool LP5562EngineAllocator::apply() {
+	// Channels with the same program share one group, which needs one engine. The group has the
+	// highest priority of its channels.
+	size_t groupFirst[NUM_CHANNELS];
+	uint8_t groupMask[NUM_CHANNELS];
+	uint8_t groupPriority[NUM_CHANNELS];
+	size_t numGroups = 0;
+
+	for(size_t channel = 0; channel < NUM_CHANNELS; channel++) {
+		const Request &request = requests[channel];
+		if (!request.hasEffect) {
+			continue;
+		}
+
+		size_t group = 0;
+		while(group < numGroups && !isSameProgram(requests[groupFirst[group]].program, request.program)) {
+			group++;
+		}
+		if (group == numGroups) {
+			groupFirst[group] = channel;
+			groupMask[group] = 0;
+			groupPriority[group] = 0;
+			numGroups++;
+		}
+		groupMask[group] |= (uint8_t)(1 << channel);
+		if (request.priority > groupPriority[group]) {
+			groupPriority[group] = request.priority;
+		}
+	}
+
+	// Highest priority first. Groups with the same priority stay in channel order.
+	size_t order[NUM_CHANNELS];
+	for(size_t ii = 0; ii < numGroups; ii++) {
+		size_t jj = ii;
+		while(jj > 0 && groupPriority[order[jj - 1]] < groupPriority[ii]) {
+			order[jj] = order[jj - 1];
+			jj--;
+		}
+		order[jj] = ii;
+	}
+	size_t numWinners = (numGroups < 3) ? numGroups : 3;
+
+	// Groups that are already running on an engine stay there, so they are not restarted
+	int engineGroup[3] = { -1, -1, -1 };
+	bool assigned[NUM_CHANNELS] = { false, false, false, false };
+
+	if (chipValid) {
+		for(size_t ii = 0; ii < numWinners; ii++) {
+			size_t group = order[ii];
+			for(size_t engine = 0; engine < 3; engine++) {
+				if (engineGroup[engine] < 0 && engines[engine].numInstructions > 0 &&
+					isSameProgram(engines[engine], requests[groupFirst[group]].program)) {
+					engineGroup[engine] = (int) group;
+					assigned[group] = true;
+					break;
+				}
+			}
+		}
+	}
+	for(size_t ii = 0; ii < numWinners; ii++) {
+		size_t group = order[ii];
+		if (assigned[group]) {
+			continue;
+		}
+		for(size_t engine = 0; engine < 3; engine++) {
+			if (engineGroup[engine] < 0) {
+				engineGroup[engine] = (int) group;
+				assigned[group] = true;
+				break;
+			}
+		}
+	}
+
+	driver.beginBatch();
+
+	bool bResult = true;
+	uint8_t loadMask = 0;
+	uint8_t holdMask = 0;
+
+	for(size_t engine = 0; engine < 3; engine++) {
+		uint8_t engineMask = driver.engineNumToMask(engine + 1);
+
+		if (engineGroup[engine] < 0) {
+			// Not needed any more
+			if (engines[engine].numInstructions > 0 || !chipValid) {
+				holdMask |= engineMask;
+			}
+			engines[engine].numInstructions = 0;
+			continue;
+		}
+
+		const Program &program = requests[groupFirst[engineGroup[engine]]].program;
+		if (chipValid && isSameProgram(engines[engine], program)) {
+			// Keep running
+			continue;
+		}
+
+		if (!driver.setProgram(engine + 1, program.instructions, program.numInstructions, false)) {
+			bResult = false;
+		}
+		engines[engine] = program;
+		loadMask |= engineMask;
+	}
+
+	if (holdMask && !driver.setEnable(holdMask, LP5562::REG_ENABLE_HOLD)) {
+		bResult = false;
+	}
+	if (!driver.startEngines(loadMask)) {
+		bResult = false;
+	}
+
+	// Channel mapping and direct levels
+	uint8_t newEngine[NUM_CHANNELS];
+	bool mappingChanged = !chipValid;
+
+	for(size_t channel = 0; channel < NUM_CHANNELS; channel++) {
+		const Request &request = requests[channel];
+
+		newEngine[channel] = 0;
+		channelDegraded[channel] = false;
+
+		if (request.hasEffect) {
+			for(size_t engine = 0; engine < 3; engine++) {
+				if (engineGroup[engine] >= 0 && (groupMask[engineGroup[engine]] & (1 << channel)) != 0) {
+					newEngine[channel] = (uint8_t)(engine + 1);
+				}
+			}
+			channelDegraded[channel] = (newEngine[channel] == 0);
+		}
+
+		if (newEngine[channel] == 0 && (!chipValid || request.level != channelLevel[channel])) {
+			switch(channel) {
+			case CHANNEL_R:
+				driver.setR(request.level);
+				break;
+			case CHANNEL_G:
+				driver.setG(request.level);
+				break;
+			case CHANNEL_B:
+				driver.setB(request.level);
+				break;
+			default:
+				driver.setW(request.level);
+				break;
+			}
+			channelLevel[channel] = request.level;
+		}
+
+		if (newEngine[channel] != channelEngine[channel]) {
+			mappingChanged = true;
+		}
+		channelEngine[channel] = newEngine[channel];
+	}
+
+	// The engine numbers are the same as REG_LED_MAP_ENGINE_1 - 3, and 0 is REG_LED_MAP_DIRECT
+	if (mappingChanged && !driver.setLedMapping(newEngine[CHANNEL_R], newEngine[CHANNEL_G], newEngine[CHANNEL_B], newEngine[CHANNEL_W])) {
+		bResult = false;
+	}
+
+	if (!driver.commit()) {
+		bResult = false;
+	}
+
+	enginesLoaded = 0;
+	for(size_t engine = 0; engine < 3; engine++) {
+		if (loadMask & driver.engineNumToMask(engine + 1)) {
+			enginesLoaded++;
+		}
+	}
+
+	// After an error, send everything again next time
+	chipValid = bResult;
+
+	return bResult;
+}
+
+// static
+bool LP5562EngineAllocator::isSameProgram(const Program &a, const Program &b) {
+	if (a.numInstructions != b.numInstructions) {
+		return false;
+	}
+	for(size_t ii = 0; ii < a.numInstructions; ii++) {
+		if (a.instructions[ii] != b.instructions[ii]) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,189 @@
+#ifndef __LP5562_RK_ALLOCATOR_H
+#define __LP5562_RK_ALLOCATOR_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Shares the three engines between effects on different channels
+ *
+ * Helpers like setBlink() and setBreathe() take over all of the engines. With the allocator, each
+ * part of your code sets the effect for the channel it owns, and apply() works out which engine
+ * runs what:
+ *
+ * LP5562EngineAllocator allocator(ledDriver);
+ * allocator.setEffect(LP5562EngineAllocator::CHANNEL_R, connectingBlink, 20);
+ * allocator.setEffect(LP5562EngineAllocator::CHANNEL_W, chargingBreathe, 10);
+ * allocator.apply();
+ *
+ * Channels with identical programs share an engine, so they stay in step. If more than three different
+ * programs are requested, the ones with the highest priority get engines, and the others are degraded to
+ * their fallback level, driven directly without an engine, until an engine is free again.
+ *
+ * apply() keeps effects that didn't change on the engine they're already running on, so they aren't
+ * restarted, and only loads the engines whose program changed. The LED mapping and direct levels are
+ * only written if they changed, in the same batch.
+ *
+ * Programs must not use trigger instructions, since the engine a program runs on is not known in
+ * advance. The allocator assumes it is the only code changing the programs, LED mapping, and direct
+ * levels.
+ */
+class LP5562EngineAllocator {
+public:
+	/**
+	 * @brief Construct an allocator with every channel off
+	 *
+	 * @param driver The LP5562 to program. begin() must be called on it before apply().
+	 */
+	LP5562EngineAllocator(LP5562 &driver);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562EngineAllocator();
+
+	/**
+	 * @brief Run a program on a channel
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+	 *
+	 * @param instructions The instruction words (1 - 16). They're copied.
+	 *
+	 * @param numInstructions Number of instructions
+	 *
+	 * @param priority Higher priority effects get engines first when there aren't enough (0 - 255)
+	 *
+	 * @param fallbackLevel The PWM level to use if the effect can't get an engine (default: 0, off)
+	 *
+	 * @return false if the channel or program is not valid, or the program uses trigger instructions.
+	 * Nothing changes until apply().
+	 */
+	bool setEffect(size_t channel, const uint16_t *instructions, size_t numInstructions, uint8_t priority = 0, uint8_t fallbackLevel = 0);
+
+	/**
+	 * @brief Run a program on a channel
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+	 *
+	 * @param program The program. It's copied.
+	 *
+	 * @param priority Higher priority effects get engines first when there aren't enough (0 - 255)
+	 *
+	 * @param fallbackLevel The PWM level to use if the effect can't get an engine (default: 0, off)
+	 */
+	bool setEffect(size_t channel, const LP5562Program &program, uint8_t priority = 0, uint8_t fallbackLevel = 0) {
+		return setEffect(channel, program.getInstructions(), program.getStepNum(), priority, fallbackLevel);
+	};
+
+	/**
+	 * @brief Set a channel to a constant level, without an engine
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+	 *
+	 * @param level The PWM level (0 = off, 255 = full brightness)
+	 */
+	bool setLevel(size_t channel, uint8_t level);
+
+	/**
+	 * @brief Turn a channel off and free its engine, same as setLevel(channel, 0)
+	 */
+	bool release(size_t channel) { return setLevel(channel, 0); };
+
+	/**
+	 * @brief Assign the engines and update the chip
+	 *
+	 * @return false if there was an I2C error. The chip state is re-sent on the next apply() in that case.
+	 */
+	bool apply();
+
+	/**
+	 * @brief Get the engine driving a channel after apply()
+	 *
+	 * @return 1 - 3, or 0 if the channel is driven directly (constant level or degraded)
+	 */
+	size_t getEngine(size_t channel) const { return (channel < NUM_CHANNELS) ? channelEngine[channel] : 0; };
+
+	/**
+	 * @brief Returns true if the channel has an effect that didn't get an engine in the last apply()
+	 */
+	bool isDegraded(size_t channel) const { return (channel < NUM_CHANNELS) && channelDegraded[channel]; };
+
+	/**
+	 * @brief Get the number of engines whose program was loaded by the last apply()
+	 */
+	size_t getEnginesLoaded() const { return enginesLoaded; };
+
+	static const size_t NUM_CHANNELS = 4;	//!< Number of LED channels
+	static const size_t CHANNEL_R = 0;		//!< Red channel index
+	static const size_t CHANNEL_G = 1;		//!< Green channel index
+	static const size_t CHANNEL_B = 2;		//!< Blue channel index
+	static const size_t CHANNEL_W = 3;		//!< White channel index
+
+protected:
+	/**
+	 * @brief A program and its length, padded with 0x0000 the same as LP5562::setProgram()
+	 */
+	struct Program {
+		uint16_t instructions[16];	//!< Instruction words
+		uint8_t numInstructions;	//!< Number of instructions, 0 if none
+	};
+
+	/**
+	 * @brief What was requested for a channel
+	 */
+	struct Request {
+		bool hasEffect;				//!< Run program, otherwise use level
+		uint8_t priority;			//!< Priority of the effect
+		uint8_t level;				//!< Constant level, or fallback level for an effect
+		Program program;			//!< The effect
+	};
+
+	/**
+	 * @brief Returns true if two programs are the same
+	 */
+	static bool isSameProgram(const Program &a, const Program &b);
+
+	/**
+	 * @brief The LP5562 to program
+	 */
+	LP5562 &driver;
+
+	/**
+	 * @brief Requested state of each channel
+	 */
+	Request requests[NUM_CHANNELS];
+
+	/**
+	 * @brief Program running on each engine, numInstructions is 0 if the engine is not used
+	 */
+	Program engines[3];
+
+	/**
+	 * @brief Engine driving each channel (1 - 3) or 0 for direct
+	 */
+	uint8_t channelEngine[NUM_CHANNELS];
+
+	/**
+	 * @brief Effect for the channel didn't get an engine
+	 */
+	bool channelDegraded[NUM_CHANNELS];
+
+	/**
+	 * @brief Direct level written for each channel
+	 */
+	uint8_t channelLevel[NUM_CHANNELS];
+
+	/**
+	 * @brief engines, channelEngine, and channelLevel match the chip
+	 */
+	bool chipValid = false;
+
+	/**
+	 * @brief Number of engines loaded by the last apply()
+	 */
+	size_t enginesLoaded = 0;
+};
+
+#endif /* __LP5562_RK_ALLOCATOR_H */
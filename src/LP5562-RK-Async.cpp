@@ -0,0 +1,407 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Async.h"
+
+LP5562Async::LP5562Async(LP5562 &driver, size_t queueSize) :
+	driver(driver), queueSize(queueSize), head(0), tail(0), completedSeq(0),
+	executedCount(0), supersededCount(0), failedCount(0), running(false) {
+
+	// One entry is always left empty to tell a full queue from an empty one
+	if (this->queueSize < 2) {
+		this->queueSize = 2;
+	}
+	queue = new Op[this->queueSize];
+}
+
+LP5562Async::~LP5562Async() {
+#if !defined(PARTICLE)
+	if (thread) {
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			running = false;
+		}
+		wakeCondition.notify_one();
+		thread->join();
+		delete thread;
+		thread = NULL;
+	}
+#endif
+	delete[] queue;
+}
+
+bool LP5562Async::start(size_t stackSize) {
+	if (started) {
+		return true;
+	}
+	running = true;
+
+#if defined(PARTICLE)
+	// Used like wakePending on the computer, with a maximum count of 1. A give while a wake-up is
+	// already pending fails, which is fine because the worker checks the whole queue after it wakes.
+	if (!wakeSemaphore && os_semaphore_create(&wakeSemaphore, 1, 0) != 0) {
+		wakeSemaphore = NULL;
+		running = false;
+		return false;
+	}
+
+	os_thread_t threadHandle;
+	if (os_thread_create(&threadHandle, "lp5562", OS_THREAD_PRIORITY_DEFAULT, threadFunctionStatic, this, stackSize) != 0) {
+		running = false;
+		return false;
+	}
+#else
+	(void) stackSize;
+	thread = new std::thread(threadFunctionStatic, this);
+#endif
+
+	started = true;
+	return true;
+}
+
+size_t LP5562Async::process() {
+	size_t count = 0;
+
+	size_t cur = tail.load(std::memory_order_relaxed);
+	while(cur != head.load(std::memory_order_acquire)) {
+		const Op &op = queue[cur];
+
+		// Look for a later entry that replaces this one. Entries between tail and head can't be
+		// changed by the producer until tail moves past them, so this is safe without a lock.
+		bool superseded = false;
+		size_t end = head.load(std::memory_order_acquire);
+		for(size_t ii = (cur + 1) % queueSize; ii != end; ii = (ii + 1) % queueSize) {
+			if (supersedes(queue[ii], op)) {
+				superseded = true;
+				break;
+			}
+		}
+
+		if (superseded) {
+			supersededCount++;
+			complete(op, RESULT_SUPERSEDED);
+		}
+		else
+		if (execute(op)) {
+			executedCount++;
+			complete(op, RESULT_SUCCESS);
+		}
+		else {
+			failedCount++;
+			complete(op, RESULT_FAILED);
+		}
+
+		// Release the entry back to the producer
+		cur = (cur + 1) % queueSize;
+		tail.store(cur, std::memory_order_release);
+		count++;
+	}
+
+	return count;
+}
+
+uint32_t LP5562Async::setRGB(uint8_t red, uint8_t green, uint8_t blue) {
+	Op *op = reserve(OP_SET_RGB);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = red;
+	op->values[1] = green;
+	op->values[2] = blue;
+	return push(op);
+}
+
+uint32_t LP5562Async::setW(uint8_t white) {
+	Op *op = reserve(OP_SET_W);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = white;
+	return push(op);
+}
+
+uint32_t LP5562Async::setRGBW(uint8_t red, uint8_t green, uint8_t blue, uint8_t white) {
+	Op *op = reserve(OP_SET_RGBW);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = red;
+	op->values[1] = green;
+	op->values[2] = blue;
+	op->values[3] = white;
+	return push(op);
+}
+
+uint32_t LP5562Async::setBlink(uint8_t red, uint8_t green, uint8_t blue, unsigned long msOn, unsigned long msOff) {
+	Op *op = reserve(OP_SET_BLINK);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = red;
+	op->values[1] = green;
+	op->values[2] = blue;
+	op->ms[0] = msOn;
+	op->ms[1] = msOff;
+	return push(op);
+}
+
+uint32_t LP5562Async::setBlink2(uint8_t red1, uint8_t green1, uint8_t blue1, unsigned long ms1, uint8_t red2, uint8_t green2, uint8_t blue2, unsigned long ms2) {
+	Op *op = reserve(OP_SET_BLINK2);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = red1;
+	op->values[1] = green1;
+	op->values[2] = blue1;
+	op->values[3] = red2;
+	op->values[4] = green2;
+	op->values[5] = blue2;
+	op->ms[0] = ms1;
+	op->ms[1] = ms2;
+	return push(op);
+}
+
+uint32_t LP5562Async::setBreathe(bool red, bool green, bool blue, uint8_t stepTimeHalfMs, uint8_t lowLevel, uint8_t highLevel) {
+	Op *op = reserve(OP_SET_BREATHE);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = red;
+	op->values[1] = green;
+	op->values[2] = blue;
+	op->values[3] = stepTimeHalfMs;
+	op->values[4] = lowLevel;
+	op->values[5] = highLevel;
+	return push(op);
+}
+
+uint32_t LP5562Async::setIndicatorMode(unsigned long on1ms, unsigned long off1ms, unsigned long on2ms, unsigned long off2ms, uint8_t breatheTime) {
+	Op *op = reserve(OP_SET_INDICATOR_MODE);
+	if (!op) {
+		return 0;
+	}
+	op->ms[0] = on1ms;
+	op->ms[1] = off1ms;
+	op->ms[2] = on2ms;
+	op->ms[3] = off2ms;
+	op->values[0] = breatheTime;
+	return push(op);
+}
+
+uint32_t LP5562Async::setLedMapping(uint8_t red, uint8_t green, uint8_t blue, uint8_t white) {
+	Op *op = reserve(OP_SET_LED_MAPPING);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = red;
+	op->values[1] = green;
+	op->values[2] = blue;
+	op->values[3] = white;
+	return push(op);
+}
+
+uint32_t LP5562Async::setEnable(uint8_t engineMask, uint8_t engineMode) {
+	Op *op = reserve(OP_SET_ENABLE);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = engineMask;
+	op->values[1] = engineMode;
+	return push(op);
+}
+
+uint32_t LP5562Async::setProgram(size_t engine, const uint16_t *instructions, size_t numInstructions, bool startRunning) {
+	if (numInstructions > sizeof(Op::instructions) / sizeof(Op::instructions[0])) {
+		return 0;
+	}
+
+	Op *op = reserve(OP_SET_PROGRAM);
+	if (!op) {
+		return 0;
+	}
+	op->values[0] = (uint8_t) engine;
+	op->values[1] = (uint8_t) numInstructions;
+	op->values[2] = startRunning;
+	for(size_t ii = 0; ii < numInstructions; ii++) {
+		op->instructions[ii] = instructions[ii];
+	}
+	return push(op);
+}
+
+bool LP5562Async::waitComplete(uint32_t seq, unsigned long timeoutMs) {
+	unsigned long start = millis();
+	while(!isComplete(seq)) {
+		if (millis() - start >= timeoutMs) {
+			return false;
+		}
+		delay(1);
+	}
+	return true;
+}
+
+size_t LP5562Async::getQueueDepth() const {
+	size_t h = head.load(std::memory_order_acquire);
+	size_t t = tail.load(std::memory_order_acquire);
+	return (h + queueSize - t) % queueSize;
+}
+
+LP5562Async::Op *LP5562Async::reserve(uint8_t type) {
+	size_t cur = head.load(std::memory_order_relaxed);
+	if ((cur + 1) % queueSize == tail.load(std::memory_order_acquire)) {
+		droppedCount++;
+		return NULL;
+	}
+
+	Op *op = &queue[cur];
+	op->type = type;
+	return op;
+}
+
+uint32_t LP5562Async::push(Op *op) {
+	// Sequence number 0 is reserved for "queue full"
+	if (++lastSeq == 0) {
+		lastSeq = 1;
+	}
+	op->seq = lastSeq;
+
+	size_t cur = head.load(std::memory_order_relaxed);
+	head.store((cur + 1) % queueSize, std::memory_order_release);
+
+	signalWorker();
+
+	return op->seq;
+}
+
+// static
+bool LP5562Async::supersedes(const Op &later, const Op &earlier) {
+	switch(earlier.type) {
+	case OP_SET_RGB:
+		return later.type == OP_SET_RGB || later.type == OP_SET_RGBW;
+
+	case OP_SET_W:
+		return later.type == OP_SET_W || later.type == OP_SET_RGBW;
+
+	case OP_SET_RGBW:
+	case OP_SET_BLINK:
+	case OP_SET_BLINK2:
+	case OP_SET_BREATHE:
+	case OP_SET_INDICATOR_MODE:
+	case OP_SET_LED_MAPPING:
+		// These set the same registers every time so a later call of the same type replaces the earlier one.
+		// The patterns of different types leave different registers behind, so they're not combined.
+		return later.type == earlier.type;
+
+	default:
+		// setEnable only changes some engines and setProgram is done in order
+		return false;
+	}
+}
+
+bool LP5562Async::execute(const Op &op) {
+	bool bResult = true;
+
+	switch(op.type) {
+	case OP_SET_RGB:
+		driver.setRGB(op.values[0], op.values[1], op.values[2]);
+		break;
+
+	case OP_SET_W:
+		driver.setW(op.values[0]);
+		break;
+
+	case OP_SET_RGBW:
+		driver.setRGBW(op.values[0], op.values[1], op.values[2], op.values[3]);
+		break;
+
+	case OP_SET_BLINK:
+		driver.setBlink(op.values[0], op.values[1], op.values[2], op.ms[0], op.ms[1]);
+		break;
+
+	case OP_SET_BLINK2:
+		driver.setBlink2(op.values[0], op.values[1], op.values[2], op.ms[0], op.values[3], op.values[4], op.values[5], op.ms[1]);
+		break;
+
+	case OP_SET_BREATHE:
+		driver.setBreathe(op.values[0] != 0, op.values[1] != 0, op.values[2] != 0, op.values[3], op.values[4], op.values[5]);
+		break;
+
+	case OP_SET_INDICATOR_MODE:
+		driver.setIndicatorMode(op.ms[0], op.ms[1], op.ms[2], op.ms[3], op.values[0]);
+		break;
+
+	case OP_SET_LED_MAPPING:
+		bResult = driver.setLedMapping(op.values[0], op.values[1], op.values[2], op.values[3]);
+		break;
+
+	case OP_SET_ENABLE:
+		bResult = driver.setEnable(op.values[0], op.values[1]);
+		break;
+
+	case OP_SET_PROGRAM:
+		bResult = driver.setProgram(op.values[0], op.instructions, op.values[1], op.values[2] != 0);
+		break;
+
+	default:
+		bResult = false;
+		break;
+	}
+
+	return bResult;
+}
+
+void LP5562Async::complete(const Op &op, Result result) {
+	completedSeq.store(op.seq, std::memory_order_release);
+
+	if (callback) {
+		callback(op.seq, result, callbackContext);
+	}
+}
+
+void LP5562Async::signalWorker() {
+#if defined(PARTICLE)
+	if (wakeSemaphore) {
+		os_semaphore_give(wakeSemaphore, false);
+	}
+#else
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wakePending = true;
+	}
+	wakeCondition.notify_one();
+#endif
+}
+
+void LP5562Async::waitForWork() {
+#if defined(PARTICLE)
+	// An operation pushed while process() was running leaves the count at 1 even if process() already
+	// did it, so this sometimes returns with an empty queue. That only costs one extra check of the queue.
+	os_semaphore_take(wakeSemaphore, CONCURRENT_WAIT_FOREVER, false);
+#else
+	std::unique_lock<std::mutex> lock(wakeMutex);
+	wakeCondition.wait(lock, [this] { return wakePending || !running; });
+	wakePending = false;
+#endif
+}
+
+void LP5562Async::threadFunction() {
+	while(running) {
+		// Operations queued before start() or while the last batch was being done are handled first,
+		// then the worker sleeps until push() signals it
+		process();
+		waitForWork();
+	}
+}
+
+// static
+void LP5562Async::threadFunctionStatic(void *param) {
+	LP5562Async *This = (LP5562Async *)param;
+
+	This->threadFunction();
+
+#if defined(PARTICLE)
+	// Device OS threads must not return
+	while(true) {
+		delay(1000);
+	}
+#endif
+}
@@ -0,0 +1,449 @@
+#ifndef __LP5562_RK_ASYNC_H
+#define __LP5562_RK_ASYNC_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+#include <atomic>
+
+#if !defined(PARTICLE)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+/**
+ * @brief Non-blocking front-end to a LP5562 object
+ *
+ * The calls like setRGB() and setBlink() on this object don't do any I2C. They add the operation to a
+ * bounded queue and return immediately. A worker thread removes operations from the queue and calls
+ * the LP5562 object, so loop() is never blocked waiting for the I2C bus:
+ *
+ * LP5562 ledDriver;
+ * LP5562Async ledAsync(ledDriver);
+ *
+ * void setup() {
+ *     ledDriver.withLEDCurrent(5.0).begin();
+ *     ledAsync.start();
+ * }
+ *
+ * void loop() {
+ *     ledAsync.setRGB(0xff0000);
+ * }
+ *
+ * The queue is a lock-free single-producer, single-consumer ring. Only one thread can call the
+ * methods that add to the queue, and once start() has been called, nothing else may call the
+ * LP5562 object directly. The worker thread blocks while the queue is empty; adding an operation
+ * wakes it up.
+ *
+ * When the worker finds a later operation in the queue that overwrites the same registers, like
+ * two calls to setRGB(), it skips the earlier one. Only the latest color is sent to the chip.
+ *
+ * Each call returns a sequence number (0 if the queue was full). Use isComplete() or
+ * waitComplete() to find out when the operation has been done, or set a callback using
+ * withCompletionCallback().
+ */
+class LP5562Async {
+public:
+	/**
+	 * @brief What happened to an operation
+	 */
+	enum Result {
+		RESULT_SUCCESS = 0,		//!< Operation was sent to the chip
+		RESULT_FAILED,			//!< Operation returned an error (I2C failure or invalid parameters)
+		RESULT_SUPERSEDED		//!< Operation was skipped because a later operation replaced it
+	};
+
+	/**
+	 * @brief Completion callback, called from the worker thread
+	 *
+	 * @param seq The sequence number returned when the operation was queued
+	 *
+	 * @param result RESULT_SUCCESS, RESULT_FAILED, or RESULT_SUPERSEDED
+	 *
+	 * @param context The context passed to withCompletionCallback()
+	 *
+	 * The setRGB(), setW(), setBlink() etc. calls in LP5562 don't return a result, so those operations
+	 * are always RESULT_SUCCESS or RESULT_SUPERSEDED.
+	 */
+	typedef void (*CompletionCallback)(uint32_t seq, Result result, void *context);
+
+	/**
+	 * @brief Construct the queue
+	 *
+	 * @param driver The LP5562 object that the worker thread calls. Call begin() on it before start().
+	 *
+	 * @param queueSize Number of operations that can be waiting. Each uses about 60 bytes of RAM.
+	 *
+	 * This object is typically allocated as a global variable. It must not be destroyed after start()
+	 * is called on a device, because the worker thread runs forever.
+	 */
+	LP5562Async(LP5562 &driver, size_t queueSize = 16);
+
+	/**
+	 * @brief Destructor. On a computer, stops the worker thread.
+	 */
+	virtual ~LP5562Async();
+
+	/**
+	 * @brief Set a function to call when each operation is done
+	 *
+	 * @param callback The function to call, or NULL for none
+	 *
+	 * @param context Passed to the callback
+	 *
+	 * Set this before start(). The callback is called from the worker thread, so it must be short and
+	 * thread-safe.
+	 */
+	LP5562Async &withCompletionCallback(CompletionCallback callback, void *context = NULL) { this->callback = callback; this->callbackContext = context; return *this; };
+
+	/**
+	 * @brief Start the worker thread
+	 *
+	 * @param stackSize Stack size for the worker thread. Ignored on a computer.
+	 *
+	 * @return true if the thread was started or was already running
+	 *
+	 * You can also call process() from your own thread instead of using start().
+	 */
+	bool start(size_t stackSize = 2048);
+
+	/**
+	 * @brief Do the operations in the queue from the calling thread
+	 *
+	 * @return The number of operations removed from the queue, including superseded ones
+	 *
+	 * This is what the worker thread calls. Use it instead of start() if you have your own thread,
+	 * or on a computer to run everything in the calling thread. Only one thread may call process().
+	 */
+	size_t process();
+
+	/**
+	 * @brief Queue LP5562::setRGB(). Superseded by later setRGB() and setRGBW() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setRGB(uint8_t red, uint8_t green, uint8_t blue);
+
+	/**
+	 * @brief Queue LP5562::setRGB() using a color like 0xRRGGBB
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setRGB(uint32_t rgb) { return setRGB((uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb); };
+
+	/**
+	 * @brief Queue LP5562::setW(). Superseded by later setW() and setRGBW() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setW(uint8_t white);
+
+	/**
+	 * @brief Queue LP5562::setRGBW(). Superseded by later setRGBW() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setRGBW(uint8_t red, uint8_t green, uint8_t blue, uint8_t white);
+
+	/**
+	 * @brief Queue LP5562::setRGBW() using a color like 0xWWRRGGBB
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setRGBW(uint32_t rgbw) { return setRGBW((uint8_t)(rgbw >> 16), (uint8_t)(rgbw >> 8), (uint8_t)rgbw, (uint8_t)(rgbw >> 24)); };
+
+	/**
+	 * @brief Queue LP5562::setBlink(). Superseded by later setBlink() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setBlink(uint8_t red, uint8_t green, uint8_t blue, unsigned long msOn, unsigned long msOff);
+
+	/**
+	 * @brief Queue LP5562::setBlink() using a color like 0xRRGGBB
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setBlink(uint32_t rgb, unsigned long msOn, unsigned long msOff) { return setBlink((uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb, msOn, msOff); };
+
+	/**
+	 * @brief Queue LP5562::setBlink2(). Superseded by later setBlink2() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setBlink2(uint8_t red1, uint8_t green1, uint8_t blue1, unsigned long ms1, uint8_t red2, uint8_t green2, uint8_t blue2, unsigned long ms2);
+
+	/**
+	 * @brief Queue LP5562::setBlink2() using colors like 0xRRGGBB
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setBlink2(uint32_t rgb1, unsigned long ms1, uint32_t rgb2, unsigned long ms2) {
+		return setBlink2((uint8_t)(rgb1 >> 16), (uint8_t)(rgb1 >> 8), (uint8_t)rgb1, ms1, (uint8_t)(rgb2 >> 16), (uint8_t)(rgb2 >> 8), (uint8_t)rgb2, ms2);
+	};
+
+	/**
+	 * @brief Queue LP5562::setBreathe(). Superseded by later setBreathe() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setBreathe(bool red, bool green, bool blue, uint8_t stepTimeHalfMs, uint8_t lowLevel, uint8_t highLevel);
+
+	/**
+	 * @brief Queue LP5562::setIndicatorMode(). Superseded by later setIndicatorMode() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setIndicatorMode(unsigned long on1ms = 500, unsigned long off1ms = 500, unsigned long on2ms = 100, unsigned long off2ms = 100, uint8_t breatheTime = 20);
+
+	/**
+	 * @brief Queue LP5562::setLedMapping(). Superseded by later setLedMapping() calls.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setLedMapping(uint8_t red, uint8_t green, uint8_t blue, uint8_t white);
+
+	/**
+	 * @brief Queue LP5562::setEnable()
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setEnable(uint8_t engineMask, uint8_t engineMode);
+
+	/**
+	 * @brief Queue LP5562::setProgram(). The program is copied into the queue.
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	uint32_t setProgram(size_t engine, const LP5562Program &program, bool startRunning) { return setProgram(engine, program.getInstructions(), program.getStepNum(), startRunning); };
+
+	/**
+	 * @brief Queue LP5562::setProgram(). The instructions are copied into the queue.
+	 *
+	 * @return The sequence number, or 0 if the queue is full or numInstructions is more than 16
+	 */
+	uint32_t setProgram(size_t engine, const uint16_t *instructions, size_t numInstructions, bool startRunning);
+
+	/**
+	 * @brief Queue LP5562::setProgram() from a const array, typically built with LP5562Opcode
+	 *
+	 * @return The sequence number, or 0 if the queue is full
+	 */
+	template<size_t N>
+	uint32_t setProgram(size_t engine, const uint16_t (&instructions)[N], bool startRunning) {
+		static_assert(N <= 16, "An engine program can have at most 16 instructions");
+		return setProgram(engine, instructions, N, startRunning);
+	}
+
+	/**
+	 * @brief Returns true if the operation with this sequence number is done (or was superseded)
+	 */
+	bool isComplete(uint32_t seq) const { return (int32_t)(completedSeq.load() - seq) >= 0; };
+
+	/**
+	 * @brief Wait for an operation to be done
+	 *
+	 * @param seq The sequence number returned when the operation was queued
+	 *
+	 * @param timeoutMs Maximum time to wait in milliseconds
+	 *
+	 * @return true if the operation is done, false on timeout
+	 */
+	bool waitComplete(uint32_t seq, unsigned long timeoutMs);
+
+	/**
+	 * @brief Returns the number of operations waiting in the queue
+	 */
+	size_t getQueueDepth() const;
+
+	/**
+	 * @brief Number of operations sent to the chip since construction
+	 */
+	uint32_t getExecutedCount() const { return executedCount.load(); };
+
+	/**
+	 * @brief Number of operations skipped because a later operation replaced them
+	 */
+	uint32_t getSupersededCount() const { return supersededCount.load(); };
+
+	/**
+	 * @brief Number of operations that returned an error
+	 */
+	uint32_t getFailedCount() const { return failedCount.load(); };
+
+	/**
+	 * @brief Number of calls that returned 0 because the queue was full
+	 */
+	uint32_t getDroppedCount() const { return droppedCount; };
+
+protected:
+	/**
+	 * @brief Type of operation in the queue
+	 */
+	enum OpType {
+		OP_SET_RGB = 0,
+		OP_SET_W,
+		OP_SET_RGBW,
+		OP_SET_BLINK,
+		OP_SET_BLINK2,
+		OP_SET_BREATHE,
+		OP_SET_INDICATOR_MODE,
+		OP_SET_LED_MAPPING,
+		OP_SET_ENABLE,
+		OP_SET_PROGRAM
+	};
+
+	/**
+	 * @brief One queue entry. The meaning of values and ms depends on type.
+	 */
+	struct Op {
+		uint32_t seq;				//!< Sequence number returned to the caller
+		uint8_t type;				//!< OpType
+		uint8_t values[8];			//!< Byte parameters in the order of the LP5562 method
+		unsigned long ms[4];		//!< Time parameters in the order of the LP5562 method
+		uint16_t instructions[16];	//!< For OP_SET_PROGRAM only, values[1] is the number of instructions
+	};
+
+	/**
+	 * @brief Claims the next free entry in the queue. Call push() after filling it in.
+	 *
+	 * @return The entry, or NULL if the queue is full
+	 */
+	Op *reserve(uint8_t type);
+
+	/**
+	 * @brief Makes the entry returned by reserve() visible to the worker and wakes it up
+	 *
+	 * @return The sequence number of the entry
+	 */
+	uint32_t push(Op *op);
+
+	/**
+	 * @brief Returns true if later completely replaces the register changes made by earlier
+	 */
+	static bool supersedes(const Op &later, const Op &earlier);
+
+	/**
+	 * @brief Calls the LP5562 method for an entry
+	 *
+	 * @return true on success
+	 */
+	bool execute(const Op &op);
+
+	/**
+	 * @brief Mark an entry done and call the completion callback
+	 */
+	void complete(const Op &op, Result result);
+
+	/**
+	 * @brief Wake up the worker thread if it's waiting in waitForWork()
+	 */
+	void signalWorker();
+
+	/**
+	 * @brief Block the worker thread until signalWorker() is called or the object is being destroyed
+	 */
+	void waitForWork();
+
+	/**
+	 * @brief Worker thread loop
+	 */
+	void threadFunction();
+
+	/**
+	 * @brief Worker thread entry point. param is the LP5562Async object.
+	 */
+	static void threadFunctionStatic(void *param);
+
+	/**
+	 * @brief The LP5562 object that operations are sent to
+	 */
+	LP5562 &driver;
+
+	/**
+	 * @brief The ring buffer of queueSize entries
+	 */
+	Op *queue;
+
+	/**
+	 * @brief Number of entries in queue. One entry is always left empty.
+	 */
+	size_t queueSize;
+
+	/**
+	 * @brief Index of the next entry to write. Only changed by the producer.
+	 */
+	std::atomic<size_t> head;
+
+	/**
+	 * @brief Index of the next entry to read. Only changed by the worker.
+	 */
+	std::atomic<size_t> tail;
+
+	/**
+	 * @brief Sequence number of the last queued operation. Only used by the producer.
+	 */
+	uint32_t lastSeq = 0;
+
+	/**
+	 * @brief Sequence number of the last completed operation
+	 */
+	std::atomic<uint32_t> completedSeq;
+
+	std::atomic<uint32_t> executedCount;	//!< See getExecutedCount()
+	std::atomic<uint32_t> supersededCount;	//!< See getSupersededCount()
+	std::atomic<uint32_t> failedCount;		//!< See getFailedCount()
+	uint32_t droppedCount = 0;				//!< See getDroppedCount(). Only used by the producer.
+
+	/**
+	 * @brief Function to call when an operation is done
+	 */
+	CompletionCallback callback = NULL;
+
+	/**
+	 * @brief Context passed to callback
+	 */
+	void *callbackContext = NULL;
+
+	/**
+	 * @brief true once start() has been called
+	 */
+	bool started = false;
+
+	/**
+	 * @brief Cleared to stop the worker thread (computer only)
+	 */
+	std::atomic<bool> running;
+
+#if defined(PARTICLE)
+	/**
+	 * @brief Given when an operation is pushed, taken by the worker before it looks at the queue (maximum count 1)
+	 */
+	os_semaphore_t wakeSemaphore = NULL;
+#else
+	/**
+	 * @brief Worker thread (computer only)
+	 */
+	std::thread *thread = NULL;
+
+	/**
+	 * @brief Protects wakePending (computer only)
+	 */
+	std::mutex wakeMutex;
+
+	/**
+	 * @brief Signaled when wakePending is set or running is cleared (computer only)
+	 */
+	std::condition_variable wakeCondition;
+
+	/**
+	 * @brief Set by signalWorker(), cleared by the worker when it wakes up (computer only)
+	 */
+	bool wakePending = false;
+#endif
+};
+
+#endif /* __LP5562_RK_ASYNC_H */
@@ -0,0 +1,179 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Bench.h"
+
+#include <stdio.h>
+
+static void prepareBlink(LP5562 &driver) {
+	driver.setBlink(255, 0, 0, 500, 500);
+}
+
+static void prepareBlink2(LP5562 &driver) {
+	driver.setBlink2(0xff0000, 500, 0x0000ff, 500);
+}
+
+static void prepareIndicator(LP5562 &driver) {
+	driver.setIndicatorMode();
+}
+
+static void measureBegin(LP5562 &driver) {
+	driver.begin();
+}
+
+static void measureSetRGB(LP5562 &driver) {
+	driver.setRGB(0x102030);
+}
+
+static void measureSetRGBW(LP5562 &driver) {
+	driver.setRGBW(0x40102030);
+}
+
+static void measureSetW(LP5562 &driver) {
+	driver.setW(128);
+}
+
+static void measureUseDirectRGB(LP5562 &driver) {
+	driver.useDirectRGB();
+}
+
+static void measureSetBlink(LP5562 &driver) {
+	driver.setBlink(255, 0, 0, 500, 500);
+}
+
+static void measureSetBlink2(LP5562 &driver) {
+	driver.setBlink2(0xff0000, 500, 0x0000ff, 500);
+}
+
+static void measureSetBlink2Color(LP5562 &driver) {
+	driver.setBlink2(0x00ff00, 500, 0xffff00, 500);
+}
+
+static void measureSetBreathe(LP5562 &driver) {
+	driver.setBreathe(false, true, true, 20, 0, 255);
+}
+
+static void measureSetIndicatorMode(LP5562 &driver) {
+	driver.setIndicatorMode();
+}
+
+static void measureSetLedMapping(LP5562 &driver) {
+	driver.setLedMapping(LP5562::REG_LED_MAP_ENGINE_1, LP5562::REG_LED_MAP_ENGINE_2, LP5562::REG_LED_MAP_ENGINE_3, LP5562::REG_LED_MAP_DIRECT);
+}
+
+static void measureSetLedMappingR(LP5562 &driver) {
+	driver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_2);
+}
+
+static void measureSetLedMappingG(LP5562 &driver) {
+	driver.setLedMappingG(LP5562::REG_LED_MAP_DIRECT, 128);
+}
+
+static void measureSetLedMappingB(LP5562 &driver) {
+	driver.setLedMappingB(LP5562::REG_LED_MAP_ENGINE_3);
+}
+
+static void measureSetLedMappingW(LP5562 &driver) {
+	driver.setLedMappingW(LP5562::REG_LED_MAP_ENGINE_1);
+}
+
+static void measureSetEnable(LP5562 &driver) {
+	driver.setEnable(LP5562::MASK_ENGINE_1, LP5562::REG_ENABLE_RUN);
+}
+
+static void measureSetOpMode(LP5562 &driver) {
+	driver.setOpMode(1, LP5562::REG_ENGINE_RUN);
+}
+
+static void measureClearAllPrograms(LP5562 &driver) {
+	driver.clearAllPrograms();
+}
+
+static void measureSetProgram(LP5562 &driver) {
+	LP5562Program program;
+	program.addCommandSetPWM(255);
+	program.addDelay(100);
+	program.addCommandSetPWM(0);
+	program.addDelay(900);
+	driver.setProgram(1, program, true);
+}
+
+static void measureGetStatus(LP5562 &driver) {
+	(void) driver.getStatus();
+}
+
+const LP5562BusBenchmark::Benchmark LP5562BusBenchmark::benchmarks[] = {
+	{ "begin", NULL, measureBegin },
+	{ "setRGB", NULL, measureSetRGB },
+	{ "setRGBW", NULL, measureSetRGBW },
+	{ "setW", NULL, measureSetW },
+	{ "useDirectRGB", prepareBlink, measureUseDirectRGB },
+	{ "setBlink", NULL, measureSetBlink },
+	{ "setBlink2", NULL, measureSetBlink2 },
+	{ "setBlink2 (color change)", prepareBlink2, measureSetBlink2Color },
+	{ "setBreathe", NULL, measureSetBreathe },
+	{ "setIndicatorMode", NULL, measureSetIndicatorMode },
+	{ "setLedMapping", NULL, measureSetLedMapping },
+	{ "setLedMappingR", prepareIndicator, measureSetLedMappingR },
+	{ "setLedMappingG", prepareIndicator, measureSetLedMappingG },
+	{ "setLedMappingB", prepareIndicator, measureSetLedMappingB },
+	{ "setLedMappingW", prepareIndicator, measureSetLedMappingW },
+	{ "setEnable", NULL, measureSetEnable },
+	{ "setOpMode", NULL, measureSetOpMode },
+	{ "clearAllPrograms", prepareBlink, measureClearAllPrograms },
+	{ "setProgram", NULL, measureSetProgram },
+	{ "getStatus", NULL, measureGetStatus },
+	{ NULL, NULL, NULL }
+};
+
+size_t LP5562BusBenchmark::run(bool shadowRegisters, ResultHandler handler, void *context) {
+	size_t count = 0;
+
+	for(const Benchmark *bench = benchmarks; bench->name; bench++) {
+		// Each benchmark starts with a freshly initialized chip
+		LP5562Simulator sim;
+		LP5562 driver(0x30, sim);
+		driver.withShadowRegisters(shadowRegisters);
+
+		if (bench->measure != measureBegin) {
+			driver.begin();
+		}
+		if (bench->prepare) {
+			bench->prepare(driver);
+		}
+		sim.advanceMillis(10);
+
+		size_t startIndex = sim.getNumTransactions();
+		bench->measure(driver);
+		LP5562MockTransport::BusCost cost = sim.getBusCost(startIndex);
+
+		Result result;
+		result.name = bench->name;
+		result.shadowRegisters = shadowRegisters;
+		result.transactions = cost.transactions;
+		result.bytes = cost.bytes;
+		result.reads = 0;
+		for(size_t ii = startIndex; ii < sim.getNumTransactions(); ii++) {
+			if (sim.getTransaction(ii).isRead) {
+				result.reads++;
+			}
+		}
+		result.micros100k = cost.getMicros(100000);
+		result.micros400k = cost.getMicros(400000);
+
+		handler(result, context);
+		count++;
+	}
+
+	return count;
+}
+
+const char *LP5562BusBenchmark::getCsvHeader() {
+	return "call,shadow,transactions,reads,bytes,us_100khz,us_400khz";
+}
+
+void LP5562BusBenchmark::formatCsv(const Result &result, char *buf, size_t bufSize) {
+	snprintf(buf, bufSize, "%s,%d,%u,%u,%u,%lu,%lu", result.name, (int)result.shadowRegisters,
+			(unsigned)result.transactions, (unsigned)result.reads, (unsigned)result.bytes,
+			(unsigned long)result.micros100k, (unsigned long)result.micros400k);
+}
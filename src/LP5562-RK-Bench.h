@@ -0,0 +1,90 @@
+#ifndef __LP5562_RK_BENCH_H
+#define __LP5562_RK_BENCH_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Sim.h"
+
+/**
+ * @brief Measures the I2C bus cost of each public LP5562 API call
+ *
+ * Each call is made against a LP5562Simulator and the recorded transactions are totaled. Since the
+ * simulator behaves like the chip, calls like useDirectRGB() that depend on the current chip state see
+ * realistic values. No hardware is needed, so this can run on a computer or on a device.
+ *
+ * The results are reported through a callback, one row per API call. formatCsv() converts a row to a
+ * line of comma-separated values for a machine-readable table:
+ *
+ * LP5562BusBenchmark::run(false, [](const LP5562BusBenchmark::Result &result, void *context) {
+ *     char buf[128];
+ *     LP5562BusBenchmark::formatCsv(result, buf, sizeof(buf));
+ *     printf("%s\n", buf);
+ * }, NULL);
+ */
+class LP5562BusBenchmark {
+public:
+	/**
+	 * @brief The cost of one API call
+	 */
+	struct Result {
+		const char *name;			//!< Name of the API call
+		bool shadowRegisters;		//!< true if the register shadow was enabled (withShadowRegisters)
+		size_t transactions;		//!< Number of I2C transactions
+		size_t bytes;				//!< Bytes on the wire, including address bytes
+		size_t reads;				//!< Number of transactions that were reads
+		uint32_t micros100k;		//!< Estimated bus time at 100 kHz in microseconds
+		uint32_t micros400k;		//!< Estimated bus time at 400 kHz in microseconds
+	};
+
+	/**
+	 * @brief Callback for each result
+	 */
+	typedef void (*ResultHandler)(const Result &result, void *context);
+
+	/**
+	 * @brief Run all of the benchmarks
+	 *
+	 * @param shadowRegisters true to enable the register shadow (withShadowRegisters) for all calls
+	 *
+	 * @param handler Called once for each API call measured
+	 *
+	 * @param context Passed to handler
+	 *
+	 * @return The number of results reported
+	 */
+	static size_t run(bool shadowRegisters, ResultHandler handler, void *context);
+
+	/**
+	 * @brief Column names for formatCsv()
+	 */
+	static const char *getCsvHeader();
+
+	/**
+	 * @brief Format a result as comma-separated values (no line terminator)
+	 *
+	 * @param result The result to format
+	 *
+	 * @param buf Buffer to write to
+	 *
+	 * @param bufSize Size of buf in bytes. 128 bytes is plenty.
+	 */
+	static void formatCsv(const Result &result, char *buf, size_t bufSize);
+
+protected:
+	/**
+	 * @brief A single benchmark
+	 */
+	struct Benchmark {
+		const char *name;						//!< Name of the API call
+		void (*prepare)(LP5562 &driver);		//!< Puts the chip in a starting state (not measured), can be NULL
+		void (*measure)(LP5562 &driver);		//!< The call to measure
+	};
+
+	/**
+	 * @brief The table of benchmarks
+	 */
+	static const Benchmark benchmarks[];
+};
+
+#endif /* __LP5562_RK_BENCH_H */
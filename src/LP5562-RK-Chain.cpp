@@ -0,0 +1,250 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Chain.h"
+#include "LP5562-RK-Disasm.h"
+#include "LP5562-RK-Pager.h"
+#include "LP5562-RK-Timing.h"
+
+LP5562Chain::LP5562Chain() {
+	clear();
+}
+
+LP5562Chain::~LP5562Chain() {
+
+}
+
+LP5562Chain &LP5562Chain::clear() {
+	numInstructions = 0;
+	for(size_t ii = 0; ii < sizeof(segmentStarts); ii++) {
+		segmentStarts[ii] = 0;
+		handOffs[ii] = 0;
+	}
+	handOffPending = false;
+	segmentError = false;
+
+	result.success = false;
+	result.error = NULL;
+	result.numEngines = 0;
+	result.numInstructions = 0;
+	result.periodMicros = 0;
+
+	return *this;
+}
+
+LP5562Chain &LP5562Chain::addSegment(const uint16_t *instructions, size_t numInstructions) {
+	if (numInstructions > MAX_PART_INSTRUCTIONS || this->numInstructions + numInstructions > MAX_INSTRUCTIONS ||
+		!LP5562Pager::isValidSegment(instructions, numInstructions)) {
+		segmentError = true;
+		return *this;
+	}
+
+	size_t first = this->numInstructions;
+	for(size_t ii = 0; ii < numInstructions; ii++) {
+		this->instructions[first + ii] = instructions[ii];
+	}
+	segmentStarts[first / 8] |= (uint8_t)(1 << (first % 8));
+	if (handOffPending) {
+		handOffs[first / 8] |= (uint8_t)(1 << (first % 8));
+		handOffPending = false;
+	}
+	this->numInstructions += numInstructions;
+
+	return *this;
+}
+
+LP5562Chain &LP5562Chain::addHandOff() {
+	if (numInstructions == 0) {
+		// There's nothing to hand off from
+		segmentError = true;
+	}
+	else {
+		handOffPending = true;
+	}
+	return *this;
+}
+
+const LP5562Chain::Result &LP5562Chain::compile() {
+	result.success = false;
+	result.error = NULL;
+	result.numEngines = 0;
+	result.numInstructions = 0;
+	result.periodMicros = 0;
+
+	for(size_t ii = 0; ii < 3; ii++) {
+		programs[ii].clear();
+	}
+
+	if (segmentError) {
+		result.error = "invalid segment";
+		return result;
+	}
+	if (numInstructions == 0) {
+		result.error = "no segments";
+		return result;
+	}
+
+	bool anyHandOff = false;
+	for(size_t ii = 0; ii < sizeof(handOffs); ii++) {
+		if (handOffs[ii]) {
+			anyHandOff = true;
+		}
+	}
+
+	// Without repeat the single engine needs room for an End instruction. With repeat, the rest of
+	// the engine is filled with go to start, or it runs past step 15 back to step 0.
+	if (!anyHandOff && numInstructions <= (repeat ? MAX_PROGRAM_INSTRUCTIONS : MAX_PROGRAM_INSTRUCTIONS - 1)) {
+		(void) appendPart(programs[0], 0, numInstructions);
+		if (!repeat) {
+			programs[0].addCommandEnd(false, false);
+		}
+		result.numEngines = 1;
+	}
+	else {
+		// Pack whole segments into the engines, leaving room for the trigger instructions
+		size_t partFirst[3];
+		size_t partCount[3];
+		size_t numParts = 0;
+
+		size_t index = 0;
+		while(index < numInstructions) {
+			if (numParts >= 3) {
+				result.error = "sequence does not fit in 3 engines";
+				return result;
+			}
+
+			size_t count = 0;
+			while(index + count < numInstructions) {
+				size_t segmentLen = 1;
+				while(index + count + segmentLen < numInstructions && !isBitSet(segmentStarts, index + count + segmentLen)) {
+					segmentLen++;
+				}
+				if (count > 0 && (isBitSet(handOffs, index + count) || count + segmentLen > MAX_PART_INSTRUCTIONS)) {
+					break;
+				}
+				count += segmentLen;
+			}
+
+			partFirst[numParts] = index;
+			partCount[numParts] = count;
+			numParts++;
+
+			index += count;
+		}
+
+		for(size_t part = 0; part < numParts; part++) {
+			LP5562Program &program = programs[part];
+			uint8_t nextMask = (uint8_t)(1 << ((part + 1) % numParts));
+
+			if (part > 0) {
+				// Wait for the previous engine to hand off
+				program.addCommandTriggerWait((uint8_t)(1 << (part - 1)));
+			}
+
+			(void) appendPart(program, partFirst[part], partCount[part]);
+
+			if (part + 1 < numParts || repeat) {
+				program.addCommandTriggerSend(nextMask);
+			}
+
+			if (part == 0) {
+				if (repeat) {
+					// Wait for the last engine to hand back
+					program.addCommandTriggerWait((uint8_t)(1 << (numParts - 1)));
+				}
+				else {
+					program.addCommandEnd(false, false);
+				}
+			}
+		}
+		result.numEngines = numParts;
+	}
+
+	const uint16_t *engineInstructions[3];
+	size_t engineNumInstructions[3];
+	for(size_t ii = 0; ii < 3; ii++) {
+		bool used = ii < result.numEngines;
+		engineInstructions[ii] = used ? programs[ii].getInstructions() : NULL;
+		engineNumInstructions[ii] = used ? programs[ii].getStepNum() : 0;
+		result.numInstructions += engineNumInstructions[ii];
+	}
+
+	LP5562Disassembler::Report report;
+	if (!LP5562Disassembler::validateEngines(engineInstructions, engineNumInstructions, report)) {
+		result.error = "generated programs are not valid";
+		return result;
+	}
+
+	// The engines are linked by triggers, so the analyzer runs them together
+	LP5562TimingAnalyzer analyzer;
+	for(size_t engine = 1; engine <= result.numEngines; engine++) {
+		analyzer.withProgram(engine, programs[engine - 1]);
+	}
+	const LP5562TimingAnalyzer::Result &timing = analyzer.analyze();
+	if (timing.success) {
+		if (repeat) {
+			result.periodMicros = analyzer.getPeriodMicros(1);
+		}
+		else {
+			// The sequence is over when the last engine finishes its part
+			uint64_t endTicks = 0;
+			for(size_t ii = 0; ii < result.numEngines; ii++) {
+				if (timing.engines[ii].endTicks > endTicks) {
+					endTicks = timing.engines[ii].endTicks;
+				}
+			}
+			result.periodMicros = LP5562SimEngines::ticksToMicros(endTicks);
+		}
+	}
+
+	result.success = true;
+	return result;
+}
+
+bool LP5562Chain::apply(LP5562 &driver) {
+	if (!result.success) {
+		return false;
+	}
+
+	uint8_t engineMask = (uint8_t)((1 << result.numEngines) - 1);
+
+	driver.beginBatch();
+
+	bool bResult = driver.setEnable(LP5562::MASK_ENGINE_ALL, LP5562::REG_ENABLE_HOLD);
+
+	for(size_t engine = 1; engine <= result.numEngines; engine++) {
+		if (!driver.setProgram(engine, programs[engine - 1], false)) {
+			bResult = false;
+		}
+	}
+
+	if (!driver.startEngines(engineMask)) {
+		bResult = false;
+	}
+
+	if (!driver.commit()) {
+		bResult = false;
+	}
+	return bResult;
+}
+
+bool LP5562Chain::appendPart(LP5562Program &program, size_t first, size_t count) const {
+	size_t segmentOffset = program.getStepNum();
+
+	for(size_t ii = 0; ii < count; ii++) {
+		size_t index = first + ii;
+		uint16_t inst = instructions[index];
+
+		if (isBitSet(segmentStarts, index)) {
+			segmentOffset = program.getStepNum();
+		}
+		if ((inst & 0xe000) == 0xa000) {
+			// Branch step numbers are relative to the segment
+			inst = (uint16_t)((inst & 0xfff0) | (((inst & 0xf) + segmentOffset) & 0xf));
+		}
+		if (!program.addCommand(inst)) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,199 @@
+#ifndef __LP5562_RK_CHAIN_H
+#define __LP5562_RK_CHAIN_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Runs one sequence of up to 42 instructions over all three engines, without the MCU
+ *
+ * The sequence is built from segments, the same as LP5562Pager: up to 14 instructions that stay
+ * together on one engine, with branch step numbers relative to the first instruction of the segment.
+ * compile() packs the segments in order into engines 1, 2, and 3, and links them with triggers the
+ * same way setBlink2() does. Engine 1 runs its part, sends a trigger to engine 2 and waits; engine 2
+ * was waiting for it, runs its part, and hands off to engine 3, which hands back to engine 1.
+ *
+ * LP5562Chain chain;
+ * chain.addSegment(redFade).addHandOff().addSegment(greenFade).addHandOff().addSegment(blueFade);
+ * if (chain.compile().success) {
+ *     ledDriver.setLedMapping(LP5562::REG_LED_MAP_ENGINE_1, LP5562::REG_LED_MAP_ENGINE_2, LP5562::REG_LED_MAP_ENGINE_3, 0);
+ *     chain.apply(ledDriver);
+ * }
+ *
+ * Each LED follows the engine it's mapped to in REG_LED_MAP, and the engines can't change the
+ * mapping. While one engine runs its part, the others hold the level they ended at. So the part on
+ * each engine shows on the channels mapped to that engine. Use addHandOff() to put a part on the
+ * next engine, like a color chase where each channel has its own engine. A sequence for a single
+ * channel can only use the engine mapped to that channel; use LP5562Pager for a long sequence on one
+ * channel.
+ */
+class LP5562Chain {
+public:
+	/**
+	 * @brief Outcome of compile()
+	 */
+	struct Result {
+		bool success;				//!< true if the sequence fit
+		const char *error;			//!< Reason for failure, or NULL on success
+		size_t numEngines;			//!< Number of engines used (1 - 3)
+		size_t numInstructions;		//!< Total instructions in all engines, including the triggers
+		uint64_t periodMicros;		//!< Time for one pass through the sequence in microseconds, or 0 if not known
+	};
+
+	/**
+	 * @brief Construct a chain with no segments
+	 */
+	LP5562Chain();
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562Chain();
+
+	/**
+	 * @brief Remove all segments
+	 */
+	LP5562Chain &clear();
+
+	/**
+	 * @brief Add a segment to the end of the sequence
+	 *
+	 * @param instructions The instruction words. They're copied.
+	 *
+	 * @param numInstructions Number of instructions (1 - 14)
+	 *
+	 * The rules are the same as LP5562Pager::addSegment(). If the segment is not valid or doesn't fit in
+	 * MAX_INSTRUCTIONS, it's not added and hasError() returns true.
+	 */
+	LP5562Chain &addSegment(const uint16_t *instructions, size_t numInstructions);
+
+	/**
+	 * @brief Add a segment to the end of the sequence
+	 *
+	 * @param program The program (1 - 14 instructions). It's copied.
+	 */
+	LP5562Chain &addSegment(const LP5562Program &program) { return addSegment(program.getInstructions(), program.getStepNum()); };
+
+	/**
+	 * @brief Start the next segment on the next engine, even if it would fit on this one
+	 */
+	LP5562Chain &addHandOff();
+
+	/**
+	 * @brief Returns true if an addSegment() or addHandOff() call failed since construction or clear()
+	 */
+	bool hasError() const { return segmentError; };
+
+	/**
+	 * @brief Go back to the start of the sequence after the end. Default is true.
+	 *
+	 * If false, engine 1 ends and the other engines wait forever after their part, so every LED holds
+	 * its last level.
+	 */
+	LP5562Chain &withRepeat(bool value = true) { repeat = value; return *this; };
+
+	/**
+	 * @brief Split the sequence into engine programs
+	 *
+	 * @return The result, which is also available from getResult(). On failure, no programs are valid.
+	 */
+	const Result &compile();
+
+	/**
+	 * @brief Get the result of the last compile()
+	 */
+	const Result &getResult() const { return result; };
+
+	/**
+	 * @brief Get the program for an engine (1 - 3). Only engines up to getResult().numEngines are used.
+	 */
+	const LP5562Program &getProgram(size_t engine) const { return programs[(engine >= 1 && engine <= 3) ? engine - 1 : 0]; };
+
+	/**
+	 * @brief Load the compiled programs and start them together
+	 *
+	 * @param driver The LP5562 to program
+	 *
+	 * @return true on success, false if compile() failed or there was an I2C error
+	 *
+	 * The LED mapping is not changed; set it with setLedMapping() before or after.
+	 */
+	bool apply(LP5562 &driver);
+
+	/**
+	 * @brief Maximum number of instructions of a segment on each engine, after the trigger instructions
+	 */
+	static const size_t MAX_PART_INSTRUCTIONS = 14;
+
+	/**
+	 * @brief Maximum number of instructions in all segments together
+	 */
+	static const size_t MAX_INSTRUCTIONS = 3 * MAX_PART_INSTRUCTIONS;
+
+protected:
+	/**
+	 * @brief Number of instructions in each engine
+	 */
+	static const size_t MAX_PROGRAM_INSTRUCTIONS = 16;
+
+	/**
+	 * @brief Returns true if the bit for index is set in a bit mask array
+	 */
+	static bool isBitSet(const uint8_t *bits, size_t index) { return (bits[index / 8] & (1 << (index % 8))) != 0; };
+
+	/**
+	 * @brief Append instructions first to first + count - 1 to program, relocating branches by segment
+	 *
+	 * @return false if the program is full
+	 */
+	bool appendPart(LP5562Program &program, size_t first, size_t count) const;
+
+	/**
+	 * @brief Instructions of all segments, with branch step numbers relative to their segment
+	 */
+	uint16_t instructions[MAX_INSTRUCTIONS];
+
+	/**
+	 * @brief Number of entries in instructions
+	 */
+	size_t numInstructions = 0;
+
+	/**
+	 * @brief Bit mask, one bit per entry in instructions, set for the first instruction of each segment
+	 */
+	uint8_t segmentStarts[(MAX_INSTRUCTIONS + 7) / 8];
+
+	/**
+	 * @brief Bit mask, one bit per entry in instructions, set for segments that start on the next engine
+	 */
+	uint8_t handOffs[(MAX_INSTRUCTIONS + 7) / 8];
+
+	/**
+	 * @brief addHandOff() was called and the next segment has not been added yet
+	 */
+	bool handOffPending = false;
+
+	/**
+	 * @brief An addSegment() or addHandOff() call failed
+	 */
+	bool segmentError = false;
+
+	/**
+	 * @brief Go back to the start of the sequence after the end
+	 */
+	bool repeat = true;
+
+	/**
+	 * @brief Result of the last compile()
+	 */
+	Result result;
+
+	/**
+	 * @brief Programs for engines 1 - 3
+	 */
+	LP5562Program programs[3];
+};
+
+#endif /* __LP5562_RK_CHAIN_H */
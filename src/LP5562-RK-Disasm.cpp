@@ -0,0 +1,393 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Disasm.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Step time in microseconds for prescale = false and prescale = true (16 and 512 cycles of 32768 Hz)
+static const uint32_t PRESCALE0_STEP_US = 488;
+static const uint32_t PRESCALE1_STEP_US = 15625;
+
+// static
+size_t LP5562Disassembler::disassembleInstruction(uint16_t inst, char *buf, size_t bufSize) {
+	size_t offset = 0;
+
+	if (bufSize > 0) {
+		buf[0] = 0;
+	}
+
+	if ((inst & 0x8000) == 0) {
+		bool prescale = (inst & 0x4000) != 0;
+		uint8_t stepTime = (inst >> 8) & 0x3f;
+		uint8_t increment = inst & 0x7f;
+
+		if (stepTime == 0) {
+			if (prescale) {
+				offset = append(buf, bufSize, offset, "set_pwm %u", inst & 0xff);
+			}
+			else {
+				offset = append(buf, bufSize, offset, "go_to_start");
+			}
+		}
+		else {
+			// Use the exact value (15.625 ms) for prescale, and 0.488 ms for no prescale
+			uint32_t us = stepTime * (prescale ? PRESCALE1_STEP_US : PRESCALE0_STEP_US);
+
+			if (increment == 0) {
+				offset = append(buf, bufSize, offset, "wait %lu.%02lu ms",
+						(unsigned long)(us / 1000), (unsigned long)((us % 1000) / 10));
+			}
+			else {
+				offset = append(buf, bufSize, offset, "ramp %c%u, %lu.%02lu ms/step",
+						(inst & 0x0080) ? '-' : '+', increment,
+						(unsigned long)(us / 1000), (unsigned long)((us % 1000) / 10));
+			}
+			offset = append(buf, bufSize, offset, " (prescale=%d step=%u)", prescale, stepTime);
+		}
+	}
+	else
+	switch(inst & 0xe000) {
+	case 0xa000: {
+		uint8_t loopCount = (inst >> 7) & 0x3f;
+		if (loopCount == 0) {
+			offset = append(buf, bufSize, offset, "branch forever to %u", inst & 0xf);
+		}
+		else {
+			offset = append(buf, bufSize, offset, "branch %u times to %u", loopCount, inst & 0xf);
+		}
+		break;
+	}
+
+	case 0xc000:
+		offset = append(buf, bufSize, offset, "end%s%s",
+				(inst & 0x1000) ? " interrupt" : "",
+				(inst & 0x0800) ? " set_pwm_0" : "");
+		break;
+
+	case 0xe000: {
+		uint8_t sendMask = (inst >> 7) & 0x7;
+		uint8_t waitMask = (inst >> 1) & 0x7;
+
+		offset = append(buf, bufSize, offset, "trigger");
+		if (sendMask) {
+			offset = append(buf, bufSize, offset, " send");
+			for(size_t engine = 1; engine <= 3; engine++) {
+				if (sendMask & (1 << (engine - 1))) {
+					offset = append(buf, bufSize, offset, " %u", (unsigned) engine);
+				}
+			}
+		}
+		if (waitMask) {
+			offset = append(buf, bufSize, offset, " wait");
+			for(size_t engine = 1; engine <= 3; engine++) {
+				if (waitMask & (1 << (engine - 1))) {
+					offset = append(buf, bufSize, offset, " %u", (unsigned) engine);
+				}
+			}
+		}
+		break;
+	}
+
+	default:
+		offset = append(buf, bufSize, offset, "invalid");
+		break;
+	}
+
+	return offset;
+}
+
+// static
+size_t LP5562Disassembler::disassemble(const uint16_t *instructions, size_t numInstructions, char *buf, size_t bufSize) {
+	size_t offset = 0;
+
+	if (bufSize > 0) {
+		buf[0] = 0;
+	}
+
+	for(size_t step = 0; step < numInstructions && step < 16; step++) {
+		char line[48];
+		disassembleInstruction(instructions[step], line, sizeof(line));
+
+		offset = append(buf, bufSize, offset, "%02u: %04x  %s\n", (unsigned) step, instructions[step], line);
+	}
+	return offset;
+}
+
+// static
+bool LP5562Disassembler::validate(const uint16_t *instructions, size_t numInstructions, size_t engine, Report &report) {
+	report.numIssues = report.numErrors = 0;
+
+	Analysis analysis;
+	analyze(instructions, numInstructions, engine, analysis, report);
+
+	return report.numErrors == 0;
+}
+
+// static
+bool LP5562Disassembler::validateEngines(const uint16_t * const instructions[3], const size_t numInstructions[3], Report &report) {
+	report.numIssues = report.numErrors = 0;
+
+	Analysis analysis[3];
+	for(size_t ii = 0; ii < 3; ii++) {
+		if (instructions[ii]) {
+			analyze(instructions[ii], numInstructions[ii], ii + 1, analysis[ii], report);
+		}
+	}
+
+	// A trigger wait only completes when the other engine sends to this one, and a trigger send only
+	// completes when the other engine is waiting for this one.
+	for(size_t ii = 0; ii < 3; ii++) {
+		if (!instructions[ii]) {
+			continue;
+		}
+		uint8_t self = (uint8_t)(1 << ii);
+
+		for(size_t step = 0; step < 16; step++) {
+			uint16_t inst = analysis[ii].words[step];
+			if ((analysis[ii].reachable & (1 << step)) == 0 || (inst & 0xe000) != 0xe000) {
+				continue;
+			}
+			uint8_t sendMask = (inst >> 7) & 0x7 & ~self;
+			uint8_t waitMask = (inst >> 1) & 0x7 & ~self;
+
+			for(size_t other = 0; other < 3; other++) {
+				uint8_t otherBit = (uint8_t)(1 << other);
+
+				if ((waitMask & otherBit) && (!instructions[other] || (analysis[other].sendMask & self) == 0)) {
+					addIssue(report, ISSUE_TRIGGER_WAIT_DEADLOCK, ii + 1, step);
+				}
+				if ((sendMask & otherBit) && (!instructions[other] || (analysis[other].waitMask & self) == 0)) {
+					addIssue(report, ISSUE_TRIGGER_SEND_DEADLOCK, ii + 1, step);
+				}
+			}
+		}
+	}
+
+	return report.numErrors == 0;
+}
+
+// static
+bool LP5562Disassembler::isError(uint8_t code) {
+	switch(code) {
+	case ISSUE_INVALID_OPCODE:
+	case ISSUE_BRANCH_OUT_OF_RANGE:
+	case ISSUE_TRIGGER_WAIT_DEADLOCK:
+	case ISSUE_TRIGGER_SEND_DEADLOCK:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// static
+const char *LP5562Disassembler::getIssueDescription(uint8_t code) {
+	switch(code) {
+	case ISSUE_INVALID_OPCODE:
+		return "invalid instruction";
+	case ISSUE_BRANCH_OUT_OF_RANGE:
+		return "branch past the end of the program";
+	case ISSUE_BRANCH_FORWARD:
+		return "branch to a later step";
+	case ISSUE_INFINITE_LOOP:
+		return "branch loops forever";
+	case ISSUE_UNREACHABLE:
+		return "instruction is never executed";
+	case ISSUE_NO_WAIT_IN_LOOP:
+		return "program repeats without a wait";
+	case ISSUE_TRIGGER_SELF:
+		return "trigger to own engine is ignored";
+	case ISSUE_TRIGGER_WAIT_DEADLOCK:
+		return "waits for a trigger that is never sent";
+	case ISSUE_TRIGGER_SEND_DEADLOCK:
+		return "sends a trigger to an engine that never waits for it";
+	default:
+		return "unknown";
+	}
+}
+
+// static
+size_t LP5562Disassembler::formatReport(const Report &report, char *buf, size_t bufSize) {
+	size_t offset = 0;
+
+	if (bufSize > 0) {
+		buf[0] = 0;
+	}
+
+	for(size_t ii = 0; ii < report.numIssues; ii++) {
+		const Issue &issue = report.issues[ii];
+		offset = append(buf, bufSize, offset, "engine %u step %u: %s: %s\n",
+				issue.engine, issue.step, isError(issue.code) ? "error" : "warning", getIssueDescription(issue.code));
+	}
+	return offset;
+}
+
+// static
+void LP5562Disassembler::analyze(const uint16_t *instructions, size_t numInstructions, size_t engine, Analysis &analysis, Report &report) {
+	if (numInstructions > 16) {
+		numInstructions = 16;
+	}
+	for(size_t step = 0; step < 16; step++) {
+		analysis.words[step] = (step < numInstructions) ? instructions[step] : 0;
+	}
+	analysis.reachable = 0;
+	analysis.sendMask = analysis.waitMask = 0;
+
+	// Follow every path from step 0. With only 16 steps a simple work list of step numbers is enough.
+	uint8_t pending[16];
+	size_t numPending = 0;
+	pending[numPending++] = 0;
+	analysis.reachable = 1;
+
+	bool hasTimed = false;
+
+	while(numPending > 0) {
+		uint8_t step = pending[--numPending];
+		uint16_t inst = analysis.words[step];
+
+		uint8_t next[2];
+		size_t numNext = 0;
+
+		if (isTimed(inst)) {
+			hasTimed = true;
+		}
+
+		if ((inst & 0x8000) == 0) {
+			if ((inst & 0x3f00) == 0 && (inst & 0x4000) == 0) {
+				// Go to start
+				next[numNext++] = 0;
+			}
+			else {
+				next[numNext++] = (step + 1) & 0xf;
+			}
+		}
+		else
+		switch(inst & 0xe000) {
+		case 0xa000:
+			next[numNext++] = inst & 0xf;
+			if (((inst >> 7) & 0x3f) != 0) {
+				next[numNext++] = (step + 1) & 0xf;
+			}
+			break;
+
+		case 0xc000:
+			// End stops the engine
+			break;
+
+		case 0xe000:
+			analysis.sendMask |= (inst >> 7) & 0x7;
+			analysis.waitMask |= (inst >> 1) & 0x7;
+			next[numNext++] = (step + 1) & 0xf;
+			break;
+
+		default:
+			// Invalid instructions are reported below. The simulator skips them.
+			next[numNext++] = (step + 1) & 0xf;
+			break;
+		}
+
+		for(size_t ii = 0; ii < numNext; ii++) {
+			if ((analysis.reachable & (1 << next[ii])) == 0) {
+				analysis.reachable |= (uint16_t)(1 << next[ii]);
+				pending[numPending++] = next[ii];
+			}
+		}
+	}
+
+	uint8_t self = (engine >= 1 && engine <= 3) ? (uint8_t)(1 << (engine - 1)) : 0;
+
+	for(size_t step = 0; step < numInstructions; step++) {
+		uint16_t inst = analysis.words[step];
+		bool reachable = (analysis.reachable & (1 << step)) != 0;
+
+		if (!reachable) {
+			addIssue(report, ISSUE_UNREACHABLE, engine, step);
+		}
+
+		switch(inst & 0xe000) {
+		case 0x8000:
+			addIssue(report, ISSUE_INVALID_OPCODE, engine, step);
+			break;
+
+		case 0xa000: {
+			uint8_t target = inst & 0xf;
+			if (target >= numInstructions) {
+				addIssue(report, ISSUE_BRANCH_OUT_OF_RANGE, engine, step);
+			}
+			else
+			if (target > step) {
+				addIssue(report, ISSUE_BRANCH_FORWARD, engine, step);
+			}
+			if (((inst >> 7) & 0x3f) == 0) {
+				addIssue(report, ISSUE_INFINITE_LOOP, engine, step);
+			}
+			break;
+		}
+
+		case 0xe000:
+			if ((((inst >> 7) | (inst >> 1)) & self) != 0) {
+				addIssue(report, ISSUE_TRIGGER_SELF, engine, step);
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!hasTimed && numInstructions > 0) {
+		addIssue(report, ISSUE_NO_WAIT_IN_LOOP, engine, 0);
+	}
+}
+
+// static
+void LP5562Disassembler::addIssue(Report &report, uint8_t code, size_t engine, size_t step) {
+	if (isError(code)) {
+		report.numErrors++;
+	}
+	if (report.numIssues < MAX_ISSUES) {
+		Issue &issue = report.issues[report.numIssues++];
+		issue.code = code;
+		issue.engine = (uint8_t) engine;
+		issue.step = (uint8_t) step;
+	}
+}
+
+// static
+size_t LP5562Disassembler::append(char *buf, size_t bufSize, size_t offset, const char *fmt, ...) {
+	if (offset + 1 >= bufSize) {
+		return offset;
+	}
+
+	va_list ap;
+	va_start(ap, fmt);
+	int count = vsnprintf(&buf[offset], bufSize - offset, fmt, ap);
+	va_end(ap);
+
+	if (count < 0) {
+		return offset;
+	}
+	offset += (size_t) count;
+	if (offset >= bufSize) {
+		offset = bufSize - 1;
+	}
+	return offset;
+}
+
+// static
+bool LP5562Disassembler::isTimed(uint16_t inst) {
+	if ((inst & 0x8000) == 0) {
+		// Ramp or wait if the step time is not 0
+		return (inst & 0x3f00) != 0;
+	}
+	switch(inst & 0xe000) {
+	case 0xc000:
+	case 0xe000:
+		return true;
+
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,173 @@
+#ifndef __LP5562_RK_DISASM_H
+#define __LP5562_RK_DISASM_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Disassembles and checks engine programs
+ *
+ * disassemble() converts the 16-bit instruction words into readable text, one line per instruction:
+ *
+ * char buf[512];
+ * LP5562Disassembler::disassemble(program.getInstructions(), program.getStepNum(), buf, sizeof(buf));
+ *
+ * validate() checks a single program for mistakes like branches out of range or code that can never run.
+ * validateEngines() also checks the trigger instructions across all three engines, since a trigger
+ * wait on an engine that never sends (or a send to an engine that never waits) stops the engines forever.
+ *
+ * Everything is static and no memory is allocated. If you define ENABLE_PROGRAM_VALIDATION when building,
+ * LP5562::setProgram() validates every program and refuses to load one with errors, and engines are only
+ * started if validateEngines() passes for them and the engines already running.
+ */
+class LP5562Disassembler {
+public:
+	/**
+	 * @brief Problems that validate() can find
+	 */
+	enum IssueCode {
+		ISSUE_INVALID_OPCODE = 0,		//!< Error: not a valid instruction (bits 15:13 = 100)
+		ISSUE_BRANCH_OUT_OF_RANGE,		//!< Error: branch to a step past the end of the program
+		ISSUE_BRANCH_FORWARD,			//!< Warning: branch to a later step (loops normally go backward)
+		ISSUE_INFINITE_LOOP,			//!< Warning: branch with a loop count of 0 loops forever
+		ISSUE_UNREACHABLE,				//!< Warning: instruction can never be executed
+		ISSUE_NO_WAIT_IN_LOOP,			//!< Warning: the program repeats without any time passing
+		ISSUE_TRIGGER_SELF,				//!< Warning: trigger to or from the engine's own engine is ignored
+		ISSUE_TRIGGER_WAIT_DEADLOCK,	//!< Error: waits for a trigger from an engine that never sends one to it
+		ISSUE_TRIGGER_SEND_DEADLOCK		//!< Error: sends a trigger to an engine that never waits for this one
+	};
+
+	/**
+	 * @brief One problem found by validate()
+	 */
+	struct Issue {
+		uint8_t code;					//!< IssueCode
+		uint8_t engine;					//!< Engine (1 - 3), or 0 if not known
+		uint8_t step;					//!< Instruction number (0 - 15)
+	};
+
+	/**
+	 * @brief Maximum number of issues stored in a Report
+	 */
+	static const size_t MAX_ISSUES = 16;
+
+	/**
+	 * @brief Results from validate() or validateEngines()
+	 */
+	struct Report {
+		size_t numIssues;				//!< Number of entries in issues
+		size_t numErrors;				//!< Number of issues that are errors, not warnings (includes ones that didn't fit)
+		Issue issues[MAX_ISSUES];		//!< The issues found, in engine and step order
+	};
+
+	/**
+	 * @brief Convert one instruction to text
+	 *
+	 * @param inst The instruction word
+	 *
+	 * @param buf Buffer to write to. Always null terminated.
+	 *
+	 * @param bufSize Size of buf in bytes. 48 bytes is enough for any instruction.
+	 *
+	 * @return The number of characters written, not including the null terminator
+	 */
+	static size_t disassembleInstruction(uint16_t inst, char *buf, size_t bufSize);
+
+	/**
+	 * @brief Convert a program to text, one line per instruction, like "03: 4d00  wait 203.12 ms"
+	 *
+	 * @param instructions The instruction words
+	 *
+	 * @param numInstructions Number of instructions (0 - 16)
+	 *
+	 * @param buf Buffer to write to. Always null terminated. Output that doesn't fit is truncated.
+	 *
+	 * @param bufSize Size of buf in bytes. 64 bytes per instruction is enough.
+	 *
+	 * @return The number of characters written, not including the null terminator
+	 */
+	static size_t disassemble(const uint16_t *instructions, size_t numInstructions, char *buf, size_t bufSize);
+
+	/**
+	 * @brief Check one program
+	 *
+	 * @param instructions The instruction words
+	 *
+	 * @param numInstructions Number of instructions (0 - 16). The rest of engine memory is 0x0000 (go to start).
+	 *
+	 * @param engine The engine (1 - 3) the program runs on, used for the trigger checks, or 0 if not known
+	 *
+	 * @param report Filled in with the issues found
+	 *
+	 * @return true if there are no errors. There may still be warnings in report.
+	 */
+	static bool validate(const uint16_t *instructions, size_t numInstructions, size_t engine, Report &report);
+
+	/**
+	 * @brief Check the programs for all three engines together, including trigger deadlocks
+	 *
+	 * @param instructions Array of 3 pointers to the instruction words for engines 1 - 3. Use NULL for an
+	 * engine that's not running.
+	 *
+	 * @param numInstructions Array of 3 instruction counts
+	 *
+	 * @param report Filled in with the issues found
+	 *
+	 * @return true if there are no errors. There may still be warnings in report.
+	 */
+	static bool validateEngines(const uint16_t * const instructions[3], const size_t numInstructions[3], Report &report);
+
+	/**
+	 * @brief Returns true if the issue code is an error, false if it's a warning
+	 */
+	static bool isError(uint8_t code);
+
+	/**
+	 * @brief Get a short description of an issue code
+	 */
+	static const char *getIssueDescription(uint8_t code);
+
+	/**
+	 * @brief Convert a report to text, one line per issue, like "engine 2 step 5: error: ..."
+	 *
+	 * @return The number of characters written, not including the null terminator
+	 */
+	static size_t formatReport(const Report &report, char *buf, size_t bufSize);
+
+protected:
+	/**
+	 * @brief Summary of one program used by the checks
+	 */
+	struct Analysis {
+		uint16_t words[16];			//!< All 16 instruction words, padded with 0x0000
+		uint16_t reachable;			//!< Bit mask of steps that can be executed
+		uint8_t sendMask;			//!< Engines that reachable trigger instructions send to
+		uint8_t waitMask;			//!< Engines that reachable trigger instructions wait for
+	};
+
+	/**
+	 * @brief Check one program and fill in analysis for the trigger checks
+	 */
+	static void analyze(const uint16_t *instructions, size_t numInstructions, size_t engine, Analysis &analysis, Report &report);
+
+	/**
+	 * @brief Add an issue to the report
+	 */
+	static void addIssue(Report &report, uint8_t code, size_t engine, size_t step);
+
+	/**
+	 * @brief Appends formatted text to buf at offset, always null terminating
+	 *
+	 * @return The new offset
+	 */
+	static size_t append(char *buf, size_t bufSize, size_t offset, const char *fmt, ...);
+
+	/**
+	 * @brief Returns true if the instruction takes time to execute (ramp, wait, trigger wait, or end)
+	 */
+	static bool isTimed(uint16_t inst);
+};
+
+#endif /* __LP5562_RK_DISASM_H */
@@ -0,0 +1,57 @@
+#ifndef __LP5562_RK_HOST_H
+#define __LP5562_RK_HOST_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Minimal stand-ins for the parts of the Particle API that the library uses, so the library can be
+// compiled with a regular compiler (g++ or clang++) on a computer. This file is only used when
+// PARTICLE is not defined. You'll need to pass a LP5562Transport (like LP5562MockTransport) to
+// the LP5562 constructor since there is no Wire object.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+/**
+ * @brief Time that millis() and micros() count from, set by the first call to either one
+ *
+ * Both use the same starting point so millis() == micros() / 1000, like on the device.
+ */
+inline std::chrono::steady_clock::time_point hostEpoch() {
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return start;
+}
+
+/**
+ * @brief Milliseconds since the first call to millis() or micros()
+ */
+inline unsigned long millis() {
+	return (unsigned long) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - hostEpoch()).count();
+}
+
+/**
+ * @brief Microseconds since the first call to millis() or micros()
+ */
+inline unsigned long micros() {
+	return (unsigned long) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostEpoch()).count();
+}
+
+/**
+ * @brief Delay in milliseconds
+ */
+inline void delay(unsigned long ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+/**
+ * @brief Delay in microseconds
+ */
+inline void delayMicroseconds(unsigned int us) {
+	std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+#endif /* __LP5562_RK_HOST_H */
@@ -0,0 +1,236 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Indicator.h"
+
+LP5562IndicatorState::LP5562IndicatorState(const char *name, uint8_t priority) : name(name), priority(priority) {
+	for(size_t ii = 0; ii < NUM_CHANNELS; ii++) {
+		modes[ii] = LP5562::REG_LED_MAP_DIRECT;
+		values[ii] = 0;
+	}
+}
+
+LP5562IndicatorState::~LP5562IndicatorState() {
+
+}
+
+LP5562IndicatorState &LP5562IndicatorState::withChannel(size_t channel, uint8_t mode, uint8_t value) {
+	if (channel < NUM_CHANNELS) {
+		channelMask |= (uint8_t)(1 << channel);
+		modes[channel] = mode & 0b11;
+		values[channel] = value;
+	}
+	return *this;
+}
+
+
+LP5562IndicatorManager::LP5562IndicatorManager(LP5562 &driver) : driver(driver) {
+	for(size_t ii = 0; ii < LP5562IndicatorState::NUM_CHANNELS; ii++) {
+		appliedModes[ii] = LP5562::REG_LED_MAP_DIRECT;
+		appliedValues[ii] = 0;
+	}
+}
+
+LP5562IndicatorManager::~LP5562IndicatorManager() {
+
+}
+
+LP5562IndicatorManager &LP5562IndicatorManager::addState(LP5562IndicatorState &state) {
+	if (numEntries < MAX_STATES && findState(state) < 0) {
+		Entry &entry = entries[numEntries++];
+		entry.state = &state;
+		entry.active = false;
+		entry.sequence = 0;
+		entry.activatedMs = 0;
+		entry.timeoutMs = 0;
+	}
+	return *this;
+}
+
+bool LP5562IndicatorManager::activate(LP5562IndicatorState &state, unsigned long timeoutMs) {
+	int index = findState(state);
+	if (index < 0) {
+		return false;
+	}
+	activateIndex((size_t) index, timeoutMs);
+	return true;
+}
+
+bool LP5562IndicatorManager::activate(const char *name, unsigned long timeoutMs) {
+	int index = findState(name);
+	if (index < 0) {
+		return false;
+	}
+	activateIndex((size_t) index, timeoutMs);
+	return true;
+}
+
+bool LP5562IndicatorManager::deactivate(LP5562IndicatorState &state) {
+	int index = findState(state);
+	if (index < 0) {
+		return false;
+	}
+	deactivateIndex((size_t) index);
+	return true;
+}
+
+bool LP5562IndicatorManager::deactivate(const char *name) {
+	int index = findState(name);
+	if (index < 0) {
+		return false;
+	}
+	deactivateIndex((size_t) index);
+	return true;
+}
+
+bool LP5562IndicatorManager::isActive(const LP5562IndicatorState &state) const {
+	int index = findState(state);
+	return index >= 0 && entries[index].active;
+}
+
+const LP5562IndicatorState *LP5562IndicatorManager::getWinningState(size_t channel) const {
+	int index = getWinningIndex(channel);
+	return (index >= 0) ? entries[index].state : NULL;
+}
+
+void LP5562IndicatorManager::loop() {
+	for(size_t ii = 0; ii < numEntries; ii++) {
+		Entry &entry = entries[ii];
+		if (entry.active && entry.timeoutMs != 0 && millis() - entry.activatedMs >= entry.timeoutMs) {
+			deactivateIndex(ii);
+		}
+	}
+
+	if (changed) {
+		(void) apply();
+	}
+}
+
+bool LP5562IndicatorManager::apply() {
+	uint8_t modes[LP5562IndicatorState::NUM_CHANNELS];
+	uint8_t values[LP5562IndicatorState::NUM_CHANNELS];
+	bool mappingChanged = !appliedValid;
+
+	for(size_t channel = 0; channel < LP5562IndicatorState::NUM_CHANNELS; channel++) {
+		int index = getWinningIndex(channel);
+		if (index >= 0) {
+			modes[channel] = entries[index].state->modes[channel];
+			values[channel] = entries[index].state->values[channel];
+		}
+		else {
+			// No state sets this channel, so it's off
+			modes[channel] = LP5562::REG_LED_MAP_DIRECT;
+			values[channel] = 0;
+		}
+
+		if (modes[channel] != appliedModes[channel]) {
+			mappingChanged = true;
+		}
+	}
+
+	driver.beginBatch();
+
+	// Direct levels are only used in direct mode, and are left alone otherwise. They're set before the
+	// mapping so a channel that changes to direct mode starts at the right level.
+	for(size_t channel = 0; channel < LP5562IndicatorState::NUM_CHANNELS; channel++) {
+		if (modes[channel] != LP5562::REG_LED_MAP_DIRECT || (appliedValid && values[channel] == appliedValues[channel])) {
+			continue;
+		}
+		switch(channel) {
+		case LP5562IndicatorState::CHANNEL_R:
+			driver.setR(values[channel]);
+			break;
+		case LP5562IndicatorState::CHANNEL_G:
+			driver.setG(values[channel]);
+			break;
+		case LP5562IndicatorState::CHANNEL_B:
+			driver.setB(values[channel]);
+			break;
+		default:
+			driver.setW(values[channel]);
+			break;
+		}
+		appliedValues[channel] = values[channel];
+	}
+
+	bool bResult = true;
+	if (mappingChanged) {
+		bResult = driver.setLedMapping(modes[LP5562IndicatorState::CHANNEL_R], modes[LP5562IndicatorState::CHANNEL_G],
+				modes[LP5562IndicatorState::CHANNEL_B], modes[LP5562IndicatorState::CHANNEL_W]);
+	}
+
+	if (!driver.commit()) {
+		bResult = false;
+	}
+
+	for(size_t channel = 0; channel < LP5562IndicatorState::NUM_CHANNELS; channel++) {
+		appliedModes[channel] = modes[channel];
+	}
+
+	// After an error, write everything again next time
+	appliedValid = bResult;
+	changed = !bResult;
+
+	return bResult;
+}
+
+int LP5562IndicatorManager::findState(const LP5562IndicatorState &state) const {
+	for(size_t ii = 0; ii < numEntries; ii++) {
+		if (entries[ii].state == &state) {
+			return (int) ii;
+		}
+	}
+	return -1;
+}
+
+int LP5562IndicatorManager::findState(const char *name) const {
+	for(size_t ii = 0; ii < numEntries; ii++) {
+		if (name && entries[ii].state->name && strcmp(entries[ii].state->name, name) == 0) {
+			return (int) ii;
+		}
+	}
+	return -1;
+}
+
+void LP5562IndicatorManager::activateIndex(size_t index, unsigned long timeoutMs) {
+	Entry &entry = entries[index];
+	entry.active = true;
+	entry.sequence = ++nextSequence;
+	entry.activatedMs = millis();
+	entry.timeoutMs = timeoutMs;
+	changed = true;
+}
+
+void LP5562IndicatorManager::deactivateIndex(size_t index) {
+	Entry &entry = entries[index];
+	if (entry.active) {
+		entry.active = false;
+		changed = true;
+	}
+}
+
+int LP5562IndicatorManager::getWinningIndex(size_t channel) const {
+	int winner = -1;
+
+	if (channel >= LP5562IndicatorState::NUM_CHANNELS) {
+		return winner;
+	}
+
+	for(size_t ii = 0; ii < numEntries; ii++) {
+		const Entry &entry = entries[ii];
+		if (!entry.active || (entry.state->channelMask & (1 << channel)) == 0) {
+			continue;
+		}
+		if (winner < 0) {
+			winner = (int) ii;
+			continue;
+		}
+
+		const Entry &best = entries[winner];
+		if (entry.state->priority > best.state->priority ||
+			(entry.state->priority == best.state->priority && entry.sequence > best.sequence)) {
+			winner = (int) ii;
+		}
+	}
+	return winner;
+}
@@ -0,0 +1,290 @@
+#ifndef __LP5562_RK_INDICATOR_H
+#define __LP5562_RK_INDICATOR_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief A named indicator state, like "cloud connecting" or "low battery"
+ *
+ * A state sets some of the channels to a pattern from setIndicatorMode() or a direct level. The
+ * channels it doesn't set show whatever lower priority state is active.
+ *
+ * LP5562IndicatorState lowBattery("low battery", 20);
+ * lowBattery.withChannel(LP5562IndicatorState::CHANNEL_R, LP5562::REG_LED_MAP_ENGINE_2);
+ */
+class LP5562IndicatorState {
+public:
+	/**
+	 * @brief Construct a state
+	 *
+	 * @param name Name of the state. The string is not copied, so it's typically a string constant.
+	 *
+	 * @param priority When more than one active state sets a channel, the highest priority wins. With
+	 * equal priorities, the one activated most recently wins.
+	 */
+	LP5562IndicatorState(const char *name, uint8_t priority);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562IndicatorState();
+
+	/**
+	 * @brief Set how a channel looks in this state
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+	 *
+	 * @param mode REG_LED_MAP_DIRECT, REG_LED_MAP_ENGINE_1 (blink), REG_LED_MAP_ENGINE_2 (fast blink), or
+	 * REG_LED_MAP_ENGINE_3 (breathe)
+	 *
+	 * @param value The PWM level for REG_LED_MAP_DIRECT (0 = off, 255 = full brightness)
+	 */
+	LP5562IndicatorState &withChannel(size_t channel, uint8_t mode, uint8_t value = 0);
+
+	/**
+	 * @brief Get the name of the state
+	 */
+	const char *getName() const { return name; };
+
+	/**
+	 * @brief Get the priority of the state
+	 */
+	uint8_t getPriority() const { return priority; };
+
+	static const size_t NUM_CHANNELS = 4;	//!< Number of LED channels
+	static const size_t CHANNEL_R = 0;		//!< Red channel index
+	static const size_t CHANNEL_G = 1;		//!< Green channel index
+	static const size_t CHANNEL_B = 2;		//!< Blue channel index
+	static const size_t CHANNEL_W = 3;		//!< White channel index
+
+protected:
+	/**
+	 * @brief Name of the state (not copied)
+	 */
+	const char *name;
+
+	/**
+	 * @brief Priority of the state
+	 */
+	uint8_t priority;
+
+	/**
+	 * @brief Bit mask of the channels this state sets
+	 */
+	uint8_t channelMask = 0;
+
+	/**
+	 * @brief LED map mode for each channel
+	 */
+	uint8_t modes[NUM_CHANNELS];
+
+	/**
+	 * @brief Direct PWM level for each channel
+	 */
+	uint8_t values[NUM_CHANNELS];
+
+	friend class LP5562IndicatorManager;
+};
+
+/**
+ * @brief Decides which indicator states are shown, for several parts of the application at once
+ *
+ * Call setIndicatorMode() on the LP5562 first, then add the states. Any part of the application can
+ * activate or deactivate states, optionally with a timeout, and loop() shows the highest priority
+ * active state for each channel:
+ *
+ * LP5562IndicatorManager indicators(ledDriver);
+ * indicators.addState(cloudConnecting).addState(lowBattery).addState(ota);
+ *
+ * indicators.activate("low battery");
+ * indicators.activate(ota, 60000);
+ *
+ * void loop() {
+ *     indicators.loop();
+ * }
+ *
+ * Only the registers that changed are written: the LED map register once if any channel's mode changed,
+ * and the PWM registers of channels with a direct level that changed, combined in one batch. A change of
+ * state that doesn't change what's shown doesn't use the bus at all.
+ *
+ * The manager assumes it is the only code changing the LED mapping and direct levels.
+ */
+class LP5562IndicatorManager {
+public:
+	/**
+	 * @brief Construct a manager with no states
+	 *
+	 * @param driver The LP5562, with setIndicatorMode() already called
+	 */
+	LP5562IndicatorManager(LP5562 &driver);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562IndicatorManager();
+
+	/**
+	 * @brief Add a state that can be activated
+	 *
+	 * @param state The state. It's not copied, so it must remain valid; it's typically a global variable.
+	 *
+	 * If there are already MAX_STATES states, it's not added.
+	 */
+	LP5562IndicatorManager &addState(LP5562IndicatorState &state);
+
+	/**
+	 * @brief Activate a state
+	 *
+	 * @param state The state, which must have been added with addState()
+	 *
+	 * @param timeoutMs Deactivate the state automatically after this many milliseconds, or 0 to stay active
+	 * until deactivate() is called
+	 *
+	 * @return false if the state was not added
+	 *
+	 * Activating a state that's already active restarts its timeout and makes it the most recent.
+	 * The change is shown by the next loop() or apply().
+	 */
+	bool activate(LP5562IndicatorState &state, unsigned long timeoutMs = 0);
+
+	/**
+	 * @brief Activate a state by name
+	 *
+	 * @return false if there is no state with that name
+	 */
+	bool activate(const char *name, unsigned long timeoutMs = 0);
+
+	/**
+	 * @brief Deactivate a state
+	 *
+	 * @return false if the state was not added
+	 */
+	bool deactivate(LP5562IndicatorState &state);
+
+	/**
+	 * @brief Deactivate a state by name
+	 *
+	 * @return false if there is no state with that name
+	 */
+	bool deactivate(const char *name);
+
+	/**
+	 * @brief Returns true if a state is active
+	 */
+	bool isActive(const LP5562IndicatorState &state) const;
+
+	/**
+	 * @brief Get the state shown on a channel
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W from LP5562IndicatorState
+	 *
+	 * @return The state, or NULL if no active state sets the channel (it's off)
+	 */
+	const LP5562IndicatorState *getWinningState(size_t channel) const;
+
+	/**
+	 * @brief Call this from loop(). Handles timeouts and shows any changes.
+	 */
+	void loop();
+
+	/**
+	 * @brief Show the current states now
+	 *
+	 * @return false if there was an I2C error. Everything is written again by the next apply() in that case.
+	 */
+	bool apply();
+
+	/**
+	 * @brief Forget what's been written, so the next apply() writes the LED map and all direct levels
+	 *
+	 * Use this if something else changed the LED mapping, like calling setIndicatorMode() again.
+	 */
+	void invalidate() { appliedValid = false; changed = true; };
+
+	/**
+	 * @brief Maximum number of states
+	 */
+	static const size_t MAX_STATES = 16;
+
+protected:
+	/**
+	 * @brief Find the index of a state, or -1 if it was not added
+	 */
+	int findState(const LP5562IndicatorState &state) const;
+
+	/**
+	 * @brief Find the index of a state by name, or -1 if there's no state with that name
+	 */
+	int findState(const char *name) const;
+
+	/**
+	 * @brief Activate the state at index
+	 */
+	void activateIndex(size_t index, unsigned long timeoutMs);
+
+	/**
+	 * @brief Deactivate the state at index
+	 */
+	void deactivateIndex(size_t index);
+
+	/**
+	 * @brief Get the index of the state shown on a channel, or -1 if none
+	 */
+	int getWinningIndex(size_t channel) const;
+
+	/**
+	 * @brief Activation status of one state
+	 */
+	struct Entry {
+		LP5562IndicatorState *state;	//!< The state (not owned)
+		bool active;					//!< The state is active
+		uint32_t sequence;				//!< Order of activation, larger is more recent
+		unsigned long activatedMs;		//!< millis() when activated
+		unsigned long timeoutMs;		//!< Timeout, or 0 for none
+	};
+
+	/**
+	 * @brief The LP5562 to update
+	 */
+	LP5562 &driver;
+
+	/**
+	 * @brief The states that have been added
+	 */
+	Entry entries[MAX_STATES];
+
+	/**
+	 * @brief Number of entries used
+	 */
+	size_t numEntries = 0;
+
+	/**
+	 * @brief Sequence number for the next activation
+	 */
+	uint32_t nextSequence = 0;
+
+	/**
+	 * @brief A state was activated or deactivated since the last apply()
+	 */
+	bool changed = true;
+
+	/**
+	 * @brief appliedModes and appliedValues match the chip
+	 */
+	bool appliedValid = false;
+
+	/**
+	 * @brief LED map mode written for each channel
+	 */
+	uint8_t appliedModes[LP5562IndicatorState::NUM_CHANNELS];
+
+	/**
+	 * @brief Direct PWM level written for each channel
+	 */
+	uint8_t appliedValues[LP5562IndicatorState::NUM_CHANNELS];
+};
+
+#endif /* __LP5562_RK_INDICATOR_H */
@@ -0,0 +1,139 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Interrupt.h"
+
+LP5562InterruptDispatcher::LP5562InterruptDispatcher(LP5562 &driver) : driver(driver) {
+	resetStats();
+}
+
+LP5562InterruptDispatcher::~LP5562InterruptDispatcher() {
+#if defined(PARTICLE)
+	detach();
+#endif
+}
+
+LP5562InterruptDispatcher &LP5562InterruptDispatcher::withEngineCallback(size_t engine, EngineCallback callback, void *context) {
+	if (engine >= 1 && engine <= 3) {
+		engineCallbacks[engine - 1] = callback;
+		engineContexts[engine - 1] = context;
+	}
+	return *this;
+}
+
+#if defined(PARTICLE)
+bool LP5562InterruptDispatcher::attach(pin_t pin) {
+	detach();
+
+	// INT is open drain
+	pinMode(pin, INPUT_PULLUP);
+	if (!attachInterrupt(pin, &LP5562InterruptDispatcher::interruptHandler, this, FALLING)) {
+		return false;
+	}
+	this->pin = pin;
+
+	// INT may already be low, which would not cause a falling edge
+	interruptFlag = true;
+	return true;
+}
+
+void LP5562InterruptDispatcher::detach() {
+	if (pin != PIN_INVALID) {
+		detachInterrupt(pin);
+		pin = PIN_INVALID;
+	}
+}
+#endif /* PARTICLE */
+
+void LP5562InterruptDispatcher::interruptHandler() {
+	interruptMicros = micros();
+	interruptFlag = true;
+	stats.interrupts++;
+}
+
+bool LP5562InterruptDispatcher::whenEnded(size_t engine, LP5562EngineCompletion &completion) {
+	if (engine < 1 || engine > 3) {
+		return false;
+	}
+	completion.done = false;
+	completions[engine - 1] = &completion;
+	return true;
+}
+
+void LP5562InterruptDispatcher::loop() {
+	unsigned long atMicros;
+
+	if (interruptFlag) {
+		// Cleared before the read, so an interrupt during the read causes another read
+		interruptFlag = false;
+		atMicros = interruptMicros;
+	}
+	else
+	if (pollPeriodMs != 0 && millis() - lastReadMs >= pollPeriodMs) {
+		atMicros = micros();
+	}
+	else {
+		return;
+	}
+
+	lastReadMs = millis();
+	stats.statusReads++;
+
+	uint8_t status;
+	if (!driver.getStatus(status)) {
+		// INT stays low until the status is read, so there won't be another edge. Try again on the next call.
+		stats.errors++;
+		interruptFlag = true;
+		return;
+	}
+
+	dispatch(status, atMicros);
+}
+
+void LP5562InterruptDispatcher::handleStatus(uint8_t status) {
+	dispatch(status, micros());
+}
+
+void LP5562InterruptDispatcher::resetStats() {
+	stats.interrupts = 0;
+	stats.statusReads = 0;
+	stats.ends = 0;
+	stats.spurious = 0;
+	stats.errors = 0;
+	stats.maxLatencyMicros = 0;
+}
+
+void LP5562InterruptDispatcher::dispatch(uint8_t status, unsigned long atMicros) {
+	static const uint8_t intBits[3] = { LP5562::REG_STATUS_ENG1_INT, LP5562::REG_STATUS_ENG2_INT, LP5562::REG_STATUS_ENG3_INT };
+
+	if ((status & (intBits[0] | intBits[1] | intBits[2])) == 0) {
+		stats.spurious++;
+	}
+
+	if (statusCallback) {
+		statusCallback(status, statusContext);
+	}
+
+	for(size_t engine = 1; engine <= 3; engine++) {
+		if ((status & intBits[engine - 1]) == 0) {
+			continue;
+		}
+		stats.ends++;
+
+		LP5562EngineCompletion *completion = completions[engine - 1];
+		if (completion) {
+			completions[engine - 1] = NULL;
+			completion->interruptMicros = atMicros;
+			completion->done = true;
+		}
+
+		if (engineCallbacks[engine - 1]) {
+			engineCallbacks[engine - 1](engine, engineContexts[engine - 1]);
+		}
+	}
+
+	uint32_t latency = (uint32_t)(micros() - atMicros);
+	if (latency > stats.maxLatencyMicros) {
+		stats.maxLatencyMicros = latency;
+	}
+}
@@ -0,0 +1,268 @@
+#ifndef __LP5562_RK_INTERRUPT_H
+#define __LP5562_RK_INTERRUPT_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Lets code wait for one engine to end, without a callback
+ *
+ * Pass it to LP5562InterruptDispatcher::whenEnded(), then check isDone() from loop().
+ */
+class LP5562EngineCompletion {
+public:
+	/**
+	 * @brief Construct a completion that is not done
+	 */
+	LP5562EngineCompletion() {};
+
+	/**
+	 * @brief Returns true once the engine has ended
+	 */
+	bool isDone() const { return done; };
+
+	/**
+	 * @brief Value of micros() when the interrupt for the end was received
+	 */
+	unsigned long getInterruptMicros() const { return interruptMicros; };
+
+protected:
+	/**
+	 * @brief The engine has ended
+	 */
+	bool done = false;
+
+	/**
+	 * @brief Value of micros() when the interrupt was received
+	 */
+	unsigned long interruptMicros = 0;
+
+	friend class LP5562InterruptDispatcher;
+};
+
+/**
+ * @brief Uses the INT pin of the LP5562 to find out when engines end, instead of polling REG_STATUS
+ *
+ * The LP5562 pulls INT low when an End instruction with the interrupt flag set is executed, until
+ * REG_STATUS is read. Connect it to a GPIO with a pull-up and call interruptHandler() from its falling
+ * edge interrupt. The interrupt handler only sets a flag, and loop() reads REG_STATUS once and calls
+ * the callbacks from the thread that called loop():
+ *
+ * LP5562InterruptDispatcher dispatcher(ledDriver);
+ *
+ * void setup() {
+ *     dispatcher.withEngineCallback(1, engine1Ended);
+ *     dispatcher.attach(D2);
+ * }
+ *
+ * void loop() {
+ *     dispatcher.loop();
+ * }
+ *
+ * Reading REG_STATUS clears the interrupt bits of all engines, so only one object should read it. If
+ * you also use LP5562Pager, call its handleStatus() from withStatusCallback() instead of its loop().
+ *
+ * On a computer, LP5562Simulator::withInterruptHandler() calls interruptHandler() when the simulated
+ * INT pin goes low.
+ */
+class LP5562InterruptDispatcher {
+public:
+	/**
+	 * @brief Called from loop() when an engine ends
+	 *
+	 * @param engine The engine number (1 - 3)
+	 *
+	 * @param context The context passed to withEngineCallback()
+	 */
+	typedef void (*EngineCallback)(size_t engine, void *context);
+
+	/**
+	 * @brief Called from loop() each time REG_STATUS is read
+	 *
+	 * @param status The value of REG_STATUS
+	 *
+	 * @param context The context passed to withStatusCallback()
+	 */
+	typedef void (*StatusCallback)(uint8_t status, void *context);
+
+	/**
+	 * @brief Counters
+	 */
+	struct Stats {
+		uint32_t interrupts;		//!< Calls to interruptHandler()
+		uint32_t statusReads;		//!< Reads of REG_STATUS
+		uint32_t ends;				//!< Engine ends dispatched
+		uint32_t spurious;			//!< Status reads with no engine interrupt bit set
+		uint32_t errors;			//!< Status reads that failed
+		uint32_t maxLatencyMicros;	//!< Longest time from interruptHandler() to the callbacks in microseconds
+	};
+
+	/**
+	 * @brief Construct a dispatcher
+	 *
+	 * @param driver The LP5562 to read the status from
+	 */
+	LP5562InterruptDispatcher(LP5562 &driver);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562InterruptDispatcher();
+
+	/**
+	 * @brief Set the function to call when an engine ends
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param callback The function to call, or NULL for none
+	 *
+	 * @param context Passed to the callback
+	 */
+	LP5562InterruptDispatcher &withEngineCallback(size_t engine, EngineCallback callback, void *context = NULL);
+
+	/**
+	 * @brief Set the function to call with the value of REG_STATUS each time it's read
+	 *
+	 * @param callback The function to call, or NULL for none
+	 *
+	 * @param context Passed to the callback
+	 */
+	LP5562InterruptDispatcher &withStatusCallback(StatusCallback callback, void *context = NULL) { statusCallback = callback; statusContext = context; return *this; };
+
+	/**
+	 * @brief Also read REG_STATUS this often, in case an interrupt is missed (default: 0, never)
+	 *
+	 * @param ms Milliseconds, or 0 to only read it after an interrupt
+	 */
+	LP5562InterruptDispatcher &withPollPeriodMs(unsigned long ms) { pollPeriodMs = ms; return *this; };
+
+#if defined(PARTICLE)
+	/**
+	 * @brief Attach interruptHandler() to the falling edge of the pin connected to INT
+	 *
+	 * @param pin The pin. It's set to INPUT_PULLUP as the INT output of the LP5562 is open drain.
+	 */
+	bool attach(pin_t pin);
+
+	/**
+	 * @brief Detach the interrupt attached by attach()
+	 */
+	void detach();
+#endif /* PARTICLE */
+
+	/**
+	 * @brief Call this from the falling edge interrupt of INT. Only sets a flag, so it's safe from an ISR.
+	 */
+	void interruptHandler();
+
+	/**
+	 * @brief Arrange for completion to be done the next time an engine ends
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param completion Set to not done now, and done when the engine ends. It must remain valid until then.
+	 *
+	 * Only one completion can wait for each engine; calling this again replaces the earlier one, which stays
+	 * not done.
+	 */
+	bool whenEnded(size_t engine, LP5562EngineCompletion &completion);
+
+	/**
+	 * @brief Call this from loop(). Reads REG_STATUS after an interrupt and calls the callbacks.
+	 */
+	void loop();
+
+	/**
+	 * @brief Dispatch a value of REG_STATUS that was read elsewhere
+	 *
+	 * @param status The value of REG_STATUS
+	 */
+	void handleStatus(uint8_t status);
+
+	/**
+	 * @brief Get the counters
+	 */
+	const Stats &getStats() const { return stats; };
+
+	/**
+	 * @brief Clear the counters
+	 */
+	void resetStats();
+
+protected:
+	/**
+	 * @brief Call the callbacks and complete the completions for the engines that ended
+	 *
+	 * @param status The value of REG_STATUS
+	 *
+	 * @param atMicros Value of micros() when the interrupt was received
+	 */
+	void dispatch(uint8_t status, unsigned long atMicros);
+
+	/**
+	 * @brief The LP5562 to read the status from
+	 */
+	LP5562 &driver;
+
+	/**
+	 * @brief Callback for each engine
+	 */
+	EngineCallback engineCallbacks[3] = { NULL, NULL, NULL };
+
+	/**
+	 * @brief Context for each engine callback
+	 */
+	void *engineContexts[3] = { NULL, NULL, NULL };
+
+	/**
+	 * @brief Completion waiting for each engine, or NULL
+	 */
+	LP5562EngineCompletion *completions[3] = { NULL, NULL, NULL };
+
+	/**
+	 * @brief Called with each value of REG_STATUS
+	 */
+	StatusCallback statusCallback = NULL;
+
+	/**
+	 * @brief Context for statusCallback
+	 */
+	void *statusContext = NULL;
+
+	/**
+	 * @brief How often to read REG_STATUS without an interrupt, 0 = never
+	 */
+	unsigned long pollPeriodMs = 0;
+
+	/**
+	 * @brief Value of millis() when REG_STATUS was last read
+	 */
+	unsigned long lastReadMs = 0;
+
+	/**
+	 * @brief Set by interruptHandler(). Starts out set so an interrupt from before the dispatcher was
+	 * set up is handled.
+	 */
+	volatile bool interruptFlag = true;
+
+	/**
+	 * @brief Value of micros() when interruptHandler() was last called
+	 */
+	volatile unsigned long interruptMicros = 0;
+
+	/**
+	 * @brief Counters
+	 */
+	Stats stats;
+
+#if defined(PARTICLE)
+	/**
+	 * @brief Pin passed to attach(), or PIN_INVALID
+	 */
+	pin_t pin = PIN_INVALID;
+#endif /* PARTICLE */
+};
+
+#endif /* __LP5562_RK_INTERRUPT_H */
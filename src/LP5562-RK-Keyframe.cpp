@@ -0,0 +1,393 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Keyframe.h"
+
+LP5562Timeline::LP5562Timeline() {
+
+}
+
+LP5562Timeline::~LP5562Timeline() {
+
+}
+
+bool LP5562Timeline::addKeyframe(unsigned long ms, uint8_t level, Interpolation interpolation) {
+	if (numKeyframes >= MAX_KEYFRAMES) {
+		return false;
+	}
+	if (numKeyframes == 0) {
+		if (ms != 0) {
+			return false;
+		}
+	}
+	else
+	if (ms <= keyframes[numKeyframes - 1].ms) {
+		return false;
+	}
+
+	keyframes[numKeyframes].ms = ms;
+	keyframes[numKeyframes].level = level;
+	keyframes[numKeyframes].interpolation = (uint8_t) interpolation;
+	numKeyframes++;
+	return true;
+}
+
+bool LP5562Timeline::isConstant() const {
+	for(size_t ii = 1; ii < numKeyframes; ii++) {
+		if (keyframes[ii].level != keyframes[0].level) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LP5562Timeline::isSameAs(const LP5562Timeline &other) const {
+	if (numKeyframes != other.numKeyframes) {
+		return false;
+	}
+	for(size_t ii = 0; ii < numKeyframes; ii++) {
+		if (keyframes[ii].ms != other.keyframes[ii].ms ||
+			keyframes[ii].level != other.keyframes[ii].level ||
+			keyframes[ii].interpolation != other.keyframes[ii].interpolation) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+LP5562KeyframeCompiler::LP5562KeyframeCompiler() {
+	for(size_t ii = 0; ii < NUM_CHANNELS; ii++) {
+		timelines[ii] = NULL;
+		ledMapping[ii] = LP5562::REG_LED_MAP_DIRECT;
+		directLevel[ii] = 0;
+	}
+	result.success = false;
+	result.error = "not compiled";
+	result.numEngines = 0;
+	result.numInstructions = 0;
+	result.loopPeriodUs = 0;
+	result.maxErrorUs = 0;
+}
+
+LP5562KeyframeCompiler::~LP5562KeyframeCompiler() {
+
+}
+
+const LP5562KeyframeCompiler::Result &LP5562KeyframeCompiler::compile() {
+	result.success = false;
+	result.error = NULL;
+	result.numEngines = 0;
+	result.numInstructions = 0;
+	result.loopPeriodUs = 0;
+	result.maxErrorUs = 0;
+
+	for(size_t ii = 0; ii < 3; ii++) {
+		programs[ii].clear();
+	}
+
+	// Assign an engine to each distinct timeline that's not constant
+	const LP5562Timeline *engineTimelines[3];
+	size_t numEngines = 0;
+
+	for(size_t channel = 0; channel < NUM_CHANNELS; channel++) {
+		const LP5562Timeline *timeline = timelines[channel];
+
+		ledMapping[channel] = LP5562::REG_LED_MAP_DIRECT;
+		directLevel[channel] = 0;
+
+		if (!timeline) {
+			continue;
+		}
+		if (timeline->getNumKeyframes() > 0 && timeline->getKeyframe(timeline->getNumKeyframes() - 1).ms >= loopMs) {
+			result.error = "keyframe is not before the end of the loop";
+			return result;
+		}
+		if (timeline->isConstant()) {
+			directLevel[channel] = timeline->getFirstLevel();
+			continue;
+		}
+
+		size_t engine;
+		for(engine = 0; engine < numEngines; engine++) {
+			if (engineTimelines[engine]->isSameAs(*timeline)) {
+				break;
+			}
+		}
+		if (engine == numEngines) {
+			if (numEngines >= 3) {
+				result.error = "more than 3 different timelines";
+				return result;
+			}
+			engineTimelines[numEngines++] = timeline;
+		}
+		ledMapping[channel] = (uint8_t)(LP5562::REG_LED_MAP_ENGINE_1 + engine);
+	}
+
+	int64_t maxAchievedTicks = 0;
+	int64_t maxErrorTicks = 0;
+
+	for(size_t engine = 0; engine < numEngines; engine++) {
+		// With more than one engine, each loop ends with a trigger so the engines stay in sync. Engine 1
+		// sends and the others wait for it, like setBlink().
+		size_t budget = MAX_PROGRAM_INSTRUCTIONS;
+		if (numEngines > 1) {
+			budget--;
+		}
+
+		int64_t achievedTicks, errorTicks;
+		const char *error = compileTimeline(*engineTimelines[engine], budget, programs[engine], achievedTicks, errorTicks);
+		if (error) {
+			for(size_t ii = 0; ii < 3; ii++) {
+				programs[ii].clear();
+			}
+			result.error = error;
+			return result;
+		}
+
+		if (numEngines > 1) {
+			if (engine == 0) {
+				programs[engine].addCommandTriggerSend((uint8_t)((numEngines == 2) ? LP5562::MASK_ENGINE_2 : (LP5562::MASK_ENGINE_2 | LP5562::MASK_ENGINE_3)));
+			}
+			else {
+				programs[engine].addCommandTriggerWait(LP5562::MASK_ENGINE_1);
+			}
+		}
+
+		if (achievedTicks > maxAchievedTicks) {
+			maxAchievedTicks = achievedTicks;
+		}
+		if (errorTicks > maxErrorTicks) {
+			maxErrorTicks = errorTicks;
+		}
+		result.numInstructions += programs[engine].getStepNum();
+	}
+
+	result.success = true;
+	result.numEngines = numEngines;
+	result.loopPeriodUs = ticksToMicros(maxAchievedTicks);
+	result.maxErrorUs = ticksToMicros(maxErrorTicks);
+
+	return result;
+}
+
+bool LP5562KeyframeCompiler::apply(LP5562 &driver) {
+	if (!result.success) {
+		return false;
+	}
+
+	uint8_t engineMask = (uint8_t)((1 << result.numEngines) - 1);
+
+	driver.beginBatch();
+
+	bool bResult = driver.setEnable(LP5562::MASK_ENGINE_ALL, LP5562::REG_ENABLE_HOLD);
+
+	for(size_t engine = 1; engine <= result.numEngines; engine++) {
+		if (!driver.setProgram(engine, programs[engine - 1], false)) {
+			bResult = false;
+		}
+	}
+
+	if (!driver.setLedMapping(ledMapping[CHANNEL_R], ledMapping[CHANNEL_G], ledMapping[CHANNEL_B], ledMapping[CHANNEL_W])) {
+		bResult = false;
+	}
+	driver.setRGBW(directLevel[CHANNEL_R], directLevel[CHANNEL_G], directLevel[CHANNEL_B], directLevel[CHANNEL_W]);
+
+	if (!driver.startEngines(engineMask)) {
+		bResult = false;
+	}
+
+	if (!driver.commit()) {
+		bResult = false;
+	}
+	return bResult;
+}
+
+const char *LP5562KeyframeCompiler::compileTimeline(const LP5562Timeline &timeline, size_t budget, LP5562Program &program, int64_t &achievedTicks, int64_t &maxErrorTicks) {
+	const size_t numSegments = timeline.getNumKeyframes();
+
+	// Set PWM instructions needed before each segment, and the encodings available for each segment
+	bool needSetPWM[LP5562Timeline::MAX_KEYFRAMES];
+	Candidates cand[LP5562Timeline::MAX_KEYFRAMES];
+	int64_t segmentTicks[LP5562Timeline::MAX_KEYFRAMES];
+
+	size_t fixedInstructions = 0;
+	int currentLevel = -1;
+
+	for(size_t seg = 0; seg < numSegments; seg++) {
+		const LP5562Timeline::Keyframe &kf = timeline.getKeyframe(seg);
+		unsigned long endMs = (seg + 1 < numSegments) ? timeline.getKeyframe(seg + 1).ms : loopMs;
+		uint8_t endLevel = kf.level;
+		if (kf.interpolation == LP5562Timeline::INTERPOLATION_LINEAR) {
+			endLevel = timeline.getKeyframe((seg + 1 < numSegments) ? seg + 1 : 0).level;
+		}
+
+		// The program always starts with a set PWM since the level from the end of the loop may not
+		// match (step interpolation) and the engine doesn't start at a known level
+		needSetPWM[seg] = (currentLevel != kf.level);
+		if (needSetPWM[seg]) {
+			fixedInstructions++;
+		}
+
+		// Times are converted from the start of the loop so rounding doesn't accumulate
+		segmentTicks[seg] = msToTicks(endMs) - msToTicks(kf.ms);
+
+		for(size_t ii = 0; ii <= MAX_SEGMENT_INSTRUCTIONS; ii++) {
+			cand[seg].byCount[ii].valid = false;
+		}
+		if (endLevel == kf.level) {
+			addWaitCandidates(segmentTicks[seg], cand[seg]);
+		}
+		else
+		if (endLevel > kf.level) {
+			addRampCandidates(segmentTicks[seg], (uint8_t)(endLevel - kf.level), false, cand[seg]);
+		}
+		else {
+			addRampCandidates(segmentTicks[seg], (uint8_t)(kf.level - endLevel), true, cand[seg]);
+		}
+		currentLevel = endLevel;
+	}
+
+	if (fixedInstructions > budget) {
+		return "too many keyframes for one engine";
+	}
+	size_t available = budget - fixedInstructions;
+
+	// Choose one encoding per segment to minimize the total timing error using at most available
+	// instructions. best[seg][n] is the smallest total error for segments 0 - seg-1 using n instructions.
+	const int32_t NONE = -1;
+	int32_t best[LP5562Timeline::MAX_KEYFRAMES + 1][MAX_PROGRAM_INSTRUCTIONS + 1];
+	uint8_t choice[LP5562Timeline::MAX_KEYFRAMES + 1][MAX_PROGRAM_INSTRUCTIONS + 1];
+
+	for(size_t n = 0; n <= available; n++) {
+		best[0][n] = (n == 0) ? 0 : NONE;
+	}
+	for(size_t seg = 0; seg < numSegments; seg++) {
+		for(size_t n = 0; n <= available; n++) {
+			best[seg + 1][n] = NONE;
+			for(size_t count = 0; count <= MAX_SEGMENT_INSTRUCTIONS && count <= n; count++) {
+				const Encoding &enc = cand[seg].byCount[count];
+				if (!enc.valid || best[seg][n - count] == NONE) {
+					continue;
+				}
+				int32_t err = best[seg][n - count] + ((enc.errorTicks < 0) ? -enc.errorTicks : enc.errorTicks);
+				if (best[seg + 1][n] == NONE || err < best[seg + 1][n]) {
+					best[seg + 1][n] = err;
+					choice[seg + 1][n] = (uint8_t) count;
+				}
+			}
+		}
+	}
+
+	// Prefer the smallest error, then the fewest instructions
+	int bestCount = -1;
+	for(size_t n = 0; n <= available; n++) {
+		if (best[numSegments][n] != NONE && (bestCount < 0 || best[numSegments][n] < best[numSegments][bestCount])) {
+			bestCount = (int) n;
+		}
+	}
+	if (bestCount < 0) {
+		return "timeline does not fit in 16 instructions";
+	}
+
+	uint8_t counts[LP5562Timeline::MAX_KEYFRAMES];
+	size_t n = (size_t) bestCount;
+	for(size_t seg = numSegments; seg > 0; seg--) {
+		counts[seg - 1] = choice[seg][n];
+		n -= choice[seg][n];
+	}
+
+	// Generate the program and measure the error at each keyframe
+	program.clear();
+	achievedTicks = 0;
+	maxErrorTicks = 0;
+	int64_t requestedTicks = 0;
+
+	for(size_t seg = 0; seg < numSegments; seg++) {
+		if (needSetPWM[seg]) {
+			program.addCommandSetPWM(timeline.getKeyframe(seg).level);
+		}
+
+		const Encoding &enc = cand[seg].byCount[counts[seg]];
+		uint8_t base = program.getStepNum();
+		for(size_t ii = 0; ii < enc.numInstructions; ii++) {
+			uint16_t inst = enc.instructions[ii];
+			if ((inst & 0xe000) == 0xa000) {
+				// Branch step numbers are relative to the start of the segment
+				inst = (uint16_t)((inst & ~0x000f) | ((inst + base) & 0x000f));
+			}
+			program.addCommand(inst);
+		}
+
+		achievedTicks += segmentTicks[seg] + enc.errorTicks;
+		requestedTicks += segmentTicks[seg];
+
+		int64_t err = achievedTicks - requestedTicks;
+		if (err < 0) {
+			err = -err;
+		}
+		if (err > maxErrorTicks) {
+			maxErrorTicks = err;
+		}
+	}
+
+	return NULL;
+}
+
+// static
+void LP5562KeyframeCompiler::addWaitCandidates(int64_t ticks, Candidates &cand) {
+	Encoding enc;
+
+	// No instructions at all
+	enc.valid = true;
+	enc.numInstructions = 0;
+	enc.errorTicks = (int32_t) -ticks;
+	consider(cand, enc);
+
+	// The same solver as LP5562Program::addDelay(), once for each instruction budget
+	for(size_t count = 1; count <= MAX_SEGMENT_INSTRUCTIONS; count++) {
+		LP5562Program::DelaySolution solution;
+		if (!LP5562Program::solveDelay((uint64_t) ticks, count, solution)) {
+			continue;
+		}
+		enc.numInstructions = solution.numInstructions;
+		for(size_t ii = 0; ii < solution.numInstructions; ii++) {
+			enc.instructions[ii] = solution.instructions[ii];
+		}
+		enc.errorTicks = (int32_t) solution.errorTicks;
+		consider(cand, enc);
+	}
+}
+
+// static
+void LP5562KeyframeCompiler::addRampCandidates(int64_t ticks, uint8_t numSteps, bool decrease, Candidates &cand) {
+	Encoding enc;
+
+	// The same solver as LP5562Program::addRamp(), once for each instruction budget
+	enc.valid = true;
+	for(size_t count = 1; count <= MAX_SEGMENT_INSTRUCTIONS; count++) {
+		LP5562Program::DelaySolution solution;
+		if (!LP5562Program::solveRamp((uint64_t) ticks, numSteps, decrease, count, solution)) {
+			continue;
+		}
+		enc.numInstructions = solution.numInstructions;
+		for(size_t ii = 0; ii < solution.numInstructions; ii++) {
+			enc.instructions[ii] = solution.instructions[ii];
+		}
+		enc.errorTicks = (int32_t) solution.errorTicks;
+		consider(cand, enc);
+	}
+}
+
+// static
+void LP5562KeyframeCompiler::consider(Candidates &cand, const Encoding &enc) {
+	Encoding &cur = cand.byCount[enc.numInstructions];
+
+	int32_t newErr = (enc.errorTicks < 0) ? -enc.errorTicks : enc.errorTicks;
+	int32_t curErr = (cur.errorTicks < 0) ? -cur.errorTicks : cur.errorTicks;
+
+	if (!cur.valid || newErr < curErr) {
+		cur = enc;
+		cur.valid = true;
+	}
+}
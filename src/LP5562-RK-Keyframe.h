@@ -0,0 +1,339 @@
+#ifndef __LP5562_RK_KEYFRAME_H
+#define __LP5562_RK_KEYFRAME_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Brightness levels at points in time for one LED channel
+ *
+ * Keyframes are added in time order. Between a keyframe and the next one, the level either ramps
+ * linearly (INTERPOLATION_LINEAR) or stays at the keyframe's level (INTERPOLATION_STEP). The
+ * timeline repeats, so the last keyframe interpolates to the first one at the end of the loop.
+ *
+ * LP5562Timeline red;
+ * red.addKeyframe(0, 0);
+ * red.addKeyframe(1000, 255);
+ * red.addKeyframe(1500, 255, LP5562Timeline::INTERPOLATION_STEP);
+ */
+class LP5562Timeline {
+public:
+	/**
+	 * @brief How the level changes from a keyframe to the next one
+	 */
+	enum Interpolation {
+		INTERPOLATION_LINEAR = 0,	//!< Ramp one PWM step at a time to the next keyframe's level
+		INTERPOLATION_STEP			//!< Hold this keyframe's level until the next keyframe
+	};
+
+	/**
+	 * @brief One point on the timeline
+	 */
+	struct Keyframe {
+		unsigned long ms;			//!< Time from the start of the loop in milliseconds
+		uint8_t level;				//!< PWM level at that time (0 - 255)
+		uint8_t interpolation;		//!< Interpolation to the next keyframe
+	};
+
+	/**
+	 * @brief Construct an empty timeline. An empty timeline leaves the channel off.
+	 */
+	LP5562Timeline();
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562Timeline();
+
+	/**
+	 * @brief Add a keyframe
+	 *
+	 * @param ms Time from the start of the loop in milliseconds. The first keyframe must be at 0 and
+	 * each keyframe must be later than the previous one.
+	 *
+	 * @param level The PWM level (0 = off, 255 = full brightness)
+	 *
+	 * @param interpolation How to get from this keyframe to the next one
+	 *
+	 * @return false if the timeline is full (MAX_KEYFRAMES) or ms is out of order
+	 */
+	bool addKeyframe(unsigned long ms, uint8_t level, Interpolation interpolation = INTERPOLATION_LINEAR);
+
+	/**
+	 * @brief Remove all keyframes
+	 */
+	void clear() { numKeyframes = 0; };
+
+	/**
+	 * @brief Get the number of keyframes
+	 */
+	size_t getNumKeyframes() const { return numKeyframes; };
+
+	/**
+	 * @brief Get a keyframe (0 <= index < getNumKeyframes())
+	 */
+	const Keyframe &getKeyframe(size_t index) const { return keyframes[index]; };
+
+	/**
+	 * @brief Returns true if every keyframe has the same level (or there are none)
+	 *
+	 * A constant timeline doesn't need a program engine; the channel is set directly.
+	 */
+	bool isConstant() const;
+
+	/**
+	 * @brief Returns the level of a constant timeline, or the first keyframe otherwise. 0 if empty.
+	 */
+	uint8_t getFirstLevel() const { return (numKeyframes > 0) ? keyframes[0].level : 0; };
+
+	/**
+	 * @brief Returns true if both timelines have the same keyframes
+	 */
+	bool isSameAs(const LP5562Timeline &other) const;
+
+	/**
+	 * @brief Maximum number of keyframes. Each engine only has 16 instructions so more wouldn't fit.
+	 */
+	static const size_t MAX_KEYFRAMES = 16;
+
+protected:
+	/**
+	 * @brief The keyframes in time order
+	 */
+	Keyframe keyframes[MAX_KEYFRAMES];
+
+	/**
+	 * @brief Number of valid entries in keyframes
+	 */
+	size_t numKeyframes = 0;
+};
+
+/**
+ * @brief Converts keyframe timelines for the R, G, B, and W channels into engine programs
+ *
+ * Channels with identical timelines share an engine, and channels with a constant level are driven
+ * directly and don't use an engine at all. When more than one engine is used, engine 1 sends a
+ * trigger at the end of each loop and the others wait for it, so the engines stay in sync.
+ *
+ * For each segment between keyframes, the compiler picks the prescale, step time, number of steps,
+ * and loops that come closest to the requested time within the 16 instruction limit. A linear
+ * ramp moves one PWM level per step, so a ramp is split into two step times when that's closer than
+ * a single step time.
+ *
+ * LP5562KeyframeCompiler compiler;
+ * compiler.withLoopMs(2000).withTimeline(LP5562KeyframeCompiler::CHANNEL_R, red);
+ * if (compiler.compile().success) {
+ *     compiler.apply(ledDriver);
+ * }
+ */
+class LP5562KeyframeCompiler {
+public:
+	/**
+	 * @brief Outcome of compile()
+	 */
+	struct Result {
+		bool success;				//!< true if all timelines fit
+		const char *error;			//!< Reason for failure, or NULL on success
+		size_t numEngines;			//!< Number of engines used (0 - 3)
+		size_t numInstructions;		//!< Total instructions in all engines
+		uint32_t loopPeriodUs;		//!< Achieved loop period in microseconds (the slowest engine)
+		uint32_t maxErrorUs;		//!< Largest difference between a requested and an achieved keyframe time in microseconds
+	};
+
+	/**
+	 * @brief Construct a compiler with no timelines
+	 */
+	LP5562KeyframeCompiler();
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562KeyframeCompiler();
+
+	/**
+	 * @brief Set the length of the loop in milliseconds. All timelines repeat at this interval.
+	 *
+	 * Every keyframe must be earlier than this. Must be set before compile().
+	 */
+	LP5562KeyframeCompiler &withLoopMs(unsigned long ms) { loopMs = ms; return *this; };
+
+	/**
+	 * @brief Set the timeline for a channel
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+	 *
+	 * @param timeline The timeline. It's not copied so it must remain valid until compile() returns.
+	 * Channels without a timeline are turned off.
+	 */
+	LP5562KeyframeCompiler &withTimeline(size_t channel, const LP5562Timeline &timeline) { if (channel < NUM_CHANNELS) { timelines[channel] = &timeline; } return *this; };
+
+	/**
+	 * @brief Convert the timelines into programs
+	 *
+	 * @return The result, which is also available from getResult(). On failure, no programs are valid.
+	 *
+	 * This uses about 3 Kbytes of stack.
+	 */
+	const Result &compile();
+
+	/**
+	 * @brief Get the result of the last compile()
+	 */
+	const Result &getResult() const { return result; };
+
+	/**
+	 * @brief Get the program for an engine (1 - 3). Only engines up to getResult().numEngines are used.
+	 */
+	const LP5562Program &getProgram(size_t engine) const { return programs[(engine >= 1 && engine <= 3) ? engine - 1 : 0]; };
+
+	/**
+	 * @brief Get how a channel is driven after compile()
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+	 *
+	 * @return LP5562::REG_LED_MAP_DIRECT, REG_LED_MAP_ENGINE_1, REG_LED_MAP_ENGINE_2, or REG_LED_MAP_ENGINE_3
+	 */
+	uint8_t getLedMapping(size_t channel) const { return (channel < NUM_CHANNELS) ? ledMapping[channel] : LP5562::REG_LED_MAP_DIRECT; };
+
+	/**
+	 * @brief Get the PWM level of a directly driven channel after compile()
+	 */
+	uint8_t getDirectLevel(size_t channel) const { return (channel < NUM_CHANNELS) ? directLevel[channel] : 0; };
+
+	/**
+	 * @brief Load the compiled programs and start them
+	 *
+	 * @param driver The LP5562 to program
+	 *
+	 * @return true on success, false if compile() failed or there was an I2C error
+	 *
+	 * Like setBlink(), this stops all engines, loads the programs, sets the LED mapping and the direct
+	 * levels, and starts the engines together.
+	 */
+	bool apply(LP5562 &driver);
+
+	static const size_t NUM_CHANNELS = 4;	//!< Number of LED channels
+	static const size_t CHANNEL_R = 0;		//!< Red channel index for withTimeline()
+	static const size_t CHANNEL_G = 1;		//!< Green channel index for withTimeline()
+	static const size_t CHANNEL_B = 2;		//!< Blue channel index for withTimeline()
+	static const size_t CHANNEL_W = 3;		//!< White channel index for withTimeline()
+
+	/**
+	 * @brief Engine clock ticks per second. The engine timing is based on a 32.768 kHz clock.
+	 */
+	static const uint32_t TICKS_PER_SECOND = 32768;
+
+protected:
+	/**
+	 * @brief Number of instructions in each engine
+	 */
+	static const size_t MAX_PROGRAM_INSTRUCTIONS = 16;
+
+	/**
+	 * @brief Maximum number of instructions one segment can be encoded as
+	 */
+	static const size_t MAX_SEGMENT_INSTRUCTIONS = 4;
+
+	/**
+	 * @brief One way of encoding a segment
+	 *
+	 * Branch instructions have a step number relative to the first instruction of the segment.
+	 */
+	struct Encoding {
+		bool valid;									//!< true if this encoding is possible
+		uint8_t numInstructions;					//!< Number of entries in instructions
+		uint16_t instructions[MAX_SEGMENT_INSTRUCTIONS]; //!< Instruction words
+		int32_t errorTicks;							//!< Achieved minus requested time in ticks
+	};
+
+	/**
+	 * @brief The best encoding of a segment for each possible number of instructions
+	 */
+	struct Candidates {
+		Encoding byCount[MAX_SEGMENT_INSTRUCTIONS + 1];	//!< Index is the number of instructions
+	};
+
+	/**
+	 * @brief Compile one timeline into a program
+	 *
+	 * @param timeline The timeline to compile
+	 *
+	 * @param budget Number of instructions available for the timeline
+	 *
+	 * @param program Filled in with the program
+	 *
+	 * @param achievedTicks Filled in with the achieved loop length in ticks
+	 *
+	 * @param maxErrorTicks Filled in with the largest keyframe time error in ticks
+	 *
+	 * @return NULL on success or an error message
+	 */
+	const char *compileTimeline(const LP5562Timeline &timeline, size_t budget, LP5562Program &program, int64_t &achievedTicks, int64_t &maxErrorTicks);
+
+	/**
+	 * @brief Find the best encodings of a wait
+	 *
+	 * @param ticks Requested time in ticks
+	 */
+	static void addWaitCandidates(int64_t ticks, Candidates &cand);
+
+	/**
+	 * @brief Find the best encodings of a linear ramp
+	 *
+	 * @param ticks Requested time in ticks
+	 *
+	 * @param numSteps Number of PWM levels to ramp (1 - 255)
+	 *
+	 * @param decrease true to ramp down
+	 */
+	static void addRampCandidates(int64_t ticks, uint8_t numSteps, bool decrease, Candidates &cand);
+
+	/**
+	 * @brief Keep enc if it's better than the current candidate with the same number of instructions
+	 */
+	static void consider(Candidates &cand, const Encoding &enc);
+
+	/**
+	 * @brief Converts a time in milliseconds to engine clock ticks, rounded to the nearest tick
+	 */
+	static int64_t msToTicks(unsigned long ms) { return ((int64_t)ms * TICKS_PER_SECOND + 500) / 1000; };
+
+	/**
+	 * @brief Converts engine clock ticks to microseconds
+	 */
+	static uint32_t ticksToMicros(int64_t ticks) { return (uint32_t)((ticks * 1000000 + TICKS_PER_SECOND / 2) / TICKS_PER_SECOND); };
+
+	/**
+	 * @brief Length of the loop in milliseconds
+	 */
+	unsigned long loopMs = 0;
+
+	/**
+	 * @brief Timeline for each channel, or NULL if not set
+	 */
+	const LP5562Timeline *timelines[NUM_CHANNELS];
+
+	/**
+	 * @brief Compiled program for each engine
+	 */
+	LP5562Program programs[3];
+
+	/**
+	 * @brief LED_MAP value for each channel
+	 */
+	uint8_t ledMapping[NUM_CHANNELS];
+
+	/**
+	 * @brief PWM level for channels that are driven directly
+	 */
+	uint8_t directLevel[NUM_CHANNELS];
+
+	/**
+	 * @brief Result of the last compile()
+	 */
+	Result result;
+};
+
+#endif /* __LP5562_RK_KEYFRAME_H */
@@ -0,0 +1,96 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Mock.h"
+
+LP5562MockTransport::LP5562MockTransport(uint8_t addr) : addr(addr) {
+	for(size_t ii = 0; ii < sizeof(registers); ii++) {
+		registers[ii] = 0;
+	}
+}
+
+LP5562MockTransport::~LP5562MockTransport() {
+
+}
+
+bool LP5562MockTransport::writeRegisters(uint8_t addr, uint8_t reg, const uint8_t *values, size_t numValues) {
+	bool success = (addr == this->addr);
+	if (failCount > 0) {
+		failCount--;
+		success = false;
+	}
+
+	if (success) {
+		// The register address auto-increments after each byte
+		for(size_t ii = 0; ii < numValues; ii++) {
+			onWriteRegister((uint8_t)(reg + ii), values[ii]);
+		}
+	}
+
+	addTransaction(addr, reg, false, success, values, numValues);
+
+	return success;
+}
+
+bool LP5562MockTransport::readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues) {
+	bool success = (addr == this->addr);
+	if (failCount > 0) {
+		failCount--;
+		success = false;
+	}
+
+	for(size_t ii = 0; ii < numValues; ii++) {
+		values[ii] = success ? onReadRegister((uint8_t)(reg + ii)) : 0xff;
+	}
+
+	addTransaction(addr, reg, true, success, values, numValues);
+
+	return success;
+}
+
+void LP5562MockTransport::addTransaction(uint8_t addr, uint8_t reg, bool isRead, bool success, const uint8_t *values, size_t numValues) {
+	Transaction t;
+
+	t.addr = addr;
+	t.reg = reg;
+	t.isRead = isRead;
+	t.success = success;
+
+	if (numValues > sizeof(t.values)) {
+		numValues = sizeof(t.values);
+	}
+	t.numValues = (uint8_t) numValues;
+	for(size_t ii = 0; ii < numValues; ii++) {
+		t.values[ii] = values[ii];
+	}
+
+	transactions.push_back(t);
+}
+
+LP5562MockTransport::BusCost LP5562MockTransport::getBusCost(size_t startIndex) const {
+	BusCost cost;
+
+	cost.transactions = cost.bytes = cost.bits = cost.failures = 0;
+
+	for(size_t ii = startIndex; ii < transactions.size(); ii++) {
+		const Transaction &t = transactions[ii];
+
+		cost.transactions++;
+		cost.bytes += getTransactionBytes(t);
+		cost.bits += getTransactionBits(t);
+		if (!t.success) {
+			cost.failures++;
+		}
+	}
+	return cost;
+}
+
+size_t LP5562MockTransport::getTransactionBits(const Transaction &t) {
+	// Start (1) + stop (1) + 9 bits per byte
+	size_t bits = 2 + getTransactionBytes(t) * 9;
+	if (t.isRead) {
+		// Repeated start
+		bits++;
+	}
+	return bits;
+}
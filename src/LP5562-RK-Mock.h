@@ -0,0 +1,169 @@
+#ifndef __LP5562_RK_MOCK_H
+#define __LP5562_RK_MOCK_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+#include <vector>
+
+/**
+ * @brief Fake I2C bus with a single LP5562-like register file that records every transaction
+ *
+ * This is used to run the library without hardware, either on a computer (host build) or on a
+ * device. Pass it to the LP5562 constructor instead of Wire:
+ *
+ * LP5562MockTransport mock;
+ * LP5562 ledDriver(0x30, mock);
+ *
+ * Registers are plain memory; writing one doesn't have any side effects like a real chip would.
+ * Use LP5562Simulator if you need the chip behavior.
+ */
+class LP5562MockTransport : public LP5562Transport {
+public:
+	/**
+	 * @brief One recorded I2C transaction
+	 */
+	struct Transaction {
+		uint8_t addr;				//!< I2C address (0x00 - 0x7f)
+		uint8_t reg;				//!< First register address
+		bool isRead;				//!< true for a read, false for a write
+		bool success;				//!< false if the transaction was NACKed
+		uint8_t numValues;			//!< Number of data bytes (not including the register address)
+		uint8_t values[32];			//!< Data bytes written or read
+	};
+
+	/**
+	 * @brief Construct the mock transport
+	 *
+	 * @param addr The I2C address the fake chip responds to (default: 0x30). Transactions to other
+	 * addresses fail as if NACKed.
+	 */
+	LP5562MockTransport(uint8_t addr = 0x30);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562MockTransport();
+
+	/**
+	 * @brief Records the write and stores the values in the register file
+	 */
+	virtual bool writeRegisters(uint8_t addr, uint8_t reg, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Records the read and returns the values from the register file
+	 */
+	virtual bool readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Get the number of transactions recorded since construction or the last clearTransactions()
+	 */
+	size_t getNumTransactions() const { return transactions.size(); };
+
+	/**
+	 * @brief Get a recorded transaction
+	 *
+	 * @param index 0 <= index < getNumTransactions()
+	 */
+	const Transaction &getTransaction(size_t index) const { return transactions[index]; };
+
+	/**
+	 * @brief Forget all recorded transactions
+	 */
+	void clearTransactions() { transactions.clear(); };
+
+	/**
+	 * @brief Totals for a range of recorded transactions
+	 */
+	struct BusCost {
+		size_t transactions;		//!< Number of I2C transactions
+		size_t bytes;				//!< Bytes on the wire, including the I2C address and register address bytes
+		size_t bits;				//!< Bit times on the wire, including start, stop, repeated start, and ACK bits
+		size_t failures;			//!< Number of transactions that failed (NACK)
+
+		/**
+		 * @brief Estimated time on the bus in microseconds
+		 *
+		 * @param clockHz I2C clock speed, typically 100000 or 400000
+		 */
+		uint32_t getMicros(uint32_t clockHz) const { return (uint32_t)(((uint64_t)bits * 1000000 + clockHz - 1) / clockHz); };
+	};
+
+	/**
+	 * @brief Get the bus cost of the recorded transactions
+	 *
+	 * @param startIndex First transaction to include. Pass the value of getNumTransactions() before
+	 * making a call to get the cost of that call.
+	 */
+	BusCost getBusCost(size_t startIndex = 0) const;
+
+	/**
+	 * @brief Get the number of bit times a transaction takes on the wire
+	 *
+	 * A write is start, address, register, data, stop. A read is start, address, register, repeated
+	 * start, address, data, stop. Each byte is 9 bits including the ACK.
+	 */
+	static size_t getTransactionBits(const Transaction &t);
+
+	/**
+	 * @brief Get the number of bytes a transaction puts on the wire, including address bytes
+	 */
+	static size_t getTransactionBytes(const Transaction &t) { return t.numValues + (t.isRead ? 3 : 2); };
+
+	/**
+	 * @brief Returns the value in the register file without recording a transaction
+	 */
+	uint8_t getRegister(uint8_t reg) const { return registers[reg]; };
+
+	/**
+	 * @brief Sets the value in the register file without recording a transaction
+	 */
+	void setRegister(uint8_t reg, uint8_t value) { registers[reg] = value; };
+
+	/**
+	 * @brief Make the next transactions fail as if the chip NACKed them
+	 *
+	 * @param count Number of transactions to fail
+	 */
+	void failNextTransactions(size_t count) { failCount = count; };
+
+protected:
+	/**
+	 * @brief Called for each byte written to the chip. Override to add side effects.
+	 */
+	virtual void onWriteRegister(uint8_t reg, uint8_t value) { registers[reg] = value; };
+
+	/**
+	 * @brief Called for each byte read from the chip. Override to add side effects.
+	 */
+	virtual uint8_t onReadRegister(uint8_t reg) { return registers[reg]; };
+
+	/**
+	 * @brief Records a transaction
+	 */
+	void addTransaction(uint8_t addr, uint8_t reg, bool isRead, bool success, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief I2C address this fake chip responds to
+	 */
+	uint8_t addr;
+
+	/**
+	 * @brief Register file. The register address is 8 bits so all addresses are valid.
+	 */
+	uint8_t registers[256];
+
+	/**
+	 * @brief Number of upcoming transactions to fail
+	 */
+	size_t failCount = 0;
+
+	/**
+	 * @brief Transactions recorded so far
+	 */
+	std::vector<Transaction> transactions;
+};
+
+#endif /* __LP5562_RK_MOCK_H */
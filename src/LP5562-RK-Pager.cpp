@@ -0,0 +1,371 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Pager.h"
+#include "LP5562-RK-Timing.h"
+
+// Start reading the status register this long before the end of a page is expected, in addition
+// to the clock tolerance
+static const uint32_t POLL_MARGIN_MICROS = 2000;
+
+LP5562Pager::LP5562Pager(LP5562 &driver, size_t engine) : driver(driver), engine(engine) {
+	clear();
+	resetStats();
+}
+
+LP5562Pager::~LP5562Pager() {
+
+}
+
+LP5562Pager &LP5562Pager::clear() {
+	if (running) {
+		(void) stop();
+	}
+	numInstructions = 0;
+	for(size_t ii = 0; ii < sizeof(segmentStarts); ii++) {
+		segmentStarts[ii] = 0;
+	}
+	segmentError = false;
+	numPages = 0;
+	currentPage = 0;
+	return *this;
+}
+
+LP5562Pager &LP5562Pager::addSegment(const uint16_t *instructions, size_t numInstructions) {
+	if (this->numInstructions + numInstructions > MAX_INSTRUCTIONS || !isValidSegment(instructions, numInstructions)) {
+		segmentError = true;
+		return *this;
+	}
+
+	size_t first = this->numInstructions;
+	for(size_t ii = 0; ii < numInstructions; ii++) {
+		this->instructions[first + ii] = instructions[ii];
+	}
+	segmentStarts[first / 8] |= (uint8_t)(1 << (first % 8));
+	this->numInstructions += numInstructions;
+
+	return *this;
+}
+
+bool LP5562Pager::start() {
+	if (engine < 1 || engine > 3 || numInstructions == 0 || segmentError || !paginate()) {
+		return false;
+	}
+
+	// Find how long each page takes. Pages are analyzed alone, so a page with triggers is not known.
+	LP5562TimingAnalyzer analyzer;
+	for(size_t page = 0; page < numPages; page++) {
+		uint16_t words[16];
+		size_t count = getPage(page, words);
+
+		analyzer.clearPrograms();
+		analyzer.withProgram(1, words, count);
+
+		const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+		const LP5562TimingAnalyzer::EngineTiming &timing = result.engines[0];
+		if (result.success && timing.behavior == LP5562TimingAnalyzer::BEHAVIOR_ENDS) {
+			pageMicros[page] = (uint32_t) LP5562SimEngines::ticksToMicros(timing.endTicks);
+		}
+		else {
+			pageMicros[page] = 0;
+		}
+	}
+
+	// Stop the engine and start from step 0 even if the first page is already loaded
+	uint8_t engineMask = driver.engineNumToMask(engine);
+	if (!driver.setEnable(engineMask, LP5562::REG_ENABLE_HOLD) || !driver.resetProgramCounters(engineMask)) {
+		return false;
+	}
+
+	// Clear any interrupt left over from before. This clears the interrupts of the other engines too.
+	(void) driver.getStatus();
+	interruptFlag = false;
+
+	for(size_t ii = 0; ii < 16; ii++) {
+		loaded[ii] = 0;
+	}
+	if (!loadPage(0)) {
+		return false;
+	}
+
+	running = true;
+	return true;
+}
+
+bool LP5562Pager::stop() {
+	running = false;
+	loadPending = false;
+
+	if (engine < 1 || engine > 3) {
+		return false;
+	}
+	return driver.setEnable(driver.engineNumToMask(engine), LP5562::REG_ENABLE_HOLD);
+}
+
+void LP5562Pager::loop() {
+	if (!running) {
+		return;
+	}
+
+	if (loadPending) {
+		// Loading the next page failed, try again
+		(void) loadNextPage();
+		return;
+	}
+
+	if (useInterruptPin) {
+		if (!interruptFlag) {
+			return;
+		}
+		interruptFlag = false;
+	}
+	else
+	if ((unsigned long)(micros() - pageStartMicros) < getPollDelayMicros()) {
+		return;
+	}
+
+	stats.statusReads++;
+	(void) handleStatus(driver.getStatus());
+}
+
+bool LP5562Pager::handleStatus(uint8_t status) {
+	if (!running || loadPending) {
+		return true;
+	}
+
+	if ((status & getStatusBit()) == 0) {
+		// Not done yet. The End instruction will be after this.
+		lastPollMicros = micros();
+		return true;
+	}
+
+	pageEndMicros = useInterruptPin ? interruptMicros : lastPollMicros;
+	loadPending = true;
+
+	return loadNextPage();
+}
+
+// static
+bool LP5562Pager::isValidSegment(const uint16_t *instructions, size_t numInstructions) {
+	if (numInstructions == 0 || numInstructions > MAX_PAGE_INSTRUCTIONS) {
+		return false;
+	}
+
+	for(size_t ii = 0; ii < numInstructions; ii++) {
+		uint16_t inst = instructions[ii];
+
+		if ((inst & 0xc000) == 0 && (inst & 0x3f00) == 0) {
+			// Go to start
+			return false;
+		}
+		switch(inst & 0xe000) {
+		case 0xa000:
+			if ((size_t)(inst & 0xf) >= numInstructions) {
+				// Branch outside of the segment
+				return false;
+			}
+			break;
+
+		case 0xc000:
+			// End
+			return false;
+
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+void LP5562Pager::interruptHandler() {
+	interruptMicros = micros();
+	interruptFlag = true;
+}
+
+size_t LP5562Pager::getPage(size_t page, uint16_t *instructions) const {
+	if (page >= numPages) {
+		return 0;
+	}
+
+	size_t count = pageCount[page];
+	size_t segmentOffset = 0;
+	for(size_t ii = 0; ii < count; ii++) {
+		size_t index = pageFirst[page] + ii;
+		uint16_t inst = this->instructions[index];
+
+		if (segmentStarts[index / 8] & (1 << (index % 8))) {
+			segmentOffset = ii;
+		}
+		if ((inst & 0xe000) == 0xa000) {
+			// Branch step numbers are relative to the segment
+			inst = (uint16_t)((inst & 0xfff0) | (((inst & 0xf) + segmentOffset) & 0xf));
+		}
+		instructions[ii] = inst;
+	}
+
+	// Hold the current level and generate an interrupt
+	instructions[count++] = LP5562Opcode::end(true, false);
+
+	return count;
+}
+
+void LP5562Pager::resetStats() {
+	stats.pagesLoaded = 0;
+	stats.repeats = 0;
+	stats.statusReads = 0;
+	stats.wordsWritten = 0;
+	stats.errors = 0;
+	stats.numGaps = 0;
+	stats.lastGapMicros = 0;
+	stats.minGapMicros = 0;
+	stats.maxGapMicros = 0;
+	stats.totalGapMicros = 0;
+	stats.maxLoadMicros = 0;
+}
+
+bool LP5562Pager::paginate() {
+	numPages = 0;
+
+	size_t index = 0;
+	while(index < numInstructions) {
+		if (numPages >= MAX_PAGES) {
+			return false;
+		}
+
+		// Add whole segments until the next one doesn't fit
+		size_t count = 0;
+		while(index + count < numInstructions) {
+			size_t segmentLen = 1;
+			while(index + count + segmentLen < numInstructions) {
+				size_t next = index + count + segmentLen;
+				if (segmentStarts[next / 8] & (1 << (next % 8))) {
+					break;
+				}
+				segmentLen++;
+			}
+			if (count + segmentLen > MAX_PAGE_INSTRUCTIONS) {
+				break;
+			}
+			count += segmentLen;
+		}
+
+		pageFirst[numPages] = (uint8_t) index;
+		pageCount[numPages] = (uint8_t) count;
+		numPages++;
+
+		index += count;
+	}
+	return true;
+}
+
+bool LP5562Pager::loadPage(size_t page) {
+	uint16_t words[16];
+	size_t count = getPage(page, words);
+	if (count == 0) {
+		return false;
+	}
+
+	// setProgram only writes the words that changed. Count them here for the stats.
+	uint32_t changed = 0;
+	for(size_t ii = 0; ii < 16; ii++) {
+		uint16_t inst = (ii < count) ? words[ii] : 0;
+		if (inst != loaded[ii]) {
+			changed++;
+		}
+	}
+
+	// The batch combines the enable and operation mode changes before and after loading into one write each
+	driver.beginBatch();
+	bool bResult = driver.setProgram(engine, words, count, true);
+	if (!driver.commit()) {
+		bResult = false;
+	}
+
+	if (!bResult) {
+		// The program memory is not known, so count every word next time
+		for(size_t ii = 0; ii < 16; ii++) {
+			loaded[ii] = 0xffff;
+		}
+		return false;
+	}
+
+	for(size_t ii = 0; ii < 16; ii++) {
+		loaded[ii] = (ii < count) ? words[ii] : 0;
+	}
+
+	pageStartMicros = lastPollMicros = micros();
+	currentPage = page;
+
+	stats.pagesLoaded++;
+	stats.wordsWritten += changed;
+
+	return true;
+}
+
+bool LP5562Pager::loadNextPage() {
+	size_t next = currentPage + 1;
+	if (next >= numPages) {
+		if (!repeat) {
+			running = false;
+			loadPending = false;
+			return true;
+		}
+		next = 0;
+	}
+
+	unsigned long loadStart = micros();
+	if (!loadPage(next)) {
+		stats.errors++;
+		return false;
+	}
+	loadPending = false;
+
+	if (next == 0) {
+		stats.repeats++;
+	}
+
+	uint32_t loadMicros = (uint32_t)(pageStartMicros - loadStart);
+	if (loadMicros > stats.maxLoadMicros) {
+		stats.maxLoadMicros = loadMicros;
+	}
+
+	uint32_t gap = (uint32_t)(pageStartMicros - pageEndMicros);
+	stats.lastGapMicros = gap;
+	if (stats.numGaps == 0 || gap < stats.minGapMicros) {
+		stats.minGapMicros = gap;
+	}
+	if (gap > stats.maxGapMicros) {
+		stats.maxGapMicros = gap;
+	}
+	stats.totalGapMicros += gap;
+	stats.numGaps++;
+
+	return true;
+}
+
+uint32_t LP5562Pager::getPollDelayMicros() const {
+	uint32_t pageLen = pageMicros[currentPage];
+	if (pageLen == 0) {
+		// Length not known, read the status every time
+		return 0;
+	}
+
+	// The engine clock can be fast, so start early by the clock tolerance
+	uint32_t ppm = LP5562TimingAnalyzer::getDefaultTolerancePpm(driver.getUseExternalOscillator());
+	uint32_t early = (uint32_t)(((uint64_t)pageLen * ppm) / 1000000) + POLL_MARGIN_MICROS;
+
+	return (pageLen > early) ? pageLen - early : 0;
+}
+
+uint8_t LP5562Pager::getStatusBit() const {
+	switch(engine) {
+	case 1:
+		return LP5562::REG_STATUS_ENG1_INT;
+	case 2:
+		return LP5562::REG_STATUS_ENG2_INT;
+	case 3:
+		return LP5562::REG_STATUS_ENG3_INT;
+	default:
+		return 0;
+	}
+}
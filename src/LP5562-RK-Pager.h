@@ -0,0 +1,375 @@
+#ifndef __LP5562_RK_PAGER_H
+#define __LP5562_RK_PAGER_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Runs a program longer than 16 instructions on one engine by loading it a page at a time
+ *
+ * The program is built from segments. A segment is up to 15 instructions that must be loaded
+ * together, like a loop, with branch step numbers relative to the first instruction of the segment.
+ * An LP5562Program is a segment, so anything built with addDelay() or addRamp() can be used as is.
+ * Segments are packed in order into pages of up to 15 instructions, and each page ends with an
+ * End instruction that generates an interrupt:
+ *
+ * LP5562Pager pager(ledDriver, 1);
+ * pager.addSegment(fadeIn).addSegment(hold).addSegment(fadeOut);
+ * pager.start();
+ *
+ * void loop() {
+ *     pager.loop();
+ * }
+ *
+ * When the engine interrupt is set in REG_STATUS, loop() loads the next page and starts the engine
+ * again. Only the instruction words that differ from the previous page are written, with the engine
+ * mode changes combined into two burst writes. The time each page takes is calculated with
+ * LP5562TimingAnalyzer, so loop() doesn't read the status register until a page is almost done.
+ *
+ * If the INT pin of the LP5562 is connected, call interruptHandler() from its falling edge interrupt
+ * and use withUseInterruptPin(). Then loop() only reads the status register after an interrupt, and the
+ * time from the end of a page to the start of the next one is measured from the interrupt.
+ *
+ * Pages end with an End instruction that leaves the PWM unchanged, so while the next page is loaded
+ * the LED holds its level. The gap shows up as a slightly longer step, not a flash. getStats()
+ * reports how long the gaps are.
+ *
+ * Reading REG_STATUS clears the interrupt bits of all engines. If more than one engine generates
+ * interrupts, read the status once and pass it to handleStatus() of each pager instead of calling loop().
+ */
+class LP5562Pager {
+public:
+	/**
+	 * @brief Counters and page gap measurements
+	 *
+	 * The gap is the time from the End instruction of a page to the start of the next page. With the INT pin
+	 * it's measured from the interrupt. Without it, the End is only known to be after the last status read
+	 * that didn't have the interrupt set, so the gap is measured from there and can be larger than the actual
+	 * gap by up to the time between calls to loop().
+	 */
+	struct Stats {
+		uint32_t pagesLoaded;		//!< Pages started, including the first one
+		uint32_t repeats;			//!< Times the program went back to the first page
+		uint32_t statusReads;		//!< Reads of REG_STATUS by loop()
+		uint32_t wordsWritten;		//!< Instruction words that differed from the previous page
+		uint32_t errors;			//!< Pages that could not be loaded
+		uint32_t numGaps;			//!< Number of gaps measured
+		uint32_t lastGapMicros;		//!< Most recent gap in microseconds
+		uint32_t minGapMicros;		//!< Shortest gap in microseconds
+		uint32_t maxGapMicros;		//!< Longest gap in microseconds
+		uint64_t totalGapMicros;	//!< Sum of all gaps in microseconds, for the average
+		uint32_t maxLoadMicros;		//!< Longest time to load and start a page in microseconds
+	};
+
+	/**
+	 * @brief Construct a pager with no segments
+	 *
+	 * @param driver The LP5562 to load the pages into
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	LP5562Pager(LP5562 &driver, size_t engine);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562Pager();
+
+	/**
+	 * @brief Remove all segments. Stops the pager if running.
+	 */
+	LP5562Pager &clear();
+
+	/**
+	 * @brief Add a segment to the end of the program
+	 *
+	 * @param instructions The instruction words. They're copied.
+	 *
+	 * @param numInstructions Number of instructions (1 - 15)
+	 *
+	 * Branch step numbers are relative to the first instruction of the segment and must be within it. Go to
+	 * start and End instructions are not allowed since they would end the page early. If the segment is
+	 * not valid or doesn't fit in MAX_INSTRUCTIONS, it's not added and hasError() returns true.
+	 */
+	LP5562Pager &addSegment(const uint16_t *instructions, size_t numInstructions);
+
+	/**
+	 * @brief Add a segment to the end of the program
+	 *
+	 * @param program The program (1 - 15 instructions). It's copied.
+	 */
+	LP5562Pager &addSegment(const LP5562Program &program) { return addSegment(program.getInstructions(), program.getStepNum()); };
+
+	/**
+	 * @brief Returns true if an addSegment() call failed since construction or clear()
+	 */
+	bool hasError() const { return segmentError; };
+
+	/**
+	 * @brief Go back to the first page after the last one. Default is true.
+	 *
+	 * If false, the engine stays in hold after the last page and isRunning() becomes false.
+	 */
+	LP5562Pager &withRepeat(bool value = true) { repeat = value; return *this; };
+
+	/**
+	 * @brief Only read the status register after interruptHandler() is called. Default is false.
+	 */
+	LP5562Pager &withUseInterruptPin(bool value = true) { useInterruptPin = value; return *this; };
+
+	/**
+	 * @brief Split the segments into pages, load the first page, and start the engine
+	 *
+	 * @return false if there are no segments, an addSegment() call failed, there are more than MAX_PAGES
+	 * pages, or there was an I2C error
+	 *
+	 * Each page is run through LP5562TimingAnalyzer to find its length, which takes a few milliseconds
+	 * for long pages.
+	 */
+	bool start();
+
+	/**
+	 * @brief Stop paging and put the engine in hold
+	 */
+	bool stop();
+
+	/**
+	 * @brief Returns true between start() and stop() (or the end of the last page with withRepeat(false))
+	 */
+	bool isRunning() const { return running; };
+
+	/**
+	 * @brief Call this from loop() as often as possible
+	 *
+	 * Reads the status register when the current page is expected to be done (or after an interrupt with
+	 * withUseInterruptPin()) and loads the next page if it is.
+	 */
+	void loop();
+
+	/**
+	 * @brief Handle a value read from REG_STATUS
+	 *
+	 * @param status The status register value from LP5562::getStatus()
+	 *
+	 * @return false if a page needed to be loaded and it failed
+	 *
+	 * Use this instead of loop() when something else reads the status register.
+	 */
+	bool handleStatus(uint8_t status);
+
+	/**
+	 * @brief Check that instructions can be used as a segment
+	 *
+	 * @param instructions The instruction words
+	 *
+	 * @param numInstructions Number of instructions
+	 *
+	 * @return true if there are 1 - 15 instructions, every branch is to a step within the segment (counting
+	 * from 0 at its first instruction), and there are no go to start or End instructions
+	 */
+	static bool isValidSegment(const uint16_t *instructions, size_t numInstructions);
+
+	/**
+	 * @brief Call from the falling edge interrupt of the INT pin. Only sets a flag; safe to call from an ISR.
+	 */
+	void interruptHandler();
+
+	/**
+	 * @brief Get the number of pages. Only valid after start().
+	 */
+	size_t getNumPages() const { return numPages; };
+
+	/**
+	 * @brief Get the page that's running (0 - getNumPages() - 1)
+	 */
+	size_t getCurrentPage() const { return currentPage; };
+
+	/**
+	 * @brief Get the instructions of a page, including the End instruction, with branches relocated
+	 *
+	 * @param page The page number (0 - getNumPages() - 1)
+	 *
+	 * @param instructions Filled in with up to 16 instruction words
+	 *
+	 * @return The number of instructions, or 0 if page is out of range
+	 */
+	size_t getPage(size_t page, uint16_t *instructions) const;
+
+	/**
+	 * @brief Get the time a page takes to run in microseconds, or 0 if it's not known
+	 *
+	 * Pages with trigger instructions depend on the other engines, so their length is not known.
+	 */
+	uint32_t getPageMicros(size_t page) const { return (page < numPages) ? pageMicros[page] : 0; };
+
+	/**
+	 * @brief Get the counters and gap measurements
+	 */
+	const Stats &getStats() const { return stats; };
+
+	/**
+	 * @brief Clear the counters and gap measurements
+	 */
+	void resetStats();
+
+	/**
+	 * @brief Maximum number of instructions in all segments together
+	 */
+	static const size_t MAX_INSTRUCTIONS = 128;
+
+	/**
+	 * @brief Maximum number of pages
+	 */
+	static const size_t MAX_PAGES = 32;
+
+	/**
+	 * @brief Maximum number of instructions in a page, not including the End instruction
+	 */
+	static const size_t MAX_PAGE_INSTRUCTIONS = 15;
+
+protected:
+	/**
+	 * @brief Split the segments into pages
+	 *
+	 * @return false if there are more than MAX_PAGES pages
+	 */
+	bool paginate();
+
+	/**
+	 * @brief Load a page and start the engine
+	 *
+	 * @param page The page number (0 - numPages - 1)
+	 */
+	bool loadPage(size_t page);
+
+	/**
+	 * @brief Load the page after the current one (or the first) and update the gap measurements
+	 *
+	 * @return false if loading failed. loadPending stays set so loop() tries again.
+	 */
+	bool loadNextPage();
+
+	/**
+	 * @brief The time after the start of the current page to start reading the status register
+	 */
+	uint32_t getPollDelayMicros() const;
+
+	/**
+	 * @brief Interrupt bit in REG_STATUS for the engine
+	 */
+	uint8_t getStatusBit() const;
+
+	/**
+	 * @brief The LP5562 to load pages into
+	 */
+	LP5562 &driver;
+
+	/**
+	 * @brief Engine number 1 - 3
+	 */
+	size_t engine;
+
+	/**
+	 * @brief Instructions of all segments, with branch step numbers relative to their segment
+	 */
+	uint16_t instructions[MAX_INSTRUCTIONS];
+
+	/**
+	 * @brief Number of entries in instructions
+	 */
+	size_t numInstructions = 0;
+
+	/**
+	 * @brief Bit mask, one bit per entry in instructions, set for the first instruction of each segment
+	 */
+	uint8_t segmentStarts[MAX_INSTRUCTIONS / 8];
+
+	/**
+	 * @brief An addSegment() call failed
+	 */
+	bool segmentError = false;
+
+	/**
+	 * @brief Go back to the first page after the last one
+	 */
+	bool repeat = true;
+
+	/**
+	 * @brief Only read the status register after an interrupt
+	 */
+	bool useInterruptPin = false;
+
+	/**
+	 * @brief Index in instructions of the first instruction of each page
+	 */
+	uint8_t pageFirst[MAX_PAGES];
+
+	/**
+	 * @brief Number of instructions in each page, not including the End instruction
+	 */
+	uint8_t pageCount[MAX_PAGES];
+
+	/**
+	 * @brief Length of each page in microseconds, or 0 if not known
+	 */
+	uint32_t pageMicros[MAX_PAGES];
+
+	/**
+	 * @brief Number of pages
+	 */
+	size_t numPages = 0;
+
+	/**
+	 * @brief Page that's running
+	 */
+	size_t currentPage = 0;
+
+	/**
+	 * @brief The pager is running
+	 */
+	bool running = false;
+
+	/**
+	 * @brief The current page has ended and the next one has not been loaded yet
+	 */
+	bool loadPending = false;
+
+	/**
+	 * @brief The instructions loaded in the engine, to count the words that change
+	 */
+	uint16_t loaded[16];
+
+	/**
+	 * @brief Value of micros() when the current page started
+	 */
+	unsigned long pageStartMicros = 0;
+
+	/**
+	 * @brief Value of micros() at the last status read that didn't have the engine interrupt set
+	 */
+	unsigned long lastPollMicros = 0;
+
+	/**
+	 * @brief Value of micros() for the end of the current page, used for the gap measurement
+	 */
+	unsigned long pageEndMicros = 0;
+
+	/**
+	 * @brief Set by interruptHandler()
+	 */
+	volatile bool interruptFlag = false;
+
+	/**
+	 * @brief Value of micros() when interruptHandler() was called
+	 */
+	volatile unsigned long interruptMicros = 0;
+
+	/**
+	 * @brief Counters and gap measurements
+	 */
+	Stats stats;
+};
+
+#endif /* __LP5562_RK_PAGER_H */
@@ -0,0 +1,219 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Phase.h"
+
+#include <limits.h>
+
+LP5562PhaseScheduler::LP5562PhaseScheduler(LP5562 &driver, size_t engine) : driver(driver), engine(engine) {
+	memset(&current, 0, sizeof(current));
+	memset(&pending, 0, sizeof(pending));
+}
+
+LP5562PhaseScheduler::~LP5562PhaseScheduler() {
+
+}
+
+bool LP5562PhaseScheduler::start(const uint16_t *instructions, size_t numInstructions, unsigned long phaseMs) {
+	Program program;
+
+	changePending = false;
+
+	if (!prepare(instructions, numInstructions, phaseMs, program)) {
+		return false;
+	}
+	return startProgram(program);
+}
+
+bool LP5562PhaseScheduler::changeAtLoopBoundary(const uint16_t *instructions, size_t numInstructions, unsigned long phaseMs) {
+	if (!started) {
+		return false;
+	}
+
+	// Past half a period the boundary predicted could be the one before or after the real one
+	const LP5562TimingAnalyzer::EngineTiming &timing = current.timing;
+	if (timing.behavior == LP5562TimingAnalyzer::BEHAVIOR_PERIODIC && timing.hasLoopBoundary &&
+		getUncertaintyMicros() > LP5562SimEngines::ticksToMicros(timing.periodTicks) / 2) {
+		return false;
+	}
+
+	if (!prepare(instructions, numInstructions, phaseMs, pending)) {
+		return false;
+	}
+
+	updateElapsed();
+	changeMicros = getBoundaryMicros(elapsedMicros + leadMicros);
+	changePending = true;
+	anchored = false;
+
+	return true;
+}
+
+void LP5562PhaseScheduler::loop() {
+	if (!changePending) {
+		return;
+	}
+
+	updateElapsed();
+	if (elapsedMicros + leadMicros < changeMicros) {
+		return;
+	}
+
+	// One read of the program counter per change, which may show the boundary is still a step or more away
+	if (!anchored) {
+		anchored = true;
+		if (reanchor() && elapsedMicros + leadMicros < changeMicros) {
+			return;
+		}
+	}
+
+	uint64_t changeAtMicros = elapsedMicros;
+	if (startProgram(pending)) {
+		lastLateMicros = (changeAtMicros > changeMicros) ? (uint32_t)(changeAtMicros - changeMicros) : 0;
+		changePending = false;
+	}
+}
+
+uint64_t LP5562PhaseScheduler::getProgramMicros() {
+	updateElapsed();
+	return elapsedMicros;
+}
+
+unsigned long LP5562PhaseScheduler::getMillisToChange() {
+	if (!changePending) {
+		return ULONG_MAX;
+	}
+
+	updateElapsed();
+	if (elapsedMicros + leadMicros >= changeMicros) {
+		return 0;
+	}
+	return (unsigned long)((changeMicros - leadMicros - elapsedMicros) / 1000);
+}
+
+uint32_t LP5562PhaseScheduler::getUncertaintyMicros() {
+	uint32_t ppm = LP5562TimingAnalyzer::getDefaultTolerancePpm(driver.getUseExternalOscillator());
+
+	updateElapsed();
+	return (uint32_t)(runMicros * ppm / 1000000);
+}
+
+bool LP5562PhaseScheduler::prepare(const uint16_t *instructions, size_t numInstructions, unsigned long phaseMs, Program &program) const {
+	if (numInstructions == 0 || numInstructions > 16) {
+		return false;
+	}
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withUseExternalOscillator(driver.getUseExternalOscillator());
+	analyzer.withProgram(engine, instructions, numInstructions);
+	if (!analyzer.analyze().success) {
+		return false;
+	}
+
+	// Fails for programs with triggers
+	if (!analyzer.getStartPoint(engine, LP5562SimEngines::microsToTicks((uint64_t) phaseMs * 1000), program.pc, program.startTicks)) {
+		return false;
+	}
+
+	for(size_t ii = 0; ii < numInstructions; ii++) {
+		program.instructions[ii] = instructions[ii];
+	}
+	program.numInstructions = (uint8_t) numInstructions;
+	program.timing = analyzer.getResult().engines[engine - 1];
+
+	return true;
+}
+
+bool LP5562PhaseScheduler::startProgram(const Program &program) {
+	if (!driver.startProgramAt(engine, program.instructions, program.numInstructions, program.pc)) {
+		return false;
+	}
+
+	// The time base starts over from the time into the program that pc corresponds to
+	lastMicros = micros();
+	elapsedMicros = LP5562SimEngines::ticksToMicros(program.startTicks);
+	runMicros = 0;
+
+	current = program;
+	started = true;
+
+	return true;
+}
+
+bool LP5562PhaseScheduler::reanchor() {
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(engine, current.instructions, current.numInstructions);
+	if (!analyzer.analyze().success) {
+		return false;
+	}
+
+	uint8_t pcs[3];
+	if (!driver.getProgramCounters(pcs)) {
+		return false;
+	}
+	// Also updates elapsedMicros to the time of the read
+	uint64_t uncertainty = getUncertaintyMicros();
+
+	uint64_t fromTicks, toTicks;
+	if (!analyzer.getStepInterval(engine, LP5562SimEngines::microsToTicks(elapsedMicros), pcs[engine - 1], fromTicks, toTicks)) {
+		return false;
+	}
+
+	// The engine is somewhere in the step interval, and within the uncertainty of the prediction. A prediction
+	// outside the interval is moved to the middle of the times that are both.
+	uint64_t fromMicros = LP5562SimEngines::ticksToMicros(fromTicks);
+	uint64_t toMicros = (toTicks == UINT64_MAX) ? UINT64_MAX : LP5562SimEngines::ticksToMicros(toTicks);
+	if (elapsedMicros < fromMicros) {
+		uint64_t high = elapsedMicros + uncertainty;
+		high = (high < fromMicros) ? fromMicros : ((high > toMicros) ? toMicros : high);
+		elapsedMicros = fromMicros + (high - fromMicros) / 2;
+	}
+	else
+	if (elapsedMicros > toMicros) {
+		uint64_t low = (elapsedMicros > uncertainty) ? elapsedMicros - uncertainty : 0;
+		low = (low > toMicros) ? toMicros : ((low < fromMicros) ? fromMicros : low);
+		elapsedMicros = low + (toMicros - low) / 2;
+	}
+	return true;
+}
+
+void LP5562PhaseScheduler::updateElapsed() {
+	// Adding up the differences keeps working when micros() rolls over
+	unsigned long now = micros();
+	unsigned long delta = now - lastMicros;
+	lastMicros = now;
+
+	elapsedMicros += delta;
+	runMicros += delta;
+}
+
+uint64_t LP5562PhaseScheduler::getBoundaryMicros(uint64_t afterMicros) const {
+	const LP5562TimingAnalyzer::EngineTiming &timing = current.timing;
+
+	// Round up so the boundary found is not before afterMicros
+	uint64_t afterTicks = LP5562SimEngines::microsToTicks(afterMicros);
+	if (LP5562SimEngines::ticksToMicros(afterTicks) < afterMicros) {
+		afterTicks++;
+	}
+
+	uint64_t ticks;
+	if (timing.behavior == LP5562TimingAnalyzer::BEHAVIOR_PERIODIC && timing.hasLoopBoundary) {
+		if (afterTicks <= timing.firstLoopTicks) {
+			ticks = timing.firstLoopTicks;
+		}
+		else {
+			uint64_t periods = (afterTicks - timing.firstLoopTicks + timing.periodTicks - 1) / timing.periodTicks;
+			ticks = timing.firstLoopTicks + periods * timing.periodTicks;
+		}
+	}
+	else
+	if (timing.behavior == LP5562TimingAnalyzer::BEHAVIOR_ENDS && afterTicks < timing.endTicks) {
+		ticks = timing.endTicks;
+	}
+	else {
+		// No loop boundary to wait for
+		return afterMicros;
+	}
+
+	return LP5562SimEngines::ticksToMicros(ticks);
+}
@@ -0,0 +1,275 @@
+#ifndef __LP5562_RK_PHASE_H
+#define __LP5562_RK_PHASE_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Timing.h"
+
+/**
+ * @brief Changes the program of an engine at the end of a loop, so a blink isn't cut off in the middle
+ *
+ * start() loads a program and starts it, optionally at a time into the program other than the beginning.
+ * changeAtLoopBoundary() queues the next program, and loop() loads it when the current program goes back
+ * to step 0:
+ *
+ * LP5562PhaseScheduler scheduler(ledDriver, 1);
+ * scheduler.start(slowBlink);
+ *
+ * scheduler.changeAtLoopBoundary(fastBlink);
+ *
+ * void loop() {
+ *     scheduler.loop();
+ * }
+ *
+ * The loop boundary is predicted with LP5562TimingAnalyzer from the time the program was started, so
+ * loop() doesn't read any registers while it waits. The prediction is only as good as the LP5562 clock:
+ * with the internal oscillator (up to 4% off) the error grows by up to 40 ms for every second since the
+ * program was started. When the change is due, loop() reads the program counters once and corrects the
+ * prediction to the time the engine is actually at that step, so a slow engine still finishes the steps
+ * before the boundary. getUncertaintyMicros() tells you how large the error can be, and
+ * changeAtLoopBoundary() fails once it's more than half the period, since the boundary could then be
+ * either of two. Use an external 32.768 kHz crystal if changes are made long after the start. Each
+ * start() or change starts the time base over again.
+ *
+ * Programs that end instead of looping are changed when they end. Programs with trigger instructions depend
+ * on the other engines and can't be used.
+ */
+class LP5562PhaseScheduler {
+public:
+	/**
+	 * @brief Construct a scheduler
+	 *
+	 * @param driver The LP5562 to program
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	LP5562PhaseScheduler(LP5562 &driver, size_t engine);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562PhaseScheduler();
+
+	/**
+	 * @brief Time to allow for the I2C transactions of a change (default: 1000 microseconds)
+	 *
+	 * @param value Microseconds. loop() starts the change this long before the loop boundary.
+	 */
+	LP5562PhaseScheduler &withLeadMicros(uint32_t value) { leadMicros = value; return *this; };
+
+	/**
+	 * @brief Load a program and start it now
+	 *
+	 * @param instructions The instruction words
+	 *
+	 * @param numInstructions Number of instructions (1 - 16)
+	 *
+	 * @param phaseMs Time into the program to start at, in milliseconds. The program is started at the
+	 * latest step where it can be started at or before this time; see LP5562TimingAnalyzer::getStartPoint().
+	 *
+	 * @return false if the program uses trigger instructions, could not be analyzed, or there was an I2C error
+	 *
+	 * A change queued by changeAtLoopBoundary() is cancelled.
+	 */
+	bool start(const uint16_t *instructions, size_t numInstructions, unsigned long phaseMs = 0);
+
+	/**
+	 * @brief Load a program and start it now
+	 *
+	 * @param program The program
+	 *
+	 * @param phaseMs Time into the program to start at, in milliseconds
+	 */
+	bool start(const LP5562Program &program, unsigned long phaseMs = 0) { return start(program.getInstructions(), program.getStepNum(), phaseMs); };
+
+	/**
+	 * @brief Change to a program at the next loop boundary of the current one
+	 *
+	 * @param instructions The instruction words
+	 *
+	 * @param numInstructions Number of instructions (1 - 16)
+	 *
+	 * @param phaseMs Time into the new program to start at, in milliseconds
+	 *
+	 * @return false if start() has not been called, the new program uses trigger instructions or could not
+	 * be analyzed, or getUncertaintyMicros() is more than half the period of the current program
+	 *
+	 * The program is analyzed now, so loop() only needs to load it. Calling this again before the change
+	 * replaces the queued program.
+	 */
+	bool changeAtLoopBoundary(const uint16_t *instructions, size_t numInstructions, unsigned long phaseMs = 0);
+
+	/**
+	 * @brief Change to a program at the next loop boundary of the current one
+	 *
+	 * @param program The program
+	 *
+	 * @param phaseMs Time into the new program to start at, in milliseconds
+	 */
+	bool changeAtLoopBoundary(const LP5562Program &program, unsigned long phaseMs = 0) { return changeAtLoopBoundary(program.getInstructions(), program.getStepNum(), phaseMs); };
+
+	/**
+	 * @brief Forget the change queued by changeAtLoopBoundary()
+	 */
+	void cancelChange() { changePending = false; };
+
+	/**
+	 * @brief Returns true if a change is queued
+	 */
+	bool isChangePending() const { return changePending; };
+
+	/**
+	 * @brief Call this from loop(). Makes the queued change when it's time.
+	 *
+	 * The first time the change is due, the program counters are read to correct the predicted time, which
+	 * can put the change off until the engine finishes the steps before the boundary. If the change fails,
+	 * it's tried again on the next call.
+	 */
+	void loop();
+
+	/**
+	 * @brief Get the time into the current program, in microseconds
+	 *
+	 * This is the time since start() or the last change plus the phase it was started at.
+	 */
+	uint64_t getProgramMicros();
+
+	/**
+	 * @brief Get the time until the queued change is made, in milliseconds
+	 *
+	 * @return Milliseconds, 0 if it's due now, or ULONG_MAX if no change is queued. Use this to sleep until
+	 * the change instead of calling loop() often.
+	 */
+	unsigned long getMillisToChange();
+
+	/**
+	 * @brief Get how far the actual loop boundary can be from the predicted one, in microseconds
+	 *
+	 * This grows with the time since the program was started and the clock tolerance of the LP5562.
+	 */
+	uint32_t getUncertaintyMicros();
+
+	/**
+	 * @brief Get the step the current program was started at
+	 */
+	uint8_t getStartPc() const { return current.pc; };
+
+	/**
+	 * @brief Get how late the last change was made compared to the predicted loop boundary, in microseconds
+	 */
+	uint32_t getLastLateMicros() const { return lastLateMicros; };
+
+protected:
+	/**
+	 * @brief A program that has been analyzed and is ready to start
+	 */
+	struct Program {
+		uint16_t instructions[16];						//!< Instruction words
+		uint8_t numInstructions;						//!< Number of instructions
+		uint8_t pc;										//!< Step to start at
+		uint64_t startTicks;							//!< Time into the program that pc corresponds to
+		LP5562TimingAnalyzer::EngineTiming timing;		//!< Timing of the program
+	};
+
+	/**
+	 * @brief Analyze a program and find where to start it
+	 *
+	 * @return false if the program can't be used
+	 */
+	bool prepare(const uint16_t *instructions, size_t numInstructions, unsigned long phaseMs, Program &program) const;
+
+	/**
+	 * @brief Load a prepared program and start it now
+	 */
+	bool startProgram(const Program &program);
+
+	/**
+	 * @brief Read the program counter and move elapsedMicros into the time the engine is at that step
+	 *
+	 * @return false if there was an I2C error or the step isn't in the current program
+	 */
+	bool reanchor();
+
+	/**
+	 * @brief Add the time since the last call to elapsedMicros
+	 */
+	void updateElapsed();
+
+	/**
+	 * @brief Get the time of the first loop boundary of the current program at or after a time into it
+	 *
+	 * @param afterMicros Time into the current program, in microseconds
+	 *
+	 * @return Time into the current program, in microseconds. For a program that ends, this is when it ends.
+	 * For a program without a loop boundary, it's afterMicros.
+	 */
+	uint64_t getBoundaryMicros(uint64_t afterMicros) const;
+
+	/**
+	 * @brief The LP5562 to program
+	 */
+	LP5562 &driver;
+
+	/**
+	 * @brief Engine number 1 - 3
+	 */
+	size_t engine;
+
+	/**
+	 * @brief Time to allow for the I2C transactions of a change
+	 */
+	uint32_t leadMicros = 1000;
+
+	/**
+	 * @brief start() has been called successfully
+	 */
+	bool started = false;
+
+	/**
+	 * @brief The current program
+	 */
+	Program current;
+
+	/**
+	 * @brief Time into the current program, in microseconds, as of lastMicros
+	 */
+	uint64_t elapsedMicros = 0;
+
+	/**
+	 * @brief Time since the current program was started, in microseconds, as of lastMicros
+	 */
+	uint64_t runMicros = 0;
+
+	/**
+	 * @brief micros() when elapsedMicros was last updated
+	 */
+	unsigned long lastMicros = 0;
+
+	/**
+	 * @brief A change is queued in pending
+	 */
+	bool changePending = false;
+
+	/**
+	 * @brief Time into the current program at which the queued change is made, in microseconds
+	 */
+	uint64_t changeMicros = 0;
+
+	/**
+	 * @brief The program counter has been read for the queued change
+	 */
+	bool anchored = false;
+
+	/**
+	 * @brief The queued program
+	 */
+	Program pending;
+
+	/**
+	 * @brief How late the last change was made, in microseconds
+	 */
+	uint32_t lastLateMicros = 0;
+};
+
+#endif /* __LP5562_RK_PHASE_H */
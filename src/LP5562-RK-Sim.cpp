@@ -0,0 +1,509 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Sim.h"
+
+LP5562SimEngines::LP5562SimEngines(const uint8_t *programMemory) : programMemory(programMemory) {
+	resetEngines();
+}
+
+LP5562SimEngines::~LP5562SimEngines() {
+
+}
+
+void LP5562SimEngines::resetEngines() {
+	for(size_t ii = 0; ii < 3; ii++) {
+		memset(&engines[ii], 0, sizeof(Engine));
+	}
+}
+
+void LP5562SimEngines::resetEnginePC(size_t engine) {
+	if (engine < 1 || engine > 3) {
+		return;
+	}
+	Engine &eng = engines[engine - 1];
+
+	eng.pc = 0;
+	eng.inTimed = false;
+	eng.waitMask = eng.sendMask = eng.received = 0;
+	eng.zeroTimeCount = 0;
+	memset(eng.loopCounters, 0, sizeof(eng.loopCounters));
+}
+
+void LP5562SimEngines::setEngineRunning(size_t engine, bool running, bool stepOnce) {
+	if (engine < 1 || engine > 3) {
+		return;
+	}
+	Engine &eng = engines[engine - 1];
+
+	eng.running = running;
+	eng.stepOnce = running && stepOnce;
+}
+
+bool LP5562SimEngines::isEngineRunning(size_t engine) const {
+	if (engine < 1 || engine > 3) {
+		return false;
+	}
+	return engines[engine - 1].running;
+}
+
+bool LP5562SimEngines::isEngineBlocked(size_t engine) const {
+	if (engine < 1 || engine > 3) {
+		return false;
+	}
+	return engines[engine - 1].waitMask != 0 || engines[engine - 1].sendMask != 0;
+}
+
+uint8_t LP5562SimEngines::getEnginePC(size_t engine) const {
+	if (engine < 1 || engine > 3) {
+		return 0;
+	}
+	return engines[engine - 1].pc;
+}
+
+void LP5562SimEngines::setEnginePC(size_t engine, uint8_t pc) {
+	if (engine < 1 || engine > 3) {
+		return;
+	}
+	Engine &eng = engines[engine - 1];
+
+	eng.pc = pc & 0xf;
+	eng.inTimed = false;
+	eng.waitMask = eng.sendMask = eng.received = 0;
+}
+
+uint8_t LP5562SimEngines::getEnginePWM(size_t engine) const {
+	if (engine < 1 || engine > 3) {
+		return 0;
+	}
+	return engines[engine - 1].pwm;
+}
+
+uint16_t LP5562SimEngines::getInstruction(size_t engine, uint8_t pc) const {
+	if (engine < 1 || engine > 3) {
+		return 0;
+	}
+	const uint8_t *p = &programMemory[(engine - 1) * 0x20 + (pc & 0xf) * 2];
+
+	// MSB first
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+void LP5562SimEngines::advanceTicks(uint64_t ticks) {
+	uint64_t end = now + ticks;
+
+	while(true) {
+		settle();
+
+		// Find the next time a step completes
+		uint64_t next = end;
+		for(size_t ii = 0; ii < 3; ii++) {
+			if (engines[ii].running && engines[ii].inTimed && now + engines[ii].ticksLeft < next) {
+				next = now + engines[ii].ticksLeft;
+			}
+		}
+
+		uint32_t elapsed = (uint32_t)(next - now);
+		now = next;
+
+		for(size_t ii = 0; ii < 3; ii++) {
+			if (engines[ii].running && engines[ii].inTimed) {
+				engines[ii].ticksLeft -= elapsed;
+				if (engines[ii].ticksLeft == 0) {
+					completeStep(ii);
+				}
+			}
+		}
+
+		if (now >= end) {
+			settle();
+			break;
+		}
+	}
+}
+
+void LP5562SimEngines::settle() {
+	bool progress;
+
+	do {
+		progress = false;
+
+		for(size_t ii = 0; ii < 3; ii++) {
+			Engine &eng = engines[ii];
+
+			if (eng.running && !eng.inTimed && eng.waitMask == 0 && eng.sendMask == 0) {
+				if (++eng.zeroTimeCount > MAX_ZERO_TIME_INSTRUCTIONS) {
+					// Stuck in a loop of zero-time instructions, let time pass
+					eng.inTimed = true;
+					eng.stall = true;
+					eng.stepsLeft = 1;
+					eng.ticksLeft = eng.stepTicks = 1;
+					onEngineStall(ii + 1);
+					continue;
+				}
+				execute(ii);
+				progress = true;
+			}
+		}
+
+		if (resolveTriggers()) {
+			progress = true;
+		}
+	} while(progress);
+}
+
+void LP5562SimEngines::execute(size_t index) {
+	Engine &eng = engines[index];
+	uint16_t inst = getInstruction(index + 1, eng.pc);
+
+	if ((inst & 0x8000) == 0) {
+		// Ramp/wait, set PWM, or go to start
+		bool prescale = (inst & 0x4000) != 0;
+		uint8_t stepTime = (inst >> 8) & 0x3f;
+
+		if (stepTime == 0) {
+			if (prescale) {
+				// Set PWM
+				setPWM(index, (uint8_t) inst);
+				nextInstruction(index);
+			}
+			else {
+				// Go to start
+				eng.pc = 0;
+				onEngineLoop(index + 1);
+			}
+		}
+		else {
+			uint8_t increment = inst & 0x7f;
+
+			eng.inTimed = true;
+			eng.stall = false;
+			eng.decrease = (inst & 0x0080) != 0;
+			eng.isWait = (increment == 0);
+			eng.stepsLeft = eng.isWait ? 1 : increment;
+			eng.stepTicks = stepTime * (prescale ? PRESCALE1_TICKS : PRESCALE0_TICKS);
+			eng.ticksLeft = eng.stepTicks;
+		}
+	}
+	else
+	switch(inst & 0xe000) {
+	case 0xa000: {
+		// Branch
+		uint8_t loopCount = (inst >> 7) & 0x3f;
+		uint8_t stepNum = inst & 0xf;
+
+		if (loopCount == 0 || ++eng.loopCounters[eng.pc] < loopCount) {
+			// Loop count 0 loops forever
+			eng.pc = stepNum;
+			if (stepNum == 0) {
+				onEngineLoop(index + 1);
+			}
+		}
+		else {
+			eng.loopCounters[eng.pc] = 0;
+			nextInstruction(index);
+		}
+		break;
+	}
+
+	case 0xc000: {
+		// End
+		bool interrupt = (inst & 0x1000) != 0;
+		if ((inst & 0x0800) != 0) {
+			setPWM(index, 0);
+		}
+		eng.running = false;
+		eng.stepOnce = false;
+		resetEnginePC(index + 1);
+		onEngineEnd(index + 1, interrupt);
+		break;
+	}
+
+	case 0xe000:
+		// Trigger. The wait part is handled after the send part completes.
+		eng.sendMask = (inst >> 7) & 0b111 & ~(1 << index);
+		eng.waitMask = (inst >> 1) & 0b111 & ~(1 << index);
+		eng.received = 0;
+		if (eng.sendMask == 0 && eng.waitMask == 0) {
+			nextInstruction(index);
+		}
+		break;
+
+	default:
+		// 100x is not a valid LP5562 instruction
+		nextInstruction(index);
+		break;
+	}
+}
+
+bool LP5562SimEngines::resolveTriggers() {
+	bool progress = false;
+
+	for(size_t ii = 0; ii < 3; ii++) {
+		Engine &sender = engines[ii];
+		if (!sender.running || sender.sendMask == 0) {
+			continue;
+		}
+
+		// The send completes when all targets are waiting for a trigger from this engine
+		bool ready = true;
+		for(size_t jj = 0; jj < 3; jj++) {
+			if ((sender.sendMask & (1 << jj)) != 0) {
+				const Engine &target = engines[jj];
+				if (!target.running || target.sendMask != 0 || (target.waitMask & (1 << ii)) == 0) {
+					ready = false;
+				}
+			}
+		}
+		if (!ready) {
+			continue;
+		}
+
+		for(size_t jj = 0; jj < 3; jj++) {
+			if ((sender.sendMask & (1 << jj)) != 0) {
+				Engine &target = engines[jj];
+				target.received |= (uint8_t)(1 << ii);
+				if ((target.received & target.waitMask) == target.waitMask) {
+					target.waitMask = target.received = 0;
+					nextInstruction(jj);
+				}
+			}
+		}
+		sender.sendMask = 0;
+		if (sender.waitMask == 0) {
+			nextInstruction(ii);
+		}
+		progress = true;
+	}
+
+	return progress;
+}
+
+void LP5562SimEngines::completeStep(size_t index) {
+	Engine &eng = engines[index];
+
+	eng.zeroTimeCount = 0;
+
+	if (eng.stall) {
+		eng.inTimed = eng.stall = false;
+		return;
+	}
+
+	if (!eng.isWait) {
+		if (eng.decrease) {
+			if (eng.pwm > 0) {
+				setPWM(index, eng.pwm - 1);
+			}
+		}
+		else {
+			if (eng.pwm < 255) {
+				setPWM(index, eng.pwm + 1);
+			}
+		}
+	}
+
+	if (--eng.stepsLeft > 0) {
+		eng.ticksLeft = eng.stepTicks;
+	}
+	else {
+		eng.inTimed = false;
+		nextInstruction(index);
+	}
+}
+
+void LP5562SimEngines::nextInstruction(size_t index) {
+	Engine &eng = engines[index];
+
+	eng.pc = (eng.pc + 1) & 0xf;
+	if (eng.pc == 0) {
+		onEngineLoop(index + 1);
+	}
+
+	if (eng.stepOnce) {
+		eng.running = eng.stepOnce = false;
+		onEngineStepDone(index + 1);
+	}
+}
+
+void LP5562SimEngines::setPWM(size_t index, uint8_t pwm) {
+	if (engines[index].pwm != pwm) {
+		engines[index].pwm = pwm;
+		onEnginePWM(index + 1, pwm);
+	}
+}
+
+
+LP5562Simulator::LP5562Simulator(uint8_t addr) : LP5562MockTransport(addr), LP5562SimEngines(&registers[LP5562::REG_PROGRAM_1]) {
+	for(size_t ii = 0; ii < 4; ii++) {
+		outputs[ii] = 0;
+	}
+	resetChip();
+}
+
+LP5562Simulator::~LP5562Simulator() {
+
+}
+
+void LP5562Simulator::resetChip() {
+	for(size_t ii = 0; ii < sizeof(registers); ii++) {
+		registers[ii] = 0;
+	}
+	registers[LP5562::REG_B_CURRENT] = LP5562::REG_CURRENT_DEFAULT;
+	registers[LP5562::REG_G_CURRENT] = LP5562::REG_CURRENT_DEFAULT;
+	registers[LP5562::REG_R_CURRENT] = LP5562::REG_CURRENT_DEFAULT;
+	registers[LP5562::REG_W_CURRENT] = LP5562::REG_CURRENT_DEFAULT;
+	registers[LP5562::REG_LED_MAP] = LP5562::REG_LED_MAP_DEFAULT;
+
+	resetEngines();
+	updateOutputs();
+}
+
+void LP5562Simulator::onWriteRegister(uint8_t reg, uint8_t value) {
+	if (reg >= LP5562::REG_PROGRAM_1 && reg < LP5562::REG_LED_MAP) {
+		// Program memory is only writable in load mode
+		size_t engine = (reg - LP5562::REG_PROGRAM_1) / 0x20 + 1;
+		if (getEngineField(registers[LP5562::REG_OP_MODE], engine) != LP5562::REG_ENGINE_LOAD) {
+			ignoredProgramWrites++;
+			return;
+		}
+		registers[reg] = value;
+		return;
+	}
+
+	switch(reg) {
+	case LP5562::REG_RESET:
+		if (value == 0xff) {
+			resetChip();
+		}
+		break;
+
+	case LP5562::REG_STATUS:
+		// Read-only
+		break;
+
+	case LP5562::REG_ENG1_PC:
+	case LP5562::REG_ENG2_PC:
+	case LP5562::REG_ENG3_PC: {
+		// PC can only be written when the engine is in hold
+		size_t engine = reg - LP5562::REG_ENG1_PC + 1;
+		if (!isEngineRunning(engine)) {
+			setEnginePC(engine, value);
+		}
+		break;
+	}
+
+	case LP5562::REG_OP_MODE: {
+		uint8_t oldValue = registers[reg];
+		registers[reg] = value;
+		for(size_t engine = 1; engine <= 3; engine++) {
+			if (getEngineField(value, engine) == LP5562::REG_ENGINE_LOAD && getEngineField(oldValue, engine) != LP5562::REG_ENGINE_LOAD) {
+				// Entering load mode resets the PC
+				resetEnginePC(engine);
+			}
+		}
+		updateEngineStates();
+		break;
+	}
+
+	case LP5562::REG_ENABLE:
+		registers[reg] = value;
+		updateEngineStates();
+		break;
+
+	default:
+		registers[reg] = value;
+		break;
+	}
+
+	updateOutputs();
+}
+
+uint8_t LP5562Simulator::onReadRegister(uint8_t reg) {
+	switch(reg) {
+	case LP5562::REG_ENG1_PC:
+	case LP5562::REG_ENG2_PC:
+	case LP5562::REG_ENG3_PC:
+		return getEnginePC(reg - LP5562::REG_ENG1_PC + 1);
+
+	case LP5562::REG_STATUS: {
+		// Reading the status register clears the interrupt bits
+		uint8_t value = registers[reg];
+		registers[reg] &= ~(LP5562::REG_STATUS_ENG1_INT | LP5562::REG_STATUS_ENG2_INT | LP5562::REG_STATUS_ENG3_INT);
+		return value;
+	}
+
+	default:
+		return registers[reg];
+	}
+}
+
+void LP5562Simulator::onEnginePWM(size_t /* engine */, uint8_t /* pwm */) {
+	updateOutputs();
+}
+
+void LP5562Simulator::onEngineEnd(size_t engine, bool interrupt) {
+	// Engine goes into hold mode
+	registers[LP5562::REG_ENABLE] &= ~(0b11 << (2 * (3 - engine)));
+
+	if (interrupt) {
+		static const uint8_t intBits[3] = { LP5562::REG_STATUS_ENG1_INT, LP5562::REG_STATUS_ENG2_INT, LP5562::REG_STATUS_ENG3_INT };
+		bool wasAsserted = isInterruptAsserted();
+		registers[LP5562::REG_STATUS] |= intBits[engine - 1];
+
+		if (!wasAsserted && interruptHandler) {
+			// Falling edge of INT
+			interruptHandler(interruptContext);
+		}
+	}
+}
+
+void LP5562Simulator::onEngineStepDone(size_t engine) {
+	registers[LP5562::REG_ENABLE] &= ~(0b11 << (2 * (3 - engine)));
+}
+
+void LP5562Simulator::updateEngineStates() {
+	uint8_t enable = registers[LP5562::REG_ENABLE];
+	uint8_t opMode = registers[LP5562::REG_OP_MODE];
+	bool chipEnabled = (enable & LP5562::REG_ENABLE_CHIP_EN) != 0;
+
+	for(size_t engine = 1; engine <= 3; engine++) {
+		uint8_t execMode = getEngineField(enable, engine);
+		bool run = chipEnabled && getEngineField(opMode, engine) == LP5562::REG_ENGINE_RUN && execMode != LP5562::REG_ENABLE_HOLD;
+		bool stepOnce = (execMode == LP5562::REG_ENABLE_STEP || execMode == LP5562::REG_ENABLE_EXEC);
+
+		if (run != isEngineRunning(engine) || (run && stepOnce)) {
+			setEngineRunning(engine, run, stepOnce);
+		}
+	}
+}
+
+void LP5562Simulator::updateOutputs() {
+	// LED_MAP: W bits 7:6, R bits 5:4, G bits 3:2, B bits 1:0
+	static const uint8_t mapShift[4] = { 4, 2, 0, 6 };
+	static const uint8_t pwmReg[4] = { LP5562::REG_R_PWM, LP5562::REG_G_PWM, LP5562::REG_B_PWM, LP5562::REG_W_PWM };
+
+	bool chipEnabled = (registers[LP5562::REG_ENABLE] & LP5562::REG_ENABLE_CHIP_EN) != 0;
+
+	for(uint8_t channel = 0; channel < 4; channel++) {
+		uint8_t value = 0;
+		if (chipEnabled) {
+			uint8_t mapping = (registers[LP5562::REG_LED_MAP] >> mapShift[channel]) & 0b11;
+			if (mapping == LP5562::REG_LED_MAP_DIRECT) {
+				value = registers[pwmReg[channel]];
+			}
+			else {
+				value = getEnginePWM(mapping);
+			}
+		}
+
+		if (value != outputs[channel]) {
+			outputs[channel] = value;
+
+			OutputChange change;
+			change.ticks = now;
+			change.channel = channel;
+			change.value = value;
+			outputChanges.push_back(change);
+		}
+	}
+}
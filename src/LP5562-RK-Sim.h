@@ -0,0 +1,464 @@
+#ifndef __LP5562_RK_SIM_H
+#define __LP5562_RK_SIM_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Mock.h"
+
+/**
+ * @brief Model of the three LP5562 program engines
+ *
+ * This executes the engine instructions against a 96-byte program memory image (engine 1 at offset 0,
+ * engine 2 at offset 0x20, engine 3 at offset 0x40, each instruction MSB first, the same layout as
+ * registers 0x10 - 0x6f). It's used by LP5562Simulator, but can also be used by itself to run
+ * programs without any register or I2C emulation.
+ *
+ * Time is kept in ticks of the 32.768 kHz oscillator. A prescale = false cycle is 16 ticks (0.49 ms)
+ * and a prescale = true cycle is 512 ticks (15.6 ms). Ramp and wait instructions take
+ * stepTime cycles per step. All other instructions take no time, except that an engine that executes
+ * more than MAX_ZERO_TIME_INSTRUCTIONS in a row without a ramp or wait is stalled for one tick so
+ * an engine stuck in a loop of zero-time instructions can't hang the simulation.
+ *
+ * Modeling choices (matching the way the library uses the chip):
+ *
+ * - Branch: the loop body executes loopCount times in total, then execution continues with the next
+ * instruction. A loopCount of 0 loops forever. Each branch instruction has its own loop counter so
+ * nested loops work.
+ * - Trigger send blocks until every target engine is blocked on a trigger wait that includes the
+ * sender. Trigger wait blocks until a trigger has been received from every engine in its mask.
+ * - End puts the engine in hold, resets the PC to 0, and optionally sets the PWM to 0 and raises
+ * the interrupt flag.
+ * - Opcodes 100x xxxx xxxx xxxx are not defined for the LP5562 and are executed as no-ops.
+ */
+class LP5562SimEngines {
+public:
+	/**
+	 * @brief Construct the engine model
+	 *
+	 * @param programMemory Pointer to 96 bytes of program memory. It's not copied, so changes made
+	 * to it (for example, by register writes) are seen by the engines.
+	 */
+	LP5562SimEngines(const uint8_t *programMemory);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562SimEngines();
+
+	/**
+	 * @brief Reset all engines (PC = 0, PWM = 0, not running, no pending triggers or interrupts)
+	 */
+	void resetEngines();
+
+	/**
+	 * @brief Reset the PC and loop counters of an engine, as happens when entering load mode.
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	void resetEnginePC(size_t engine);
+
+	/**
+	 * @brief Start or stop execution of an engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param running true to run, false to hold
+	 *
+	 * @param stepOnce If true, execute one instruction then stop and call onEngineStepDone().
+	 */
+	void setEngineRunning(size_t engine, bool running, bool stepOnce = false);
+
+	/**
+	 * @brief Returns true if the engine is running
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	bool isEngineRunning(size_t engine) const;
+
+	/**
+	 * @brief Returns true if the engine is blocked on a trigger send or wait instruction
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	bool isEngineBlocked(size_t engine) const;
+
+	/**
+	 * @brief Get the program counter (0 - 15) of an engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	uint8_t getEnginePC(size_t engine) const;
+
+	/**
+	 * @brief Set the program counter of an engine. Also cancels any instruction in progress.
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param pc The program counter 0 - 15
+	 */
+	void setEnginePC(size_t engine, uint8_t pc);
+
+	/**
+	 * @brief Get the current PWM value (0 - 255) of an engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	uint8_t getEnginePWM(size_t engine) const;
+
+	/**
+	 * @brief Get an instruction word from program memory
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param pc The instruction number 0 - 15
+	 */
+	uint16_t getInstruction(size_t engine, uint8_t pc) const;
+
+	/**
+	 * @brief Run the engines for a number of ticks of the 32.768 kHz clock
+	 *
+	 * @param ticks The number of ticks to run. Engines that are not running don't change.
+	 */
+	void advanceTicks(uint64_t ticks);
+
+	/**
+	 * @brief Get the current simulated time in ticks of the 32.768 kHz clock
+	 */
+	uint64_t getTicks() const { return now; };
+
+	/**
+	 * @brief Convert ticks of the 32.768 kHz clock to microseconds
+	 */
+	static uint64_t ticksToMicros(uint64_t ticks) { return (ticks * 1000000) / TICKS_PER_SECOND; };
+
+	/**
+	 * @brief Convert microseconds to ticks of the 32.768 kHz clock (rounded down)
+	 */
+	static uint64_t microsToTicks(uint64_t us) { return (us * TICKS_PER_SECOND) / 1000000; };
+
+	/**
+	 * @brief Number of ticks of the 32.768 kHz clock in one second
+	 */
+	static const uint32_t TICKS_PER_SECOND = 32768;
+
+	/**
+	 * @brief Number of ticks per cycle with prescale = false (0.49 ms)
+	 */
+	static const uint32_t PRESCALE0_TICKS = 16;
+
+	/**
+	 * @brief Number of ticks per cycle with prescale = true (15.6 ms)
+	 */
+	static const uint32_t PRESCALE1_TICKS = 512;
+
+	/**
+	 * @brief Number of zero-time instructions an engine can execute in a row before being stalled a tick
+	 */
+	static const uint8_t MAX_ZERO_TIME_INSTRUCTIONS = 16;
+
+protected:
+	/**
+	 * @brief Called when an engine PWM value changes
+	 */
+	virtual void onEnginePWM(size_t /* engine */, uint8_t /* pwm */) {};
+
+	/**
+	 * @brief Called when an engine executes an End instruction
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param interrupt true if the End instruction had the interrupt bit set
+	 */
+	virtual void onEngineEnd(size_t /* engine */, bool /* interrupt */) {};
+
+	/**
+	 * @brief Called when an engine started with stepOnce = true has executed its instruction
+	 */
+	virtual void onEngineStepDone(size_t /* engine */) {};
+
+	/**
+	 * @brief Called when an engine goes back to step 0 by a go to start instruction, a branch to
+	 * step 0, or running past step 15
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	virtual void onEngineLoop(size_t /* engine */) {};
+
+	/**
+	 * @brief Called when an engine is stalled a tick after more than MAX_ZERO_TIME_INSTRUCTIONS
+	 * zero-time instructions in a row
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	virtual void onEngineStall(size_t /* engine */) {};
+
+	/**
+	 * @brief State of a single engine
+	 */
+	struct Engine {
+		bool running;				//!< Engine is executing instructions
+		bool stepOnce;				//!< Stop after the current instruction completes
+		uint8_t pc;					//!< Program counter 0 - 15
+		uint8_t pwm;				//!< Current PWM value of the engine
+		bool inTimed;				//!< A ramp, wait, or stall is in progress
+		bool stall;					//!< The timed operation is a stall (don't increment pc when done)
+		bool decrease;				//!< Ramp direction
+		bool isWait;				//!< Ramp with an increment of 0
+		uint32_t stepTicks;			//!< Ticks per ramp step
+		uint32_t ticksLeft;			//!< Ticks left in the current step
+		uint8_t stepsLeft;			//!< Steps left in the ramp, including the current one
+		uint8_t waitMask;			//!< Non-zero when blocked on a trigger wait
+		uint8_t sendMask;			//!< Non-zero when blocked on a trigger send
+		uint8_t received;			//!< Triggers received while waiting
+		uint8_t zeroTimeCount;		//!< Zero-time instructions executed in a row
+		uint8_t loopCounters[16];	//!< Loop counter for the branch instruction at each pc
+	};
+
+	/**
+	 * @brief Execute zero-time instructions and resolve triggers until every running engine is
+	 * in a timed instruction or blocked.
+	 */
+	void settle();
+
+	/**
+	 * @brief Execute the instruction at the pc of an engine
+	 *
+	 * @param index The engine index 0 - 2 (not the engine number)
+	 */
+	void execute(size_t index);
+
+	/**
+	 * @brief Deliver triggers from engines blocked in trigger send to engines blocked in trigger wait
+	 *
+	 * @return true if any engine was unblocked
+	 */
+	bool resolveTriggers();
+
+	/**
+	 * @brief Called when a step of a timed instruction completes
+	 *
+	 * @param index The engine index 0 - 2 (not the engine number)
+	 */
+	void completeStep(size_t index);
+
+	/**
+	 * @brief Move to the next instruction
+	 *
+	 * @param index The engine index 0 - 2 (not the engine number)
+	 */
+	void nextInstruction(size_t index);
+
+	/**
+	 * @brief Set the engine PWM value and call onEnginePWM() if it changed
+	 */
+	void setPWM(size_t index, uint8_t pwm);
+
+	/**
+	 * @brief The program memory (96 bytes), not owned by this object
+	 */
+	const uint8_t *programMemory;
+
+	/**
+	 * @brief Current time in ticks of the 32.768 kHz clock
+	 */
+	uint64_t now = 0;
+
+	/**
+	 * @brief The three engines. Index 0 is engine 1.
+	 */
+	Engine engines[3];
+};
+
+
+/**
+ * @brief Simulated LP5562 chip that plugs in as an I2C transport
+ *
+ * Pass this to the LP5562 constructor instead of Wire. Register writes have the same side effects
+ * they have on the real chip (reset, engine enable and operation modes, program counters, status
+ * register clear on read) and the three program engines are executed by LP5562SimEngines.
+ *
+ * LP5562Simulator sim;
+ * LP5562 ledDriver(0x30, sim);
+ *
+ * ledDriver.begin();
+ * ledDriver.setBlink(255, 0, 0, 500, 500);
+ * sim.advanceMillis(2000);
+ *
+ * Time only moves forward when you call advanceMillis() or advanceTicks(), so simulations run
+ * as fast as the computer can execute them. Every change of the LED outputs is recorded with its
+ * timestamp so you can check the waveforms.
+ *
+ * Since this is a subclass of LP5562MockTransport, all I2C transactions are recorded as well.
+ *
+ * The LED outputs are the 8-bit PWM values before the logarithmic/linear conversion. Program memory
+ * writes are only accepted when the engine is in load mode, like the real chip.
+ */
+class LP5562Simulator : public LP5562MockTransport, public LP5562SimEngines {
+public:
+	/**
+	 * @brief One recorded change of an LED output
+	 */
+	struct OutputChange {
+		uint64_t ticks;				//!< Time of the change in ticks of the 32.768 kHz clock
+		uint8_t channel;			//!< CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+		uint8_t value;				//!< New PWM value 0 - 255
+	};
+
+	/**
+	 * @brief Called when the simulated INT pin goes low
+	 *
+	 * @param context The context passed to withInterruptHandler()
+	 */
+	typedef void (*InterruptHandler)(void *context);
+
+	/**
+	 * @brief Construct the simulator in the power-on reset state
+	 *
+	 * @param addr The I2C address the simulated chip responds to (default: 0x30).
+	 */
+	LP5562Simulator(uint8_t addr = 0x30);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562Simulator();
+
+	/**
+	 * @brief Reset all registers to their power-on defaults, as a write of 0xff to REG_RESET does.
+	 */
+	void resetChip();
+
+	/**
+	 * @brief Run the simulation for a number of milliseconds
+	 */
+	void advanceMillis(uint32_t ms) { advanceTicks(((uint64_t)ms * TICKS_PER_SECOND) / 1000); };
+
+	/**
+	 * @brief Get the simulated time in milliseconds
+	 */
+	uint64_t getMillis() const { return (now * 1000) / TICKS_PER_SECOND; };
+
+	/**
+	 * @brief Get the current output of an LED
+	 *
+	 * @param channel CHANNEL_R, CHANNEL_G, CHANNEL_B, or CHANNEL_W
+	 *
+	 * @return PWM value 0 - 255. If the LED is mapped to an engine, this is the engine PWM value.
+	 */
+	uint8_t getOutput(uint8_t channel) const { return outputs[channel & 0b11]; };
+
+	/**
+	 * @brief Get the number of output changes recorded since construction or clearOutputChanges()
+	 */
+	size_t getNumOutputChanges() const { return outputChanges.size(); };
+
+	/**
+	 * @brief Get a recorded output change
+	 *
+	 * @param index 0 <= index < getNumOutputChanges()
+	 */
+	const OutputChange &getOutputChange(size_t index) const { return outputChanges[index]; };
+
+	/**
+	 * @brief Forget all recorded output changes
+	 */
+	void clearOutputChanges() { outputChanges.clear(); };
+
+	/**
+	 * @brief Get the number of program memory bytes written while the engine was not in load mode
+	 *
+	 * The real chip ignores those writes, and so does the simulator.
+	 */
+	size_t getIgnoredProgramWrites() const { return ignoredProgramWrites; };
+
+	/**
+	 * @brief Returns true if any engine interrupt flag is set, which is when the real chip pulls INT low
+	 */
+	bool isInterruptAsserted() const { return (registers[LP5562::REG_STATUS] & (LP5562::REG_STATUS_ENG1_INT | LP5562::REG_STATUS_ENG2_INT | LP5562::REG_STATUS_ENG3_INT)) != 0; };
+
+	/**
+	 * @brief Set a function to call when the simulated INT pin goes low, like a falling edge interrupt
+	 *
+	 * @param handler The function to call, or NULL for none
+	 *
+	 * @param context Passed to the handler
+	 *
+	 * INT goes low when an engine sets its interrupt flag and none was set before. The handler is called
+	 * from advanceTicks() at the simulated time of the End instruction.
+	 */
+	LP5562Simulator &withInterruptHandler(InterruptHandler handler, void *context = NULL) { interruptHandler = handler; interruptContext = context; return *this; };
+
+	static const uint8_t CHANNEL_R = 0;		//!< Red channel index for getOutput()
+	static const uint8_t CHANNEL_G = 1;		//!< Green channel index for getOutput()
+	static const uint8_t CHANNEL_B = 2;		//!< Blue channel index for getOutput()
+	static const uint8_t CHANNEL_W = 3;		//!< White channel index for getOutput()
+
+protected:
+	/**
+	 * @brief Applies the register side effects of the chip
+	 */
+	virtual void onWriteRegister(uint8_t reg, uint8_t value);
+
+	/**
+	 * @brief Returns the program counters and clears the status register on read
+	 */
+	virtual uint8_t onReadRegister(uint8_t reg);
+
+	/**
+	 * @brief Updates the outputs when an engine PWM changes
+	 */
+	virtual void onEnginePWM(size_t engine, uint8_t pwm);
+
+	/**
+	 * @brief Puts the engine in hold in REG_ENABLE and sets the status interrupt flag
+	 */
+	virtual void onEngineEnd(size_t engine, bool interrupt);
+
+	/**
+	 * @brief Puts the engine in hold in REG_ENABLE after single step or direct execute
+	 */
+	virtual void onEngineStepDone(size_t engine);
+
+	/**
+	 * @brief Start or stop the engines based on REG_ENABLE and REG_OP_MODE
+	 */
+	void updateEngineStates();
+
+	/**
+	 * @brief Recalculate the LED outputs and record any changes
+	 */
+	void updateOutputs();
+
+	/**
+	 * @brief Get the 2-bit field for an engine (1 - 3) from REG_ENABLE or REG_OP_MODE
+	 */
+	static uint8_t getEngineField(uint8_t value, size_t engine) { return (value >> (2 * (3 - engine))) & 0b11; };
+
+	/**
+	 * @brief Current LED outputs, indexed by CHANNEL_R, CHANNEL_G, CHANNEL_B, CHANNEL_W
+	 */
+	uint8_t outputs[4];
+
+	/**
+	 * @brief Recorded output changes
+	 */
+	std::vector<OutputChange> outputChanges;
+
+	/**
+	 * @brief Number of program memory bytes written while not in load mode
+	 */
+	size_t ignoredProgramWrites = 0;
+
+	/**
+	 * @brief Called when INT goes low
+	 */
+	InterruptHandler interruptHandler = NULL;
+
+	/**
+	 * @brief Context for interruptHandler
+	 */
+	void *interruptContext = NULL;
+};
+
+#endif /* __LP5562_RK_SIM_H */
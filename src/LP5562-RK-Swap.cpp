@@ -0,0 +1,172 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Swap.h"
+
+LP5562ProgramSwapper::LP5562ProgramSwapper(LP5562 &driver) : driver(driver) {
+	lastSwap.doubleBuffered = false;
+	lastSwap.engine = 0;
+	lastSwap.totalMicros = 0;
+	lastSwap.switchMicros = 0;
+
+	resetStats();
+}
+
+LP5562ProgramSwapper::~LP5562ProgramSwapper() {
+
+}
+
+bool LP5562ProgramSwapper::swap(uint8_t channelMask, const uint16_t *instructions, size_t numInstructions) {
+	if ((channelMask & 0x0f) == 0 || numInstructions == 0 || numInstructions > 16) {
+		return false;
+	}
+
+	unsigned long startMicros = micros();
+
+	// Find which engines the channels in channelMask and the other channels use
+	uint8_t ledMap = driver.getLedMapping();
+	uint8_t usedBySwapped = 0;
+	uint8_t usedByOthers = 0;
+
+	for(size_t channel = 0; channel < 4; channel++) {
+		uint8_t mode = (ledMap >> getMapShift(channel)) & 0b11;
+		if (mode == LP5562::REG_LED_MAP_DIRECT) {
+			continue;
+		}
+		if (channelMask & (1 << channel)) {
+			usedBySwapped |= driver.engineNumToMask(mode);
+		}
+		else {
+			usedByOthers |= driver.engineNumToMask(mode);
+		}
+	}
+
+	// A free engine isn't shown on any channel, so it can be loaded and started without being seen
+	size_t engine = 0;
+	bool doubleBuffered = false;
+	for(size_t ii = 1; ii <= 3; ii++) {
+		if (((usedBySwapped | usedByOthers) & driver.engineNumToMask(ii)) == 0) {
+			engine = ii;
+			doubleBuffered = true;
+			break;
+		}
+	}
+	if (!doubleBuffered) {
+		// Load in place on an engine that only the swapped channels use
+		for(size_t ii = 1; ii <= 3; ii++) {
+			if ((usedBySwapped & driver.engineNumToMask(ii)) != 0 && (usedByOthers & driver.engineNumToMask(ii)) == 0) {
+				engine = ii;
+				break;
+			}
+		}
+	}
+	if (engine == 0) {
+		stats.errors++;
+		return false;
+	}
+
+	uint8_t engineMask = driver.engineNumToMask(engine);
+
+	// The new mapping for the swapped channels
+	uint8_t newMap = ledMap;
+	for(size_t channel = 0; channel < 4; channel++) {
+		if (channelMask & (1 << channel)) {
+			newMap &= (uint8_t)~(0b11 << getMapShift(channel));
+			newMap |= (uint8_t)(engine << getMapShift(channel));
+		}
+	}
+
+	bool bResult;
+	unsigned long runMicros;
+
+	if (doubleBuffered) {
+		// Nothing shows this engine, so it doesn't matter that it's stopped while loading
+		bResult = driver.setProgram(engine, instructions, numInstructions, false) &&
+				driver.resetProgramCounters(engineMask);
+
+		// Start it and show it right after. Staging both in a batch does the read of the enable register
+		// first, so only the two writes are left between starting the engine and showing it.
+		driver.beginBatch();
+		bResult = bResult && driver.setEnable(engineMask, LP5562::REG_ENABLE_RUN) && driver.setLedMapping(
+				(newMap >> 4) & 0b11, (newMap >> 2) & 0b11, newMap & 0b11, (newMap >> 6) & 0b11);
+		runMicros = micros();
+		if (!driver.commit()) {
+			bResult = false;
+		}
+		lastSwap.switchMicros = (uint32_t)(micros() - runMicros);
+
+		// Engines that no channel uses any more are stopped, ready for the next swap
+		uint8_t stillUsed = usedByOthers | engineMask;
+		uint8_t holdMask = usedBySwapped & ~stillUsed;
+		if (bResult && holdMask) {
+			bResult = driver.setEnable(holdMask, LP5562::REG_ENABLE_HOLD);
+		}
+	}
+	else {
+		// The LEDs on this engine freeze while it's loaded
+		runMicros = micros();
+		driver.beginBatch();
+		bResult = driver.setProgram(engine, instructions, numInstructions, false) &&
+				driver.resetProgramCounters(engineMask) &&
+				driver.setEnable(engineMask, LP5562::REG_ENABLE_RUN);
+		if (!driver.commit()) {
+			bResult = false;
+		}
+		uint32_t frozenMicros = (uint32_t)(micros() - runMicros);
+		if (frozenMicros > stats.maxFrozenMicros) {
+			stats.maxFrozenMicros = frozenMicros;
+		}
+		lastSwap.switchMicros = 0;
+
+		if (bResult && newMap != ledMap) {
+			// Swapped channels that were direct or on other engines join this one
+			bResult = driver.setLedMapping((newMap >> 4) & 0b11, (newMap >> 2) & 0b11, newMap & 0b11, (newMap >> 6) & 0b11);
+		}
+	}
+
+	if (!bResult) {
+		stats.errors++;
+		return false;
+	}
+
+	lastSwap.doubleBuffered = doubleBuffered;
+	lastSwap.engine = (uint8_t) engine;
+	lastSwap.totalMicros = (uint32_t)(micros() - startMicros);
+
+	stats.swaps++;
+	if (!doubleBuffered) {
+		stats.inPlace++;
+	}
+	if (lastSwap.totalMicros > stats.maxTotalMicros) {
+		stats.maxTotalMicros = lastSwap.totalMicros;
+	}
+	if (lastSwap.switchMicros > stats.maxSwitchMicros) {
+		stats.maxSwitchMicros = lastSwap.switchMicros;
+	}
+
+	return true;
+}
+
+void LP5562ProgramSwapper::resetStats() {
+	stats.swaps = 0;
+	stats.inPlace = 0;
+	stats.errors = 0;
+	stats.maxTotalMicros = 0;
+	stats.maxSwitchMicros = 0;
+	stats.maxFrozenMicros = 0;
+}
+
+// static
+uint8_t LP5562ProgramSwapper::getMapShift(size_t channel) {
+	// REG_LED_MAP is W in bits 7:6, R in 5:4, G in 3:2, and B in 1:0
+	switch(channel) {
+	case 0:
+		return 4;
+	case 1:
+		return 2;
+	case 2:
+		return 0;
+	default:
+		return 6;
+	}
+}
@@ -0,0 +1,133 @@
+#ifndef __LP5562_RK_SWAP_H
+#define __LP5562_RK_SWAP_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Changes the program shown on channels without stopping them, using a spare engine
+ *
+ * LP5562::setProgram() puts the engine in hold while it loads the new program, so the LEDs driven by
+ * it freeze for the time it takes to load. swap() instead loads the new program into an engine that no
+ * channel is mapped to, where it can't be seen, starts it, and then switches the channels to it with one
+ * write of the LED map register:
+ *
+ * LP5562ProgramSwapper swapper(ledDriver);
+ * swapper.swap(LP5562ProgramSwapper::CHANNEL_MASK_R, newProgram);
+ *
+ * The engine the channels were using is put in hold once no channel is mapped to it, so it's the
+ * spare engine for the next swap. If no engine is free, the program is loaded in place on the engine
+ * the channels are using, the same as setProgram(), and getLastSwap().doubleBuffered is false.
+ *
+ * Programs with trigger instructions depend on which engine they run on, so they should not be swapped
+ * onto a different engine this way.
+ */
+class LP5562ProgramSwapper {
+public:
+	/**
+	 * @brief Details of one swap
+	 */
+	struct SwapInfo {
+		bool doubleBuffered;		//!< Loaded into a free engine (false = loaded in place)
+		uint8_t engine;				//!< Engine the channels are mapped to now (1 - 3)
+		uint32_t totalMicros;		//!< Time for the whole swap() call in microseconds
+		uint32_t switchMicros;		//!< Time from starting the engine until the channels show it in microseconds
+	};
+
+	/**
+	 * @brief Counters and the longest times seen
+	 */
+	struct Stats {
+		uint32_t swaps;				//!< Successful swaps
+		uint32_t inPlace;			//!< Swaps that had to load in place because no engine was free
+		uint32_t errors;			//!< Swaps that failed
+		uint32_t maxTotalMicros;	//!< Longest totalMicros
+		uint32_t maxSwitchMicros;	//!< Longest switchMicros for double buffered swaps
+		uint32_t maxFrozenMicros;	//!< Longest time the engine was stopped for an in place swap
+	};
+
+	/**
+	 * @brief Construct a swapper
+	 *
+	 * @param driver The LP5562 to program
+	 */
+	LP5562ProgramSwapper(LP5562 &driver);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562ProgramSwapper();
+
+	/**
+	 * @brief Run a program on channels, switching to it without stopping the LEDs
+	 *
+	 * @param channelMask The channels to show the program on. Logical OR CHANNEL_MASK_R, CHANNEL_MASK_G,
+	 * CHANNEL_MASK_B, and CHANNEL_MASK_W.
+	 *
+	 * @param instructions The instruction words
+	 *
+	 * @param numInstructions Number of instructions (1 - 16)
+	 *
+	 * @return false if channelMask or the program is not valid, no engine could be used, or there was an
+	 * I2C error
+	 *
+	 * The LED map register is read once to find a free engine. Channels not in channelMask are not changed.
+	 */
+	bool swap(uint8_t channelMask, const uint16_t *instructions, size_t numInstructions);
+
+	/**
+	 * @brief Run a program on channels, switching to it without stopping the LEDs
+	 *
+	 * @param channelMask The channels to show the program on
+	 *
+	 * @param program The program
+	 */
+	bool swap(uint8_t channelMask, const LP5562Program &program) { return swap(channelMask, program.getInstructions(), program.getStepNum()); };
+
+	/**
+	 * @brief Get the details of the last successful swap
+	 */
+	const SwapInfo &getLastSwap() const { return lastSwap; };
+
+	/**
+	 * @brief Get the counters and the longest times seen
+	 */
+	const Stats &getStats() const { return stats; };
+
+	/**
+	 * @brief Clear the counters and longest times
+	 */
+	void resetStats();
+
+	static const uint8_t CHANNEL_MASK_R = 0x01;		//!< Red channel for channelMask
+	static const uint8_t CHANNEL_MASK_G = 0x02;		//!< Green channel for channelMask
+	static const uint8_t CHANNEL_MASK_B = 0x04;		//!< Blue channel for channelMask
+	static const uint8_t CHANNEL_MASK_W = 0x08;		//!< White channel for channelMask
+
+protected:
+	/**
+	 * @brief Bit position of a channel's two bits in REG_LED_MAP
+	 *
+	 * @param channel Channel index 0 - 3 (R, G, B, W)
+	 */
+	static uint8_t getMapShift(size_t channel);
+
+	/**
+	 * @brief The LP5562 to program
+	 */
+	LP5562 &driver;
+
+	/**
+	 * @brief Details of the last swap
+	 */
+	SwapInfo lastSwap;
+
+	/**
+	 * @brief Counters and the longest times seen
+	 */
+	Stats stats;
+};
+
+#endif /* __LP5562_RK_SWAP_H */
@@ -0,0 +1,525 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Timing.h"
+
+LP5562TimingAnalyzer::LP5562TimingAnalyzer() : LP5562SimEngines(memory) {
+	memset(memory, 0, sizeof(memory));
+	memset(&result, 0, sizeof(result));
+}
+
+LP5562TimingAnalyzer::~LP5562TimingAnalyzer() {
+
+}
+
+LP5562TimingAnalyzer &LP5562TimingAnalyzer::withProgram(size_t engine, const uint16_t *instructions, size_t numInstructions) {
+	if (engine < 1 || engine > 3 || numInstructions > 16) {
+		return *this;
+	}
+
+	// Unused instructions are 0x0000 (go to start), like LP5562::setProgram()
+	uint8_t *mem = &memory[(engine - 1) * 32];
+	memset(mem, 0, 32);
+	for(size_t ii = 0; ii < numInstructions; ii++) {
+		mem[ii * 2] = (uint8_t)(instructions[ii] >> 8);
+		mem[ii * 2 + 1] = (uint8_t) instructions[ii];
+	}
+
+	if (numInstructions > 0) {
+		programMask |= (uint8_t)(1 << (engine - 1));
+	}
+	else {
+		programMask &= (uint8_t) ~(1 << (engine - 1));
+	}
+	return *this;
+}
+
+LP5562TimingAnalyzer &LP5562TimingAnalyzer::clearPrograms() {
+	memset(memory, 0, sizeof(memory));
+	programMask = 0;
+	return *this;
+}
+
+const LP5562TimingAnalyzer::Result &LP5562TimingAnalyzer::analyze() {
+	memset(&result, 0, sizeof(result));
+	result.success = true;
+
+	// Engines that use triggers depend on each other and are run together. The others are independent.
+	uint8_t syncMask = 0;
+	for(size_t ii = 0; ii < 3; ii++) {
+		if ((programMask & (1 << ii)) == 0) {
+			continue;
+		}
+		for(uint8_t pc = 0; pc < 16; pc++) {
+			if ((getInstruction(ii + 1, pc) & 0xe000) == 0xe000) {
+				syncMask |= (uint8_t)(1 << ii);
+				result.engines[ii].synchronized = true;
+				break;
+			}
+		}
+	}
+
+	for(size_t ii = 0; ii < 3 && result.success; ii++) {
+		uint8_t mask = (uint8_t)(1 << ii);
+		if ((programMask & mask) != 0 && (syncMask & mask) == 0) {
+			result.error = analyzeGroup(mask);
+			result.success = (result.error == NULL);
+		}
+	}
+	if (syncMask != 0 && result.success) {
+		result.error = analyzeGroup(syncMask);
+		result.success = (result.error == NULL);
+	}
+
+	// Period of all of the periodic engines together
+	if (result.success) {
+		for(size_t ii = 0; ii < 3; ii++) {
+			uint64_t period = result.engines[ii].periodTicks;
+			if (result.engines[ii].behavior != BEHAVIOR_PERIODIC || period == 0) {
+				continue;
+			}
+			if (result.periodTicks == 0) {
+				result.periodTicks = period;
+				continue;
+			}
+
+			uint64_t a = result.periodTicks, b = period;
+			while(b != 0) {
+				uint64_t t = a % b;
+				a = b;
+				b = t;
+			}
+			uint64_t factor = period / a;
+			if (result.periodTicks > UINT64_MAX / factor) {
+				// Too large to represent
+				result.periodTicks = 0;
+				break;
+			}
+			result.periodTicks *= factor;
+		}
+	}
+
+	resetEngines();
+
+	return result;
+}
+
+double LP5562TimingAnalyzer::getPeriodMs(size_t engine) const {
+	const EngineTiming *timing = getEngineTiming(engine);
+	if (!timing || timing->behavior != BEHAVIOR_PERIODIC) {
+		return 0;
+	}
+	return (double) timing->periodTicks * 1000.0 / TICKS_PER_SECOND;
+}
+
+uint64_t LP5562TimingAnalyzer::getPeriodMicros(size_t engine) const {
+	const EngineTiming *timing = getEngineTiming(engine);
+	if (!timing || timing->behavior != BEHAVIOR_PERIODIC) {
+		return 0;
+	}
+	return (timing->periodTicks * 1000000 + TICKS_PER_SECOND / 2) / TICKS_PER_SECOND;
+}
+
+bool LP5562TimingAnalyzer::getPeriodRangeMicros(size_t engine, uint64_t &minMicros, uint64_t &maxMicros) const {
+	const EngineTiming *timing = getEngineTiming(engine);
+	if (!timing || timing->behavior != BEHAVIOR_PERIODIC) {
+		return false;
+	}
+
+	// A fast clock makes the period shorter and a slow clock makes it longer
+	double nominal = (double) timing->periodTicks * 1000000.0 / TICKS_PER_SECOND;
+	double tolerance = (double) getTolerancePpm() / 1000000.0;
+
+	minMicros = (uint64_t)(nominal / (1.0 + tolerance));
+	maxMicros = (uint64_t)(nominal / (1.0 - tolerance) + 0.999);
+	return true;
+}
+
+int64_t LP5562TimingAnalyzer::getPhaseTicks(size_t engine, size_t reference) const {
+	const EngineTiming *timing = getEngineTiming(engine);
+	const EngineTiming *refTiming = getEngineTiming(reference);
+	if (!timing || !refTiming || !timing->hasLoopBoundary || !refTiming->hasLoopBoundary) {
+		return -1;
+	}
+
+	int64_t period = (int64_t) timing->periodTicks;
+	int64_t phase = ((int64_t) timing->firstLoopTicks - (int64_t) refTiming->firstLoopTicks) % period;
+	if (phase < 0) {
+		phase += period;
+	}
+	return phase;
+}
+
+uint64_t LP5562TimingAnalyzer::getNextLoopBoundaryTicks(size_t engine, uint64_t elapsedTicks) const {
+	const EngineTiming *timing = getEngineTiming(engine);
+	if (!timing || !timing->hasLoopBoundary) {
+		return 0;
+	}
+	if (elapsedTicks <= timing->firstLoopTicks) {
+		return timing->firstLoopTicks;
+	}
+
+	uint64_t periods = (elapsedTicks - timing->firstLoopTicks + timing->periodTicks - 1) / timing->periodTicks;
+	return timing->firstLoopTicks + periods * timing->periodTicks;
+}
+
+unsigned long LP5562TimingAnalyzer::getNextLoopBoundaryMs(size_t engine, unsigned long elapsedMs) const {
+	uint64_t elapsedTicks = ((uint64_t) elapsedMs * TICKS_PER_SECOND + 999) / 1000;
+
+	uint64_t ticks = getNextLoopBoundaryTicks(engine, elapsedTicks);
+
+	return (unsigned long)((ticks * 1000 + TICKS_PER_SECOND - 1) / TICKS_PER_SECOND);
+}
+
+bool LP5562TimingAnalyzer::getStartPoint(size_t engine, uint64_t elapsedTicks, uint8_t &pc, uint64_t &startTicks) {
+	const EngineTiming *timing = getEngineTiming(engine);
+	if (!timing || (programMask & (1 << (engine - 1))) == 0) {
+		return false;
+	}
+	for(uint8_t ii = 0; ii < 16; ii++) {
+		if ((getInstruction(engine, ii) & 0xe000) == 0xe000) {
+			// Depends on where the other engines are
+			return false;
+		}
+	}
+
+	if (timing->behavior == BEHAVIOR_PERIODIC && timing->hasLoopBoundary && elapsedTicks >= timing->firstLoopTicks + timing->periodTicks) {
+		elapsedTicks = timing->firstLoopTicks + (elapsedTicks - timing->firstLoopTicks) % timing->periodTicks;
+	}
+
+	size_t index = engine - 1;
+	startGroup((uint8_t)(1 << index));
+
+	pc = 0;
+	startTicks = 0;
+
+	uint32_t steps = 0;
+	while(steps++ < maxSteps) {
+		Engine before = engines[index];
+		if (!nextStep() || now > elapsedTicks) {
+			break;
+		}
+
+		// Only the end of a ramp or wait is an instruction boundary
+		if (!before.inTimed || before.stall || before.stepsLeft != 1) {
+			continue;
+		}
+
+		bool inLoop = false;
+		for(size_t ii = 0; ii < 16; ii++) {
+			if (before.loopCounters[ii] != 0) {
+				inLoop = true;
+			}
+		}
+
+		uint8_t nextPc = (uint8_t)((before.pc + 1) & 0xf);
+		if (!inLoop && (nextPc == 0 || isLevelSetAt(engine, nextPc))) {
+			pc = nextPc;
+			startTicks = now;
+		}
+	}
+
+	resetEngines();
+	return true;
+}
+
+bool LP5562TimingAnalyzer::getStepInterval(size_t engine, uint64_t nearTicks, uint8_t pc, uint64_t &fromTicks, uint64_t &toTicks) {
+	const EngineTiming *timing = getEngineTiming(engine);
+	if (!timing || (programMask & (1 << (engine - 1))) == 0 || timing->synchronized) {
+		return false;
+	}
+
+	// Run from one period before nearTicks to one period after, after removing whole periods
+	uint64_t shift = 0, limit = UINT64_MAX;
+	if (timing->behavior == BEHAVIOR_PERIODIC && timing->periodTicks != 0) {
+		uint64_t periodStart = timing->transientTicks + timing->periodTicks;
+		if (nearTicks >= periodStart + timing->periodTicks) {
+			shift = ((nearTicks - periodStart) / timing->periodTicks) * timing->periodTicks;
+		}
+		limit = nearTicks - shift + timing->periodTicks;
+	}
+	uint64_t target = nearTicks - shift;
+
+	size_t index = engine - 1;
+	startGroup((uint8_t)(1 << index));
+
+	bool found = false, stopped = false;
+	uint64_t bestDistance = 0;
+	uint64_t runStart = 0;
+	uint8_t runPc = engines[index].pc;
+
+	uint32_t steps = 0;
+	while(steps++ < maxSteps) {
+		// A stopped engine stays at step 0, where End leaves it
+		bool more = !stopped && nextStep();
+		if (more && engines[index].running && engines[index].pc == runPc) {
+			if (now > limit || (found && now > target + bestDistance)) {
+				break;
+			}
+			continue;
+		}
+
+		// The engine was at runPc from runStart until now
+		uint64_t runEnd = more ? now : UINT64_MAX;
+		if (runPc == pc && runEnd > runStart) {
+			uint64_t distance = 0;
+			if (target < runStart) {
+				distance = runStart - target;
+			}
+			else
+			if (target >= runEnd) {
+				distance = target - runEnd + 1;
+			}
+			if (!found || distance < bestDistance) {
+				found = true;
+				bestDistance = distance;
+				fromTicks = runStart + shift;
+				toTicks = more ? runEnd + shift : UINT64_MAX;
+			}
+		}
+		if (!more || now > limit || (found && now > target + bestDistance)) {
+			break;
+		}
+
+		stopped = !engines[index].running;
+		runStart = now;
+		runPc = engines[index].pc;
+	}
+
+	resetEngines();
+	return found;
+}
+
+bool LP5562TimingAnalyzer::isLevelSetAt(size_t engine, uint8_t pc) const {
+	// Set PWM, or go to start which is the same as starting at step 0. A ramp starts from the current
+	// level and a wait shows it, so neither can be started at.
+	uint16_t inst = getInstruction(engine, pc);
+	return (inst & 0xff00) == 0x4000 || inst == 0x0000;
+}
+
+const char *LP5562TimingAnalyzer::analyzeGroup(uint8_t mask) {
+	// Brent's cycle detection. The engines are deterministic, so once the state of all of them is the
+	// same as at an earlier step, everything from there on repeats.
+	startGroup(mask);
+
+	Snapshot start, tortoise, hare;
+	save(start);
+	tortoise = start;
+
+	uint32_t power = 1, lambda = 1, steps = 0;
+	if (!nextStep()) {
+		setStopped(mask);
+		return NULL;
+	}
+	while(!isSameState(tortoise)) {
+		if (power == lambda) {
+			save(tortoise);
+			power *= 2;
+			lambda = 0;
+		}
+		if (!nextStep()) {
+			setStopped(mask);
+			return NULL;
+		}
+		lambda++;
+		if (++steps > maxSteps) {
+			return "period too long to analyze";
+		}
+	}
+	uint64_t periodTicks = getTicks() - tortoise.now;
+
+	// Find the first step of the periodic part by running from the start and from lambda steps after
+	// the start until the two states are the same
+	restore(start);
+	for(uint32_t ii = 0; ii < lambda; ii++) {
+		nextStep();
+	}
+	save(hare);
+	tortoise = start;
+
+	restore(tortoise);
+	while(!isSameState(hare)) {
+		nextStep();
+		save(tortoise);
+
+		restore(hare);
+		nextStep();
+		save(hare);
+
+		restore(tortoise);
+	}
+
+	// Run one period to find the loop boundaries and engines that are stuck
+	uint8_t progressMask = 0;
+	for(size_t ii = 0; ii < 3; ii++) {
+		if ((mask & (1 << ii)) != 0) {
+			result.engines[ii].hasLoopBoundary = false;
+			result.engines[ii].transientTicks = tortoise.now;
+		}
+	}
+	recordFrom = tortoise.now;
+	recording = true;
+	stallMask = 0;
+	for(uint32_t ii = 0; ii < lambda; ii++) {
+		nextStep();
+		for(size_t jj = 0; jj < 3; jj++) {
+			if (memcmp(&engines[jj], &tortoise.engines[jj], sizeof(Engine)) != 0) {
+				progressMask |= (uint8_t)(1 << jj);
+			}
+		}
+	}
+	recording = false;
+
+	// The period of an engine that loops through only zero-time instructions comes from the one tick
+	// stalls of the engine model, which isn't what the chip does
+	if (stallMask != 0) {
+		return "program loops without a ramp or wait";
+	}
+
+	for(size_t ii = 0; ii < 3; ii++) {
+		if ((mask & (1 << ii)) == 0) {
+			continue;
+		}
+		EngineTiming &timing = result.engines[ii];
+		const Engine &eng = tortoise.engines[ii];
+
+		if (!eng.running) {
+			timing.behavior = BEHAVIOR_ENDS;
+			timing.hasLoopBoundary = false;
+		}
+		else
+		if ((progressMask & (1 << ii)) == 0 && (eng.waitMask != 0 || eng.sendMask != 0)) {
+			timing.behavior = BEHAVIOR_DEADLOCK;
+			timing.endTicks = tortoise.now;
+			timing.hasLoopBoundary = false;
+		}
+		else {
+			timing.behavior = BEHAVIOR_PERIODIC;
+			timing.periodTicks = periodTicks;
+			if (timing.hasLoopBoundary) {
+				// A boundary at the start of the periodic part is recorded one period later
+				timing.firstLoopTicks = tortoise.now + (timing.firstLoopTicks - tortoise.now) % periodTicks;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+void LP5562TimingAnalyzer::startGroup(uint8_t mask) {
+	resetEngines();
+	now = 0;
+
+	for(size_t ii = 0; ii < 3; ii++) {
+		if ((mask & (1 << ii)) != 0) {
+			setEngineRunning(ii + 1, true);
+		}
+	}
+
+	// Execute the zero-time instructions at the start
+	advanceTicks(0);
+	normalize();
+}
+
+bool LP5562TimingAnalyzer::nextStep() {
+	bool found = false;
+	uint32_t ticks = 0;
+
+	for(size_t ii = 0; ii < 3; ii++) {
+		if (engines[ii].running && engines[ii].inTimed && (!found || engines[ii].ticksLeft < ticks)) {
+			ticks = engines[ii].ticksLeft;
+			found = true;
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	advanceTicks(ticks);
+	normalize();
+	return true;
+}
+
+void LP5562TimingAnalyzer::normalize() {
+	// The count of zero-time instructions is cleared when a step completes, so it doesn't affect
+	// what happens next while an engine is in a ramp or wait. Clearing it here keeps it from hiding
+	// a repeated state.
+	for(size_t ii = 0; ii < 3; ii++) {
+		if (engines[ii].inTimed) {
+			engines[ii].zeroTimeCount = 0;
+		}
+	}
+}
+
+void LP5562TimingAnalyzer::save(Snapshot &snapshot) const {
+	memcpy(snapshot.engines, engines, sizeof(snapshot.engines));
+	snapshot.now = now;
+}
+
+void LP5562TimingAnalyzer::restore(const Snapshot &snapshot) {
+	memcpy(engines, snapshot.engines, sizeof(engines));
+	now = snapshot.now;
+}
+
+bool LP5562TimingAnalyzer::isSameState(const Snapshot &snapshot) const {
+	return memcmp(engines, snapshot.engines, sizeof(engines)) == 0;
+}
+
+void LP5562TimingAnalyzer::setStopped(uint8_t mask) {
+	for(size_t ii = 0; ii < 3; ii++) {
+		if ((mask & (1 << ii)) == 0) {
+			continue;
+		}
+		EngineTiming &timing = result.engines[ii];
+
+		if (engines[ii].running) {
+			// Still running but not in a timed instruction, so it's waiting for a trigger that never comes
+			timing.behavior = BEHAVIOR_DEADLOCK;
+			timing.endTicks = now;
+		}
+		else {
+			// endTicks was set by onEngineEnd()
+			timing.behavior = BEHAVIOR_ENDS;
+		}
+	}
+}
+
+void LP5562TimingAnalyzer::onEngineLoop(size_t engine) {
+	EngineTiming &timing = result.engines[engine - 1];
+
+	// A branch back to step 0 that's still counting loops is part of the program, not the start of it
+	for(size_t ii = 0; ii < 16; ii++) {
+		if (engines[engine - 1].loopCounters[ii] != 0) {
+			return;
+		}
+	}
+
+	if (recording && !timing.hasLoopBoundary && now >= recordFrom) {
+		timing.hasLoopBoundary = true;
+		timing.firstLoopTicks = now;
+	}
+}
+
+void LP5562TimingAnalyzer::onEngineEnd(size_t engine, bool /* interrupt */) {
+	result.engines[engine - 1].endTicks = now;
+}
+
+void LP5562TimingAnalyzer::onEngineStall(size_t engine) {
+	if (recording) {
+		stallMask |= (uint8_t)(1 << (engine - 1));
+	}
+}
+
+uint32_t LP5562TimingAnalyzer::getTolerancePpm() const {
+	if (tolerancePpm != 0) {
+		return tolerancePpm;
+	}
+	return getDefaultTolerancePpm(useExternalOscillator);
+}
+
+const LP5562TimingAnalyzer::EngineTiming *LP5562TimingAnalyzer::getEngineTiming(size_t engine) const {
+	if (engine < 1 || engine > 3) {
+		return NULL;
+	}
+	return &result.engines[engine - 1];
+}
@@ -0,0 +1,394 @@
+#ifndef __LP5562_RK_TIMING_H
+#define __LP5562_RK_TIMING_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Sim.h"
+
+/**
+ * @brief Calculates the exact loop period of engine programs and the phase between engines
+ *
+ * The programs are executed by the engine model from LP5562SimEngines (as fast as possible, not in
+ * real time) until the state of the engines repeats. Since the engines are driven by a 32.768 kHz
+ * clock, the period found this way is exact, including prescale, nested branch loop counts, and
+ * engines that wait for triggers from each other.
+ *
+ * LP5562TimingAnalyzer analyzer;
+ * analyzer.withProgram(1, program1).withProgram(2, program2);
+ * if (analyzer.analyze().success) {
+ *     double ms = analyzer.getPeriodMs(1);
+ * }
+ *
+ * Engines that don't use trigger instructions are analyzed separately, so each has its own period.
+ * Engines that use triggers are analyzed together and share the period of the group.
+ *
+ * The loop boundaries of an engine are the times its program goes back to step 0 with no branch loop
+ * in progress, so a branch to step 0 that's still counting isn't one. They're measured
+ * from the time the engines were started together, which lets you schedule a change at the end of
+ * a loop, or keep the patterns on several boards in step, using only the elapsed time and not reading
+ * the PC registers. The internal oscillator of the LP5562 is not as accurate as an external 32.768 kHz
+ * crystal, so getPeriodRangeMicros() widens the period by the clock tolerance.
+ */
+class LP5562TimingAnalyzer : protected LP5562SimEngines {
+public:
+	/**
+	 * @brief What an engine does in the long run
+	 */
+	enum Behavior {
+		BEHAVIOR_NOT_RUNNING = 0,	//!< No program was set for the engine
+		BEHAVIOR_PERIODIC,			//!< The program repeats forever with periodTicks
+		BEHAVIOR_ENDS,				//!< The program executes an End instruction at endTicks
+		BEHAVIOR_DEADLOCK			//!< The program is stuck forever on a trigger from endTicks
+	};
+
+	/**
+	 * @brief Timing of one engine
+	 */
+	struct EngineTiming {
+		uint8_t behavior;			//!< Behavior
+		bool synchronized;			//!< Uses trigger instructions, so it was analyzed together with the other engines that do
+		bool hasLoopBoundary;		//!< The program goes back to step 0 in every period
+		uint64_t periodTicks;		//!< Length of the period in ticks (BEHAVIOR_PERIODIC)
+		uint64_t transientTicks;	//!< Time from the start until the periodic part begins, in ticks
+		uint64_t firstLoopTicks;	//!< First loop boundary at or after transientTicks (hasLoopBoundary)
+		uint64_t endTicks;			//!< Time the engine stopped (BEHAVIOR_ENDS or BEHAVIOR_DEADLOCK)
+	};
+
+	/**
+	 * @brief Outcome of analyze()
+	 */
+	struct Result {
+		bool success;				//!< true if all engines were analyzed
+		const char *error;			//!< Reason for failure, or NULL on success
+		uint64_t periodTicks;		//!< Period of all periodic engines together (least common multiple), 0 if none or too large
+		EngineTiming engines[3];	//!< Timing of engines 1 - 3 (index 0 is engine 1)
+	};
+
+	/**
+	 * @brief Construct an analyzer with no programs
+	 */
+	LP5562TimingAnalyzer();
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562TimingAnalyzer();
+
+	/**
+	 * @brief Set the program for an engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param instructions The instruction words. They're copied.
+	 *
+	 * @param numInstructions Number of instructions (1 - 16). The rest of engine memory is 0x0000 (go to start),
+	 * the same as LP5562::setProgram().
+	 */
+	LP5562TimingAnalyzer &withProgram(size_t engine, const uint16_t *instructions, size_t numInstructions);
+
+	/**
+	 * @brief Set the program for an engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param program The program. It's copied.
+	 */
+	LP5562TimingAnalyzer &withProgram(size_t engine, const LP5562Program &program) { return withProgram(engine, program.getInstructions(), program.getStepNum()); };
+
+	/**
+	 * @brief Remove all programs
+	 */
+	LP5562TimingAnalyzer &clearPrograms();
+
+	/**
+	 * @brief Set external oscillator mode. Default is internal. This only affects getPeriodRangeMicros().
+	 *
+	 * Use withUseExternalOscillator(ledDriver.getUseExternalOscillator()) to match the driver settings.
+	 */
+	LP5562TimingAnalyzer &withUseExternalOscillator(bool value = true) { useExternalOscillator = value; return *this; };
+
+	/**
+	 * @brief Set the accuracy of the clock in parts per million, instead of the default for the oscillator mode
+	 *
+	 * The default is DEFAULT_INTERNAL_TOLERANCE_PPM with the internal oscillator and DEFAULT_EXTERNAL_TOLERANCE_PPM
+	 * with an external one. Check the datasheet of your crystal, or of the LP5562 for the temperature range you use.
+	 */
+	LP5562TimingAnalyzer &withClockTolerancePpm(uint32_t ppm) { tolerancePpm = ppm; return *this; };
+
+	/**
+	 * @brief Set the maximum number of engine steps to simulate for each analysis. Default is 1,000,000.
+	 *
+	 * Each ramp step, wait, and trigger counts as one. Programs with deeply nested loops can need more.
+	 */
+	LP5562TimingAnalyzer &withMaxSteps(uint32_t value) { maxSteps = value; return *this; };
+
+	/**
+	 * @brief Run the programs and calculate the timing
+	 *
+	 * @return The result, which is also available from getResult()
+	 *
+	 * Fails if an engine loops forever without a ramp or wait, since the period would only come from the
+	 * way the engine model stalls zero-time loops, not from the chip.
+	 */
+	const Result &analyze();
+
+	/**
+	 * @brief Get the result of the last analyze()
+	 */
+	const Result &getResult() const { return result; };
+
+	/**
+	 * @brief Get the period of an engine in milliseconds, or 0 if it's not periodic
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	double getPeriodMs(size_t engine) const;
+
+	/**
+	 * @brief Get the period of an engine in microseconds (rounded to nearest), or 0 if it's not periodic
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 */
+	uint64_t getPeriodMicros(size_t engine) const;
+
+	/**
+	 * @brief Get the shortest and longest period of an engine allowed by the clock tolerance
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param minMicros Filled in with the shortest period in microseconds
+	 *
+	 * @param maxMicros Filled in with the longest period in microseconds
+	 *
+	 * @return false if the engine is not periodic
+	 */
+	bool getPeriodRangeMicros(size_t engine, uint64_t &minMicros, uint64_t &maxMicros) const;
+
+	/**
+	 * @brief Get the time from a loop boundary of the reference engine to the next loop boundary of engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param reference An engine number 1 <= engine <= 3
+	 *
+	 * @return The phase in ticks (0 <= phase < period of engine), or -1 if either engine has no loop boundary
+	 *
+	 * When the two engines have the same period this is constant. Otherwise it's the phase at the first loop
+	 * boundary of reference in its periodic part.
+	 */
+	int64_t getPhaseTicks(size_t engine, size_t reference) const;
+
+	/**
+	 * @brief Get the time of the next loop boundary of an engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param elapsedTicks Time since the engines were started
+	 *
+	 * @return The time of the first loop boundary at or after elapsedTicks, measured from the time
+	 * the engines were started, or 0 if the engine has no loop boundary
+	 */
+	uint64_t getNextLoopBoundaryTicks(size_t engine, uint64_t elapsedTicks) const;
+
+	/**
+	 * @brief Get the time of the next loop boundary of an engine in milliseconds
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param elapsedMs Time since the engines were started in milliseconds
+	 *
+	 * @return The time of the first loop boundary at or after elapsedMs in milliseconds (rounded up), measured
+	 * from the time the engines were started, or 0 if the engine has no loop boundary
+	 */
+	unsigned long getNextLoopBoundaryMs(size_t engine, unsigned long elapsedMs) const;
+
+	/**
+	 * @brief Find where to start an engine so it looks like it has been running for a given time
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param elapsedTicks The time into the program to start at
+	 *
+	 * @param pc Filled in with the step number to start from, for LP5562::startProgramAt()
+	 *
+	 * @param startTicks Filled in with the time into the program that starting at pc corresponds to. This is
+	 * the latest usable instruction boundary at or before elapsedTicks (after reducing it by whole periods).
+	 *
+	 * @return false if the engine has no program or uses trigger instructions
+	 *
+	 * A step is only used if no branch loop is in progress at that point and it's a Set PWM instruction, since
+	 * the PWM level of an engine can't be set from outside. Step 0
+	 * at a loop boundary can always be used. Call analyze() first so long times are reduced to one period.
+	 */
+	bool getStartPoint(size_t engine, uint64_t elapsedTicks, uint8_t &pc, uint64_t &startTicks);
+
+	/**
+	 * @brief Find the time an engine is executing a step, nearest to a time into the program
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param nearTicks The predicted time into the program
+	 *
+	 * @param pc The step number, usually read from the chip with LP5562::getProgramCounters()
+	 *
+	 * @param fromTicks Filled in with the time the engine starts executing the step
+	 *
+	 * @param toTicks Filled in with the time the engine moves on from the step
+	 *
+	 * @return false if the engine has no program, uses trigger instructions, or doesn't spend any time at pc
+	 *
+	 * The actual time into the program is somewhere from fromTicks to toTicks, which corrects a prediction
+	 * made from the time since the program was started. Call analyze() first.
+	 */
+	bool getStepInterval(size_t engine, uint64_t nearTicks, uint8_t pc, uint64_t &fromTicks, uint64_t &toTicks);
+
+	/**
+	 * @brief Returns the default clock tolerance in ppm for an oscillator mode
+	 *
+	 * @param useExternalOscillator true for an external 32.768 kHz crystal, false for the internal oscillator
+	 */
+	static uint32_t getDefaultTolerancePpm(bool useExternalOscillator) { return useExternalOscillator ? DEFAULT_EXTERNAL_TOLERANCE_PPM : DEFAULT_INTERNAL_TOLERANCE_PPM; };
+
+	/**
+	 * @brief Default internal oscillator tolerance (4%)
+	 */
+	static const uint32_t DEFAULT_INTERNAL_TOLERANCE_PPM = 40000;
+
+	/**
+	 * @brief Default external crystal tolerance (50 ppm)
+	 */
+	static const uint32_t DEFAULT_EXTERNAL_TOLERANCE_PPM = 50;
+
+protected:
+	/**
+	 * @brief Complete state of the engines at one point in time
+	 */
+	struct Snapshot {
+		Engine engines[3];			//!< Engine state
+		uint64_t now;				//!< Time in ticks
+	};
+
+	/**
+	 * @brief Returns true if the instruction of engine at pc sets the PWM level, or goes to step 0
+	 */
+	bool isLevelSetAt(size_t engine, uint8_t pc) const;
+
+	/**
+	 * @brief Analyze a group of engines that run together
+	 *
+	 * @param mask Bit mask of engine indexes (bit 0 = engine 1) to run
+	 *
+	 * @return NULL on success or an error message
+	 */
+	const char *analyzeGroup(uint8_t mask);
+
+	/**
+	 * @brief Start the engines in mask from step 0 at time 0
+	 */
+	void startGroup(uint8_t mask);
+
+	/**
+	 * @brief Run until the next ramp or wait step completes
+	 *
+	 * @return false if no engine in the group is executing a timed instruction, so nothing will ever change again
+	 */
+	bool nextStep();
+
+	/**
+	 * @brief Clear state that doesn't affect the future, so equal states compare equal
+	 */
+	void normalize();
+
+	/**
+	 * @brief Save the engine state to snapshot
+	 */
+	void save(Snapshot &snapshot) const;
+
+	/**
+	 * @brief Restore the engine state from snapshot
+	 */
+	void restore(const Snapshot &snapshot);
+
+	/**
+	 * @brief Returns true if the engine state is the same as snapshot, not including the time
+	 */
+	bool isSameState(const Snapshot &snapshot) const;
+
+	/**
+	 * @brief Mark engines in mask that were stopped when the group stopped changing
+	 */
+	void setStopped(uint8_t mask);
+
+	/**
+	 * @brief Records loop boundaries while measuring the periodic part
+	 */
+	virtual void onEngineLoop(size_t engine);
+
+	/**
+	 * @brief Records the time of End instructions
+	 */
+	virtual void onEngineEnd(size_t engine, bool interrupt);
+
+	/**
+	 * @brief Records stalls while measuring the periodic part
+	 */
+	virtual void onEngineStall(size_t engine);
+
+	/**
+	 * @brief Returns the clock tolerance in ppm for the oscillator mode
+	 */
+	uint32_t getTolerancePpm() const;
+
+	/**
+	 * @brief Returns the engine timing for an engine number, or NULL if out of range
+	 */
+	const EngineTiming *getEngineTiming(size_t engine) const;
+
+	/**
+	 * @brief Program memory for all three engines, in the same layout as registers 0x10 - 0x6f
+	 */
+	uint8_t memory[96];
+
+	/**
+	 * @brief Bit mask of engine indexes that have a program
+	 */
+	uint8_t programMask = 0;
+
+	/**
+	 * @brief Use external oscillator tolerance in getPeriodRangeMicros()
+	 */
+	bool useExternalOscillator = false;
+
+	/**
+	 * @brief Clock tolerance set by withClockTolerancePpm(), or 0 to use the default
+	 */
+	uint32_t tolerancePpm = 0;
+
+	/**
+	 * @brief Maximum number of steps to simulate for each group
+	 */
+	uint32_t maxSteps = 1000000;
+
+	/**
+	 * @brief Only record loop boundaries at or after this time
+	 */
+	uint64_t recordFrom = 0;
+
+	/**
+	 * @brief Recording loop boundaries
+	 */
+	bool recording = false;
+
+	/**
+	 * @brief Bit mask of engine indexes that stalled while recording
+	 */
+	uint8_t stallMask = 0;
+
+	/**
+	 * @brief Result of the last analyze()
+	 */
+	Result result;
+};
+
+#endif /* __LP5562_RK_TIMING_H */
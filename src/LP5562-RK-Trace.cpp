@@ -0,0 +1,279 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK-Trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Size of the header of a binary trace
+static const size_t BINARY_HEADER_SIZE = 8;
+
+// Size of an entry in a binary trace, not including the data bytes
+static const size_t BINARY_ENTRY_SIZE = 10;
+
+LP5562TraceTransport::LP5562TraceTransport(LP5562Transport &next, Entry *buffer, size_t numEntries) :
+	nextTransport(next), buffer(buffer), numEntries(numEntries) {
+
+}
+
+LP5562TraceTransport::~LP5562TraceTransport() {
+
+}
+
+void LP5562TraceTransport::begin() {
+	nextTransport.begin();
+}
+
+bool LP5562TraceTransport::writeRegisters(uint8_t addr, uint8_t reg, const uint8_t *values, size_t numValues) {
+	unsigned long startMicros = micros();
+
+	bool bResult = nextTransport.writeRegisters(addr, reg, values, numValues);
+
+	if (enabled) {
+		record(startMicros, addr, reg, false, bResult, values, numValues);
+	}
+	return bResult;
+}
+
+bool LP5562TraceTransport::readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues) {
+	unsigned long startMicros = micros();
+
+	bool bResult = nextTransport.readRegisters(addr, reg, values, numValues);
+
+	if (enabled) {
+		record(startMicros, addr, reg, true, bResult, values, numValues);
+	}
+	return bResult;
+}
+
+const LP5562TraceTransport::Entry *LP5562TraceTransport::getEntry(size_t index) const {
+	if (index >= count) {
+		return NULL;
+	}
+	// When the buffer is full, next is also the index of the oldest entry
+	size_t oldest = (count < numEntries) ? 0 : next;
+	return &buffer[(oldest + index) % numEntries];
+}
+
+// static
+void LP5562TraceTransport::formatEntry(const Entry &entry, char *buf, size_t bufSize, bool withTimes) {
+	if (bufSize == 0) {
+		return;
+	}
+
+	size_t offset = 0;
+	int len;
+
+	if (withTimes) {
+		len = snprintf(buf, bufSize, "%10lu %5u ", (unsigned long)entry.micros, (unsigned)entry.durationMicros);
+	}
+	else {
+		len = 0;
+		buf[0] = 0;
+	}
+	if (len > 0) {
+		offset += (size_t)len;
+	}
+
+	if (offset < bufSize) {
+		len = snprintf(&buf[offset], bufSize - offset, "%c %02x reg=%02x %s",
+				(entry.flags & FLAG_READ) ? 'R' : 'W', entry.addr, entry.reg,
+				(entry.flags & FLAG_SUCCESS) ? "ok  " : "FAIL");
+		if (len > 0) {
+			offset += (size_t)len;
+		}
+	}
+
+	for(size_t ii = 0; ii < entry.numValues && offset < bufSize; ii++) {
+		len = snprintf(&buf[offset], bufSize - offset, " %02x", entry.values[ii]);
+		if (len > 0) {
+			offset += (size_t)len;
+		}
+	}
+}
+
+size_t LP5562TraceTransport::getBinarySize() const {
+	size_t size = BINARY_HEADER_SIZE;
+
+	for(size_t ii = 0; ii < count; ii++) {
+		size += BINARY_ENTRY_SIZE + getEntry(ii)->numValues;
+	}
+	return size;
+}
+
+size_t LP5562TraceTransport::writeBinary(uint8_t *buf, size_t bufSize) const {
+	if (bufSize < BINARY_HEADER_SIZE) {
+		return 0;
+	}
+
+	size_t offset = BINARY_HEADER_SIZE;
+	uint32_t numWritten = 0;
+
+	for(size_t ii = 0; ii < count; ii++) {
+		const Entry *entry = getEntry(ii);
+		if (offset + BINARY_ENTRY_SIZE + entry->numValues > bufSize) {
+			break;
+		}
+
+		uint8_t *p = &buf[offset];
+		p[0] = (uint8_t) entry->micros;
+		p[1] = (uint8_t)(entry->micros >> 8);
+		p[2] = (uint8_t)(entry->micros >> 16);
+		p[3] = (uint8_t)(entry->micros >> 24);
+		p[4] = (uint8_t) entry->durationMicros;
+		p[5] = (uint8_t)(entry->durationMicros >> 8);
+		p[6] = entry->addr;
+		p[7] = entry->reg;
+		p[8] = entry->flags;
+		p[9] = entry->numValues;
+		memcpy(&p[BINARY_ENTRY_SIZE], entry->values, entry->numValues);
+
+		offset += BINARY_ENTRY_SIZE + entry->numValues;
+		numWritten++;
+	}
+
+	buf[0] = 'L';
+	buf[1] = 'P';
+	buf[2] = 'T';
+	buf[3] = '1';
+	buf[4] = (uint8_t) numWritten;
+	buf[5] = (uint8_t)(numWritten >> 8);
+	buf[6] = (uint8_t)(numWritten >> 16);
+	buf[7] = (uint8_t)(numWritten >> 24);
+
+	return offset;
+}
+
+void LP5562TraceTransport::record(uint32_t startMicros, uint8_t addr, uint8_t reg, bool isRead, bool success, const uint8_t *values, size_t numValues) {
+	if (numEntries == 0) {
+		return;
+	}
+
+	uint32_t durationMicros = (uint32_t)micros() - startMicros;
+
+	Entry &entry = buffer[next];
+	entry.micros = startMicros;
+	entry.durationMicros = (durationMicros > 0xffff) ? 0xffff : (uint16_t) durationMicros;
+	entry.addr = addr;
+	entry.reg = reg;
+	entry.flags = (isRead ? FLAG_READ : 0) | (success ? FLAG_SUCCESS : 0);
+
+	if (numValues > sizeof(entry.values)) {
+		numValues = sizeof(entry.values);
+	}
+	entry.numValues = (uint8_t) numValues;
+	memcpy(entry.values, values, numValues);
+
+	if (++next >= numEntries) {
+		next = 0;
+	}
+	if (count < numEntries) {
+		count++;
+	}
+	totalRecorded++;
+}
+
+
+LP5562TraceReplayer::LP5562TraceReplayer(const uint8_t *data, size_t size) : data(data), size(size) {
+
+}
+
+LP5562TraceReplayer::~LP5562TraceReplayer() {
+
+}
+
+bool LP5562TraceReplayer::isValid() const {
+	return size >= BINARY_HEADER_SIZE && data[0] == 'L' && data[1] == 'P' && data[2] == 'T' && data[3] == '1';
+}
+
+uint32_t LP5562TraceReplayer::getNumEntries() const {
+	if (!isValid()) {
+		return 0;
+	}
+	return (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+}
+
+bool LP5562TraceReplayer::getEntry(uint32_t index, LP5562TraceTransport::Entry &entry) {
+	if (index >= getNumEntries()) {
+		return false;
+	}
+
+	if (index < cursorIndex) {
+		// Entries are variable length, so start over from the first one
+		cursorIndex = 0;
+		cursorOffset = BINARY_HEADER_SIZE;
+	}
+
+	while(true) {
+		if (cursorOffset + BINARY_ENTRY_SIZE > size) {
+			return false;
+		}
+		const uint8_t *p = &data[cursorOffset];
+		size_t numValues = p[9];
+		if (numValues > sizeof(entry.values) || cursorOffset + BINARY_ENTRY_SIZE + numValues > size) {
+			return false;
+		}
+
+		if (cursorIndex == index) {
+			entry.micros = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+			entry.durationMicros = (uint16_t)(p[4] | (p[5] << 8));
+			entry.addr = p[6];
+			entry.reg = p[7];
+			entry.flags = p[8];
+			entry.numValues = (uint8_t) numValues;
+			memcpy(entry.values, &p[BINARY_ENTRY_SIZE], numValues);
+			return true;
+		}
+
+		cursorOffset += BINARY_ENTRY_SIZE + numValues;
+		cursorIndex++;
+	}
+}
+
+bool LP5562TraceReplayer::replay(LP5562Transport &transport) {
+	readMismatches = 0;
+	failures = 0;
+
+	if (!isValid()) {
+		return false;
+	}
+
+	uint32_t numEntries = getNumEntries();
+	uint32_t lastMicros = 0;
+
+	for(uint32_t ii = 0; ii < numEntries; ii++) {
+		LP5562TraceTransport::Entry entry;
+		if (!getEntry(ii, entry)) {
+			return false;
+		}
+
+		if (timeCallback && ii > 0) {
+			timeCallback(entry.micros - lastMicros, timeContext);
+		}
+		lastMicros = entry.micros;
+
+		if ((entry.flags & LP5562TraceTransport::FLAG_SUCCESS) == 0) {
+			// The chip didn't get it either
+			continue;
+		}
+
+		if (entry.flags & LP5562TraceTransport::FLAG_READ) {
+			uint8_t values[sizeof(entry.values)];
+			if (!transport.readRegisters(entry.addr, entry.reg, values, entry.numValues)) {
+				failures++;
+			}
+			else
+			if (memcmp(values, entry.values, entry.numValues) != 0) {
+				readMismatches++;
+			}
+		}
+		else {
+			if (!transport.writeRegisters(entry.addr, entry.reg, entry.values, entry.numValues)) {
+				failures++;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,317 @@
+#ifndef __LP5562_RK_TRACE_H
+#define __LP5562_RK_TRACE_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+#include "LP5562-RK.h"
+
+/**
+ * @brief Transport that records every I2C transaction into a ring buffer, then passes it on
+ *
+ * Put it between the LP5562 and the real transport:
+ *
+ * LP5562WireTransport wireTransport(Wire);
+ * LP5562TraceTransport::Entry traceBuffer[64];
+ * LP5562TraceTransport trace(wireTransport, traceBuffer, 64);
+ * LP5562 ledDriver(0x30, trace);
+ *
+ * Recording is a copy of the transaction into the buffer and two calls to micros(), so it can be left
+ * on in the field. When the buffer is full, the oldest entries are overwritten. The trace can be
+ * printed with formatEntry(), or saved with writeBinary() and replayed on a computer with
+ * LP5562TraceReplayer.
+ *
+ * The buffer is not locked. If LP5562Async is used, read the trace when the queue is empty, or
+ * call setEnabled(false) first.
+ */
+class LP5562TraceTransport : public LP5562Transport {
+public:
+	/**
+	 * @brief One recorded transaction
+	 */
+	struct Entry {
+		uint32_t micros;			//!< Value of micros() when the transaction started
+		uint16_t durationMicros;	//!< Time the transaction took in microseconds (65535 if longer)
+		uint8_t addr;				//!< I2C address
+		uint8_t reg;				//!< First register address
+		uint8_t flags;				//!< FLAG_READ and FLAG_SUCCESS
+		uint8_t numValues;			//!< Number of data bytes
+		uint8_t values[32];			//!< Data bytes written or read
+	};
+
+	/**
+	 * @brief Construct the recorder
+	 *
+	 * @param next The transport that does the actual I2C transactions
+	 *
+	 * @param buffer Ring buffer of entries. It's not copied, so it must remain valid; it's typically a
+	 * global variable.
+	 *
+	 * @param numEntries Number of entries in buffer
+	 */
+	LP5562TraceTransport(LP5562Transport &next, Entry *buffer, size_t numEntries);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562TraceTransport();
+
+	/**
+	 * @brief Calls begin() of the next transport
+	 */
+	virtual void begin();
+
+	/**
+	 * @brief Passes the write to the next transport and records it
+	 */
+	virtual bool writeRegisters(uint8_t addr, uint8_t reg, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Passes the read to the next transport and records it
+	 */
+	virtual bool readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Start or stop recording. Transactions are passed on either way. Default is enabled.
+	 */
+	void setEnabled(bool value) { enabled = value; };
+
+	/**
+	 * @brief Returns true if recording is enabled
+	 */
+	bool getEnabled() const { return enabled; };
+
+	/**
+	 * @brief Forget all recorded entries
+	 */
+	void clear() { count = 0; next = 0; totalRecorded = 0; };
+
+	/**
+	 * @brief Get the number of entries in the buffer (at most numEntries)
+	 */
+	size_t getNumEntries() const { return count; };
+
+	/**
+	 * @brief Get the number of transactions recorded since construction or clear(), including those that
+	 * were overwritten
+	 */
+	uint32_t getTotalRecorded() const { return totalRecorded; };
+
+	/**
+	 * @brief Get an entry
+	 *
+	 * @param index 0 is the oldest entry in the buffer, getNumEntries() - 1 the most recent
+	 *
+	 * @return The entry, or NULL if index is out of range
+	 */
+	const Entry *getEntry(size_t index) const;
+
+	/**
+	 * @brief Format an entry as one line of text
+	 *
+	 * @param entry The entry
+	 *
+	 * @param buf Buffer to write to. It's always null terminated.
+	 *
+	 * @param bufSize Size of buf in bytes. 128 bytes is enough for any entry.
+	 *
+	 * @param withTimes Include the time and duration. Leave them out to compare two traces with a diff tool.
+	 *
+	 * For example: "   1203456   112 W 30 reg=00 ok   40", time and duration in microseconds
+	 */
+	static void formatEntry(const Entry &entry, char *buf, size_t bufSize, bool withTimes = true);
+
+	/**
+	 * @brief Get the number of bytes writeBinary() needs for the entries in the buffer
+	 */
+	size_t getBinarySize() const;
+
+	/**
+	 * @brief Save the entries in the buffer in a compact binary format, oldest first
+	 *
+	 * @param buf Buffer to write to
+	 *
+	 * @param bufSize Size of buf in bytes
+	 *
+	 * @return Number of bytes written. Entries that don't fit are left out.
+	 *
+	 * The format is an 8-byte header ("LPT1" and the number of entries, little endian) followed by each
+	 * entry: micros (4 bytes), durationMicros (2 bytes), addr, reg, flags, numValues, then the data bytes.
+	 * Multi-byte values are little endian.
+	 */
+	size_t writeBinary(uint8_t *buf, size_t bufSize) const;
+
+	static const uint8_t FLAG_READ = 0x01;		//!< Entry flag for a read (otherwise a write)
+	static const uint8_t FLAG_SUCCESS = 0x02;	//!< Entry flag for a transaction that succeeded
+
+protected:
+	/**
+	 * @brief Add a transaction to the ring buffer
+	 */
+	void record(uint32_t startMicros, uint8_t addr, uint8_t reg, bool isRead, bool success, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief The transport that does the actual I2C transactions
+	 */
+	LP5562Transport &nextTransport;
+
+	/**
+	 * @brief Ring buffer (not owned)
+	 */
+	Entry *buffer;
+
+	/**
+	 * @brief Number of entries in buffer
+	 */
+	size_t numEntries;
+
+	/**
+	 * @brief Number of entries used
+	 */
+	size_t count = 0;
+
+	/**
+	 * @brief Index in buffer to write the next entry to
+	 */
+	size_t next = 0;
+
+	/**
+	 * @brief Transactions recorded since construction or clear()
+	 */
+	uint32_t totalRecorded = 0;
+
+	/**
+	 * @brief Recording is enabled
+	 */
+	bool enabled = true;
+};
+
+/**
+ * @brief Reads a trace saved by LP5562TraceTransport::writeBinary() and sends it to a transport
+ *
+ * On a computer, replaying a trace from the field into LP5562Simulator shows what the LEDs did:
+ *
+ * LP5562Simulator sim;
+ * LP5562TraceReplayer replayer(traceData, traceSize);
+ * replayer.withTimeCallback(advanceSim, &sim);
+ * replayer.replay(sim);
+ *
+ * Writes are sent to the transport as they were recorded. Reads are done too, so a simulator sees the
+ * same side effects (like clearing the status register), and the values are compared with the ones
+ * recorded. Transactions that failed when recorded are skipped.
+ */
+class LP5562TraceReplayer {
+public:
+	/**
+	 * @brief Called before each transaction with the time since the previous one
+	 *
+	 * @param deltaMicros Microseconds from the start of the previous transaction to the start of this one
+	 *
+	 * @param context The context passed to withTimeCallback()
+	 */
+	typedef void (*TimeCallback)(uint32_t deltaMicros, void *context);
+
+	/**
+	 * @brief Construct a replayer for a binary trace
+	 *
+	 * @param data The trace. It's not copied, so it must remain valid.
+	 *
+	 * @param size Size of the trace in bytes
+	 */
+	LP5562TraceReplayer(const uint8_t *data, size_t size);
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562TraceReplayer();
+
+	/**
+	 * @brief Set a function to call with the time between transactions, for example to advance a simulator
+	 */
+	LP5562TraceReplayer &withTimeCallback(TimeCallback callback, void *context = NULL) { timeCallback = callback; timeContext = context; return *this; };
+
+	/**
+	 * @brief Returns true if the header is valid
+	 */
+	bool isValid() const;
+
+	/**
+	 * @brief Get the number of entries in the trace, from the header
+	 */
+	uint32_t getNumEntries() const;
+
+	/**
+	 * @brief Get an entry
+	 *
+	 * @param index 0 <= index < getNumEntries()
+	 *
+	 * @param entry Filled in with the entry
+	 *
+	 * @return false if index is out of range or the trace is truncated
+	 *
+	 * Entries are variable length, so this is fastest when called with increasing indexes.
+	 */
+	bool getEntry(uint32_t index, LP5562TraceTransport::Entry &entry);
+
+	/**
+	 * @brief Send all of the transactions in the trace to a transport
+	 *
+	 * @param transport The transport, typically LP5562Simulator
+	 *
+	 * @return false if the trace is not valid or truncated
+	 */
+	bool replay(LP5562Transport &transport);
+
+	/**
+	 * @brief Number of reads in the last replay() that returned different values than recorded
+	 */
+	uint32_t getReadMismatches() const { return readMismatches; };
+
+	/**
+	 * @brief Number of transactions in the last replay() that failed on the transport but not when recorded
+	 */
+	uint32_t getFailures() const { return failures; };
+
+protected:
+	/**
+	 * @brief The trace (not owned)
+	 */
+	const uint8_t *data;
+
+	/**
+	 * @brief Size of the trace in bytes
+	 */
+	size_t size;
+
+	/**
+	 * @brief Index of the entry at offset, for sequential getEntry() calls
+	 */
+	uint32_t cursorIndex = 0;
+
+	/**
+	 * @brief Offset in data of the entry cursorIndex
+	 */
+	size_t cursorOffset = 8;
+
+	/**
+	 * @brief Called with the time between transactions
+	 */
+	TimeCallback timeCallback = NULL;
+
+	/**
+	 * @brief Context for timeCallback
+	 */
+	void *timeContext = NULL;
+
+	/**
+	 * @brief Reads that returned different values in the last replay()
+	 */
+	uint32_t readMismatches = 0;
+
+	/**
+	 * @brief Transactions that failed in the last replay()
+	 */
+	uint32_t failures = 0;
+};
+
+#endif /* __LP5562_RK_TRACE_H */
@@ -3,11 +3,77 @@
 
 #include "LP5562-RK.h"
 
-LP5562::LP5562(uint8_t addr, TwoWire &wire) : addr(addr), wire(wire) {
+#ifdef ENABLE_PROGRAM_VALIDATION
+#include "LP5562-RK-Disasm.h"
+#endif
+
+// Counting for withStats(). Without LP5562_ENABLE_STATS these expand to nothing.
+#ifdef LP5562_ENABLE_STATS
+#define LP5562_STATS_SCOPE(method) LP5562Stats::Scope statsScope(stats, LP5562Stats::method)
+#define LP5562_STATS_TRANSACTION(numValues, success) do { if (stats) { stats->countTransaction(numValues, success); } } while(0)
+#else
+#define LP5562_STATS_SCOPE(method)
+#define LP5562_STATS_TRANSACTION(numValues, success)
+#endif
+
+#if defined(PARTICLE)
+void LP5562WireTransport::begin() {
+	// Initialize the I2C bus in standard master mode.
+	wire.begin();
+}
+
+bool LP5562WireTransport::writeRegisters(uint8_t addr, uint8_t reg, const uint8_t *values, size_t numValues) {
+	wire.beginTransmission(addr);
+	wire.write(reg);
+	for(size_t ii = 0; ii < numValues; ii++) {
+		wire.write(values[ii]);
+	}
+
+	int stat = wire.endTransmission(true);
+
+	return (stat == 0);
+}
+
+bool LP5562WireTransport::readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues) {
+	wire.beginTransmission(addr);
+	wire.write(reg);
+	if (wire.endTransmission(false) != 0) {
+		return false;
+	}
+
+	if (wire.requestFrom(addr, (uint8_t) numValues, (uint8_t) true) != numValues) {
+		return false;
+	}
+	for(size_t ii = 0; ii < numValues; ii++) {
+		values[ii] = (uint8_t) wire.read();
+	}
+	return true;
+}
+
+LP5562::LP5562(uint8_t addr, TwoWire &wire) : addr(addr), wireTransport(wire), transport(wireTransport) {
 	if (addr < 0x4) {
 		// Just passed in 0 - 3, add in the 0x30 automatically to make addresses 0x30 - 0x33
-		addr |= 0x30;
+		this->addr |= 0x30;
 	}
+	invalidateShadow();
+}
+#endif /* PARTICLE */
+
+// Engine clock used by LP5562Program::solveDelay()
+static const int64_t DELAY_TICKS_PER_SECOND = 32768;
+static const int64_t DELAY_PRESCALE0_TICKS = 16;
+static const int64_t DELAY_PRESCALE1_TICKS = 512;
+
+LP5562::LP5562(uint8_t addr, LP5562Transport &transport) : addr(addr),
+#if defined(PARTICLE)
+		wireTransport(Wire),
+#endif
+		transport(transport) {
+	if (addr < 0x4) {
+		// Just passed in 0 - 3, add in the 0x30 automatically to make addresses 0x30 - 0x33
+		this->addr |= 0x30;
+	}
+	invalidateShadow();
 }
 
 LP5562::~LP5562() {
@@ -35,8 +101,18 @@ uint8_t LP5562::floatToCurrent(float value) const {
 }
 
 bool LP5562::begin() {
-	// Initialize the I2C bus in standard master mode.
-	wire.begin();
+	LP5562_STATS_SCOPE(METHOD_BEGIN);
+
+	// Initialize the I2C bus
+	transport.begin();
+
+	warmStarted = false;
+	if (warmStart) {
+		bool bResult = beginWarm();
+		if (!bResult || warmStarted) {
+			return bResult;
+		}
+	}
 
 	// Reset chip - reset all registers to default values. Note that resetting the MCU won't reset
 	// the values in the chip, so it's a good idea to do this in begin().
@@ -45,6 +121,9 @@ bool LP5562::begin() {
 		return false;
 	}
 
+	// All registers are now at their power-on defaults, so the shadow is fully known without reading
+	resetShadow();
+
 	// Set current level. The hardware default is 17.8 mA, but we default to 5 mA in software. You can
 	// override this with the withLEDCurrent methods. Be sure to do this before enabling the chip!
 	bResult = writeRegister(REG_R_CURRENT, redCurrent);
@@ -88,14 +167,7 @@ bool LP5562::begin() {
 	delayMicroseconds(500);
 
 	// Enable clock
-	value = 0x00;
-	if (!useExternalOscillator) {
-		value |= REG_CONFIG_INT_CLK_EN;
-	}
-	if (highFrequencyMode) {
-		value |= REG_CONFIG_HF;
-	}
-	bResult = writeRegister(REG_CONFIG, value);
+	bResult = writeRegister(REG_CONFIG, getConfigValue());
 	if (!bResult) {
 		return false;
 	}
@@ -109,6 +181,78 @@ bool LP5562::begin() {
 	return true;
 }
 
+bool LP5562::beginWarm() {
+	// Nothing is known about the chip after an MCU reset. Status is skipped so pending interrupts are
+	// not cleared.
+	invalidateShadow();
+
+	uint8_t values[REG_STATUS - REG_ENABLE];
+	uint8_t white[2];
+	uint8_t ledMap;
+	if (!readRegisters(REG_ENABLE, values, sizeof(values)) ||
+		!readRegisters(REG_W_PWM, white, sizeof(white)) ||
+		!readRegisters(REG_LED_MAP, &ledMap, 1)) {
+		return false;
+	}
+
+	if ((values[REG_ENABLE] & REG_ENABLE_CHIP_EN) == 0) {
+		// Power cycled or never set up, so do the full begin()
+		return true;
+	}
+
+	// Only the configuration is changed. The engines, LED mapping, and PWM levels are left alone so
+	// the pattern that's showing keeps running.
+	beginBatch();
+
+	if (values[REG_R_CURRENT] != redCurrent) {
+		writeRegister(REG_R_CURRENT, redCurrent);
+	}
+	if (values[REG_G_CURRENT] != greenCurrent) {
+		writeRegister(REG_G_CURRENT, greenCurrent);
+	}
+	if (values[REG_B_CURRENT] != blueCurrent) {
+		writeRegister(REG_B_CURRENT, blueCurrent);
+	}
+	if (white[REG_W_CURRENT - REG_W_PWM] != whiteCurrent) {
+		writeRegister(REG_W_CURRENT, whiteCurrent);
+	}
+	if (values[REG_CONFIG] != getConfigValue()) {
+		writeRegister(REG_CONFIG, getConfigValue());
+	}
+
+	if (!commit()) {
+		return false;
+	}
+
+	uint8_t logEnable = useLogarithmicMode ? REG_ENABLE_LOG_EN : 0;
+	if ((values[REG_ENABLE] & REG_ENABLE_LOG_EN) != logEnable) {
+		// An engine may have ended since the read above, which puts it in hold. Read the register again
+		// right before writing it so only LOG_EN changes.
+		uint8_t enable;
+		if (!readRegisters(REG_ENABLE, &enable, 1)) {
+			return false;
+		}
+		enable = (uint8_t)((enable & ~REG_ENABLE_LOG_EN) | logEnable);
+		if (!writeRegister(REG_ENABLE, enable)) {
+			return false;
+		}
+	}
+
+	warmStarted = true;
+	return true;
+}
+
+uint8_t LP5562::getConfigValue() const {
+	uint8_t value = 0x00;
+	if (!useExternalOscillator) {
+		value |= REG_CONFIG_INT_CLK_EN;
+	}
+	if (highFrequencyMode) {
+		value |= REG_CONFIG_HF;
+	}
+	return value;
+}
+
 #ifdef ENABLE_TESTPGM
 
 void LP5562::testPgm1() {
@@ -169,6 +313,8 @@ void LP5562::testPgm2() {
 
 
 bool LP5562::clearAllPrograms() {
+	LP5562_STATS_SCOPE(METHOD_CLEAR_ALL_PROGRAMS);
+
 	for(size_t engine = 1; engine <= 3; engine++) {
 		bool bResult = clearProgram(engine);
 		if (!bResult) {
@@ -179,17 +325,27 @@ bool LP5562::clearAllPrograms() {
 }
 
 bool LP5562::setProgram(size_t engine, const uint16_t *instructions, size_t numInstructions, bool startRunning) {
+	LP5562_STATS_SCOPE(METHOD_SET_PROGRAM);
 
 	bool  bResult;
 
-	// Set the engine to hold. This might not be necessary, I think it might happen automatically.
-	setEnable(engineNumToMask(engine), REG_ENABLE_HOLD);
+	if (engine < 1 || engine > 3 || numInstructions > 16) {
+		return false;
+	}
 
-	// Enter code loading mode.
-	bResult = setOpMode(engine, REG_ENGINE_LOAD);
-	if (!bResult) {
+#ifdef ENABLE_PROGRAM_VALIDATION
+	// Debug builds: don't load a program that can't work. The trigger checks across engines need all three
+	// programs so they're done when engines are started, in validateRunningEngines().
+	LP5562Disassembler::Report report;
+	if (!LP5562Disassembler::validate(instructions, numInstructions, engine, report)) {
+#if defined(PARTICLE)
+		char buf[256];
+		LP5562Disassembler::formatReport(report, buf, sizeof(buf));
+		Log.error("setProgram engine %u rejected:\n%s", (unsigned) engine, buf);
+#endif
 		return false;
 	}
+#endif /* ENABLE_PROGRAM_VALIDATION */
 
 	// Make a copy of the instruction list with 0x0000 (go to start) instructions to the end of the buffer, like
 	// is the case on boot. Also, so you don't need to manually add one to have the code loop.
@@ -205,40 +361,83 @@ bool LP5562::setProgram(size_t engine, const uint16_t *instructions, size_t numI
 
 	uint8_t startAddr = (uint8_t)(REG_PROGRAM_1 + (engine - 1) * 0x20);
 
-	// We can only write 15 instructions at a time because the I2C writes are limited to 32 bytes
-	// and the register address takes 1, leaving 31 byte or 15 instructions (each instruction word is 2 bytes).
-	wire.beginTransmission(addr);
-	wire.write(startAddr);
-
-	for(size_t ii = 0; ii < 15; ii++) {
-		wire.write((uint8_t) (instructionsPadded[ii] >> 8)); // MSB first
-		wire.write((uint8_t) instructionsPadded[ii]); // LSB second
-
-		// Log.info("startAddr=%02x ii=%u program=%04x", startAddr, ii, instructionsPadded[ii]);
-
-		startAddr += 2;
+	// Instructions are stored MSB first
+	uint8_t programBytes[32];
+	for(size_t ii = 0; ii < 16; ii++) {
+		programBytes[ii * 2] = (uint8_t) (instructionsPadded[ii] >> 8); // MSB first
+		programBytes[ii * 2 + 1] = (uint8_t) instructionsPadded[ii]; // LSB second
 	}
 
-	int stat = wire.endTransmission(true);
-	if (stat != 0) {
+	// Set the engine to hold. This might not be necessary, I think it might happen automatically.
+	// Without withShadowRegisters this reads REG_ENABLE, which also finds out if the chip was reset.
+	setEnable(engineNumToMask(engine), REG_ENABLE_HOLD);
 
-		return false;
+	// Find which instruction words differ from what's known to be loaded in the engine. Program memory
+	// is only changed by writes from this object or a reset of the chip, so the shadow is used whether
+	// or not withShadowRegisters is enabled.
+	bool changed[16];
+	bool anyChanged = false;
+	for(size_t ii = 0; ii < 16; ii++) {
+		uint8_t reg = (uint8_t)(startAddr + ii * 2);
+		changed[ii] = !isShadowValid(reg) || !isShadowValid(reg + 1) ||
+				shadowRegs[reg] != programBytes[ii * 2] || shadowRegs[reg + 1] != programBytes[ii * 2 + 1];
+		if (changed[ii]) {
+			anyChanged = true;
+		}
 	}
 
-	// Write the last instruction word that did not fit
-	wire.beginTransmission(addr);
-	wire.write(startAddr);
-
-	wire.write((uint8_t) (instructionsPadded[15] >> 8)); // MSB first
-	wire.write((uint8_t) instructionsPadded[15]); // LSB second
-	// Log.info("startAddr=%02x ii=%u program=%04x", startAddr, 15, instructionsPadded[15]);
+	if (anyChanged) {
+		// Enter code loading mode. This also resets the PC to 0.
+		bResult = setOpMode(engine, REG_ENGINE_LOAD);
+		if (!bResult) {
+			return false;
+		}
 
-	stat = wire.endTransmission(true);
-	if (stat != 0) {
-		return false;
+		// Write only the runs of changed words. An unchanged word between two changed ones is cheaper to
+		// rewrite (2 bytes) than starting a new transaction, so those are merged. Each run is limited to
+		// 15 words because the I2C writes are limited to 32 bytes and the register address takes 1.
+		const size_t maxRunWords = MAX_WRITE_LEN / 2;
+		size_t ii = 0;
+		while(ii < 16) {
+			if (!changed[ii]) {
+				ii++;
+				continue;
+			}
+
+			size_t first = ii;
+			size_t last = ii;
+			while(last + 1 < 16 && (last + 1 - first) < maxRunWords) {
+				if (changed[last + 1]) {
+					last++;
+				}
+				else
+				if (last + 2 < 16 && changed[last + 2] && (last + 2 - first) < maxRunWords) {
+					last += 2;
+				}
+				else {
+					break;
+				}
+			}
+			ii = last + 1;
+
+			bResult = writeRegisters((uint8_t)(startAddr + first * 2), &programBytes[first * 2], (last - first + 1) * 2);
+			if (!bResult) {
+				return false;
+			}
+		}
+	}
+	else {
+		// Program is already loaded, so load mode is skipped
+		if (startRunning && numInstructions > 0) {
+			// Load mode would have reset the PC, so the program still starts from the beginning
+			bResult = resetProgramCounters(engineNumToMask(engine));
+			if (!bResult) {
+				return false;
+			}
+		}
 	}
 
-	// Get out of programming mode
+	// Get out of programming mode (setOpMode doesn't write if it's already in the right mode)
 	bResult = setOpMode(engine, (numInstructions > 0) ? REG_ENGINE_RUN : REG_ENGINE_DISABLED);
 	if (!bResult) {
 		return false;
@@ -246,12 +445,113 @@ bool LP5562::setProgram(size_t engine, const uint16_t *instructions, size_t numI
 
 	// If startRunning is true, actually start running
 	if (startRunning && numInstructions > 0) {
+		if (!validateRunningEngines(engineNumToMask(engine))) {
+			return false;
+		}
 		setEnable(engineNumToMask(engine), REG_ENABLE_RUN);
 	}
 
 	return true;
 }
 
+uint8_t LP5562::getStatus() {
+	LP5562_STATS_SCOPE(METHOD_GET_STATUS);
+
+	uint8_t value = 0;
+
+	(void) getStatus(value);
+
+	return value;
+}
+
+bool LP5562::getStatus(uint8_t &value) {
+	LP5562_STATS_SCOPE(METHOD_GET_STATUS);
+
+	return readRegisters(REG_STATUS, &value, 1);
+}
+
+bool LP5562::resetProgramCounters(uint8_t engineMask) {
+	LP5562_STATS_SCOPE(METHOD_PROGRAM_COUNTERS);
+
+	// The PC registers are consecutive, so write each contiguous run of engines in one transaction
+	uint8_t zeros[3] = { 0, 0, 0 };
+
+	size_t engine = 1;
+	while(engine <= 3) {
+		if ((engineMask & engineNumToMask(engine)) == 0) {
+			engine++;
+			continue;
+		}
+		size_t first = engine;
+		while(engine <= 3 && (engineMask & engineNumToMask(engine)) != 0) {
+			engine++;
+		}
+
+		bool bResult = writeRegisters((uint8_t)(REG_ENG1_PC + first - 1), zeros, engine - first);
+		if (!bResult) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LP5562::startEngines(uint8_t engineMask) {
+	LP5562_STATS_SCOPE(METHOD_START_ENGINES);
+
+	if ((engineMask & MASK_ENGINE_ALL) == 0) {
+		return true;
+	}
+
+	beginBatch();
+
+	// The program counter can only be written in hold mode
+	bool bResult = validateRunningEngines(engineMask) &&
+			setEnable(engineMask, REG_ENABLE_HOLD) &&
+			resetProgramCounters(engineMask) &&
+			setEnable(engineMask, REG_ENABLE_RUN);
+
+	if (!commit()) {
+		bResult = false;
+	}
+	return bResult;
+}
+
+bool LP5562::getProgramCounters(uint8_t *pcs) {
+	LP5562_STATS_SCOPE(METHOD_PROGRAM_COUNTERS);
+
+	// REG_ENG1_PC - REG_ENG3_PC are consecutive
+	return readRegisters(REG_ENG1_PC, pcs, 3);
+}
+
+bool LP5562::setProgramCounter(size_t engine, uint8_t pc) {
+	LP5562_STATS_SCOPE(METHOD_PROGRAM_COUNTERS);
+
+	if (engine < 1 || engine > 3) {
+		return false;
+	}
+	return writeRegister((uint8_t)(REG_ENG1_PC + engine - 1), pc & 0xf);
+}
+
+bool LP5562::startProgramAt(size_t engine, const uint16_t *instructions, size_t numInstructions, uint8_t pc) {
+	LP5562_STATS_SCOPE(METHOD_START_PROGRAM_AT);
+
+	if (engine < 1 || engine > 3 || numInstructions == 0 || pc >= numInstructions) {
+		return false;
+	}
+
+	beginBatch();
+
+	// setProgram leaves the engine in hold, which is required to write the PC
+	bool bResult = setProgram(engine, instructions, numInstructions, false) &&
+			setProgramCounter(engine, pc) &&
+			setEnable(engineNumToMask(engine), REG_ENABLE_RUN);
+
+	if (!commit()) {
+		bResult = false;
+	}
+	return bResult;
+}
+
 uint8_t LP5562::engineNumToMask(size_t engine) const {
 	switch(engine) {
 	case 1:
@@ -266,6 +566,8 @@ uint8_t LP5562::engineNumToMask(size_t engine) const {
 }
 
 bool LP5562::setLedMapping(uint8_t red, uint8_t green, uint8_t blue, uint8_t white) {
+	LP5562_STATS_SCOPE(METHOD_SET_LED_MAPPING);
+
 	uint8_t value = 0;
 
 	value |= (white & 0b11) << 6;
@@ -277,7 +579,9 @@ bool LP5562::setLedMapping(uint8_t red, uint8_t green, uint8_t blue, uint8_t whi
 }
 
 bool LP5562::setLedMappingR(uint8_t mode, uint8_t value) {
-	uint8_t regValue = getLedMapping();
+	LP5562_STATS_SCOPE(METHOD_SET_LED_MAPPING);
+
+	uint8_t regValue = readRegisterCached(REG_LED_MAP);
 
 	regValue &= 0b11001111;
 	regValue |= (mode & 0b11) << 4;
@@ -290,7 +594,9 @@ bool LP5562::setLedMappingR(uint8_t mode, uint8_t value) {
 }
 
 bool LP5562::setLedMappingG(uint8_t mode, uint8_t value) {
-	uint8_t regValue = getLedMapping();
+	LP5562_STATS_SCOPE(METHOD_SET_LED_MAPPING);
+
+	uint8_t regValue = readRegisterCached(REG_LED_MAP);
 
 	regValue &= 0b11110011;
 	regValue |= (mode & 0b11) << 2;
@@ -303,7 +609,9 @@ bool LP5562::setLedMappingG(uint8_t mode, uint8_t value) {
 }
 
 bool LP5562::setLedMappingB(uint8_t mode, uint8_t value) {
-	uint8_t regValue = getLedMapping();
+	LP5562_STATS_SCOPE(METHOD_SET_LED_MAPPING);
+
+	uint8_t regValue = readRegisterCached(REG_LED_MAP);
 
 	regValue &= 0b11111100;
 	regValue |= (mode & 0b11);
@@ -316,7 +624,9 @@ bool LP5562::setLedMappingB(uint8_t mode, uint8_t value) {
 }
 
 bool LP5562::setLedMappingW(uint8_t mode, uint8_t value) {
-	uint8_t regValue = getLedMapping();
+	LP5562_STATS_SCOPE(METHOD_SET_LED_MAPPING);
+
+	uint8_t regValue = readRegisterCached(REG_LED_MAP);
 
 	regValue &= 0b00111111;
 	regValue |= (mode & 0b11) << 6;
@@ -330,8 +640,24 @@ bool LP5562::setLedMappingW(uint8_t mode, uint8_t value) {
 
 
 bool LP5562::setEnable(uint8_t engineMask, uint8_t engineMode) {
+	LP5562_STATS_SCOPE(METHOD_SET_ENABLE);
+
+	bool fromShadow = (useShadowRegisters || batchDepth > 0) && isShadowValid(REG_ENABLE);
+	uint8_t value = readRegisterCached(REG_ENABLE);
 
-	uint8_t value = readRegister(REG_ENABLE);
+	// The chip puts an engine in hold when it executes End, so the shadow is out of date for an engine
+	// that it shows as running. Engines never leave hold on their own, so if the other engines are in
+	// hold in the shadow (or REG_ENABLE was already staged in this batch), the shadow can be used.
+	// Otherwise the register is read so an engine that has ended is not started again.
+	uint8_t otherEngineBits = 0;
+	for(size_t engine = 1; engine <= 3; engine++) {
+		if ((engineMask & engineNumToMask(engine)) == 0) {
+			otherEngineBits |= (uint8_t)(0b11 << (2 * (3 - engine)));
+		}
+	}
+	if (fromShadow && (value & otherEngineBits) != 0 && !(batchDepth > 0 && isBatchDirty(REG_ENABLE))) {
+		value = readRegister(REG_ENABLE);
+	}
 
 	if ((engineMask & MASK_ENGINE_1) != 0) {
 		value &= 0b11001111;
@@ -355,8 +681,10 @@ bool LP5562::setEnable(uint8_t engineMask, uint8_t engineMode) {
 
 
 bool LP5562::setOpMode(size_t engine, uint8_t engineMode) {
+	LP5562_STATS_SCOPE(METHOD_SET_OP_MODE);
 
-	uint8_t value = readRegister(REG_OP_MODE);
+	uint8_t oldValue = readRegisterCached(REG_OP_MODE);
+	uint8_t value = oldValue;
 
 	switch(engine) {
 	case 1:
@@ -376,37 +704,132 @@ bool LP5562::setOpMode(size_t engine, uint8_t engineMode) {
 	}
 	// Log.info("setOpMode engine=%u engineMode=%u value=%04x", engine, engineMode, value);
 
+	if (value == oldValue) {
+		// Already in this mode. The chip never changes the operation mode on its own, so this is safe
+		// to skip even when using the shadow.
+		return true;
+	}
+
 	return writeRegister(REG_OP_MODE, value);
 }
 
 
+void LP5562::beginProgramChange(uint8_t engineMask) {
+	// Combine the many enable and operation mode register changes into as few writes as possible
+	beginBatch();
+
+	// Stop all engines. setProgram only writes the instruction words that changed, so unlike
+	// clearAllPrograms() this doesn't rewrite programs that are already loaded.
+	setEnable(MASK_ENGINE_ALL, REG_ENABLE_HOLD);
+
+	// A program that's already loaded is not reloaded, so load mode doesn't reset its PC. The engines are
+	// in hold now, which is required to write the PC.
+	resetProgramCounters(engineMask);
+}
+
+bool LP5562::commitProgramChange(uint8_t engineMask) {
+	// The programs are still written, but the engines are left in hold if they can't work together
+	bool bResult = validateRunningEngines(engineMask);
+	if (bResult) {
+		setEnable(engineMask, REG_ENABLE_RUN);
+	}
+
+	if (!commit()) {
+		bResult = false;
+	}
+	return bResult;
+}
+
+bool LP5562::validateRunningEngines(uint8_t engineMask) {
+#ifdef ENABLE_PROGRAM_VALIDATION
+	// Starting engines writes REG_ENABLE right after reading it, so the shadow is used even without
+	// withShadowRegisters. An engine that has ended since is still checked, which can only hide a problem.
+	uint8_t enable = isShadowValid(REG_ENABLE) ? shadowRegs[REG_ENABLE] : readRegister(REG_ENABLE);
+
+	uint16_t words[3][16];
+	const uint16_t *instructions[3] = { NULL, NULL, NULL };
+	size_t numInstructions[3] = { 0, 0, 0 };
+
+	for(size_t engine = 1; engine <= 3; engine++) {
+		uint8_t shift = (uint8_t)(2 * (3 - engine));
+		if ((engineMask & engineNumToMask(engine)) == 0 && ((enable >> shift) & 0b11) != REG_ENABLE_RUN) {
+			continue;
+		}
+
+		uint8_t startAddr = (uint8_t)(REG_PROGRAM_1 + (engine - 1) * 0x20);
+		for(size_t ii = 0; ii < 0x20; ii++) {
+			if (!isShadowValid((uint8_t)(startAddr + ii))) {
+				// Program memory can only be read in load mode, which would stop the engine
+				return true;
+			}
+		}
+		for(size_t ii = 0; ii < 16; ii++) {
+			words[engine - 1][ii] = (uint16_t)((shadowRegs[startAddr + ii * 2] << 8) | shadowRegs[startAddr + ii * 2 + 1]);
+		}
+		instructions[engine - 1] = words[engine - 1];
+		numInstructions[engine - 1] = 16;
+	}
+
+	LP5562Disassembler::Report report;
+	if (!LP5562Disassembler::validateEngines(instructions, numInstructions, report)) {
+#if defined(PARTICLE)
+		char buf[256];
+		LP5562Disassembler::formatReport(report, buf, sizeof(buf));
+		Log.error("engines 0x%02x not started:\n%s", (unsigned) engineMask, buf);
+#endif
+		return false;
+	}
+#else
+	(void) engineMask;
+#endif /* ENABLE_PROGRAM_VALIDATION */
+	return true;
+}
+
 void LP5562::setR(uint8_t red) {
+	LP5562_STATS_SCOPE(METHOD_SET_PWM);
+
 	(void) writeRegister(REG_R_PWM, red);
 }
 
 void LP5562::setG(uint8_t green) {
+	LP5562_STATS_SCOPE(METHOD_SET_PWM);
+
 	(void) writeRegister(REG_G_PWM, green);
 }
 
 void LP5562::setB(uint8_t blue) {
+	LP5562_STATS_SCOPE(METHOD_SET_PWM);
+
 	(void) writeRegister(REG_B_PWM, blue);
 }
 
 void LP5562::setRGB(uint8_t red, uint8_t green, uint8_t blue) {
-	setR(red);
-	setG(green);
-	setB(blue);
+	LP5562_STATS_SCOPE(METHOD_SET_PWM);
+
+	// REG_B_PWM, REG_G_PWM, REG_R_PWM are consecutive
+	uint8_t values[3] = { blue, green, red };
+
+	(void) writeRegisters(REG_B_PWM, values, sizeof(values));
 }
 
 void LP5562::setRGB(uint32_t rgb) {
-	setR(rgb >> 16);
-	setG(rgb >> 8);
-	setB(rgb);
+	LP5562_STATS_SCOPE(METHOD_SET_PWM);
+
+	setRGB((uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb);
+}
+
+void LP5562::setRGBW(uint8_t red, uint8_t green, uint8_t blue, uint8_t white) {
+	LP5562_STATS_SCOPE(METHOD_SET_PWM);
+
+	setRGB(red, green, blue);
+	setW(white);
 }
 
 
 void LP5562::useDirectRGB() {
-	uint8_t ledMap = getLedMapping();
+	LP5562_STATS_SCOPE(METHOD_USE_DIRECT);
+
+	uint8_t ledMap = readRegisterCached(REG_LED_MAP);
 
 	uint8_t engineMask = 0;
 
@@ -421,11 +844,15 @@ void LP5562::useDirectRGB() {
 }
 
 void LP5562::setW(uint8_t white) {
+	LP5562_STATS_SCOPE(METHOD_SET_PWM);
+
 	(void) writeRegister(REG_W_PWM, white);
 }
 
 void LP5562::useDirectW() {
-	uint8_t ledMap = getLedMapping();
+	LP5562_STATS_SCOPE(METHOD_USE_DIRECT);
+
+	uint8_t ledMap = readRegisterCached(REG_LED_MAP);
 
 	uint8_t engineMask = 0;
 	engineMask |= engineNumToMask((ledMap >> 6) & 0b11);
@@ -437,17 +864,17 @@ void LP5562::useDirectW() {
 }
 
 void LP5562::setIndicatorMode(unsigned long on1ms, unsigned long off1ms, unsigned long on2ms, unsigned long off2ms, uint8_t breatheTime) {
+	LP5562_STATS_SCOPE(METHOD_SET_INDICATOR_MODE);
 
 	// Engine 1 = Blink
 	// Engine 2 = Fast Blink
 	// Engine 3 = Breathe
 
-	clearAllPrograms();
-
+	beginProgramChange(MASK_ENGINE_ALL);
 
 	LP5562Program program;
 
-	// The main program is either 6 or 8 instructions. When msOn or msOff is > 1000 ms, then the delay requires 2 instructions.
+	// The blink programs are at most 9 instructions. Each delay is up to 3 instructions.
 
 	// Normally blink
 	program.addCommandSetPWM(255); // full brightness
@@ -468,9 +895,9 @@ void LP5562::setIndicatorMode(unsigned long on1ms, unsigned long off1ms, unsigne
 
 	// Breathe
 	program.clear();
-	program.addCommandSetPWM(0); // Start at lowLevel
-	program.addCommandRamp(false, breatheTime, false, 255); // Ramp up
-	program.addCommandRamp(false, breatheTime, true, 255); // Ramp down
+	program.addCommandSetPWM(0); // Start at off
+	program.addRampSteps(false, breatheTime, false, 255); // Ramp up (2 instructions)
+	program.addRampSteps(false, breatheTime, true, 255); // Ramp down (2 instructions)
 	setProgram(3, program, false);
 
 
@@ -479,17 +906,17 @@ void LP5562::setIndicatorMode(unsigned long on1ms, unsigned long off1ms, unsigne
 	setRGB(0, 0, 0);
 	setW(0);
 
-	setEnable(MASK_ENGINE_ALL, REG_ENABLE_RUN);
-
-
+	commitProgramChange(MASK_ENGINE_ALL);
 }
 
 void LP5562::setBlink(uint8_t red, uint8_t green, uint8_t blue, unsigned long msOn, unsigned long msOff) {
+	LP5562_STATS_SCOPE(METHOD_SET_BLINK);
+
 	LP5562Program program;
 
-	clearAllPrograms();
+	beginProgramChange(MASK_ENGINE_ALL);
 
-	// The main program is either 6 or 8 instructions. When msOn or msOff is > 1000 ms, then the delay requires 2 instructions.
+	// The main program is at most 10 instructions. Each delay is up to 3 instructions.
 	program.addCommandSetPWM(red);
 	program.addDelay(msOn);
 	program.addCommandSetPWM(0);
@@ -508,10 +935,12 @@ void LP5562::setBlink(uint8_t red, uint8_t green, uint8_t blue, unsigned long ms
 
 	setLedMapping(REG_LED_MAP_ENGINE_1, REG_LED_MAP_ENGINE_2, REG_LED_MAP_ENGINE_3, REG_LED_MAP_DIRECT);
 
-	setEnable(MASK_ENGINE_ALL, REG_ENABLE_RUN);
+	commitProgramChange(MASK_ENGINE_ALL);
 }
 
 void LP5562::setBlink2(uint32_t rgb1, unsigned long ms1, uint32_t rgb2, unsigned long ms2) {
+	LP5562_STATS_SCOPE(METHOD_SET_BLINK2);
+
 	setBlink2((uint8_t)(rgb1 >> 16), (uint8_t)(rgb1 >> 8), (uint8_t)rgb1, ms1,
 			(uint8_t)(rgb2 >> 16), (uint8_t)(rgb2 >> 8), (uint8_t)rgb2, ms2);
 }
@@ -519,11 +948,13 @@ void LP5562::setBlink2(uint32_t rgb1, unsigned long ms1, uint32_t rgb2, unsigned
 
 
 void LP5562::setBlink2(uint8_t red1, uint8_t green1, uint8_t blue1, unsigned long ms1, uint8_t red2, uint8_t green2, uint8_t blue2, unsigned long ms2) {
+	LP5562_STATS_SCOPE(METHOD_SET_BLINK2);
+
 	LP5562Program program;
 
-	clearAllPrograms();
+	beginProgramChange(MASK_ENGINE_ALL);
 
-	// The main program is either 6 or 8 instructions. When ms1 or ms2 is > 1000 ms, then the delay requires 2 instructions.
+	// The main program is at most 10 instructions. Each delay is up to 3 instructions.
 	program.addCommandSetPWM(red1);
 	program.addDelay(ms1);
 	uint8_t colorStep = program.getStepNum();
@@ -545,45 +976,48 @@ void LP5562::setBlink2(uint8_t red1, uint8_t green1, uint8_t blue1, unsigned lon
 
 	setLedMapping(REG_LED_MAP_ENGINE_1, REG_LED_MAP_ENGINE_2, REG_LED_MAP_ENGINE_3, REG_LED_MAP_DIRECT);
 
-	setEnable(MASK_ENGINE_ALL, REG_ENABLE_RUN);
+	commitProgramChange(MASK_ENGINE_ALL);
 }
 
 void LP5562::setBreathe(bool red, bool green, bool blue, uint8_t stepTimeHalfMs, uint8_t lowLevel, uint8_t highLevel) {
+	LP5562_STATS_SCOPE(METHOD_SET_BREATHE);
+
 	LP5562Program program;
 
-	clearAllPrograms();
+	beginProgramChange(MASK_ENGINE_1);
 
 	// Clear all LEDs because if they're not turned on, then we want them to be off.
 	setRGB(0, 0, 0);
 
-	// Program is 3 instructions
+	// Program is 3 to 5 instructions. A ramp instruction is limited to 127 steps, so a ramp of more
+	// than that is split in two.
+	uint8_t numSteps = (highLevel > lowLevel) ? highLevel - lowLevel : 0;
 
 	// Start at lowLevel
 	program.addCommandSetPWM(lowLevel);
 
 	// Ramp up
-	program.addCommandRamp(false, stepTimeHalfMs, false, highLevel - lowLevel);
+	program.addRampSteps(false, stepTimeHalfMs, false, numSteps);
 
 	// Ramp down
-	program.addCommandRamp(false, stepTimeHalfMs, true, highLevel - lowLevel);
+	program.addRampSteps(false, stepTimeHalfMs, true, numSteps);
 
-	setProgram(1, program, true);
+	setProgram(1, program, false);
 
 	setLedMapping(red ? REG_LED_MAP_ENGINE_1 : REG_LED_MAP_DIRECT,
 			green ? REG_LED_MAP_ENGINE_1 : REG_LED_MAP_DIRECT,
 			blue ? REG_LED_MAP_ENGINE_1 : REG_LED_MAP_DIRECT,
 			REG_LED_MAP_DIRECT);
 
-	setEnable(REG_LED_MAP_ENGINE_1, REG_ENABLE_RUN);
+	commitProgramChange(MASK_ENGINE_1);
 }
 
 uint8_t LP5562::readRegister(uint8_t reg) {
-	wire.beginTransmission(addr);
-	wire.write(reg);
-	wire.endTransmission(false);
+	LP5562_STATS_SCOPE(METHOD_REGISTERS);
 
-	wire.requestFrom(addr, (uint8_t) 1, (uint8_t) true);
-	uint8_t value = (uint8_t) wire.read();
+	uint8_t value = 0;
+
+	(void) readRegisters(reg, &value, 1);
 
 	// Log.trace("readRegister reg=%d value=%d", reg, value);
 
@@ -591,100 +1025,629 @@ uint8_t LP5562::readRegister(uint8_t reg) {
 }
 
 bool LP5562::writeRegister(uint8_t reg, uint8_t value) {
-	wire.beginTransmission(addr);
-	wire.write(reg);
-	wire.write(value);
+	LP5562_STATS_SCOPE(METHOD_REGISTERS);
 
-	int stat = wire.endTransmission(true);
-
-	// Log.trace("writeRegister reg=%d value=%d stat=%d read=%d", reg, value, stat, readRegister(reg));
+	if (stageRegisters(reg, &value, 1)) {
+		return true;
+	}
 
-	return (stat == 0);
-}
+	// Anything that can't be staged is written in order after the staged writes
+	if (!flushBatch()) {
+		return false;
+	}
 
+	bool bResult = transport.writeRegisters(addr, reg, &value, 1);
+	LP5562_STATS_TRANSACTION(1, bResult);
 
+	// Log.trace("writeRegister reg=%d value=%d bResult=%d read=%d", reg, value, bResult, readRegister(reg));
 
-LP5562Program::LP5562Program() {
+	if (!bResult) {
+		return false;
+	}
 
+	if (reg == REG_RESET && value == 0xff) {
+		resetShadow();
+	}
+	else {
+		updateShadow(reg, value);
+	}
+	return true;
 }
 
-LP5562Program::~LP5562Program() {
+bool LP5562::readRegisters(uint8_t reg, uint8_t *values, size_t numValues) {
+	LP5562_STATS_SCOPE(METHOD_REGISTERS);
 
-}
+	while(numValues > 0) {
+		size_t count = numValues;
+		if (count > MAX_READ_LEN) {
+			count = MAX_READ_LEN;
+		}
 
-bool LP5562Program::addCommandRamp(bool prescale, uint8_t stepTime, bool decrease, uint8_t numSteps, int atInst) {
-	uint16_t command = 0;
+		bool bResult = transport.readRegisters(addr, reg, values, count);
+		LP5562_STATS_TRANSACTION(count, bResult);
+		if (!bResult) {
+			return false;
+		}
 
-	if (stepTime > 0x3f) {
-		stepTime = 0x3f;
+		for(size_t ii = 0; ii < count; ii++) {
+			updateShadow((uint8_t)(reg + ii), values[ii]);
+		}
+
+		if (reg == REG_ENABLE && (values[0] & REG_ENABLE_CHIP_EN) == 0) {
+			// The chip was reset or lost power (brownout), so program memory is no longer what was written
+			invalidateProgramShadow();
+		}
+
+		reg += (uint8_t) count;
+		values += count;
+		numValues -= count;
 	}
+	return true;
+}
 
-	if (prescale) {
-		command |= 0b0100000000000000;
+bool LP5562::writeRegisters(uint8_t reg, const uint8_t *values, size_t numValues) {
+	LP5562_STATS_SCOPE(METHOD_REGISTERS);
+
+	if (stageRegisters(reg, values, numValues)) {
+		return true;
 	}
-	command |= (uint16_t)stepTime << 8;
 
-	if (decrease) {
-		command |= 0b0000000010000000;
+	if (!flushBatch()) {
+		return false;
 	}
-	command |= (numSteps & 0x7f);
 
-	return addCommand(command, atInst);
+	return writeRegistersNow(reg, values, numValues);
 }
 
-bool LP5562Program::addCommandSetPWM(uint8_t level, int atInst) {
-	uint16_t command = 0b0100000000000000 | level;
+bool LP5562::writeRegistersNow(uint8_t reg, const uint8_t *values, size_t numValues) {
+	while(numValues > 0) {
+		size_t count = numValues;
+		if (count > MAX_WRITE_LEN) {
+			count = MAX_WRITE_LEN;
+		}
 
-	return addCommand(command, atInst);
-}
+		bool bResult = transport.writeRegisters(addr, reg, values, count);
+		LP5562_STATS_TRANSACTION(count, bResult);
+		if (!bResult) {
+			return false;
+		}
 
-bool LP5562Program::addCommandGoToStart(int atInst) {
-	uint16_t command = 0b0000000000000000;
+		for(size_t ii = 0; ii < count; ii++) {
+			updateShadow((uint8_t)(reg + ii), values[ii]);
+		}
 
-	return addCommand(command, atInst);
+		reg += (uint8_t) count;
+		values += count;
+		numValues -= count;
+	}
+	return true;
 }
 
-bool LP5562Program::addCommandBranch(uint8_t loopCount, uint8_t stepNum, int atInst) {
-	if (loopCount > 0x3f) {
-		loopCount = 0x3f;
+bool LP5562::resyncShadow() {
+	LP5562_STATS_SCOPE(METHOD_RESYNC_SHADOW);
+
+	// Control registers 0x00 - 0x0f in one read. Program memory is only readable in load mode
+	// so it's left as unknown.
+	invalidateShadow();
+
+	uint8_t values[REG_PROGRAM_1 - REG_ENABLE];
+	if (!readRegisters(REG_ENABLE, values, sizeof(values))) {
+		return false;
 	}
-	if (stepNum > 0xf) {
-		// Invalid step number
+
+	// LED mapping register is separate from the control registers
+	uint8_t value;
+	if (!readRegisters(REG_LED_MAP, &value, 1)) {
 		return false;
 	}
 
-	uint16_t command = 0b1010000000000000 | (((uint16_t)loopCount) << 7) | stepNum;
+	return true;
+}
+
+bool LP5562::snapshot(Snapshot &snap) {
+	LP5562_STATS_SCOPE(METHOD_SNAPSHOT);
+
+	memset(&snap, 0, sizeof(snap));
+	snap.magic = SNAPSHOT_MAGIC;
+
+	// 0x00 - 0x0b and 0x0e - 0x0f. Reading REG_STATUS would clear the interrupts, and REG_RESET reads as 0.
+	if (!readRegisters(REG_ENABLE, snap.control, REG_STATUS - REG_ENABLE) ||
+		!readRegisters(REG_W_PWM, &snap.control[REG_W_PWM], 2) ||
+		!readRegisters(REG_LED_MAP, &snap.ledMap, 1)) {
+		return false;
+	}
+
+	uint8_t enable = snap.control[REG_ENABLE];
+	uint8_t opMode = snap.control[REG_OP_MODE];
+	uint8_t loadOpMode = opMode;
+	uint8_t holdEnable = enable;
+	uint8_t readMask = 0;
+
+	for(size_t engine = 1; engine <= 3; engine++) {
+		uint8_t shift = (uint8_t)(2 * (3 - engine));
+		if (((opMode >> shift) & 0b11) == REG_ENGINE_DISABLED) {
+			continue;
+		}
 
-	return addCommand(command, atInst);
+		uint8_t startAddr = (uint8_t)(REG_PROGRAM_1 + (engine - 1) * 0x20);
+		bool known = true;
+		for(size_t ii = 0; ii < 0x20; ii++) {
+			if (!isShadowValid((uint8_t)(startAddr + ii))) {
+				known = false;
+				break;
+			}
+		}
+
+		if (known) {
+			memcpy(&snap.program[startAddr - REG_PROGRAM_1], &shadowRegs[startAddr], 0x20);
+		}
+		else {
+			loadOpMode = (uint8_t)((loadOpMode & ~(0b11 << shift)) | (REG_ENGINE_LOAD << shift));
+			holdEnable = (uint8_t)(holdEnable & ~(0b11 << shift));
+			readMask |= engineNumToMask(engine);
+		}
+	}
+
+	if (readMask) {
+		// Program memory can only be read in load mode, which stops the engine and resets its PC
+		bool bResult = writeRegister(REG_ENABLE, holdEnable) && writeRegister(REG_OP_MODE, loadOpMode);
+
+		for(size_t engine = 1; engine <= 3 && bResult; engine++) {
+			if (readMask & engineNumToMask(engine)) {
+				uint8_t startAddr = (uint8_t)(REG_PROGRAM_1 + (engine - 1) * 0x20);
+				bResult = readRegisters(startAddr, &snap.program[startAddr - REG_PROGRAM_1], 0x20);
+			}
+		}
+
+		// Put the engines back where they were
+		bResult = bResult && writeRegister(REG_OP_MODE, opMode) &&
+				writeRegisters(REG_ENG1_PC, &snap.control[REG_ENG1_PC], 3) &&
+				writeRegister(REG_ENABLE, enable);
+		if (!bResult) {
+			return false;
+		}
+	}
+
+	snap.checksum = calculateChecksum(snap);
+	return true;
 }
 
-bool LP5562Program::addCommandEnd(bool generateInterrupt, bool setPWMto0, int atInst) {
-	uint16_t command = 0b110000000000;
+bool LP5562::restore(const Snapshot &snap) {
+	LP5562_STATS_SCOPE(METHOD_RESTORE);
 
-	if (generateInterrupt) {
-		command |= 0b0001000000000000;
+	if (!isValidSnapshot(snap)) {
+		return false;
 	}
-	if (setPWMto0) {
-		command |= 0b0000100000000000;
+
+	uint8_t enable = snap.control[REG_ENABLE];
+	uint8_t opMode = snap.control[REG_OP_MODE];
+	uint8_t config = snap.control[REG_CONFIG];
+
+	redCurrent = snap.control[REG_R_CURRENT];
+	greenCurrent = snap.control[REG_G_CURRENT];
+	blueCurrent = snap.control[REG_B_CURRENT];
+	whiteCurrent = snap.control[REG_W_CURRENT];
+	useLogarithmicMode = (enable & REG_ENABLE_LOG_EN) != 0;
+	useExternalOscillator = (config & REG_CONFIG_INT_CLK_EN) == 0;
+	highFrequencyMode = (config & REG_CONFIG_HF) != 0;
+
+	// Without withShadowRegisters this reads REG_ENABLE. If the chip was reset or lost power while asleep,
+	// readRegisters() forgets the program shadow so all of the programs are written again.
+	bool chipWasEnabled = (readRegisterCached(REG_ENABLE) & REG_ENABLE_CHIP_EN) != 0;
+
+	// PWM and current for R, G, B (0x02 - 0x07), and W (0x0e - 0x0f), set before the chip is enabled like begin()
+	bool bResult = writeRegisters(REG_B_PWM, &snap.control[REG_B_PWM], REG_CONFIG - REG_B_PWM) &&
+			writeRegisters(REG_W_PWM, &snap.control[REG_W_PWM], 2);
+	if (!bResult) {
+		return false;
 	}
 
-	return addCommand(command, atInst);
+	// Enable the chip with all engines in hold
+	if (!writeRegister(REG_ENABLE, enable & (REG_ENABLE_CHIP_EN | REG_ENABLE_LOG_EN))) {
+		return false;
+	}
+	if ((enable & REG_ENABLE_CHIP_EN) != 0 && !chipWasEnabled) {
+		// Hardware start-up delay
+		delayMicroseconds(500);
+	}
+	if (!writeRegister(REG_CONFIG, config)) {
+		return false;
+	}
+
+	// Programs of engines that are not disabled, unless they're known to be loaded already
+	uint8_t loadOpMode = opMode;
+	bool loadNeeded = false;
+	bool changed[3] = { false, false, false };
+	uint8_t pcs[3];
+
+	for(size_t engine = 1; engine <= 3; engine++) {
+		uint8_t shift = (uint8_t)(2 * (3 - engine));
+		uint8_t startAddr = (uint8_t)(REG_PROGRAM_1 + (engine - 1) * 0x20);
+
+		pcs[engine - 1] = getRestartPC(&snap.program[startAddr - REG_PROGRAM_1], snap.control[REG_ENG1_PC + engine - 1]);
+
+		if (((opMode >> shift) & 0b11) == REG_ENGINE_DISABLED) {
+			continue;
+		}
+
+		for(size_t ii = 0; ii < 0x20; ii++) {
+			uint8_t reg = (uint8_t)(startAddr + ii);
+			if (!isShadowValid(reg) || shadowRegs[reg] != snap.program[reg - REG_PROGRAM_1]) {
+				changed[engine - 1] = true;
+				break;
+			}
+		}
+		if (changed[engine - 1]) {
+			loadOpMode = (uint8_t)((loadOpMode & ~(0b11 << shift)) | (REG_ENGINE_LOAD << shift));
+			loadNeeded = true;
+		}
+	}
+
+	if (loadNeeded) {
+		if (!writeRegister(REG_OP_MODE, loadOpMode)) {
+			return false;
+		}
+
+		// Programs of adjacent engines are contiguous, so each run of changed engines is one write
+		size_t engine = 1;
+		while(engine <= 3) {
+			if (!changed[engine - 1]) {
+				engine++;
+				continue;
+			}
+			size_t first = engine;
+			while(engine <= 3 && changed[engine - 1]) {
+				engine++;
+			}
+
+			uint8_t startAddr = (uint8_t)(REG_PROGRAM_1 + (first - 1) * 0x20);
+			if (!writeRegisters(startAddr, &snap.program[startAddr - REG_PROGRAM_1], (engine - first) * 0x20)) {
+				return false;
+			}
+		}
+	}
+
+	// Leaving load mode resets the PC, so the PCs are written after the operation mode. The engines are
+	// still in hold, which is required to write the PC.
+	bResult = writeRegister(REG_OP_MODE, opMode) &&
+			writeRegisters(REG_ENG1_PC, pcs, 3) &&
+			writeRegister(REG_LED_MAP, snap.ledMap) &&
+			writeRegister(REG_ENABLE, enable);
+
+	return bResult;
 }
 
-bool LP5562Program::addCommandTriggerSend(uint8_t engineMask, int atInst) {
-	uint16_t command = 0b1110000000000000;
+// static
+uint8_t LP5562::getRestartPC(const uint8_t *programBytes, uint8_t pc) {
+	// The engine's PWM level isn't saved, so an engine stopped in a wait would show the wrong level.
+	// Going back over waits to the Set PWM before them replays that part of the pattern from its start.
+	pc &= 0xf;
+	for(int step = pc; step >= 0; step--) {
+		uint16_t inst = (uint16_t)((programBytes[step * 2] << 8) | programBytes[step * 2 + 1]);
+		if ((inst & 0xff00) == 0x4000) {
+			// Set PWM
+			return (uint8_t) step;
+		}
+		if ((inst & 0x8000) != 0 || (inst & 0x3f00) == 0 || (inst & 0x007f) != 0) {
+			// Not a wait
+			break;
+		}
+	}
+	return pc;
+}
+
+// static
+bool LP5562::isValidSnapshot(const Snapshot &snap) {
+	return snap.magic == SNAPSHOT_MAGIC && snap.checksum == calculateChecksum(snap);
+}
 
-	command |= (uint16_t)engineMask << 7;
+// static
+uint16_t LP5562::calculateChecksum(const Snapshot &snap) {
+	const uint8_t *bytes = (const uint8_t *) &snap;
+	uint16_t sum1 = 0, sum2 = 0;
 
-	return addCommand(command, atInst);
+	for(size_t ii = 0; ii < offsetof(Snapshot, checksum); ii++) {
+		sum1 = (uint16_t)((sum1 + bytes[ii]) % 255);
+		sum2 = (uint16_t)((sum2 + sum1) % 255);
+	}
+	return (uint16_t)((sum2 << 8) | sum1);
 }
 
-bool LP5562Program::addCommandTriggerWait(uint8_t engineMask, int atInst) {
-	uint16_t command = 0b1110000000000000;
+bool LP5562::isShadowValid(uint8_t reg) const {
+	if (reg >= NUM_REGISTERS) {
+		return false;
+	}
+	return (shadowValid[reg / 8] & (1 << (reg % 8))) != 0;
+}
+
+uint8_t LP5562::readRegisterCached(uint8_t reg) {
+	if ((useShadowRegisters || batchDepth > 0) && isShadowValid(reg)) {
+		return shadowRegs[reg];
+	}
+	return readRegister(reg);
+}
 
-	command |= engineMask << 1;
+void LP5562::updateShadow(uint8_t reg, uint8_t value) {
+	if (reg >= NUM_REGISTERS) {
+		return;
+	}
 
-	return addCommand(command, atInst);
+	if (isVolatileRegister(reg)) {
+		// Changed by the hardware, never shadowed
+		return;
+	}
+
+	shadowRegs[reg] = value;
+	shadowValid[reg / 8] |= (uint8_t)(1 << (reg % 8));
+}
+
+bool LP5562::isVolatileRegister(uint8_t reg) {
+	switch(reg) {
+	case REG_ENG1_PC:
+	case REG_ENG2_PC:
+	case REG_ENG3_PC:
+	case REG_STATUS:
+	case REG_RESET:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+void LP5562::resetShadow() {
+	invalidateShadow();
+
+	for(uint8_t reg = 0; reg < NUM_REGISTERS; reg++) {
+		updateShadow(reg, 0x00);
+	}
+	updateShadow(REG_B_CURRENT, REG_CURRENT_DEFAULT);
+	updateShadow(REG_G_CURRENT, REG_CURRENT_DEFAULT);
+	updateShadow(REG_R_CURRENT, REG_CURRENT_DEFAULT);
+	updateShadow(REG_W_CURRENT, REG_CURRENT_DEFAULT);
+	updateShadow(REG_LED_MAP, REG_LED_MAP_DEFAULT);
+}
+
+void LP5562::invalidateShadow(bool includePrograms) {
+	if (includePrograms) {
+		for(size_t ii = 0; ii < sizeof(shadowValid); ii++) {
+			shadowValid[ii] = 0;
+		}
+	}
+	else {
+		// Control registers and LED_MAP only. Program memory is only changed by writes from this object
+		// or a reset of the chip.
+		for(uint8_t reg = 0; reg < NUM_REGISTERS; reg++) {
+			if (reg < REG_PROGRAM_1 || reg == REG_LED_MAP) {
+				shadowValid[reg / 8] &= (uint8_t)~(1 << (reg % 8));
+			}
+		}
+	}
+}
+
+void LP5562::invalidateProgramShadow() {
+	for(uint8_t reg = REG_PROGRAM_1; reg < REG_LED_MAP; reg++) {
+		shadowValid[reg / 8] &= (uint8_t)~(1 << (reg % 8));
+	}
+}
+
+void LP5562::beginBatch() {
+	if (batchDepth++ > 0) {
+		// Nested, the outermost commit() writes everything
+		return;
+	}
+
+	for(size_t ii = 0; ii < sizeof(batchDirty); ii++) {
+		batchDirty[ii] = 0;
+	}
+
+	if (!useShadowRegisters) {
+		// Without the shadow, values from earlier calls may be out of date. Read each register at most
+		// once during the batch.
+		invalidateShadow(false);
+	}
+}
+
+bool LP5562::commit() {
+	LP5562_STATS_SCOPE(METHOD_COMMIT);
+
+	if (batchDepth == 0) {
+		return true;
+	}
+	if (batchDepth > 1) {
+		batchDepth--;
+		return true;
+	}
+
+	bool bResult = flushBatch();
+	batchDepth = 0;
+	return bResult;
+}
+
+bool LP5562::stageRegisters(uint8_t reg, const uint8_t *values, size_t numValues) {
+	if (batchDepth == 0) {
+		return false;
+	}
+
+	// Only the control registers and LED_MAP can be staged. Program memory requires load mode so it's
+	// written in order, as are the registers that have side effects.
+	for(size_t ii = 0; ii < numValues; ii++) {
+		uint8_t r = (uint8_t)(reg + ii);
+		if (isVolatileRegister(r) || (r >= REG_PROGRAM_1 && r != REG_LED_MAP) || r >= NUM_REGISTERS) {
+			return false;
+		}
+	}
+
+	for(size_t ii = 0; ii < numValues; ii++) {
+		uint8_t r = (uint8_t)(reg + ii);
+		updateShadow(r, values[ii]);
+		batchDirty[r / 8] |= (uint8_t)(1 << (r % 8));
+	}
+	return true;
+}
+
+bool LP5562::flushBatch() {
+	if (batchDepth == 0) {
+		return true;
+	}
+
+	bool bResult = true;
+
+	uint8_t reg = 0;
+	while(reg < NUM_REGISTERS) {
+		if (!isBatchDirty(reg)) {
+			reg++;
+			continue;
+		}
+
+		// Extend the burst over following dirty registers. A gap of up to 2 clean registers is rewritten
+		// with its known value since that's cheaper than starting another transaction.
+		uint8_t first = reg;
+		uint8_t last = reg;
+		while((size_t)(last - first + 1) < MAX_WRITE_LEN) {
+			uint8_t next = last + 1;
+			while(next < NUM_REGISTERS && !isBatchDirty(next) && (next - last) <= 2 && isSafeToRewrite(next)) {
+				next++;
+			}
+			if (next >= NUM_REGISTERS || !isBatchDirty(next) || (size_t)(next - first + 1) > MAX_WRITE_LEN) {
+				break;
+			}
+			last = next;
+		}
+
+		if (!writeRegistersNow(first, &shadowRegs[first], last - first + 1)) {
+			// State of these registers is now unknown
+			for(uint8_t r = first; r <= last; r++) {
+				shadowValid[r / 8] &= (uint8_t)~(1 << (r % 8));
+			}
+			bResult = false;
+		}
+
+		for(uint8_t r = first; r <= last; r++) {
+			batchDirty[r / 8] &= (uint8_t)~(1 << (r % 8));
+		}
+		reg = last + 1;
+	}
+
+	return bResult;
+}
+
+bool LP5562::isSafeToRewrite(uint8_t reg) const {
+	// REG_ENABLE is excluded because the chip changes the engine bits when a program ends
+	return reg != REG_ENABLE && !isVolatileRegister(reg) && (reg < REG_PROGRAM_1 || reg == REG_LED_MAP) && isShadowValid(reg);
+}
+
+LP5562Stats::LP5562Stats() {
+	reset();
+}
+
+LP5562Stats::~LP5562Stats() {
+
+}
+
+void LP5562Stats::reset() {
+	memset(methods, 0, sizeof(methods));
+}
+
+// static
+const char *LP5562Stats::getMethodName(Method method) {
+	static const char * const names[NUM_METHODS] = {
+		"begin", "setPWM", "useDirect", "setBlink", "setBlink2", "setBreathe", "setIndicatorMode",
+		"setLedMapping", "setEnable", "setOpMode", "getStatus", "setProgram", "clearAllPrograms",
+		"programCounters", "startProgramAt", "startEngines", "registers", "resyncShadow", "snapshot", "restore", "commit"
+	};
+	if (method < 0 || method >= NUM_METHODS) {
+		return "";
+	}
+	return names[method];
+}
+
+void LP5562Stats::countTransaction(size_t numValues, bool success) {
+	if (currentMethod >= NUM_METHODS) {
+		return;
+	}
+	MethodStats &ms = methods[currentMethod];
+	ms.transactions++;
+	ms.bytes += (uint32_t) numValues;
+	if (!success) {
+		ms.failures++;
+	}
+}
+
+LP5562Stats::Scope::Scope(LP5562Stats *stats, Method method) : stats(NULL), startMicros(0) {
+	if (stats && stats->currentMethod == NUM_METHODS && method < NUM_METHODS) {
+		// Outermost call
+		this->stats = stats;
+		stats->currentMethod = method;
+		stats->methods[method].calls++;
+		startMicros = micros();
+	}
+}
+
+LP5562Stats::Scope::~Scope() {
+	if (stats) {
+		MethodStats &ms = stats->methods[stats->currentMethod];
+		uint32_t elapsed = (uint32_t)(micros() - startMicros);
+		ms.totalMicros += elapsed;
+		if (elapsed > ms.maxMicros) {
+			ms.maxMicros = elapsed;
+		}
+		stats->currentMethod = NUM_METHODS;
+	}
+}
+
+
+
+LP5562Program::LP5562Program() {
+
+}
+
+LP5562Program::~LP5562Program() {
+
+}
+
+bool LP5562Program::addCommandRamp(bool prescale, uint8_t stepTime, bool decrease, uint8_t numSteps, int atInst) {
+	if (stepTime > 0x3f) {
+		stepTime = 0x3f;
+	}
+	if (numSteps > 0x7f) {
+		// Only 7 bits in the instruction
+		return false;
+	}
+
+	return addCommand(LP5562Opcode::ramp(prescale, stepTime, decrease, numSteps), atInst);
+}
+
+bool LP5562Program::addCommandSetPWM(uint8_t level, int atInst) {
+	return addCommand(LP5562Opcode::setPWM(level), atInst);
+}
+
+bool LP5562Program::addCommandGoToStart(int atInst) {
+	return addCommand(LP5562Opcode::goToStart(), atInst);
+}
+
+bool LP5562Program::addCommandBranch(uint8_t loopCount, uint8_t stepNum, int atInst) {
+	if (loopCount > 0x3f) {
+		loopCount = 0x3f;
+	}
+	if (stepNum > 0xf) {
+		// Invalid step number
+		return false;
+	}
+
+	return addCommand(LP5562Opcode::branch(loopCount, stepNum), atInst);
+}
+
+bool LP5562Program::addCommandEnd(bool generateInterrupt, bool setPWMto0, int atInst) {
+	return addCommand(LP5562Opcode::end(generateInterrupt, setPWMto0), atInst);
+}
+
+bool LP5562Program::addCommandTriggerSend(uint8_t engineMask, int atInst) {
+	return addCommand(LP5562Opcode::triggerSend(engineMask), atInst);
+}
+
+bool LP5562Program::addCommandTriggerWait(uint8_t engineMask, int atInst) {
+	return addCommand(LP5562Opcode::triggerWait(engineMask), atInst);
 }
 
 
@@ -705,42 +1668,458 @@ bool LP5562Program::addCommand(uint16_t cmd, int atInst) {
 }
 
 
-bool LP5562Program::addDelay(unsigned long milliseconds) {
-	if (milliseconds < 32) {
-		// No prescale, no branch
-		// 0.49 milliseconds per cycle
-		uint8_t steps = (uint8_t) (milliseconds * 2);
+bool LP5562Program::addDelay(unsigned long milliseconds, size_t maxInstructions, int32_t *errorMicros) {
+	if (maxInstructions > MAX_INSTRUCTIONS - nextInst) {
+		maxInstructions = MAX_INSTRUCTIONS - nextInst;
+	}
+
+	uint64_t ticks = ((uint64_t)milliseconds * DELAY_TICKS_PER_SECOND + 500) / 1000;
 
-		return addCommandWait(false, steps);
+	DelaySolution solution;
+	if (!solveDelay(ticks, maxInstructions, solution)) {
+		return false;
 	}
-	else
-	if (milliseconds <= 1000) {
-		// Prescale, no branch
-		// 15.6 milliseconds per cycle
-		uint8_t steps = (uint8_t) (milliseconds / 16);
 
-		return addCommandWait(true, steps);
+	// Branches in the solution are relative to the first instruction of the delay
+	uint8_t stepNum = getStepNum();
+	for(size_t ii = 0; ii < solution.numInstructions; ii++) {
+		uint16_t inst = solution.instructions[ii];
+		if ((inst & 0xe000) == 0xa000) {
+			inst += stepNum;
+		}
+		if (!addCommand(inst)) {
+			return false;
+		}
 	}
-	else
-	if (milliseconds <= 63000) {
-		// Prescale and branch
 
-		// Each delay is 1 second (63 steps), up to 63 loops
-		uint8_t loopCount = (uint8_t) (milliseconds / 1000);
+	if (errorMicros) {
+		*errorMicros = (int32_t)(solution.errorTicks * 1000000 / (int64_t)DELAY_TICKS_PER_SECOND);
+	}
+	return true;
+}
 
-		uint8_t stepNum = getStepNum();
+bool LP5562Program::addRampSteps(bool prescale, uint8_t stepTime, bool decrease, uint16_t numSteps) {
+	while(numSteps > 0) {
+		uint8_t count = (numSteps > 127) ? 127 : (uint8_t) numSteps;
+		if (!addCommandRamp(prescale, stepTime, decrease, count)) {
+			return false;
+		}
+		numSteps -= count;
+	}
+	return true;
+}
 
-		bool bResult = addCommandWait(true, 63);
-		if (!bResult) {
+bool LP5562Program::addRamp(uint8_t fromLevel, uint8_t toLevel, unsigned long durationMs, unsigned long toleranceMicros, int32_t *errorMicros) {
+	if (nextInst >= MAX_INSTRUCTIONS) {
+		return false;
+	}
+
+	uint64_t ticks = ((uint64_t)durationMs * DELAY_TICKS_PER_SECOND + 500) / 1000;
+	int64_t toleranceTicks = ((int64_t)toleranceMicros * DELAY_TICKS_PER_SECOND) / 1000000;
+	bool decrease = (toLevel < fromLevel);
+	uint8_t numSteps = decrease ? fromLevel - toLevel : toLevel - fromLevel;
+
+	// Use the fewest instructions that meet the tolerance. One instruction is needed for the set PWM.
+	// More instructions never make the error worse, so this is a binary search.
+	DelaySolution solution;
+	size_t low = 0, high = MAX_INSTRUCTIONS - nextInst - 1;
+	if (!solveRamp(ticks, numSteps, decrease, high, solution) ||
+		solution.errorTicks > toleranceTicks || -solution.errorTicks > toleranceTicks) {
+		return false;
+	}
+	while(low < high) {
+		size_t mid = (low + high) / 2;
+		if (solveRamp(ticks, numSteps, decrease, mid, solution) &&
+			solution.errorTicks <= toleranceTicks && -solution.errorTicks <= toleranceTicks) {
+			high = mid;
+		}
+		else {
+			low = mid + 1;
+		}
+	}
+	solveRamp(ticks, numSteps, decrease, high, solution);
+
+	addCommandSetPWM(fromLevel);
+
+	// Branches in the solution are relative to the first instruction of the ramp
+	uint8_t stepNum = getStepNum();
+	for(size_t ii = 0; ii < solution.numInstructions; ii++) {
+		uint16_t inst = solution.instructions[ii];
+		if ((inst & 0xe000) == 0xa000) {
+			inst += stepNum;
+		}
+		if (!addCommand(inst)) {
 			return false;
 		}
+	}
 
-		return addCommandBranch(loopCount, stepNum);
+	if (errorMicros) {
+		*errorMicros = (int32_t)(solution.errorTicks * 1000000 / DELAY_TICKS_PER_SECOND);
 	}
-	else {
-		// Too long
+	return true;
+}
+
+// static
+bool LP5562Program::solveDelay(uint64_t ticks, size_t maxInstructions, DelaySolution &solution) {
+	if (maxInstructions > MAX_DELAY_INSTRUCTIONS) {
+		maxInstructions = MAX_DELAY_INSTRUCTIONS;
+	}
+
+	solution.numInstructions = 0;
+	solution.errorTicks = -(int64_t)ticks;
+	if (ticks == 0) {
+		return true;
+	}
+
+	// The longest delay is the longest wait in as many nested loops as fit, followed by more
+	// of the longest wait
+	const int64_t longestWait = 63 * DELAY_PRESCALE1_TICKS;
+	int64_t maxTicks = 0;
+	if (maxInstructions > 0) {
+		size_t depth = (maxInstructions - 1 < 3) ? maxInstructions - 1 : 3;
+		maxTicks = longestWait;
+		for(size_t ii = 0; ii < depth; ii++) {
+			maxTicks *= 63;
+		}
+		maxTicks += (int64_t)(maxInstructions - 1 - depth) * longestWait;
+	}
+	if ((int64_t)ticks > maxTicks) {
+		return false;
+	}
+
+	int64_t target = (int64_t)ticks;
+
+	// Every wait is a multiple of 16 ticks, so nothing can do better than the nearest multiple
+	int64_t bestPossible = target % DELAY_PRESCALE0_TICKS;
+	if (bestPossible > DELAY_PRESCALE0_TICKS / 2) {
+		bestPossible = DELAY_PRESCALE0_TICKS - bestPossible;
+	}
+
+	DelaySolution candidate;
+	for(size_t count = 1; count <= maxInstructions; count++) {
+		// Waits only
+		candidate.numInstructions = 0;
+		candidate.errorTicks = appendWaits(target, count, candidate) - target;
+		considerDelay(solution, candidate);
+
+		// A wait in 1 - 3 nested loops. Three loops are only needed past 65 minutes.
+		for(size_t depth = 1; depth <= 3 && depth < count; depth++) {
+			if (depth == 3 && target <= longestWait * 63 * 63) {
+				break;
+			}
+			size_t maxWaits = count - 1 - depth;
+
+			for(int prescale = 0; prescale < 2; prescale++) {
+				for(int64_t stepTime = 1; stepTime <= 63; stepTime++) {
+					int64_t body = stepTime * (prescale ? DELAY_PRESCALE1_TICKS : DELAY_PRESCALE0_TICKS);
+					int64_t loops[3];
+
+					// The innermost loops are chosen by brute force, and the outermost one is the
+					// loop count just below or above the requested time
+					int64_t inner1Max = (depth >= 2) ? 63 : 2;
+					int64_t inner2Max = (depth >= 3) ? 63 : 2;
+					for(int64_t inner1 = 2; inner1 <= inner1Max; inner1++) {
+						for(int64_t inner2 = 2; inner2 <= inner2Max; inner2++) {
+							int64_t innerTicks = body;
+							if (depth >= 2) {
+								loops[0] = inner1;
+								innerTicks *= inner1;
+							}
+							if (depth >= 3) {
+								loops[1] = inner2;
+								innerTicks *= inner2;
+							}
+
+							int64_t outer = target / innerTicks;
+							for(int64_t ii = 0; ii < 2; ii++, outer++) {
+								if (outer < 2 || outer > 63) {
+									continue;
+								}
+								loops[depth - 1] = outer;
+								considerLoop(target, prescale != 0, (uint8_t)stepTime, loops, depth, maxWaits, solution);
+							}
+						}
+					}
+				}
+			}
+		}
+
+		int64_t error = (solution.errorTicks < 0) ? -solution.errorTicks : solution.errorTicks;
+		if (error <= bestPossible) {
+			break;
+		}
+	}
+
+	return true;
+}
+
+// static
+bool LP5562Program::solveRamp(uint64_t ticks, uint8_t numSteps, bool decrease, size_t maxInstructions, DelaySolution &solution) {
+	if (numSteps == 0) {
+		return solveDelay(ticks, maxInstructions, solution);
+	}
+	if (maxInstructions > MAX_INSTRUCTIONS) {
+		maxInstructions = MAX_INSTRUCTIONS;
+	}
+
+	// Nothing found yet
+	solution.numInstructions = 0;
+	solution.errorTicks = INT64_MAX;
+
+	int64_t target = (int64_t)ticks;
+	DelaySolution candidate;
+
+	for(int prescale = 0; prescale < 2; prescale++) {
+		int64_t unit = prescale ? DELAY_PRESCALE1_TICKS : DELAY_PRESCALE0_TICKS;
+
+		// Same step time for every step
+		int64_t stepTime = (target + (numSteps * unit) / 2) / (numSteps * unit);
+		if (stepTime < 1) {
+			stepTime = 1;
+		}
+		if (stepTime > 63) {
+			stepTime = 63;
+		}
+		candidate.numInstructions = 0;
+		if (appendRampGroup(candidate, maxInstructions, prescale != 0, (uint8_t) stepTime, decrease, numSteps)) {
+			candidate.errorTicks = numSteps * stepTime * unit - target;
+			considerDelay(solution, candidate);
+		}
+
+		// Two step times, one cycle apart. The slower steps are done first.
+		int64_t units = (target + unit / 2) / unit;
+		int64_t slow = units % numSteps;
+		stepTime = units / numSteps;
+		if (slow != 0 && stepTime >= 1 && stepTime + 1 <= 63) {
+			candidate.numInstructions = 0;
+			if (appendRampGroup(candidate, maxInstructions, prescale != 0, (uint8_t)(stepTime + 1), decrease, (uint16_t) slow) &&
+				appendRampGroup(candidate, maxInstructions, prescale != 0, (uint8_t) stepTime, decrease, (uint16_t)(numSteps - slow))) {
+				candidate.errorTicks = units * unit - target;
+				considerDelay(solution, candidate);
+			}
+		}
+	}
+
+	// Slow ramps: each step is a delay followed by a one-cycle ramp step, in a loop. Either every step
+	// is the same length, or some steps are one cycle longer than the others to get closer.
+	int64_t units = (target + DELAY_PRESCALE0_TICKS / 2) / DELAY_PRESCALE0_TICKS;
+	int64_t shortUnits = units / numSteps;
+	int64_t longSteps = units % numSteps;
+	int64_t sameUnits = (units + numSteps / 2) / numSteps;
+
+	for(size_t delayInstructions = 1; delayInstructions <= MAX_DELAY_INSTRUCTIONS; delayInstructions++) {
+		int64_t achievedTicks;
+
+		candidate.numInstructions = 0;
+		if (appendSlowSteps(candidate, maxInstructions, sameUnits * DELAY_PRESCALE0_TICKS, numSteps, decrease, delayInstructions, achievedTicks)) {
+			candidate.errorTicks = achievedTicks - target;
+			considerDelay(solution, candidate);
+		}
+
+		if (longSteps != 0) {
+			int64_t longTicks, shortTicks;
+
+			candidate.numInstructions = 0;
+			if (appendSlowSteps(candidate, maxInstructions, (shortUnits + 1) * DELAY_PRESCALE0_TICKS, longSteps, decrease, delayInstructions, longTicks) &&
+				appendSlowSteps(candidate, maxInstructions, shortUnits * DELAY_PRESCALE0_TICKS, numSteps - longSteps, decrease, delayInstructions, shortTicks)) {
+				candidate.errorTicks = longTicks + shortTicks - target;
+				considerDelay(solution, candidate);
+			}
+		}
+	}
+
+	return solution.errorTicks != INT64_MAX;
+}
+
+// static
+int64_t LP5562Program::appendWaits(int64_t ticks, size_t maxWaits, DelaySolution &solution) {
+	if (ticks <= 0 || maxWaits == 0) {
+		return 0;
+	}
+
+	// Try each split between coarse (prescale = true) and fine (prescale = false) waits. The
+	// coarse waits get as close as they can and the fine waits make up the rest.
+	int64_t bestCoarse = 0, bestFine = 0, bestTotal = 0;
+	size_t bestCoarseWaits = 0, bestFineWaits = 0;
+
+	for(size_t coarseWaits = 0; coarseWaits <= maxWaits; coarseWaits++) {
+		for(size_t fineWaits = 0; coarseWaits + fineWaits <= maxWaits; fineWaits++) {
+			if (coarseWaits + fineWaits == 0) {
+				continue;
+			}
+			int64_t minFine = (int64_t)fineWaits, maxFine = 63 * (int64_t)fineWaits;
+			int64_t minCoarse = (int64_t)coarseWaits, maxCoarse = 63 * (int64_t)coarseWaits;
+
+			int64_t tryCoarse[4];
+			tryCoarse[0] = (ticks - minFine * DELAY_PRESCALE0_TICKS) / DELAY_PRESCALE1_TICKS;
+			tryCoarse[1] = tryCoarse[0] + 1;
+			tryCoarse[2] = (ticks - maxFine * DELAY_PRESCALE0_TICKS) / DELAY_PRESCALE1_TICKS;
+			tryCoarse[3] = tryCoarse[2] + 1;
+
+			for(size_t ii = 0; ii < 4; ii++) {
+				int64_t coarse = tryCoarse[ii];
+				if (coarse < minCoarse) {
+					coarse = minCoarse;
+				}
+				if (coarse > maxCoarse) {
+					coarse = maxCoarse;
+				}
+
+				int64_t remainder = ticks - coarse * DELAY_PRESCALE1_TICKS;
+				int64_t fine = (remainder > 0) ? (remainder + DELAY_PRESCALE0_TICKS / 2) / DELAY_PRESCALE0_TICKS : 0;
+				if (fine < minFine) {
+					fine = minFine;
+				}
+				if (fine > maxFine) {
+					fine = maxFine;
+				}
+
+				int64_t total = coarse * DELAY_PRESCALE1_TICKS + fine * DELAY_PRESCALE0_TICKS;
+				int64_t error = (total > ticks) ? total - ticks : ticks - total;
+				int64_t bestError = (bestTotal > ticks) ? bestTotal - ticks : ticks - bestTotal;
+				if (error < bestError || (error == bestError && coarseWaits + fineWaits < bestCoarseWaits + bestFineWaits)) {
+					bestCoarse = coarse;
+					bestFine = fine;
+					bestTotal = total;
+					bestCoarseWaits = coarseWaits;
+					bestFineWaits = fineWaits;
+				}
+			}
+		}
+	}
+
+	// Split the units between the waits, up to 63 each
+	for(size_t ii = 0; ii < bestCoarseWaits; ii++) {
+		int64_t steps = bestCoarse - (int64_t)(bestCoarseWaits - 1 - ii);
+		if (steps > 63) {
+			steps = 63;
+		}
+		solution.instructions[solution.numInstructions++] = LP5562Opcode::wait(true, (uint8_t)steps);
+		bestCoarse -= steps;
+	}
+	for(size_t ii = 0; ii < bestFineWaits; ii++) {
+		int64_t steps = bestFine - (int64_t)(bestFineWaits - 1 - ii);
+		if (steps > 63) {
+			steps = 63;
+		}
+		solution.instructions[solution.numInstructions++] = LP5562Opcode::wait(false, (uint8_t)steps);
+		bestFine -= steps;
+	}
+
+	return bestTotal;
+}
+
+// static
+void LP5562Program::considerLoop(int64_t ticks, bool prescale, uint8_t stepTime, const int64_t *loops, size_t depth, size_t maxWaits, DelaySolution &best) {
+	DelaySolution candidate;
+
+	int64_t loopTicks = stepTime * (prescale ? DELAY_PRESCALE1_TICKS : DELAY_PRESCALE0_TICKS);
+
+	// Each branch goes back to the wait at the start, so the loops multiply
+	candidate.numInstructions = 0;
+	candidate.instructions[candidate.numInstructions++] = LP5562Opcode::wait(prescale, stepTime);
+	for(size_t ii = 0; ii < depth; ii++) {
+		candidate.instructions[candidate.numInstructions++] = LP5562Opcode::branch((uint8_t)loops[ii], 0);
+		loopTicks *= loops[ii];
+	}
+
+	candidate.errorTicks = loopTicks + appendWaits(ticks - loopTicks, maxWaits, candidate) - ticks;
+	considerDelay(best, candidate);
+}
+
+// static
+bool LP5562Program::appendSlowSteps(DelaySolution &solution, size_t maxInstructions, int64_t stepTicks, int64_t numSteps, bool decrease, size_t delayInstructions, int64_t &achievedTicks) {
+	// The step is a delay and a one-cycle ramp step, so the delay must be at least one cycle
+	DelaySolution body;
+	if (stepTicks < 2 * DELAY_PRESCALE0_TICKS || !solveDelay((uint64_t)(stepTicks - DELAY_PRESCALE0_TICKS), delayInstructions, body) ||
+		body.numInstructions < delayInstructions) {
+		// Fewer instructions were enough, which was already tried
+		return false;
+	}
+	body.instructions[body.numInstructions++] = LP5562Opcode::ramp(false, 1, decrease, 1);
+	achievedTicks = numSteps * (stepTicks + body.errorTicks);
+
+	// Up to 63 steps is one loop. More is two nested loops, and the steps left over are a second copy.
+	int64_t inner = numSteps, outer = 1, extra = 0;
+	if (numSteps > 63) {
+		extra = numSteps;
+		for(int64_t ii = 2; ii <= 63; ii++) {
+			int64_t jj = numSteps / ii;
+			if (jj <= 63 && numSteps - ii * jj < extra) {
+				inner = ii;
+				outer = jj;
+				extra = numSteps - ii * jj;
+			}
+		}
+	}
+
+	uint8_t start = solution.numInstructions;
+	if (!appendSolution(solution, maxInstructions, body) ||
+		!appendBranch(solution, maxInstructions, inner, start) ||
+		!appendBranch(solution, maxInstructions, outer, start)) {
+		return false;
+	}
+	if (extra > 0) {
+		start = solution.numInstructions;
+		if (!appendSolution(solution, maxInstructions, body) ||
+			!appendBranch(solution, maxInstructions, extra, start)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// static
+bool LP5562Program::appendRampGroup(DelaySolution &solution, size_t maxInstructions, bool prescale, uint8_t stepTime, bool decrease, uint16_t numSteps) {
+	while(numSteps > 0) {
+		uint16_t count = (numSteps > 127) ? 127 : numSteps;
+		if (solution.numInstructions >= maxInstructions) {
+			return false;
+		}
+		solution.instructions[solution.numInstructions++] = LP5562Opcode::ramp(prescale, stepTime, decrease, (uint8_t) count);
+		numSteps -= count;
+	}
+	return true;
+}
+
+// static
+bool LP5562Program::appendSolution(DelaySolution &solution, size_t maxInstructions, const DelaySolution &part) {
+	if (solution.numInstructions + part.numInstructions > maxInstructions) {
 		return false;
 	}
+
+	uint8_t start = solution.numInstructions;
+	for(size_t ii = 0; ii < part.numInstructions; ii++) {
+		uint16_t inst = part.instructions[ii];
+		if ((inst & 0xe000) == 0xa000) {
+			inst += start;
+		}
+		solution.instructions[solution.numInstructions++] = inst;
+	}
+	return true;
+}
+
+// static
+bool LP5562Program::appendBranch(DelaySolution &solution, size_t maxInstructions, int64_t loopCount, uint8_t stepNum) {
+	if (loopCount < 2) {
+		// Looping once is the same as not looping
+		return true;
+	}
+	if (solution.numInstructions >= maxInstructions) {
+		return false;
+	}
+	solution.instructions[solution.numInstructions++] = LP5562Opcode::branch((uint8_t) loopCount, stepNum);
+	return true;
+}
+
+// static
+void LP5562Program::considerDelay(DelaySolution &best, const DelaySolution &candidate) {
+	int64_t error = (candidate.errorTicks < 0) ? -candidate.errorTicks : candidate.errorTicks;
+	int64_t bestError = (best.errorTicks < 0) ? -best.errorTicks : best.errorTicks;
+
+	if (error < bestError || (error == bestError && candidate.numInstructions < best.numInstructions)) {
+		best = candidate;
+	}
 }
 
 void LP5562Program::clear() {
@@ -4,7 +4,189 @@
 // Repository: https://github.com/rickkas7/LP5562-RK
 // License: MIT
 
+#if defined(PARTICLE)
 #include "Particle.h"
+#else
+#include "LP5562-RK-Host.h"
+#endif
+
+/**
+ * @brief Encodes LP5562 engine instructions at compile time
+ *
+ * The constexpr functions return the 16-bit instruction word. Out of range values are masked to the
+ * size of the field, the same as LP5562Program does. The templates do the same thing but check the
+ * values with static_assert so mistakes are caught when compiling.
+ *
+ * A program built this way is a const array, so it's stored in flash and nothing is computed at
+ * runtime when the pattern is set:
+ *
+ * static const uint16_t blinkProgram[] = {
+ *     LP5562Opcode::SetPWM<255>::value,
+ *     LP5562Opcode::WaitMs<500>::value,
+ *     LP5562Opcode::SetPWM<0>::value,
+ *     LP5562Opcode::WaitMs<500>::value
+ * };
+ *
+ * ledDriver.setProgram(1, blinkProgram, true);
+ *
+ * Passing the array (not a pointer) to setProgram() also checks that it's not longer than 16
+ * instructions at compile time.
+ */
+class LP5562Opcode {
+public:
+	/**
+	 * @brief Ramp or wait instruction. See LP5562Program::addCommandRamp().
+	 */
+	static constexpr uint16_t ramp(bool prescale, uint8_t stepTime, bool decrease, uint8_t numSteps) {
+		return (uint16_t)((prescale ? 0x4000 : 0) | ((stepTime & 0x3f) << 8) | (decrease ? 0x0080 : 0) | (numSteps & 0x7f));
+	}
+
+	/**
+	 * @brief Wait instruction. See LP5562Program::addCommandWait().
+	 */
+	static constexpr uint16_t wait(bool prescale, uint8_t stepTime) {
+		return ramp(prescale, stepTime, false, 0);
+	}
+
+	/**
+	 * @brief Wait instruction for a number of milliseconds (1 - 984), rounded to the nearest step
+	 *
+	 * Up to 30 ms uses the 0.49 ms cycle time, longer waits use the 15.6 ms cycle time. Unlike the
+	 * other fields, ms is not masked: 0 gives the shortest wait (0.49 ms) and more than 984 gives
+	 * the longest (984 ms), since a wrapped step time would be a much shorter wait.
+	 */
+	static constexpr uint16_t waitMs(unsigned long ms) {
+		return (ms * 2048 + 500) / 1000 <= 63 ? wait(false, clampStepTime((ms * 2048 + 500) / 1000)) : wait(true, clampStepTime((ms * 64 + 500) / 1000));
+	}
+
+	/**
+	 * @brief Limit a number of cycles to the step time field (1 - 63)
+	 */
+	static constexpr uint8_t clampStepTime(unsigned long cycles) {
+		return (uint8_t)(cycles < 1 ? 1 : (cycles > 63 ? 63 : cycles));
+	}
+
+	/**
+	 * @brief Set PWM instruction. See LP5562Program::addCommandSetPWM().
+	 */
+	static constexpr uint16_t setPWM(uint8_t level) {
+		return (uint16_t)(0x4000 | level);
+	}
+
+	/**
+	 * @brief Go to start instruction. See LP5562Program::addCommandGoToStart().
+	 */
+	static constexpr uint16_t goToStart() {
+		return 0x0000;
+	}
+
+	/**
+	 * @brief Branch instruction. See LP5562Program::addCommandBranch().
+	 */
+	static constexpr uint16_t branch(uint8_t loopCount, uint8_t stepNum) {
+		return (uint16_t)(0xa000 | ((loopCount & 0x3f) << 7) | (stepNum & 0xf));
+	}
+
+	/**
+	 * @brief End instruction. See LP5562Program::addCommandEnd().
+	 */
+	static constexpr uint16_t end(bool generateInterrupt, bool setPWMto0) {
+		return (uint16_t)(0xc000 | (generateInterrupt ? 0x1000 : 0) | (setPWMto0 ? 0x0800 : 0));
+	}
+
+	/**
+	 * @brief Trigger send instruction. See LP5562Program::addCommandTriggerSend().
+	 */
+	static constexpr uint16_t triggerSend(uint8_t engineMask) {
+		return (uint16_t)(0xe000 | ((engineMask & 0x7) << 7));
+	}
+
+	/**
+	 * @brief Trigger wait instruction. See LP5562Program::addCommandTriggerWait().
+	 */
+	static constexpr uint16_t triggerWait(uint8_t engineMask) {
+		return (uint16_t)(0xe000 | ((engineMask & 0x7) << 1));
+	}
+
+	/**
+	 * @brief Ramp instruction with compile-time range checks
+	 */
+	template<bool prescale, uint8_t stepTime, bool decrease, uint8_t numSteps>
+	struct Ramp {
+		static_assert(stepTime >= 1 && stepTime <= 63, "stepTime must be 1 - 63");
+		static_assert(numSteps >= 1 && numSteps <= 127, "numSteps must be 1 - 127");
+		static constexpr uint16_t value = ramp(prescale, stepTime, decrease, numSteps);	//!< Instruction word
+	};
+
+	/**
+	 * @brief Wait instruction with compile-time range checks
+	 */
+	template<bool prescale, uint8_t stepTime>
+	struct Wait {
+		static_assert(stepTime >= 1 && stepTime <= 63, "stepTime must be 1 - 63");
+		static constexpr uint16_t value = wait(prescale, stepTime);	//!< Instruction word
+	};
+
+	/**
+	 * @brief Wait in milliseconds with compile-time range checks. Longer delays need a Branch.
+	 */
+	template<unsigned long ms>
+	struct WaitMs {
+		static_assert(ms >= 1 && ms <= 984, "ms must be 1 - 984; use a Branch for longer delays");
+		static constexpr uint16_t value = waitMs(ms);	//!< Instruction word
+	};
+
+	/**
+	 * @brief Set PWM instruction
+	 */
+	template<uint8_t level>
+	struct SetPWM {
+		static constexpr uint16_t value = setPWM(level);	//!< Instruction word
+	};
+
+	/**
+	 * @brief Go to start instruction
+	 */
+	struct GoToStart {
+		static constexpr uint16_t value = 0x0000;	//!< Instruction word
+	};
+
+	/**
+	 * @brief Branch instruction with compile-time range checks
+	 */
+	template<uint8_t loopCount, uint8_t stepNum>
+	struct Branch {
+		static_assert(loopCount <= 63, "loopCount must be 0 - 63");
+		static_assert(stepNum <= 15, "stepNum must be 0 - 15");
+		static constexpr uint16_t value = branch(loopCount, stepNum);	//!< Instruction word
+	};
+
+	/**
+	 * @brief End instruction
+	 */
+	template<bool generateInterrupt, bool setPWMto0>
+	struct End {
+		static constexpr uint16_t value = end(generateInterrupt, setPWMto0);	//!< Instruction word
+	};
+
+	/**
+	 * @brief Trigger send instruction with compile-time range checks
+	 */
+	template<uint8_t engineMask>
+	struct TriggerSend {
+		static_assert(engineMask >= 1 && engineMask <= 7, "engineMask must be a combination of MASK_ENGINE_1, MASK_ENGINE_2, and MASK_ENGINE_3");
+		static constexpr uint16_t value = triggerSend(engineMask);	//!< Instruction word
+	};
+
+	/**
+	 * @brief Trigger wait instruction with compile-time range checks
+	 */
+	template<uint8_t engineMask>
+	struct TriggerWait {
+		static_assert(engineMask >= 1 && engineMask <= 7, "engineMask must be a combination of MASK_ENGINE_1, MASK_ENGINE_2, and MASK_ENGINE_3");
+		static constexpr uint16_t value = triggerWait(engineMask);	//!< Instruction word
+	};
+};
 
 /**
  * @brief Class for programming the LP5562 directly
@@ -41,7 +223,7 @@ public:
 	 * With prescale = true, 15.6 ms to 982.8 ms. You can make even longer wait times by putting
 	 * a wait in a loop. Since a loop can be executed up to 63 times, you can get a 62 second delay.
 	 */
-	bool addCommandWait(bool prescale, uint8_t stepTime, int atInst = -1) { return addCommandRamp(prescale, stepTime, false, 0); };
+	bool addCommandWait(bool prescale, uint8_t stepTime, int atInst = -1) { return addCommandRamp(prescale, stepTime, false, 0, atInst); };
 
 	/**
 	 * @brief Add a ramp
@@ -52,7 +234,7 @@ public:
 	 *
 	 * @param decrease false = step up, true = step down
 	 *
-	 * @param numSteps Number of times the PWM is increased by 1.
+	 * @param numSteps Number of times the PWM is increased by 1 (0 - 127). Use addRampSteps() or addRamp() for more.
 	 *
 	 * @param atInst (can omit) Normally instructions are added at the current end of the program
 	 * but you can use the atInst parameter to set a specific instruction (0 - 15) in the program.
@@ -62,9 +244,50 @@ public:
 	 *
 	 * The starting and ending point of the ramp depend on the current PWM value when you start,
 	 * when you are incrementing or decrementing, and the number of steps.
+	 *
+	 * Returns false if numSteps is more than 127, which doesn't fit in the instruction.
 	 */
 	bool addCommandRamp(bool prescale, uint8_t stepTime, bool decrease, uint8_t numSteps, int atInst = -1);
 
+	/**
+	 * @brief Add a ramp of up to 255 steps, split into as many ramp instructions as needed
+	 *
+	 * @param prescale false = 0.49 ms cycle time; true = 15.6 ms cycle time
+	 *
+	 * @param stepTime Wait this this many cycles (1 - 63) for each step
+	 *
+	 * @param decrease false = step up, true = step down
+	 *
+	 * @param numSteps Number of times the PWM is changed by 1 (1 - 255)
+	 *
+	 * A ramp instruction can only do 127 steps, so a full 0 to 255 ramp takes 3 instructions. Like
+	 * addDelay(), this can only be added at the end of the program.
+	 */
+	bool addRampSteps(bool prescale, uint8_t stepTime, bool decrease, uint16_t numSteps);
+
+	/**
+	 * @brief Add a ramp from one level to another that takes a given time
+	 *
+	 * @param fromLevel PWM level at the start of the ramp (0 - 255). A set PWM instruction is added first.
+	 *
+	 * @param toLevel PWM level at the end of the ramp (0 - 255). If it's the same as fromLevel, the level
+	 * is held for durationMs.
+	 *
+	 * @param durationMs Time for the ramp in milliseconds
+	 *
+	 * @param toleranceMicros (can omit) The largest acceptable difference between the achieved and the
+	 * requested time in microseconds. Default is 1 ms.
+	 *
+	 * @param errorMicros (can omit) If not NULL, filled in with the achieved time minus durationMs in microseconds
+	 *
+	 * @return false if the ramp can't be done within the tolerance in the space left in the program
+	 *
+	 * The fewest instructions that meet the tolerance are used; see solveRamp(). Each step takes a
+	 * whole number of 0.49 ms cycles, so a ramp can't be faster than 0.49 ms per level. Like addDelay(),
+	 * this can only be added at the end of the program.
+	 */
+	bool addRamp(uint8_t fromLevel, uint8_t toLevel, unsigned long durationMs, unsigned long toleranceMicros = 1000, int32_t *errorMicros = NULL);
+
 	/**
 	 * @brief Set a specific PWM level
 	 *
@@ -162,16 +385,87 @@ public:
 	/**
 	 * @brief Add a delay in milliseconds
 	 *
-	 * @param milliseconds The number of milliseconds to delay (1 - 61916).
+	 * @param milliseconds The number of milliseconds to delay. With the default of 3 instructions, up
+	 * to 3906984 (about 65 minutes). 0 adds nothing.
+	 *
+	 * @param maxInstructions The maximum number of instructions to use (1 - MAX_DELAY_INSTRUCTIONS). It's
+	 * also limited to the space left in the program.
+	 *
+	 * @param errorMicros (can omit) If not NULL, filled in with the achieved delay minus the requested
+	 * delay in microseconds
+	 *
+	 * There is no atInst option for this method because depending on the delay, it may add several
+	 * instructions: waits with either prescale, and waits in loops (including nested loops for very long
+	 * delays). Since it has a variable number of instructions, it can't be inserted into arbitrary code,
+	 * only added at the end.
+	 *
+	 * The combination closest to the requested time is used; see solveDelay(). The engine clock
+	 * resolution is 0.49 ms, so with enough instructions the error is at most 0.25 ms for delays up to
+	 * about 30 minutes. Longer delays are mostly made of one looped wait, so the error can be much
+	 * larger (141 ms for one hour with MAX_DELAY_INSTRUCTIONS); check errorMicros if it matters.
+	 *
+	 * @return false if the program is full or the delay is too long for maxInstructions
+	 */
+	bool addDelay(unsigned long milliseconds, size_t maxInstructions = DEFAULT_DELAY_INSTRUCTIONS, int32_t *errorMicros = NULL);
+
+	/**
+	 * @brief Maximum number of instructions a delay can be encoded as
+	 */
+	static const size_t MAX_DELAY_INSTRUCTIONS = 6;
+
+	/**
+	 * @brief Number of instructions addDelay() uses by default
+	 */
+	static const size_t DEFAULT_DELAY_INSTRUCTIONS = 3;
+
+	/**
+	 * @brief A delay or ramp converted to instructions by solveDelay() or solveRamp()
+	 *
+	 * Branch instructions have a step number relative to the first instruction of the delay.
+	 */
+	struct DelaySolution {
+		uint8_t numInstructions;							//!< Number of entries in instructions
+		uint16_t instructions[16];							//!< Instruction words (at most the 16 that fit in an engine)
+		int64_t errorTicks;									//!< Achieved minus requested time in ticks of the 32.768 kHz clock
+	};
+
+	/**
+	 * @brief Find the instructions that come closest to a delay
+	 *
+	 * @param ticks The delay in ticks of the 32.768 kHz engine clock
+	 *
+	 * @param maxInstructions The maximum number of instructions to use (0 - MAX_DELAY_INSTRUCTIONS)
+	 *
+	 * @param solution Filled in with the instructions and the remaining error
+	 *
+	 * @return false if the delay is longer than can be encoded in maxInstructions
+	 *
+	 * The solution is a sequence of waits (prescale 0.49 ms or 15.6 ms units, 1 - 63 units each),
+	 * optionally with the first wait in 1 - 3 nested loops of up to 63 times each. Of the solutions
+	 * with the smallest error, the one with the fewest instructions is used.
+	 */
+	static bool solveDelay(uint64_t ticks, size_t maxInstructions, DelaySolution &solution);
+
+	/**
+	 * @brief Find the instructions that come closest to a ramp of a given length
+	 *
+	 * @param ticks The length of the ramp in ticks of the 32.768 kHz engine clock
+	 *
+	 * @param numSteps Number of PWM levels to change (0 - 255). 0 is the same as solveDelay().
+	 *
+	 * @param decrease true to ramp down
+	 *
+	 * @param maxInstructions The maximum number of instructions to use (0 - 16)
 	 *
-	 * There is no atInst option for this method because depending on the delay, it may add two
-	 * instructions: a wait (for up to 1000 milliseconds), or a wait and a loop. Since it has
-	 * a variable number of instructions, it can't be inserted into arbitrary code, only added
-	 * at the end.
+	 * @param solution Filled in with the instructions and the remaining error
 	 *
-	 * When the delay is > 1000 milliseconds, the resolution is 1 second.
+	 * @return false if no encoding fits in maxInstructions
+	 *
+	 * The steps are done at one step time, or at two step times one cycle apart to get closer. Steps
+	 * longer than the longest ramp step (0.98 s) are a delay followed by a one-step ramp, in a loop.
+	 * Of the solutions with the smallest error, the one with the fewest instructions is used.
 	 */
-	bool addDelay(unsigned long milliseconds);
+	static bool solveRamp(uint64_t ticks, uint8_t numSteps, bool decrease, size_t maxInstructions, DelaySolution &solution);
 
 	/**
 	 * @brief Clear the current program
@@ -214,8 +508,315 @@ protected:
 	 * @brief The array of program instructions. Each instruction is a 16-bit word.
 	 */
 	uint16_t instructions[MAX_INSTRUCTIONS];
+
+	/**
+	 * @brief Append waits to solution that add up as close as possible to ticks
+	 *
+	 * @param ticks The time to add in ticks. If 0 or less, nothing is added.
+	 *
+	 * @param maxWaits Maximum number of wait instructions to add
+	 *
+	 * @param solution The solution to append to. There must be room for maxWaits more instructions.
+	 *
+	 * @return The number of ticks added
+	 */
+	static int64_t appendWaits(int64_t ticks, size_t maxWaits, DelaySolution &solution);
+
+	/**
+	 * @brief Try a wait in nested loops followed by waits for the remainder, and keep it in best if it's better
+	 *
+	 * @param ticks Requested time in ticks
+	 *
+	 * @param prescale Prescale of the wait in the loop
+	 *
+	 * @param stepTime Step time of the wait in the loop (1 - 63)
+	 *
+	 * @param loops Loop count of each branch (2 - 63), innermost first
+	 *
+	 * @param depth Number of entries in loops (1 - 3)
+	 *
+	 * @param maxWaits Maximum number of waits after the loops
+	 */
+	static void considerLoop(int64_t ticks, bool prescale, uint8_t stepTime, const int64_t *loops, size_t depth, size_t maxWaits, DelaySolution &best);
+
+	/**
+	 * @brief Append ramp instructions of up to 127 steps each to solution
+	 *
+	 * @return false if they don't fit in maxInstructions
+	 */
+	static bool appendRampGroup(DelaySolution &solution, size_t maxInstructions, bool prescale, uint8_t stepTime, bool decrease, uint16_t numSteps);
+
+	/**
+	 * @brief Append a slow ramp, where each step is a delay and a one-cycle ramp step, in loops
+	 *
+	 * @param stepTicks Length of each step in ticks
+	 *
+	 * @param numSteps Number of steps (1 - 255)
+	 *
+	 * @param delayInstructions Number of instructions for the delay in each step
+	 *
+	 * @param achievedTicks Filled in with the total time of the steps
+	 *
+	 * @return false if they don't fit in maxInstructions, or the delay needs fewer than delayInstructions
+	 */
+	static bool appendSlowSteps(DelaySolution &solution, size_t maxInstructions, int64_t stepTicks, int64_t numSteps, bool decrease, size_t delayInstructions, int64_t &achievedTicks);
+
+	/**
+	 * @brief Append the instructions of part to solution, adjusting the branch step numbers
+	 *
+	 * @return false if they don't fit in maxInstructions
+	 */
+	static bool appendSolution(DelaySolution &solution, size_t maxInstructions, const DelaySolution &part);
+
+	/**
+	 * @brief Append a branch to solution, unless loopCount is less than 2
+	 *
+	 * @return false if it doesn't fit in maxInstructions
+	 */
+	static bool appendBranch(DelaySolution &solution, size_t maxInstructions, int64_t loopCount, uint8_t stepNum);
+
+	/**
+	 * @brief Replace best with candidate if it's closer, or the same with fewer instructions
+	 */
+	static void considerDelay(DelaySolution &best, const DelaySolution &candidate);
+};
+
+
+/**
+ * @brief Interface for the I2C bus used to talk to the LP5562
+ *
+ * Normally you don't need to worry about this; the LP5562 constructor that takes a TwoWire uses
+ * LP5562WireTransport automatically. You can pass a different transport to the LP5562 constructor,
+ * for example LP5562MockTransport to run the library on a computer instead of a Particle device.
+ */
+class LP5562Transport {
+public:
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562Transport() {};
+
+	/**
+	 * @brief Initialize the bus. Called from LP5562::begin().
+	 */
+	virtual void begin() {};
+
+	/**
+	 * @brief Write one or more consecutive registers in a single I2C transaction
+	 *
+	 * @param addr The I2C address (0x00 - 0x7f)
+	 *
+	 * @param reg The first register to write
+	 *
+	 * @param values The values to write. The chip auto-increments the register address.
+	 *
+	 * @param numValues Number of values to write. The caller never passes more than LP5562::MAX_WRITE_LEN.
+	 *
+	 * @return true on success, false if the transaction failed (NACK, bus error)
+	 */
+	virtual bool writeRegisters(uint8_t addr, uint8_t reg, const uint8_t *values, size_t numValues) = 0;
+
+	/**
+	 * @brief Read one or more consecutive registers in a single I2C transaction
+	 *
+	 * @param addr The I2C address (0x00 - 0x7f)
+	 *
+	 * @param reg The first register to read
+	 *
+	 * @param values Filled in with the values read
+	 *
+	 * @param numValues Number of values to read. The caller never passes more than LP5562::MAX_READ_LEN.
+	 *
+	 * @return true on success, false if the transaction failed (NACK, bus error, short read)
+	 */
+	virtual bool readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues) = 0;
+};
+
+#if defined(PARTICLE)
+/**
+ * @brief LP5562Transport that uses the Particle Wire (TwoWire) API
+ */
+class LP5562WireTransport : public LP5562Transport {
+public:
+	/**
+	 * @brief Construct the transport
+	 *
+	 * @param wire The I2C interface to use. Normally Wire, the primary I2C interface.
+	 */
+	LP5562WireTransport(TwoWire &wire) : wire(wire) {};
+
+	/**
+	 * @brief Calls wire.begin() to initialize the I2C bus in standard master mode
+	 */
+	virtual void begin();
+
+	/**
+	 * @brief Writes registers using beginTransmission, write, and endTransmission
+	 */
+	virtual bool writeRegisters(uint8_t addr, uint8_t reg, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Reads registers using a write of the register address, a repeated start, then requestFrom
+	 */
+	virtual bool readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues);
+
+protected:
+	/**
+	 * @brief The I2C interface to use. Default is Wire. Could be Wire1 on some devices.
+	 */
+	TwoWire &wire;
 };
+#endif /* PARTICLE */
+
+
+/**
+ * @brief Per-method call statistics for a LP5562 object
+ *
+ * Attach one to the driver with withStats(). The driver then counts, for each public method, the
+ * number of calls, I2C transactions, data bytes, failed transactions, and the total and longest time
+ * per call:
+ *
+ * LP5562Stats ledStats;
+ * ledDriver.withStats(&ledStats);
+ * ...
+ * const LP5562Stats::MethodStats &blink = ledStats.getMethodStats(LP5562Stats::METHOD_SET_BLINK);
+ *
+ * Counting is only compiled into the library when LP5562_ENABLE_STATS is defined for the library
+ * sources, for example with -DLP5562_ENABLE_STATS. Without it, withStats() is accepted but nothing is
+ * counted and the driver has no extra code. Either way the LP5562 class has the same layout.
+ *
+ * When a public method calls another one, like setBlink() calling setProgram(), only the outer call is
+ * counted and all of its transactions are counted for it. Use a separate LP5562Stats object for each
+ * LP5562 object.
+ */
+class LP5562Stats {
+public:
+	/**
+	 * @brief Public methods of LP5562 that stats are kept for
+	 *
+	 * Overloads and variations share one entry: METHOD_SET_PWM is setR(), setG(), setB(), setW(), setRGB(),
+	 * and setRGBW(); METHOD_SET_LED_MAPPING includes setLedMappingR() etc.; METHOD_PROGRAM_COUNTERS is
+	 * resetProgramCounters(), getProgramCounters(), and setProgramCounter(); METHOD_REGISTERS is
+	 * readRegister(), writeRegister(), readRegisters(), writeRegisters(), and the getters like getEnable().
+	 */
+	enum Method {
+		METHOD_BEGIN = 0,			//!< begin()
+		METHOD_SET_PWM,				//!< setR(), setG(), setB(), setW(), setRGB(), setRGBW()
+		METHOD_USE_DIRECT,			//!< useDirectRGB(), useDirectW()
+		METHOD_SET_BLINK,			//!< setBlink()
+		METHOD_SET_BLINK2,			//!< setBlink2()
+		METHOD_SET_BREATHE,			//!< setBreathe()
+		METHOD_SET_INDICATOR_MODE,	//!< setIndicatorMode()
+		METHOD_SET_LED_MAPPING,		//!< setLedMapping(), setLedMappingR(), setLedMappingG(), setLedMappingB(), setLedMappingW()
+		METHOD_SET_ENABLE,			//!< setEnable()
+		METHOD_SET_OP_MODE,			//!< setOpMode()
+		METHOD_GET_STATUS,			//!< getStatus()
+		METHOD_SET_PROGRAM,			//!< setProgram(), clearProgram()
+		METHOD_CLEAR_ALL_PROGRAMS,	//!< clearAllPrograms()
+		METHOD_PROGRAM_COUNTERS,	//!< resetProgramCounters(), getProgramCounters(), setProgramCounter()
+		METHOD_START_PROGRAM_AT,	//!< startProgramAt()
+		METHOD_START_ENGINES,		//!< startEngines()
+		METHOD_REGISTERS,			//!< readRegister(), writeRegister(), readRegisters(), writeRegisters()
+		METHOD_RESYNC_SHADOW,		//!< resyncShadow()
+		METHOD_SNAPSHOT,			//!< snapshot()
+		METHOD_RESTORE,				//!< restore()
+		METHOD_COMMIT,				//!< commit()
+		NUM_METHODS					//!< Number of methods
+	};
+
+	/**
+	 * @brief Counters for one public method
+	 */
+	struct MethodStats {
+		uint32_t calls;				//!< Number of calls
+		uint32_t transactions;		//!< I2C transactions done by the calls
+		uint32_t bytes;				//!< Data bytes read or written, not including the address and register bytes
+		uint32_t failures;			//!< Transactions that failed (NACK or bus error)
+		uint32_t totalMicros;		//!< Total time spent in the calls in microseconds
+		uint32_t maxMicros;			//!< Longest call in microseconds
+	};
+
+	/**
+	 * @brief Construct the counters, all 0
+	 */
+	LP5562Stats();
+
+	/**
+	 * @brief Destructor
+	 */
+	virtual ~LP5562Stats();
+
+	/**
+	 * @brief Get the counters for a method
+	 *
+	 * Failed transactions are counted even for methods that don't return an error, like setRGB().
+	 */
+	const MethodStats &getMethodStats(Method method) const { return methods[(method < NUM_METHODS) ? method : 0]; };
+
+	/**
+	 * @brief Clear the counters
+	 */
+	void reset();
+
+	/**
+	 * @brief Get the name of a method, such as "setBlink", for logging
+	 */
+	static const char *getMethodName(Method method);
+
+	/**
+	 * @brief Counts a call to a public method and the time it takes
+	 *
+	 * Constructed at the start of each public method of LP5562. Only the outermost one counts, so
+	 * transactions of nested calls are counted for the method that was called by the user.
+	 */
+	class Scope {
+	public:
+		/**
+		 * @brief Start counting a call
+		 *
+		 * @param stats The stats to count in, or NULL to not count
+		 *
+		 * @param method The method being called
+		 */
+		Scope(LP5562Stats *stats, Method method);
+
+		/**
+		 * @brief Add the time of the call
+		 */
+		~Scope();
 
+	protected:
+		/**
+		 * @brief The stats to count in, NULL if not counting or not the outermost call
+		 */
+		LP5562Stats *stats;
+
+		/**
+		 * @brief micros() at the start of the call
+		 */
+		unsigned long startMicros;
+	};
+
+	/**
+	 * @brief Count an I2C transaction for the method currently being called
+	 *
+	 * @param numValues Number of data bytes
+	 *
+	 * @param success The transaction succeeded
+	 */
+	void countTransaction(size_t numValues, bool success);
+
+protected:
+	/**
+	 * @brief Counters, indexed by Method
+	 */
+	MethodStats methods[NUM_METHODS];
+
+	/**
+	 * @brief The method being counted, or NUM_METHODS outside of any public method
+	 */
+	Method currentMethod = NUM_METHODS;
+};
 
 /**
  * @brief Class for the LP5562 LED driver
@@ -236,6 +837,7 @@ protected:
  */
 class LP5562 {
 public:
+#if defined(PARTICLE)
 	/**
 	 * @brief Construct the object
 	 *
@@ -246,6 +848,18 @@ public:
 	 * different one on devices with more than one I2C interface.
 	 */
 	LP5562(uint8_t addr = 0x30, TwoWire &wire = Wire);
+#endif /* PARTICLE */
+
+	/**
+	 * @brief Construct the object using a custom transport
+	 *
+	 * @param addr The address. Can be 0 - 3 based on the address select pins, using the normal base
+	 * address of 0x30 to make 0x30 to 0x33. Or you can pass in the full I2C address 0x00 - 0x7f.
+	 *
+	 * @param transport The transport to use for I2C transactions, for example LP5562MockTransport.
+	 * The transport object must remain valid for the lifetime of this object.
+	 */
+	LP5562(uint8_t addr, LP5562Transport &transport);
 
 	/**
 	 * @brief Destructor. Not normally used as this is typically a globally instantiated object.
@@ -288,6 +902,11 @@ public:
 	 */
 	LP5562 &withUseExternalOscillator(bool value = true) { useExternalOscillator = value; return *this; };
 
+	/**
+	 * @brief Returns true if external oscillator mode was set with withUseExternalOscillator()
+	 */
+	bool getUseExternalOscillator() const { return useExternalOscillator; };
+
 	/**
 	 * @brief Use Logarithmic Mode for PWM brightness. Default = true.
 	 *
@@ -306,6 +925,44 @@ public:
 	 */
 	LP5562 &withHighFrequencyMode(bool value = true) { highFrequencyMode = value; return *this; };
 
+	/**
+	 * @brief Keep a shadow copy of the writable registers in RAM. Default = false.
+	 *
+	 * When enabled, the read-modify-write operations in setOpMode(), setLedMappingR(), setLedMappingG(),
+	 * setLedMappingB(), setLedMappingW(), useDirectRGB(), and useDirectW() use the shadow copy instead of
+	 * reading the register over I2C first, so they only write.
+	 *
+	 * The shadow is filled in by begin() (which resets the chip to known values) and by every successful
+	 * register write. If something else changes the chip registers, call resyncShadow() to read them
+	 * back. The engine bits of the enable register are the exception: a program that executes an End
+	 * instruction puts its engine into hold mode behind the library's back, so setEnable() still reads
+	 * the enable register if an engine it's not changing could be running.
+	 *
+	 * This method returns a LP5562 object so you can chain multiple configuration calls together, fluent-style.
+	 */
+	LP5562 &withShadowRegisters(bool value = true) { useShadowRegisters = value; return *this; };
+
+	/**
+	 * @brief Keep a pattern that's already running when begin() is called. Default = false.
+	 *
+	 * Normally begin() resets the chip, which stops whatever it was showing when only the MCU was reset,
+	 * for example by a firmware update. With warm start, begin() first reads the chip with three burst reads.
+	 * If it's already enabled, only the LED currents, CONFIG, and the logarithmic mode bit that differ from
+	 * the settings of this object are written, and the engines, programs, LED mapping, and PWM levels are
+	 * left as they are. If the chip is not enabled, begin() resets it as usual.
+	 *
+	 * The programs on the chip are not known after a warm start, so the first setProgram() to each engine
+	 * writes all of the instruction words. Use getWarmStarted() to find out which happened.
+	 *
+	 * This method returns a LP5562 object so you can chain multiple configuration calls together, fluent-style.
+	 */
+	LP5562 &withWarmStart(bool value = true) { warmStart = value; return *this; };
+
+	/**
+	 * @brief Returns true if the last begin() kept the running state of the chip (see withWarmStart())
+	 */
+	bool getWarmStarted() const { return warmStarted; };
+
 
 	/**
 	 * @brief Set up the I2C device and begin running.
@@ -351,11 +1008,38 @@ public:
 	 * If you were previously using a program (setProgram, setBlink, setBlink2, or setBreathe,
 	 * you must stop the program using useDirectRGB() before you can set the RGB values.
 	 */
-	void setB(uint8_t blue);
-
+	void setB(uint8_t blue);
+
+
+	/**
+	 * @brief Sets the PWM for the R, G, and B channels.
+	 *
+	 * @param red value 0 - 255. 0 = off, 255 = full brightness.
+	 *
+	 * @param green value 0 - 255. 0 = off, 255 = full brightness.
+
+	 * @param blue value 0 - 255. 0 = off, 255 = full brightness.
+	 *
+	 * The three values are written in a single I2C transaction so the color changes all at once.
+	 *
+	 * If you were previously using a program (setProgram, setBlink, setBlink2, or setBreathe,
+	 * you must stop the program using useDirectRGB() before you can set the RGB values.
+	 */
+	void setRGB(uint8_t red, uint8_t green, uint8_t blue);
+
+	/**
+	 * @brief Sets the PWM for the R, G, and B channels.
+	 *
+	 * @param rgb Value in the form of 0x00RRGGBB. Each of RR, GG, and BB are from
+	 * 0x00 (off) to 0xFF (full brightness).
+	 *
+	 * If you were previously using a program (setProgram, setBlink, setBlink2, or setBreathe,
+	 * you must stop the program using useDirectRGB() before you can set the RGB values.
+	 */
+	void setRGB(uint32_t rgb);
 
 	/**
-	 * @brief Sets the PWM for the R, G, and B channels.
+	 * @brief Sets the PWM for the R, G, B, and W channels.
 	 *
 	 * @param red value 0 - 255. 0 = off, 255 = full brightness.
 	 *
@@ -363,21 +1047,26 @@ public:
 
 	 * @param blue value 0 - 255. 0 = off, 255 = full brightness.
 	 *
+	 * @param white value 0 - 255. 0 = off, 255 = full brightness.
+	 *
+	 * The R, G, and B registers are contiguous so they're written in a single I2C transaction. The W
+	 * register is not adjacent to them (and the reset register is in between) so it takes a second one.
+	 *
 	 * If you were previously using a program (setProgram, setBlink, setBlink2, or setBreathe,
-	 * you must stop the program using useDirectRGB() before you can set the RGB values.
+	 * you must stop the program using useDirectRGB() and useDirectW() before you can set the values.
 	 */
-	void setRGB(uint8_t red, uint8_t green, uint8_t blue);
+	void setRGBW(uint8_t red, uint8_t green, uint8_t blue, uint8_t white);
 
 	/**
-	 * @brief Sets the PWM for the R, G, and B channels.
+	 * @brief Sets the PWM for the R, G, B, and W channels.
 	 *
-	 * @param rgb Value in the form of 0x00RRGGBB. Each of RR, GG, and BB are from
+	 * @param rgbw Value in the form of 0xWWRRGGBB. Each of WW, RR, GG, and BB are from
 	 * 0x00 (off) to 0xFF (full brightness).
 	 *
 	 * If you were previously using a program (setProgram, setBlink, setBlink2, or setBreathe,
-	 * you must stop the program using useDirectRGB() before you can set the RGB values.
+	 * you must stop the program using useDirectRGB() and useDirectW() before you can set the values.
 	 */
-	void setRGB(uint32_t rgb);
+	void setRGBW(uint32_t rgbw) { setRGBW((uint8_t)(rgbw >> 16), (uint8_t)(rgbw >> 8), (uint8_t)rgbw, (uint8_t)(rgbw >> 24)); };
 
 
 	/**
@@ -416,9 +1105,9 @@ public:
 
 	 * @param blue value 0 - 255. 0 = off, 255 = full brightness.
 	 *
-	 * @param msOn The number of milliseconds to be on (1 - 61916)
+	 * @param msOn The number of milliseconds to be on (1 - 3906984)
 	 *
-	 * @param msOff The number of milliseconds to be off (1 - 61916)
+	 * @param msOff The number of milliseconds to be off (1 - 3906984)
 	 */
 	void setBlink(uint8_t red, uint8_t green, uint8_t blue, unsigned long msOn, unsigned long msOff);
 
@@ -428,9 +1117,9 @@ public:
 	 * @param rgb Value in the form of 0x00RRGGBB. Each of RR, GG, and BB are from
 	 * 0x00 (off) to 0xFF (full brightness).
 	 *
-	 * @param msOn The number of milliseconds to be on (1 - 61916)
+	 * @param msOn The number of milliseconds to be on (1 - 3906984)
 	 *
-	 * @param msOff The number of milliseconds to be off (1 - 61916)
+	 * @param msOff The number of milliseconds to be off (1 - 3906984)
 	 */
 	void setBlink(uint32_t rgb, unsigned long msOn, unsigned long msOff) { setBlink((uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb, msOn, msOff); };
 
@@ -443,7 +1132,7 @@ public:
 
 	 * @param blue1 value 0 - 255. 0 = off, 255 = full brightness.
 	 *
-	 * @param ms1 The number of milliseconds to be the 1 color (1 - 61916)
+	 * @param ms1 The number of milliseconds to be the 1 color (1 - 3906984)
 	 *
 	 * @param red2 value 0 - 255. 0 = off, 255 = full brightness.
 	 *
@@ -451,7 +1140,7 @@ public:
 
 	 * @param blue2 value 0 - 255. 0 = off, 255 = full brightness.
 	 *
-	 * @param ms2 The number of milliseconds to be the 2 color (1 - 61916)
+	 * @param ms2 The number of milliseconds to be the 2 color (1 - 3906984)
 	 */
 	void setBlink2(uint8_t red1, uint8_t green1, uint8_t blue1, unsigned long ms1, uint8_t red2, uint8_t green2, uint8_t blue2, unsigned long ms2);
 
@@ -461,12 +1150,12 @@ public:
 	 * @param rgb1 Value in the form of 0x00RRGGBB. Each of RR, GG, and BB are from
 	 * 0x00 (off) to 0xFF (full brightness).
 	 *
-	 * @param ms1 The number of milliseconds to be the 1 color (1 - 61916)
+	 * @param ms1 The number of milliseconds to be the 1 color (1 - 3906984)
 	 *
 	 * @param rgb2 Value in the form of 0x00RRGGBB. Each of RR, GG, and BB are from
 	 * 0x00 (off) to 0xFF (full brightness).
 	 *
-	 * @param ms2 The number of milliseconds to be the 2 color (1 - 61916)
+	 * @param ms2 The number of milliseconds to be the 2 color (1 - 3906984)
 	 */
 	void setBlink2(uint32_t rgb1, unsigned long ms1, uint32_t rgb2, unsigned long ms2);
 
@@ -614,7 +1303,16 @@ public:
 	 *
 	 * Reading the status/interrupt register will clear any interrupts that are set.
 	 */
-	uint8_t getStatus() { return readRegister(REG_STATUS); };
+	uint8_t getStatus();
+
+	/**
+	 * @brief Get the value of the status/interrupt register, with an indication of I2C errors
+	 *
+	 * @param value Filled in with the value of the register
+	 *
+	 * @return false if there was an I2C error, in which case the interrupts are not cleared
+	 */
+	bool getStatus(uint8_t &value);
 
 	/**
 	 * @brief Clears a program on the specified engine
@@ -652,9 +1350,105 @@ public:
 	 *
 	 * The unused instruction words (numInstruction to 16) are always set to 0 for safety. If you call this
 	 * with numInstruction == 0 it clears the program (which is what clearProgram and clearAllPrograms do).
+	 *
+	 * The library remembers what was written to each engine's program memory and only writes the
+	 * instruction words that changed. If the program is identical to what's loaded, load mode is skipped
+	 * entirely. With startRunning true the PC is then reset with a single write, so the program still
+	 * starts from the beginning. With startRunning false the PC is left where it was; use
+	 * resetProgramCounters() before starting the engine if that matters.
 	 */
 	bool setProgram(size_t engine, const uint16_t *instructions, size_t numInstruction, bool startRunning);
 
+	/**
+	 * @brief Sets the program for an engine from a const array, typically built with LP5562Opcode
+	 *
+	 * @param engine The engine to set (1, 2, or 3)
+	 *
+	 * @param instructions An array of up to 16 instructions. The length is checked at compile time.
+	 *
+	 * @param startRunning true to start the program running immediately
+	 */
+	template<size_t N>
+	bool setProgram(size_t engine, const uint16_t (&instructions)[N], bool startRunning) {
+		static_assert(N <= 16, "An engine program can have at most 16 instructions");
+		return setProgram(engine, instructions, N, startRunning);
+	}
+
+	/**
+	 * @brief Sets the program counter of one or more engines to 0
+	 *
+	 * @param engineMask A mask of the engines to reset. Logical OR the values MASK_ENGINE_1,
+	 * MASK_ENGINE_2, and MASK_ENGINE_3 or use MASK_ENGINE_ALL for all 3 engines.
+	 *
+	 * The engines must be in hold mode (setEnable with REG_ENABLE_HOLD) for this to have an effect.
+	 */
+	bool resetProgramCounters(uint8_t engineMask);
+
+	/**
+	 * @brief Start one or more engines from step 0
+	 *
+	 * @param engineMask A mask of the engines to start. Logical OR the values MASK_ENGINE_1,
+	 * MASK_ENGINE_2, and MASK_ENGINE_3 or use MASK_ENGINE_ALL for all 3 engines.
+	 *
+	 * Puts the engines in hold, resets their program counters, and puts them in run mode. Use this after
+	 * setProgram() with startRunning false: a program that was already loaded is not reloaded, so load mode
+	 * does not reset its program counter. Inside a batch, the hold is combined with other changes to the
+	 * enable register.
+	 *
+	 * If you define ENABLE_PROGRAM_VALIDATION when building, the engines are not started if their trigger
+	 * instructions and those of the engines already running would deadlock.
+	 */
+	bool startEngines(uint8_t engineMask);
+
+	/**
+	 * @brief Read the program counters of all three engines in one transaction
+	 *
+	 * @param pcs Filled in with the program counters (0 - 15). pcs[0] is engine 1, pcs[1] engine 2, and pcs[2]
+	 * engine 3. Must have room for 3 values.
+	 *
+	 * @return false if there was an I2C error
+	 */
+	bool getProgramCounters(uint8_t *pcs);
+
+	/**
+	 * @brief Sets the program counter of an engine
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param pc The step number to continue from (0 - 15)
+	 *
+	 * The engine must be in hold mode (setEnable with REG_ENABLE_HOLD) for this to have an effect.
+	 */
+	bool setProgramCounter(size_t engine, uint8_t pc);
+
+	/**
+	 * @brief Sets the program for an engine and starts it running from a step other than 0
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param instructions The instruction words
+	 *
+	 * @param numInstructions Number of instructions (1 - 16)
+	 *
+	 * @param pc The step number to start from (0 <= pc < numInstructions)
+	 *
+	 * The engine's PWM level is not changed by this, so starting in the middle of a ramp starts the ramp
+	 * from the level the engine had before. LP5562TimingAnalyzer::getStartPoint() finds a step that
+	 * doesn't depend on that for a given time into the program.
+	 */
+	bool startProgramAt(size_t engine, const uint16_t *instructions, size_t numInstructions, uint8_t pc);
+
+	/**
+	 * @brief Sets the program for an engine and starts it running from a step other than 0
+	 *
+	 * @param engine An engine number 1 <= engine <= 3
+	 *
+	 * @param program The program
+	 *
+	 * @param pc The step number to start from
+	 */
+	bool startProgramAt(size_t engine, const LP5562Program &program, uint8_t pc) { return startProgramAt(engine, program.getInstructions(), program.getStepNum(), pc); };
+
 	/**
 	 * @brief Convert a current value in mA to the format used by the LP5562
 	 *
@@ -682,7 +1476,173 @@ public:
 	 */
 	bool writeRegister(uint8_t reg, uint8_t value);
 
-	static const uint8_t REG_ENABLE = 0x00;				//!< Enable register (0x00)
+	/**
+	 * @brief Low-level call to read multiple consecutive registers
+	 *
+	 * @param reg The first register to read (0x00 to 0x70)
+	 *
+	 * @param values Filled in with the values read. values[0] is from reg, values[1] from reg + 1, and so on.
+	 *
+	 * @param numValues The number of values to read
+	 *
+	 * Reads of more than MAX_READ_LEN bytes are split into multiple transactions.
+	 */
+	bool readRegisters(uint8_t reg, uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Low-level call to write multiple consecutive registers
+	 *
+	 * @param reg The first register to write (0x00 to 0x70)
+	 *
+	 * @param values The values to write. values[0] goes in reg, values[1] in reg + 1, and so on.
+	 *
+	 * @param numValues The number of values to write
+	 *
+	 * The chip auto-increments the register address, so this is done in a single I2C transaction as
+	 * long as numValues is <= MAX_WRITE_LEN. Longer writes are split into multiple transactions.
+	 * Be careful not to span REG_RESET (0x0d) or the chip will be reset!
+	 */
+	bool writeRegisters(uint8_t reg, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Reload the register shadow from the chip
+	 *
+	 * Reads the control registers (0x00 - 0x0f) and the LED mapping register (0x70) in bulk. The
+	 * program memory (0x10 - 0x6f) can only be read with the engine in load mode, so it's not read
+	 * back; it becomes known again the next time a program is written to that engine.
+	 *
+	 * Only useful if you enabled the shadow using withShadowRegisters().
+	 */
+	bool resyncShadow();
+
+	/**
+	 * @brief The state of the chip, saved by snapshot() and written back by restore()
+	 *
+	 * This is plain data with no pointers, so it can be kept in retained memory or written to a file,
+	 * and is checked with a magic number and checksum before it's used.
+	 */
+	struct Snapshot {
+		uint32_t magic;				//!< SNAPSHOT_MAGIC
+		uint8_t control[16];		//!< Registers 0x00 - 0x0f, indexed by register (status and reset are not saved)
+		uint8_t program[96];		//!< Program memory 0x10 - 0x6f (zero for engines that are disabled)
+		uint8_t ledMap;				//!< REG_LED_MAP
+		uint8_t reserved;			//!< Always 0
+		uint16_t checksum;			//!< Fletcher-16 checksum of the bytes before it
+	};
+
+	/**
+	 * @brief Save the state of the chip, including the programs and where the engines are in them
+	 *
+	 * @param snap Filled in with the state
+	 *
+	 * @return false if there was an I2C error
+	 *
+	 * The control registers are read with two burst reads (skipping REG_STATUS, so pending interrupts are not
+	 * cleared), plus one for the LED mapping. Programs written by this object are taken from the shadow. A
+	 * program that isn't known has to be read in load mode, which briefly stops that engine; it's started
+	 * again from the same step.
+	 */
+	bool snapshot(Snapshot &snap);
+
+	/**
+	 * @brief Write a state saved by snapshot() back to the chip, for example after waking from sleep
+	 *
+	 * @param snap The state
+	 *
+	 * @return false if snap is not valid or there was an I2C error
+	 *
+	 * Use this instead of begin() and the pattern calls. The registers are written in as few burst writes as
+	 * possible, with the engines in hold until everything is in place, and then started together from the
+	 * saved steps. Programs that are known to be loaded already are not written again. Without
+	 * withShadowRegisters, REG_ENABLE is read first so programs are written again if the chip was reset. Branch loop counts, the
+	 * progress of a ramp or wait, and the engine PWM level are not readable, so an engine that was in the
+	 * middle of a wait starts over from the Set PWM before it, and one in a loop or ramp starts that
+	 * instruction over.
+	 *
+	 * The LED current, logarithmic mode, high frequency mode, and oscillator settings of this object are set
+	 * from the snapshot.
+	 */
+	bool restore(const Snapshot &snap);
+
+	/**
+	 * @brief Returns true if snap has the right magic number and checksum
+	 */
+	static bool isValidSnapshot(const Snapshot &snap);
+
+	/**
+	 * @brief Calculate the checksum of a snapshot (all of the bytes before the checksum field)
+	 */
+	static uint16_t calculateChecksum(const Snapshot &snap);
+
+	/**
+	 * @brief Magic number in Snapshot::magic. The low byte is the version of the structure.
+	 */
+	static const uint32_t SNAPSHOT_MAGIC = 0x4c503501;
+
+	/**
+	 * @brief Start staging register changes instead of writing them immediately
+	 *
+	 * After calling beginBatch(), calls like setEnable(), setOpMode(), setLedMapping(), setLedMappingR(),
+	 * setRGB(), and setW() only update the register shadow. When you call commit(), each changed
+	 * register is written once with its final value, with adjacent registers combined into a single
+	 * I2C write. For example:
+	 *
+	 * ledDriver.beginBatch();
+	 * ledDriver.setLedMappingR(LP5562::REG_LED_MAP_DIRECT, 255);
+	 * ledDriver.setLedMappingG(LP5562::REG_LED_MAP_ENGINE_1);
+	 * ledDriver.setLedMappingB(LP5562::REG_LED_MAP_ENGINE_2);
+	 * ledDriver.commit();
+	 *
+	 * Only the control registers (0x00 - 0x08, 0x0e, 0x0f) and LED_MAP (0x70) are staged. Writes to
+	 * program memory (setProgram), the program counters, and the reset register first write out
+	 * everything staged so far, then are done immediately, so the order of operations is preserved.
+	 * On commit, staged registers are written in address order.
+	 *
+	 * Calls to beginBatch() can be nested; only the outermost commit() writes. The getter
+	 * methods like getLedMapping() read the chip, so they don't see staged values until commit.
+	 */
+	void beginBatch();
+
+	/**
+	 * @brief Write all register changes staged since beginBatch()
+	 *
+	 * @return true if all writes succeeded (or nothing needed to be written)
+	 */
+	bool commit();
+
+	/**
+	 * @brief Returns true if between beginBatch() and commit()
+	 */
+	bool isBatchActive() const { return batchDepth > 0; };
+
+	/**
+	 * @brief Returns true if the shadow copy of the register is known to match the chip
+	 *
+	 * @param reg The register (0x00 to 0x70)
+	 *
+	 * The program counter, status, and reset registers are never shadowed because the hardware changes
+	 * them on its own.
+	 */
+	bool isShadowValid(uint8_t reg) const;
+
+	/**
+	 * @brief Count calls, I2C transactions, and time for each public method (see LP5562Stats)
+	 *
+	 * @param stats The counters to add to, or NULL to stop counting. The object is not copied, so it
+	 * must remain valid; it's typically a global variable.
+	 *
+	 * Nothing is counted unless the library is built with LP5562_ENABLE_STATS.
+	 *
+	 * This method returns a LP5562 object so you can chain multiple configuration calls together, fluent-style.
+	 */
+	LP5562 &withStats(LP5562Stats *stats) { this->stats = stats; return *this; };
+
+	/**
+	 * @brief Get the counters set with withStats(), or NULL if none
+	 */
+	LP5562Stats *getStats() const { return stats; };
+
+	static const uint8_t REG_ENABLE = 0x00;			//!< Enable register (0x00)
 	static const uint8_t REG_ENABLE_LOG_EN = 0x80;		//!< The logarithmic mode for PWM brightness when set (instead of linear)
 	static const uint8_t REG_ENABLE_CHIP_EN = 0x40;		//!< Enable the chip. Power-up default is off. Make sure you set the current before enabling!
 
@@ -969,8 +1929,156 @@ public:
 	 */
 	static const uint8_t MASK_ENGINE_ALL = 0b111;
 
+	/**
+	 * @brief Number of register addresses (0x00 - 0x70 inclusive)
+	 */
+	static const size_t NUM_REGISTERS = 0x71;
+
+	/**
+	 * @brief Maximum number of register bytes in one I2C write
+	 *
+	 * The I2C buffer is 32 bytes and the register address takes 1.
+	 */
+	static const size_t MAX_WRITE_LEN = 31;
+
+	/**
+	 * @brief Maximum number of register bytes in one I2C read (the size of the I2C buffer)
+	 */
+	static const size_t MAX_READ_LEN = 32;
+
+	/**
+	 * @brief Current register power-on default value (17.5 mA)
+	 */
+	static const uint8_t REG_CURRENT_DEFAULT = 0xaf;
+
+	/**
+	 * @brief LED mapping register power-on default value (B = engine 1, G = engine 2, R = engine 3, W = direct)
+	 */
+	static const uint8_t REG_LED_MAP_DEFAULT = 0x39;
+
 
 protected:
+	/**
+	 * @brief Read a register, using the shadow copy if enabled and valid
+	 *
+	 * @param reg The register to read (0x00 to 0x70)
+	 *
+	 * This is used by the read-modify-write operations like setEnable() and setLedMappingR().
+	 */
+	uint8_t readRegisterCached(uint8_t reg);
+
+	/**
+	 * @brief Update the shadow copy after a successful read or write of a register
+	 *
+	 * @param reg The register (0x00 to 0x70)
+	 *
+	 * @param value The value that the register now has
+	 */
+	void updateShadow(uint8_t reg, uint8_t value);
+
+	/**
+	 * @brief Start a batch that replaces the programs of setBlink(), setBreathe(), etc.
+	 *
+	 * @param engineMask The engines that will be started by commitProgramChange()
+	 *
+	 * Puts all engines in hold and resets the PCs of the engines in engineMask. Then call setProgram()
+	 * with startRunning false for each engine, and commitProgramChange().
+	 */
+	void beginProgramChange(uint8_t engineMask);
+
+	/**
+	 * @brief Start the engines and write the batch started by beginProgramChange()
+	 *
+	 * @param engineMask The engines to start, normally the same as passed to beginProgramChange()
+	 */
+	bool commitProgramChange(uint8_t engineMask);
+
+	/**
+	 * @brief Check the trigger instructions of the engines that will be running after starting engineMask
+	 *
+	 * @param engineMask The engines about to be started
+	 *
+	 * @return false if ENABLE_PROGRAM_VALIDATION is defined and the programs have errors. Always true otherwise.
+	 *
+	 * The programs come from the program memory shadow, along with those of the engines already in run
+	 * mode. If one isn't known (it was not written by this object since the chip was reset), nothing is checked.
+	 */
+	bool validateRunningEngines(uint8_t engineMask);
+
+	/**
+	 * @brief The warm start part of begin()
+	 *
+	 * @return false if there was an I2C error. Sets warmStarted if the chip was already running, otherwise
+	 * begin() continues with a reset.
+	 */
+	bool beginWarm();
+
+	/**
+	 * @brief Get the value of REG_CONFIG for the settings of this object
+	 */
+	uint8_t getConfigValue() const;
+
+	/**
+	 * @brief Set the shadow to the chip's power-on defaults. Called after writing REG_RESET.
+	 */
+	void resetShadow();
+
+	/**
+	 * @brief Mark shadow registers as unknown
+	 *
+	 * @param includePrograms If false, the program memory (0x10 - 0x6f) stays valid
+	 */
+	void invalidateShadow(bool includePrograms = true);
+
+	/**
+	 * @brief Mark the program memory shadow (0x10 - 0x6f) as unknown. Called when the chip was reset.
+	 */
+	void invalidateProgramShadow();
+
+	/**
+	 * @brief Returns true for the registers that the chip changes on its own (PC, status, reset)
+	 */
+	static bool isVolatileRegister(uint8_t reg);
+
+	/**
+	 * @brief Get the step to restart an engine from when restoring a snapshot
+	 *
+	 * @param programBytes The 32 bytes of program memory of the engine
+	 *
+	 * @param pc The saved program counter
+	 *
+	 * @return pc, or the Set PWM instruction before it if there are only waits in between
+	 */
+	static uint8_t getRestartPC(const uint8_t *programBytes, uint8_t pc);
+
+	/**
+	 * @brief Write registers to the chip without staging, splitting into MAX_WRITE_LEN transactions
+	 */
+	bool writeRegistersNow(uint8_t reg, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief If a batch is active and all of the registers can be staged, update the shadow and mark them dirty
+	 *
+	 * @return true if staged, false if the registers must be written now
+	 */
+	bool stageRegisters(uint8_t reg, const uint8_t *values, size_t numValues);
+
+	/**
+	 * @brief Write the registers staged so far, leaving the batch active
+	 */
+	bool flushBatch();
+
+	/**
+	 * @brief Returns true if the register has been staged but not written yet
+	 */
+	bool isBatchDirty(uint8_t reg) const { return (batchDirty[reg / 8] & (1 << (reg % 8))) != 0; };
+
+	/**
+	 * @brief Returns true if a register can be rewritten with its shadow value to fill a gap in a burst write
+	 */
+	bool isSafeToRewrite(uint8_t reg) const;
+
+
 	/**
 	 * @brief The I2C address (0x00 - 0x7f). Default is 0x30.
 	 *
@@ -978,10 +2086,17 @@ protected:
 	 */
 	uint8_t addr;
 
+#if defined(PARTICLE)
 	/**
-	 * @brief The I2C interface to use. Default is Wire. Could be Wire1 on some devices.
+	 * @brief Transport used when constructed with a TwoWire. Default is Wire. Could be Wire1 on some devices.
 	 */
-	TwoWire &wire;
+	LP5562WireTransport wireTransport;
+#endif
+
+	/**
+	 * @brief The transport used for all I2C transactions. Either wireTransport or the one passed to the constructor.
+	 */
+	LP5562Transport &transport;
 
 	/**
 	 * @brief Current to supply to the red LED. Default is 5 mA
@@ -1037,6 +2152,51 @@ protected:
 	 * Low frequency (default) is 256 Hz. High frequency is 558 Hz.
 	 */
 	bool highFrequencyMode = false;
+
+	/**
+	 * @brief Whether to keep a shadow copy of the registers in RAM (default: false).
+	 *
+	 * See withShadowRegisters().
+	 */
+	bool useShadowRegisters = false;
+
+	/**
+	 * @brief Whether begin() keeps a running chip as it is (default: false)
+	 *
+	 * See withWarmStart().
+	 */
+	bool warmStart = false;
+
+	/**
+	 * @brief The last begin() kept the running state of the chip
+	 */
+	bool warmStarted = false;
+
+	/**
+	 * @brief Shadow copy of the registers 0x00 - 0x70. Only meaningful where shadowValid is set.
+	 */
+	uint8_t shadowRegs[NUM_REGISTERS];
+
+	/**
+	 * @brief Bit mask, one bit per register, set when shadowRegs contains the value that's in the chip.
+	 */
+	uint8_t shadowValid[(NUM_REGISTERS + 7) / 8];
+
+	/**
+	 * @brief Nesting level of beginBatch() calls. 0 when not batching.
+	 */
+	uint8_t batchDepth = 0;
+
+	/**
+	 * @brief Bit mask, one bit per register, set when the register has been staged but not written yet
+	 */
+	uint8_t batchDirty[(NUM_REGISTERS + 7) / 8];
+
+	/**
+	 * @brief Counters set with withStats(), or NULL. Declared even without LP5562_ENABLE_STATS so the
+	 * class has the same layout in every build.
+	 */
+	LP5562Stats *stats = NULL;
 };
 
 
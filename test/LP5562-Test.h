@@ -0,0 +1,130 @@
+#ifndef __LP5562_TEST_H
+#define __LP5562_TEST_H
+
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Minimal checks for the host tests. Each test file is its own executable: call the test functions
+// from main() and return testResult(). Also has the simulated chip and the programs that several of
+// the tests use.
+
+#include "LP5562-RK-Sim.h"
+
+#include <stdio.h>
+
+#include <vector>
+
+/**
+ * @brief Number of checks that failed
+ */
+static int testFailures = 0;
+
+/**
+ * @brief Fail the test if cond is false, but keep going
+ */
+#define TEST_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			testFailures++; \
+		} \
+	} while(0)
+
+/**
+ * @brief Fail the test if the two integer values differ, printing both
+ */
+#define TEST_CHECK_EQUAL(actual, expected) \
+	do { \
+		long long testActual = (long long)(actual); \
+		long long testExpected = (long long)(expected); \
+		if (testActual != testExpected) { \
+			printf("%s:%d: check failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, testActual, testExpected); \
+			testFailures++; \
+		} \
+	} while(0)
+
+/**
+ * @brief Run a test function, printing its name
+ */
+#define TEST_RUN(fn) \
+	do { \
+		printf("%s\n", #fn); \
+		fn(); \
+	} while(0)
+
+/**
+ * @brief Value to return from main()
+ */
+static inline int testResult() {
+	if (testFailures) {
+		printf("%d checks failed\n", testFailures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
+
+/**
+ * @brief A simulated chip with a LP5562 object connected to it at the default address
+ */
+class TestChip {
+public:
+	/**
+	 * @brief Construct the chip and the driver
+	 *
+	 * @param callBegin true to call begin() on the driver with the default settings. Pass false to
+	 * configure it first, for example with withShadowRegisters().
+	 */
+	TestChip(bool callBegin = true) : ledDriver(0x30, sim) {
+		if (callBegin) {
+			TEST_CHECK(ledDriver.begin());
+		}
+	}
+
+	LP5562Simulator sim;		//!< The simulated chip
+	LP5562 ledDriver;			//!< The driver, using sim as its transport
+};
+
+/**
+ * @brief Get the output changes of one channel recorded by the simulator
+ */
+static inline std::vector<LP5562Simulator::OutputChange> getChanges(const LP5562Simulator &sim, uint8_t channel) {
+	std::vector<LP5562Simulator::OutputChange> result;
+	for(size_t ii = 0; ii < sim.getNumOutputChanges(); ii++) {
+		if (sim.getOutputChange(ii).channel == channel) {
+			result.push_back(sim.getOutputChange(ii));
+		}
+	}
+	return result;
+}
+
+/**
+ * @brief Repeating program: level for msOn, 0 for msOff
+ */
+static inline void makeBlink(LP5562Program &program, uint8_t level, unsigned long msOn = 200, unsigned long msOff = 200) {
+	program.clear();
+	program.addCommandSetPWM(level);
+	program.addDelay(msOn);
+	program.addCommandSetPWM(0);
+	program.addDelay(msOff);
+	program.addCommandGoToStart();
+}
+
+/**
+ * @brief Program that sets level and waits for ms. Without anything after it, it repeats.
+ */
+static inline void makeSegment(LP5562Program &program, uint8_t level, unsigned long ms) {
+	program.clear();
+	program.addCommandSetPWM(level);
+	program.addDelay(ms);
+}
+
+/**
+ * @brief Program that is on at full brightness for ms, then ends with an interrupt and the PWM set to 0
+ */
+static inline void makeOneShot(LP5562Program &program, unsigned long ms) {
+	makeSegment(program, 255, ms);
+	program.addCommandEnd(true, true);
+}
+
+#endif /* __LP5562_TEST_H */
@@ -0,0 +1,116 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Prints the LP5562BusBenchmark table as CSV, like the 5-bus-cost example does on a device.
+//
+// bus-cost                  Print the table
+// bus-cost baseline.csv     Print the table and fail if any call does more transactions, reads, or
+//                           bytes than in baseline.csv
+//
+// To update the baseline after a change that's expected to cost more (or less):
+// bus-cost > test/bus-cost-baseline.csv
+
+#include "LP5562-RK-Bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+/**
+ * @brief The columns of a CSV line that are checked against the baseline
+ */
+struct Cost {
+	unsigned long transactions;
+	unsigned long reads;
+	unsigned long bytes;
+};
+
+/**
+ * @brief Baseline costs by "call,shadow"
+ */
+static std::map<std::string, Cost> baseline;
+
+/**
+ * @brief Number of calls that cost more than the baseline
+ */
+static int numExceeded = 0;
+
+/**
+ * @brief Split a CSV line into its key ("call,shadow") and cost
+ *
+ * @return false if the line is not a result line, like the header
+ */
+static bool parseLine(const char *line, std::string &key, Cost &cost) {
+	const char *comma = strchr(line, ',');
+	if (!comma) {
+		return false;
+	}
+	int shadow;
+	if (sscanf(comma + 1, "%d,%lu,%lu,%lu", &shadow, &cost.transactions, &cost.reads, &cost.bytes) != 4) {
+		return false;
+	}
+	key = std::string(line, comma - line) + (shadow ? ",1" : ",0");
+	return true;
+}
+
+static bool readBaseline(const char *path) {
+	FILE *fd = fopen(path, "r");
+	if (!fd) {
+		fprintf(stderr, "could not open %s\n", path);
+		return false;
+	}
+
+	char line[256];
+	while(fgets(line, sizeof(line), fd)) {
+		std::string key;
+		Cost cost;
+		if (parseLine(line, key, cost)) {
+			baseline[key] = cost;
+		}
+	}
+	fclose(fd);
+	return true;
+}
+
+static void resultHandler(const LP5562BusBenchmark::Result &result, void *) {
+	char line[256];
+	LP5562BusBenchmark::formatCsv(result, line, sizeof(line));
+	printf("%s\n", line);
+
+	std::string key;
+	Cost cost;
+	if (baseline.empty() || !parseLine(line, key, cost)) {
+		return;
+	}
+
+	std::map<std::string, Cost>::const_iterator it = baseline.find(key);
+	if (it == baseline.end()) {
+		fprintf(stderr, "%s: not in the baseline\n", key.c_str());
+		return;
+	}
+	if (cost.transactions > it->second.transactions || cost.reads > it->second.reads || cost.bytes > it->second.bytes) {
+		fprintf(stderr, "%s: transactions=%lu reads=%lu bytes=%lu, baseline is %lu, %lu, %lu\n", key.c_str(),
+				cost.transactions, cost.reads, cost.bytes,
+				it->second.transactions, it->second.reads, it->second.bytes);
+		numExceeded++;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 1 && !readBaseline(argv[1])) {
+		return 1;
+	}
+
+	printf("%s\n", LP5562BusBenchmark::getCsvHeader());
+	LP5562BusBenchmark::run(false, resultHandler, NULL);
+	LP5562BusBenchmark::run(true, resultHandler, NULL);
+
+	if (numExceeded) {
+		fprintf(stderr, "%d calls cost more than the baseline\n", numExceeded);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562EngineAllocator
+
+#include "LP5562-RK-Allocator.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testSharedEngine() {
+	TestChip chip;
+
+	LP5562Program blink, fast;
+	makeBlink(blink, 255, 200, 200);
+	makeBlink(fast, 100, 50, 50);
+
+	LP5562EngineAllocator allocator(chip.ledDriver);
+	TEST_CHECK(allocator.setEffect(LP5562EngineAllocator::CHANNEL_R, blink));
+	TEST_CHECK(allocator.setEffect(LP5562EngineAllocator::CHANNEL_G, blink));
+	TEST_CHECK(allocator.setEffect(LP5562EngineAllocator::CHANNEL_B, fast));
+	TEST_CHECK(allocator.setLevel(LP5562EngineAllocator::CHANNEL_W, 33));
+	TEST_CHECK(allocator.apply());
+
+	// R and G run the same program, so they share an engine and stay in step
+	TEST_CHECK(allocator.getEngine(LP5562EngineAllocator::CHANNEL_R) != 0);
+	TEST_CHECK_EQUAL(allocator.getEngine(LP5562EngineAllocator::CHANNEL_G), allocator.getEngine(LP5562EngineAllocator::CHANNEL_R));
+	TEST_CHECK(allocator.getEngine(LP5562EngineAllocator::CHANNEL_B) != 0);
+	TEST_CHECK(allocator.getEngine(LP5562EngineAllocator::CHANNEL_B) != allocator.getEngine(LP5562EngineAllocator::CHANNEL_R));
+	TEST_CHECK_EQUAL(allocator.getEngine(LP5562EngineAllocator::CHANNEL_W), 0);
+	TEST_CHECK_EQUAL(allocator.getEnginesLoaded(), 2);
+
+	chip.sim.advanceMillis(25);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_G), 255);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_B), 100);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 33);
+
+	// Changing B doesn't reload or restart the engine R and G are on
+	chip.sim.advanceMillis(250);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+	TEST_CHECK(allocator.setLevel(LP5562EngineAllocator::CHANNEL_B, 7));
+	TEST_CHECK(allocator.apply());
+	TEST_CHECK_EQUAL(allocator.getEnginesLoaded(), 0);
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_B), 7);
+}
+
+static void testDegraded() {
+	TestChip chip;
+
+	LP5562Program programs[4];
+	for(size_t ii = 0; ii < 4; ii++) {
+		makeBlink(programs[ii], 255, 100 + 50 * ii, 100);
+	}
+
+	// Four different programs, W has the lowest priority
+	LP5562EngineAllocator allocator(chip.ledDriver);
+	TEST_CHECK(allocator.setEffect(LP5562EngineAllocator::CHANNEL_R, programs[0], 30));
+	TEST_CHECK(allocator.setEffect(LP5562EngineAllocator::CHANNEL_G, programs[1], 20));
+	TEST_CHECK(allocator.setEffect(LP5562EngineAllocator::CHANNEL_B, programs[2], 20));
+	TEST_CHECK(allocator.setEffect(LP5562EngineAllocator::CHANNEL_W, programs[3], 10, 44));
+	TEST_CHECK(allocator.apply());
+
+	TEST_CHECK(allocator.isDegraded(LP5562EngineAllocator::CHANNEL_W));
+	TEST_CHECK(!allocator.isDegraded(LP5562EngineAllocator::CHANNEL_R));
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 44);
+
+	// Freeing an engine gives W its effect, starting from the beginning
+	TEST_CHECK(allocator.release(LP5562EngineAllocator::CHANNEL_R));
+	TEST_CHECK(allocator.apply());
+	TEST_CHECK(!allocator.isDegraded(LP5562EngineAllocator::CHANNEL_W));
+	TEST_CHECK(allocator.getEngine(LP5562EngineAllocator::CHANNEL_W) != 0);
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 255);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+}
+
+static void testTriggersRejected() {
+	TestChip chip(false);
+
+	LP5562Program program;
+	program.addCommandTriggerWait(LP5562::MASK_ENGINE_2);
+
+	LP5562EngineAllocator allocator(chip.ledDriver);
+	TEST_CHECK(!allocator.setEffect(LP5562EngineAllocator::CHANNEL_R, program));
+}
+
+int main() {
+	TEST_RUN(testSharedEngine);
+	TEST_RUN(testDegraded);
+	TEST_RUN(testTriggersRejected);
+	return testResult();
+}
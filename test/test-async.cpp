@@ -0,0 +1,66 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Async
+
+#include "LP5562-RK-Async.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testSuperseded() {
+	TestChip chip;
+
+	// Without start(), nothing happens until process() is called
+	LP5562Async ledAsync(chip.ledDriver);
+	uint32_t seq1 = ledAsync.setRGB(0x100000);
+	uint32_t seq2 = ledAsync.setRGB(0x200000);
+	TEST_CHECK(seq1 != 0);
+	TEST_CHECK(seq2 != 0);
+	TEST_CHECK_EQUAL(ledAsync.getQueueDepth(), 2);
+	TEST_CHECK(!ledAsync.isComplete(seq1));
+
+	TEST_CHECK_EQUAL(ledAsync.process(), 2);
+	TEST_CHECK(ledAsync.isComplete(seq2));
+	TEST_CHECK_EQUAL(ledAsync.getSupersededCount(), 1);
+	TEST_CHECK_EQUAL(ledAsync.getExecutedCount(), 1);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0x20);
+}
+
+static void testQueueFull() {
+	TestChip chip;
+
+	// One entry is always left empty
+	LP5562Async ledAsync(chip.ledDriver, 3);
+	TEST_CHECK(ledAsync.setW(1) != 0);
+	TEST_CHECK(ledAsync.setW(2) != 0);
+	TEST_CHECK_EQUAL(ledAsync.setW(3), 0);
+	TEST_CHECK_EQUAL(ledAsync.getDroppedCount(), 1);
+}
+
+static void testWorkerThread() {
+	TestChip chip;
+
+	LP5562Async ledAsync(chip.ledDriver);
+
+	// Queued before the worker starts
+	uint32_t seq = ledAsync.setRGB(0x010203);
+	TEST_CHECK(ledAsync.start());
+	TEST_CHECK(ledAsync.waitComplete(seq, 1000));
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_B), 3);
+
+	// The worker is blocked on an empty queue now; queuing wakes it up
+	delay(20);
+	seq = ledAsync.setW(99);
+	TEST_CHECK(ledAsync.waitComplete(seq, 1000));
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 99);
+	TEST_CHECK_EQUAL(ledAsync.getFailedCount(), 0);
+
+	// The destructor wakes the worker to stop it
+}
+
+int main() {
+	TEST_RUN(testSuperseded);
+	TEST_RUN(testQueueFull);
+	TEST_RUN(testWorkerThread);
+	return testResult();
+}
@@ -0,0 +1,83 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of beginBatch() and commit()
+
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testStagedUntilCommit() {
+	TestChip chip;
+
+	chip.sim.clearTransactions();
+	chip.ledDriver.beginBatch();
+	TEST_CHECK(chip.ledDriver.isBatchActive());
+	chip.ledDriver.setRGB(1, 2, 3);
+	chip.ledDriver.setRGB(10, 20, 30);
+	chip.ledDriver.setW(40);
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 0);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+
+	// Each register is written once with its last value: B, G, R (0x02 - 0x04) in one write, W separately
+	TEST_CHECK(chip.ledDriver.commit());
+	TEST_CHECK(!chip.ledDriver.isBatchActive());
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 2);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_G), 20);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_B), 30);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 40);
+}
+
+static void testNested() {
+	TestChip chip;
+
+	chip.sim.clearTransactions();
+	chip.ledDriver.beginBatch();
+	chip.ledDriver.beginBatch();
+	chip.ledDriver.setW(5);
+	TEST_CHECK(chip.ledDriver.commit());
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 0);
+	TEST_CHECK(chip.ledDriver.commit());
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 1);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 5);
+}
+
+static void testProgramWriteFlushesFirst() {
+	TestChip chip;
+
+	LP5562Program program;
+	program.addCommandSetPWM(100);
+	program.addCommandEnd(false, false);
+
+	chip.sim.clearTransactions();
+	chip.ledDriver.beginBatch();
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, false));
+
+	// The LED map was written before the program memory
+	TEST_CHECK(chip.sim.getNumTransactions() >= 2);
+	TEST_CHECK_EQUAL(chip.sim.getTransaction(0).reg, LP5562::REG_LED_MAP);
+	TEST_CHECK(chip.ledDriver.commit());
+
+	TEST_CHECK(chip.ledDriver.setEnable(LP5562::MASK_ENGINE_1, LP5562::REG_ENABLE_RUN));
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 100);
+}
+
+static void testFailedCommit() {
+	TestChip chip;
+
+	chip.ledDriver.beginBatch();
+	chip.ledDriver.setW(5);
+	chip.sim.failNextTransactions(1);
+	TEST_CHECK(!chip.ledDriver.commit());
+	TEST_CHECK(!chip.ledDriver.isBatchActive());
+}
+
+int main() {
+	TEST_RUN(testStagedUntilCommit);
+	TEST_RUN(testNested);
+	TEST_RUN(testProgramWriteFlushesFirst);
+	TEST_RUN(testFailedCommit);
+	return testResult();
+}
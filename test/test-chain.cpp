@@ -0,0 +1,163 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Chain
+
+#include "LP5562-RK-Chain.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+#include <string.h>
+
+/**
+ * @brief Check which of R, G, and B are on
+ */
+static void checkOn(const LP5562Simulator &sim, bool red, bool green, bool blue) {
+	TEST_CHECK_EQUAL(sim.getOutput(LP5562Simulator::CHANNEL_R), red ? 255 : 0);
+	TEST_CHECK_EQUAL(sim.getOutput(LP5562Simulator::CHANNEL_G), green ? 255 : 0);
+	TEST_CHECK_EQUAL(sim.getOutput(LP5562Simulator::CHANNEL_B), blue ? 255 : 0);
+}
+
+static void testChase() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMapping(LP5562::REG_LED_MAP_ENGINE_1, LP5562::REG_LED_MAP_ENGINE_2, LP5562::REG_LED_MAP_ENGINE_3, LP5562::REG_LED_MAP_DIRECT));
+
+	LP5562Program flash;
+	makeSegment(flash, 255, 100);
+	flash.addCommandSetPWM(0);
+
+	LP5562Chain chain;
+	chain.addSegment(flash).addHandOff().addSegment(flash).addHandOff().addSegment(flash);
+	TEST_CHECK(!chain.hasError());
+
+	const LP5562Chain::Result &result = chain.compile();
+	TEST_CHECK(result.success);
+	TEST_CHECK_EQUAL(result.numEngines, 3);
+	TEST_CHECK(result.periodMicros >= 299000 && result.periodMicros <= 302000);
+
+	TEST_CHECK(chain.apply(chip.ledDriver));
+
+	chip.sim.advanceMillis(50);
+	checkOn(chip.sim, true, false, false);
+	chip.sim.advanceMillis(100);
+	checkOn(chip.sim, false, true, false);
+	chip.sim.advanceMillis(100);
+	checkOn(chip.sim, false, false, true);
+
+	// Back to engine 1
+	chip.sim.advanceMillis(100);
+	checkOn(chip.sim, true, false, false);
+
+	// Applying again starts over from engine 1, even though the programs are already loaded
+	chip.sim.advanceMillis(100);
+	checkOn(chip.sim, false, true, false);
+	TEST_CHECK(chain.apply(chip.ledDriver));
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+}
+
+static void testTooLong() {
+	LP5562Program flash;
+	makeSegment(flash, 255, 100);
+	flash.addCommandSetPWM(0);
+
+	// Each engine holds one segment and its triggers, so a fourth hand off doesn't fit
+	LP5562Chain chain;
+	chain.addSegment(flash).addHandOff().addSegment(flash).addHandOff().addSegment(flash).addHandOff().addSegment(flash);
+	TEST_CHECK(!chain.hasError());
+	const LP5562Chain::Result &result = chain.compile();
+	TEST_CHECK(!result.success);
+	TEST_CHECK(result.error && strcmp(result.error, "sequence does not fit in 3 engines") == 0);
+
+	// 42 instructions fit, 43 don't
+	LP5562Program big;
+	for(size_t ii = 0; ii < LP5562Chain::MAX_PART_INSTRUCTIONS; ii++) {
+		big.addCommandSetPWM((uint8_t)ii);
+	}
+	chain.clear();
+	chain.addSegment(big).addSegment(big).addSegment(big);
+	TEST_CHECK(!chain.hasError());
+	chain.addSegment(flash);
+	TEST_CHECK(chain.hasError());
+	TEST_CHECK(strcmp(chain.compile().error, "invalid segment") == 0);
+}
+
+static void testLongSequenceSplit() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMapping(LP5562::REG_LED_MAP_ENGINE_1, LP5562::REG_LED_MAP_ENGINE_2, LP5562::REG_LED_MAP_DIRECT, LP5562::REG_LED_MAP_DIRECT));
+
+	// 8 segments of 3 instructions is more than one engine holds, so without addHandOff() the
+	// sequence still moves on to engine 2 after the segments that fit on engine 1. 125 ms is exactly
+	// 8 cycles of 15.625 ms, so the wait is one instruction.
+	LP5562Chain chain;
+	LP5562Program segment;
+	for(size_t ii = 0; ii < 8; ii++) {
+		makeSegment(segment, (uint8_t)(10 * (ii + 1)), 125);
+		segment.addCommandSetPWM(0);
+		TEST_CHECK_EQUAL(segment.getStepNum(), 3);
+		chain.addSegment(segment);
+	}
+	TEST_CHECK(!chain.hasError());
+
+	const LP5562Chain::Result &result = chain.compile();
+	TEST_CHECK(result.success);
+	TEST_CHECK_EQUAL(result.numEngines, 2);
+	// Engine 1: 4 segments, send and wait. Engine 2: wait, 4 segments, send.
+	TEST_CHECK_EQUAL(chain.getProgram(1).getStepNum(), 14);
+	TEST_CHECK_EQUAL(chain.getProgram(2).getStepNum(), 14);
+	TEST_CHECK(result.periodMicros >= 1000000 && result.periodMicros <= 1002000);
+
+	TEST_CHECK(chain.apply(chip.ledDriver));
+
+	// The first four segments are on red, the last four on green
+	for(size_t ii = 0; ii < 8; ii++) {
+		chip.sim.advanceMillis((ii == 0) ? 60 : 125);
+		TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), (ii < 4) ? 10 * (ii + 1) : 0);
+		TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_G), (ii < 4) ? 0 : 10 * (ii + 1));
+	}
+
+	// And around again
+	chip.sim.advanceMillis(125);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 10);
+}
+
+static void testNoRepeat() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMapping(LP5562::REG_LED_MAP_ENGINE_1, LP5562::REG_LED_MAP_ENGINE_2, LP5562::REG_LED_MAP_ENGINE_3, LP5562::REG_LED_MAP_DIRECT));
+
+	LP5562Program flash;
+	makeSegment(flash, 255, 100);
+	flash.addCommandSetPWM(0);
+
+	LP5562Chain chain;
+	chain.withRepeat(false).addSegment(flash).addHandOff().addSegment(flash).addHandOff().addSegment(flash);
+
+	const LP5562Chain::Result &result = chain.compile();
+	TEST_CHECK(result.success);
+	TEST_CHECK_EQUAL(result.numEngines, 3);
+	TEST_CHECK(result.periodMicros >= 299000 && result.periodMicros <= 302000);
+
+	TEST_CHECK(chain.apply(chip.ledDriver));
+
+	chip.sim.advanceMillis(50);
+	checkOn(chip.sim, true, false, false);
+	chip.sim.advanceMillis(100);
+	checkOn(chip.sim, false, true, false);
+	chip.sim.advanceMillis(100);
+	checkOn(chip.sim, false, false, true);
+
+	// Engine 1 ended instead of waiting for engine 3, so nothing comes on again
+	TEST_CHECK(!chip.sim.isEngineRunning(1));
+	chip.sim.advanceMillis(100);
+	checkOn(chip.sim, false, false, false);
+	chip.sim.advanceMillis(1000);
+	checkOn(chip.sim, false, false, false);
+}
+
+int main() {
+	TEST_RUN(testChase);
+	TEST_RUN(testTooLong);
+	TEST_RUN(testLongSequenceSplit);
+	TEST_RUN(testNoRepeat);
+	return testResult();
+}
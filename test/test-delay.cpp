@@ -0,0 +1,142 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Program::solveDelay() and addDelay(), checked against the time the engine model
+// takes to run the instructions
+
+#include "LP5562-RK-Timing.h"
+#include "LP5562-Test.h"
+
+/**
+ * @brief Add an End to program and get the time the engine executes it, in ticks
+ *
+ * Only ramps and waits take time in the engine model, so this is the length of the delay.
+ */
+static uint64_t getEndTicks(LP5562Program &program) {
+	program.addCommandEnd(false, false);
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, program);
+
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(result.success);
+	TEST_CHECK_EQUAL(result.engines[0].behavior, LP5562TimingAnalyzer::BEHAVIOR_ENDS);
+	return result.engines[0].endTicks;
+}
+
+/**
+ * @brief Run a solution and check that it takes ticks + errorTicks
+ */
+static void checkSolution(uint64_t ticks, const LP5562Program::DelaySolution &solution) {
+	LP5562Program program;
+	for(size_t ii = 0; ii < solution.numInstructions; ii++) {
+		TEST_CHECK(program.addCommand(solution.instructions[ii]));
+	}
+	TEST_CHECK_EQUAL(getEndTicks(program), (int64_t) ticks + solution.errorTicks);
+}
+
+static void testSolveDelay() {
+	// Short waits, the longest single wait (63 x 15.6 ms), just past it, one second, 63 s (the longest
+	// wait in one loop), 10 minutes, and the longest delay in 3 instructions
+	const uint64_t ticks[] = { 1, 16, 100, 1008, 63 * 512, 63 * 512 + 1, 32768, 63 * 63 * 512, 600ULL * 32768, 63ULL * 63 * 63 * 512 };
+
+	for(size_t ii = 0; ii < sizeof(ticks) / sizeof(ticks[0]); ii++) {
+		int64_t lastError = INT64_MAX;
+
+		for(size_t maxInstructions = 1; maxInstructions <= LP5562Program::MAX_DELAY_INSTRUCTIONS; maxInstructions++) {
+			LP5562Program::DelaySolution solution;
+			if (!LP5562Program::solveDelay(ticks[ii], maxInstructions, solution)) {
+				// Only fails when there are too few instructions, so fewer can't work either
+				TEST_CHECK(lastError == INT64_MAX);
+				continue;
+			}
+			TEST_CHECK(solution.numInstructions <= maxInstructions);
+			checkSolution(ticks[ii], solution);
+
+			// More instructions are never worse
+			int64_t error = (solution.errorTicks < 0) ? -solution.errorTicks : solution.errorTicks;
+			TEST_CHECK(error <= lastError);
+			lastError = error;
+		}
+
+		// Every delay here can be done with all of the instructions, to within half of a 0.49 ms cycle
+		TEST_CHECK(lastError <= 8);
+	}
+}
+
+static void testLongDelay() {
+	// One hour with the default 3 instructions: 63 s loops can't hit it exactly
+	LP5562Program program;
+	int32_t errorMicros = 0;
+	TEST_CHECK(program.addDelay(3600000, LP5562Program::DEFAULT_DELAY_INSTRUCTIONS, &errorMicros));
+	TEST_CHECK(program.getStepNum() <= LP5562Program::DEFAULT_DELAY_INSTRUCTIONS);
+	TEST_CHECK_EQUAL(errorMicros, 843750);
+	TEST_CHECK_EQUAL(LP5562SimEngines::ticksToMicros(getEndTicks(program)), 3600000000ULL + 843750);
+
+	// With more instructions it's closer, but only the first wait can be in the loops so it's not
+	// within a cycle
+	program.clear();
+	TEST_CHECK(program.addDelay(3600000, LP5562Program::MAX_DELAY_INSTRUCTIONS, &errorMicros));
+	TEST_CHECK_EQUAL(errorMicros, -140625);
+	int64_t endMicros = (int64_t) LP5562SimEngines::ticksToMicros(getEndTicks(program));
+	TEST_CHECK_EQUAL(endMicros - 3600000000LL, errorMicros);
+
+	// The longest delay in 3 instructions is 3 nested loops of 63 x 15.6 ms
+	program.clear();
+	TEST_CHECK(program.addDelay(3906984, 3, &errorMicros));
+	TEST_CHECK_EQUAL(getEndTicks(program), 63ULL * 63 * 63 * 512);
+	program.clear();
+	TEST_CHECK(!program.addDelay(3906985, 3));
+}
+
+static void testResidualError() {
+	// Every millisecond value up to 3 s, with enough instructions, is within a quarter millisecond
+	for(unsigned long ms = 1; ms <= 3000; ms += 7) {
+		LP5562Program program;
+		int32_t errorMicros = 0;
+		TEST_CHECK(program.addDelay(ms, LP5562Program::MAX_DELAY_INSTRUCTIONS, &errorMicros));
+		TEST_CHECK(errorMicros >= -250 && errorMicros <= 250);
+
+		int64_t endMicros = (int64_t) LP5562SimEngines::ticksToMicros(getEndTicks(program));
+		int64_t expectedMicros = (int64_t) ms * 1000 + errorMicros;
+		// errorMicros is relative to ms rounded to the nearest tick (30.5 us)
+		TEST_CHECK(endMicros >= expectedMicros - 31 && endMicros <= expectedMicros + 31);
+	}
+}
+
+static void testInstructionBudget() {
+	// A single wait is at most 63 x 15.6 ms = 984 ms
+	LP5562Program program;
+	TEST_CHECK(program.addDelay(984, 1));
+	TEST_CHECK_EQUAL(program.getStepNum(), 1);
+	TEST_CHECK(!program.addDelay(1001, 1));
+	TEST_CHECK_EQUAL(program.getStepNum(), 1);
+
+	// The budget is also limited by the space left in the program
+	program.clear();
+	for(size_t ii = 0; ii < 15; ii++) {
+		program.addCommandSetPWM((uint8_t) ii);
+	}
+	TEST_CHECK(!program.addDelay(5000));
+	TEST_CHECK(program.addDelay(500));
+	TEST_CHECK_EQUAL(program.getStepNum(), 16);
+
+	// 0 adds nothing
+	program.clear();
+	TEST_CHECK(program.addDelay(0));
+	TEST_CHECK_EQUAL(program.getStepNum(), 0);
+
+	// Branch step numbers are relative to where the delay is added
+	program.clear();
+	program.addCommandSetPWM(255);
+	TEST_CHECK(program.addDelay(10000));
+	TEST_CHECK_EQUAL(getEndTicks(program), 10000ULL * 32768 / 1000);
+}
+
+int main() {
+	TEST_RUN(testSolveDelay);
+	TEST_RUN(testLongDelay);
+	TEST_RUN(testResidualError);
+	TEST_RUN(testInstructionBudget);
+	return testResult();
+}
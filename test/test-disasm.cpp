@@ -0,0 +1,201 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Disassembler
+
+#include "LP5562-RK-Disasm.h"
+#include "LP5562-Test.h"
+
+#include <string.h>
+
+/**
+ * @brief Returns true if report has an issue with code at engine and step
+ */
+static bool hasIssue(const LP5562Disassembler::Report &report, uint8_t code, size_t engine, size_t step) {
+	for(size_t ii = 0; ii < report.numIssues; ii++) {
+		const LP5562Disassembler::Issue &issue = report.issues[ii];
+		if (issue.code == code && issue.engine == engine && issue.step == step) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void testDisassemble() {
+	static const uint16_t instructions[] = {
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::ramp(false, 2, true, 100),
+		LP5562Opcode::branch(3, 0),
+		LP5562Opcode::triggerSend(LP5562::MASK_ENGINE_2),
+		LP5562Opcode::end(true, true)
+	};
+
+	char buf[512];
+	LP5562Disassembler::disassemble(instructions, sizeof(instructions) / sizeof(instructions[0]), buf, sizeof(buf));
+	TEST_CHECK(strstr(buf, "00: 40ff  set_pwm 255\n") != NULL);
+	TEST_CHECK(strstr(buf, "01: 6000  wait 500.00 ms (prescale=1 step=32)\n") != NULL);
+	TEST_CHECK(strstr(buf, "ramp -100, 0.97 ms/step") != NULL);
+	TEST_CHECK(strstr(buf, "03: a180  branch 3 times to 0\n") != NULL);
+	TEST_CHECK(strstr(buf, "trigger send 2\n") != NULL);
+	TEST_CHECK(strstr(buf, "05: d800  end interrupt set_pwm_0\n") != NULL);
+
+	// Always null terminated, even if it doesn't fit
+	char small[8];
+	LP5562Disassembler::disassemble(instructions, 1, small, sizeof(small));
+	TEST_CHECK_EQUAL(strlen(small), sizeof(small) - 1);
+}
+
+static void testUnreachable() {
+	// Nothing after a go to start runs
+	static const uint16_t instructions[] = {
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::goToStart(),
+		LP5562Opcode::setPWM(0)
+	};
+
+	LP5562Disassembler::Report report;
+	TEST_CHECK(LP5562Disassembler::validate(instructions, 4, 1, report));
+	TEST_CHECK_EQUAL(report.numErrors, 0);
+	TEST_CHECK_EQUAL(report.numIssues, 1);
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_UNREACHABLE, 1, 3));
+	TEST_CHECK(!LP5562Disassembler::isError(LP5562Disassembler::ISSUE_UNREACHABLE));
+
+	// Nor after an End
+	static const uint16_t ends[] = {
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::end(false, false),
+		LP5562Opcode::wait(true, 32)
+	};
+	TEST_CHECK(LP5562Disassembler::validate(ends, 3, 2, report));
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_UNREACHABLE, 2, 2));
+}
+
+static void testBranchOutOfRange() {
+	// Step 5 is past the end of the program
+	static const uint16_t instructions[] = {
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::branch(2, 5)
+	};
+
+	LP5562Disassembler::Report report;
+	TEST_CHECK(!LP5562Disassembler::validate(instructions, 2, 1, report));
+	TEST_CHECK_EQUAL(report.numErrors, 1);
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_BRANCH_OUT_OF_RANGE, 1, 1));
+
+	char buf[128];
+	LP5562Disassembler::formatReport(report, buf, sizeof(buf));
+	TEST_CHECK(strstr(buf, "engine 1 step 1: error: branch past the end of the program\n") != NULL);
+}
+
+static void testBranchForward() {
+	// Skips step 1, which still runs on the last pass
+	static const uint16_t instructions[] = {
+		LP5562Opcode::branch(2, 2),
+		LP5562Opcode::setPWM(100),
+		LP5562Opcode::wait(true, 32)
+	};
+
+	LP5562Disassembler::Report report;
+	TEST_CHECK(LP5562Disassembler::validate(instructions, 3, 1, report));
+	TEST_CHECK_EQUAL(report.numIssues, 1);
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_BRANCH_FORWARD, 1, 0));
+
+	// A loop count of 0 loops forever, so nothing after it runs
+	static const uint16_t forever[] = {
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::branch(0, 0),
+		LP5562Opcode::setPWM(0)
+	};
+	TEST_CHECK(LP5562Disassembler::validate(forever, 3, 1, report));
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_INFINITE_LOOP, 1, 1));
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_UNREACHABLE, 1, 2));
+
+	// Nothing takes time
+	static const uint16_t noWait[] = {
+		LP5562Opcode::setPWM(10),
+		LP5562Opcode::setPWM(20)
+	};
+	TEST_CHECK(LP5562Disassembler::validate(noWait, 2, 1, report));
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_NO_WAIT_IN_LOOP, 1, 0));
+}
+
+static void testInvalidOpcode() {
+	static const uint16_t instructions[] = {
+		LP5562Opcode::wait(true, 32),
+		0x8000
+	};
+
+	LP5562Disassembler::Report report;
+	TEST_CHECK(!LP5562Disassembler::validate(instructions, 2, 1, report));
+	TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_INVALID_OPCODE, 1, 1));
+}
+
+static void testTriggerDeadlock() {
+	static const uint16_t waitFor2[] = {
+		LP5562Opcode::triggerWait(LP5562::MASK_ENGINE_2),
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(true, 32)
+	};
+	static const uint16_t sendTo1[] = {
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::triggerSend(LP5562::MASK_ENGINE_1)
+	};
+	static const uint16_t sendTo3[] = {
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::triggerSend(LP5562::MASK_ENGINE_3)
+	};
+	static const uint16_t blink[] = {
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(true, 32)
+	};
+
+	LP5562Disassembler::Report report;
+
+	// Engine 2 sends to engine 1, which waits for it
+	{
+		const uint16_t * const instructions[3] = { waitFor2, sendTo1, NULL };
+		const size_t numInstructions[3] = { 3, 2, 0 };
+		TEST_CHECK(LP5562Disassembler::validateEngines(instructions, numInstructions, report));
+		TEST_CHECK_EQUAL(report.numErrors, 0);
+	}
+
+	// Engine 2 never sends, so engine 1 waits forever
+	{
+		const uint16_t * const instructions[3] = { waitFor2, blink, NULL };
+		const size_t numInstructions[3] = { 3, 2, 0 };
+		TEST_CHECK(!LP5562Disassembler::validateEngines(instructions, numInstructions, report));
+		TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_TRIGGER_WAIT_DEADLOCK, 1, 0));
+	}
+
+	// The same when engine 2 isn't running
+	{
+		const uint16_t * const instructions[3] = { waitFor2, NULL, NULL };
+		const size_t numInstructions[3] = { 3, 0, 0 };
+		TEST_CHECK(!LP5562Disassembler::validateEngines(instructions, numInstructions, report));
+		TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_TRIGGER_WAIT_DEADLOCK, 1, 0));
+	}
+
+	// Engine 3 never waits for engine 2, so the send never completes
+	{
+		const uint16_t * const instructions[3] = { NULL, sendTo3, blink };
+		const size_t numInstructions[3] = { 0, 2, 2 };
+		TEST_CHECK(!LP5562Disassembler::validateEngines(instructions, numInstructions, report));
+		TEST_CHECK_EQUAL(report.numErrors, 1);
+		TEST_CHECK(hasIssue(report, LP5562Disassembler::ISSUE_TRIGGER_SEND_DEADLOCK, 2, 1));
+	}
+
+	// validate() alone can't tell
+	TEST_CHECK(LP5562Disassembler::validate(waitFor2, 3, 1, report));
+}
+
+int main() {
+	TEST_RUN(testDisassemble);
+	TEST_RUN(testUnreachable);
+	TEST_RUN(testBranchOutOfRange);
+	TEST_RUN(testBranchForward);
+	TEST_RUN(testInvalidOpcode);
+	TEST_RUN(testTriggerDeadlock);
+	return testResult();
+}
@@ -0,0 +1,92 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562IndicatorManager
+
+#include "LP5562-RK-Indicator.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testPriority() {
+	TestChip chip;
+	chip.ledDriver.setIndicatorMode();
+
+	LP5562IndicatorState connecting("connecting", 10);
+	connecting.withChannel(LP5562IndicatorState::CHANNEL_G, LP5562::REG_LED_MAP_ENGINE_1)
+		.withChannel(LP5562IndicatorState::CHANNEL_W, LP5562::REG_LED_MAP_DIRECT, 20);
+
+	LP5562IndicatorState lowBattery("low battery", 20);
+	lowBattery.withChannel(LP5562IndicatorState::CHANNEL_W, LP5562::REG_LED_MAP_DIRECT, 200);
+
+	LP5562IndicatorManager indicators(chip.ledDriver);
+	indicators.addState(connecting).addState(lowBattery);
+
+	TEST_CHECK(indicators.activate("connecting"));
+	TEST_CHECK(indicators.apply());
+	TEST_CHECK(indicators.getWinningState(LP5562IndicatorState::CHANNEL_G) == &connecting);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 20);
+
+	// Low battery wins W; G still shows connecting
+	TEST_CHECK(indicators.activate(lowBattery));
+	TEST_CHECK(indicators.apply());
+	TEST_CHECK(indicators.getWinningState(LP5562IndicatorState::CHANNEL_W) == &lowBattery);
+	TEST_CHECK(indicators.getWinningState(LP5562IndicatorState::CHANNEL_G) == &connecting);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 200);
+
+	TEST_CHECK(indicators.deactivate("low battery"));
+	TEST_CHECK(indicators.apply());
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 20);
+
+	// Nothing sets R
+	TEST_CHECK(indicators.getWinningState(LP5562IndicatorState::CHANNEL_R) == NULL);
+	TEST_CHECK(!indicators.activate("not a state"));
+}
+
+static void testNoChangeNoBus() {
+	TestChip chip;
+	chip.ledDriver.setIndicatorMode();
+
+	LP5562IndicatorState a("a", 10);
+	a.withChannel(LP5562IndicatorState::CHANNEL_R, LP5562::REG_LED_MAP_DIRECT, 50);
+	LP5562IndicatorState b("b", 5);
+	b.withChannel(LP5562IndicatorState::CHANNEL_R, LP5562::REG_LED_MAP_DIRECT, 60);
+
+	LP5562IndicatorManager indicators(chip.ledDriver);
+	indicators.addState(a).addState(b);
+	TEST_CHECK(indicators.activate(a));
+	TEST_CHECK(indicators.apply());
+
+	// b is lower priority, so what's shown doesn't change
+	chip.sim.clearTransactions();
+	TEST_CHECK(indicators.activate(b));
+	TEST_CHECK(indicators.apply());
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 0);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 50);
+}
+
+static void testTimeout() {
+	TestChip chip;
+	chip.ledDriver.setIndicatorMode();
+
+	LP5562IndicatorState ota("ota", 10);
+	ota.withChannel(LP5562IndicatorState::CHANNEL_B, LP5562::REG_LED_MAP_DIRECT, 99);
+
+	LP5562IndicatorManager indicators(chip.ledDriver);
+	indicators.addState(ota);
+	TEST_CHECK(indicators.activate(ota, 20));
+	indicators.loop();
+	TEST_CHECK(indicators.isActive(ota));
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_B), 99);
+
+	delay(40);
+	indicators.loop();
+	TEST_CHECK(!indicators.isActive(ota));
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_B), 0);
+}
+
+int main() {
+	TEST_RUN(testPriority);
+	TEST_RUN(testNoChangeNoBus);
+	TEST_RUN(testTimeout);
+	return testResult();
+}
@@ -0,0 +1,91 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562InterruptDispatcher, with the simulated INT pin
+
+#include "LP5562-RK-Interrupt.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+/**
+ * @brief Simulator interrupt handler that calls the dispatcher's
+ */
+static void simInterrupt(void *context) {
+	((LP5562InterruptDispatcher *)context)->interruptHandler();
+}
+
+/**
+ * @brief Engine callback that counts calls in an array indexed by engine - 1
+ */
+static void engineEnded(size_t engine, void *context) {
+	((int *)context)[engine - 1]++;
+}
+
+static void testCallbacks() {
+	TestChip chip;
+
+	int ended[3] = { 0, 0, 0 };
+	LP5562InterruptDispatcher dispatcher(chip.ledDriver);
+	dispatcher.withEngineCallback(1, engineEnded, ended).withEngineCallback(2, engineEnded, ended);
+	chip.sim.withInterruptHandler(simInterrupt, &dispatcher);
+
+	LP5562Program shortShot, longShot;
+	makeOneShot(shortShot, 50);
+	makeOneShot(longShot, 150);
+	TEST_CHECK(chip.ledDriver.setProgram(1, shortShot, true));
+	TEST_CHECK(chip.ledDriver.setProgram(2, longShot, true));
+
+	// The first loop() reads the status in case INT was already low
+	chip.sim.advanceMillis(10);
+	dispatcher.loop();
+	TEST_CHECK_EQUAL(dispatcher.getStats().statusReads, 1);
+
+	// No interrupt since, so loop() doesn't use the bus
+	chip.sim.advanceMillis(10);
+	chip.sim.clearTransactions();
+	dispatcher.loop();
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 0);
+
+	chip.sim.advanceMillis(50);
+	dispatcher.loop();
+	TEST_CHECK_EQUAL(ended[0], 1);
+	TEST_CHECK_EQUAL(ended[1], 0);
+
+	chip.sim.advanceMillis(100);
+	dispatcher.loop();
+	TEST_CHECK_EQUAL(ended[0], 1);
+	TEST_CHECK_EQUAL(ended[1], 1);
+
+	TEST_CHECK_EQUAL(dispatcher.getStats().interrupts, 2);
+	TEST_CHECK_EQUAL(dispatcher.getStats().statusReads, 3);
+	TEST_CHECK_EQUAL(dispatcher.getStats().ends, 2);
+}
+
+static void testCompletion() {
+	TestChip chip;
+
+	LP5562InterruptDispatcher dispatcher(chip.ledDriver);
+	chip.sim.withInterruptHandler(simInterrupt, &dispatcher);
+
+	LP5562Program program;
+	makeOneShot(program, 50);
+
+	LP5562EngineCompletion completion;
+	TEST_CHECK(dispatcher.whenEnded(3, completion));
+	TEST_CHECK(!dispatcher.whenEnded(4, completion));
+	TEST_CHECK(chip.ledDriver.setProgram(3, program, true));
+
+	chip.sim.advanceMillis(30);
+	dispatcher.loop();
+	TEST_CHECK(!completion.isDone());
+
+	chip.sim.advanceMillis(30);
+	dispatcher.loop();
+	TEST_CHECK(completion.isDone());
+}
+
+int main() {
+	TEST_RUN(testCallbacks);
+	TEST_RUN(testCompletion);
+	return testResult();
+}
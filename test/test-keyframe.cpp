@@ -0,0 +1,65 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562KeyframeCompiler
+
+#include "LP5562-RK-Keyframe.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+/**
+ * @brief Red on for 200 ms, off for 200 ms
+ */
+static void makeRed(LP5562Timeline &red) {
+	red.clear();
+	red.addKeyframe(0, 255, LP5562Timeline::INTERPOLATION_STEP);
+	red.addKeyframe(200, 0, LP5562Timeline::INTERPOLATION_STEP);
+}
+
+static void testApply() {
+	TestChip chip;
+
+	LP5562Timeline red;
+	makeRed(red);
+
+	LP5562KeyframeCompiler compiler;
+	compiler.withLoopMs(400).withTimeline(LP5562KeyframeCompiler::CHANNEL_R, red);
+	TEST_CHECK(compiler.compile().success);
+	TEST_CHECK_EQUAL(compiler.getResult().numEngines, 1);
+	TEST_CHECK(compiler.apply(chip.ledDriver));
+
+	chip.sim.advanceMillis(100);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+	chip.sim.advanceMillis(200);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+	chip.sim.advanceMillis(200);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+}
+
+static void testApplyAgainRestarts() {
+	TestChip chip;
+
+	LP5562Timeline red;
+	makeRed(red);
+
+	LP5562KeyframeCompiler compiler;
+	compiler.withLoopMs(400).withTimeline(LP5562KeyframeCompiler::CHANNEL_R, red);
+	TEST_CHECK(compiler.compile().success);
+	TEST_CHECK(compiler.apply(chip.ledDriver));
+
+	chip.sim.advanceMillis(300);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+
+	// The program is already loaded so it's not reloaded, but the loop still starts over
+	chip.sim.clearTransactions();
+	TEST_CHECK(compiler.apply(chip.ledDriver));
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+	TEST_CHECK_EQUAL(chip.sim.getIgnoredProgramWrites(), 0);
+}
+
+int main() {
+	TEST_RUN(testApply);
+	TEST_RUN(testApplyAgainRestarts);
+	return testResult();
+}
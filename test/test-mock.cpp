@@ -0,0 +1,134 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562MockTransport and the transport interface of LP5562
+
+#include "LP5562-RK-Mock.h"
+#include "LP5562-Test.h"
+
+static void testRecordsWrites() {
+	LP5562MockTransport mock;
+	LP5562 ledDriver(0x30, mock);
+
+	ledDriver.setRGB(10, 20, 30);
+
+	TEST_CHECK_EQUAL(mock.getNumTransactions(), 1);
+	const LP5562MockTransport::Transaction &t = mock.getTransaction(0);
+	TEST_CHECK_EQUAL(t.addr, 0x30);
+	TEST_CHECK_EQUAL(t.reg, LP5562::REG_B_PWM);
+	TEST_CHECK(!t.isRead);
+	TEST_CHECK(t.success);
+	TEST_CHECK_EQUAL(t.numValues, 3);
+	TEST_CHECK_EQUAL(t.values[0], 30);
+	TEST_CHECK_EQUAL(t.values[1], 20);
+	TEST_CHECK_EQUAL(t.values[2], 10);
+
+	TEST_CHECK_EQUAL(mock.getRegister(LP5562::REG_R_PWM), 10);
+	TEST_CHECK_EQUAL(mock.getRegister(LP5562::REG_G_PWM), 20);
+	TEST_CHECK_EQUAL(mock.getRegister(LP5562::REG_B_PWM), 30);
+}
+
+static void testRecordsReads() {
+	LP5562MockTransport mock;
+	LP5562 ledDriver(0x30, mock);
+
+	mock.setRegister(LP5562::REG_LED_MAP, 0x39);
+
+	TEST_CHECK_EQUAL(ledDriver.getLedMapping(), 0x39);
+
+	TEST_CHECK_EQUAL(mock.getNumTransactions(), 1);
+	const LP5562MockTransport::Transaction &t = mock.getTransaction(0);
+	TEST_CHECK(t.isRead);
+	TEST_CHECK(t.success);
+	TEST_CHECK_EQUAL(t.reg, LP5562::REG_LED_MAP);
+	TEST_CHECK_EQUAL(t.numValues, 1);
+	TEST_CHECK_EQUAL(t.values[0], 0x39);
+}
+
+static void testFailNextTransactions() {
+	LP5562MockTransport mock;
+	LP5562 ledDriver(0x30, mock);
+
+	mock.failNextTransactions(1);
+	TEST_CHECK(!ledDriver.writeRegister(LP5562::REG_W_PWM, 0x55));
+	TEST_CHECK_EQUAL(mock.getRegister(LP5562::REG_W_PWM), 0);
+
+	TEST_CHECK(ledDriver.writeRegister(LP5562::REG_W_PWM, 0x66));
+	TEST_CHECK_EQUAL(mock.getRegister(LP5562::REG_W_PWM), 0x66);
+
+	TEST_CHECK_EQUAL(mock.getNumTransactions(), 2);
+	TEST_CHECK(!mock.getTransaction(0).success);
+	TEST_CHECK(mock.getTransaction(1).success);
+
+	LP5562MockTransport::BusCost cost = mock.getBusCost();
+	TEST_CHECK_EQUAL(cost.transactions, 2);
+	TEST_CHECK_EQUAL(cost.failures, 1);
+
+	// A failed first write stops begin()
+	mock.clearTransactions();
+	mock.failNextTransactions(1);
+	TEST_CHECK(!ledDriver.begin());
+	TEST_CHECK_EQUAL(mock.getNumTransactions(), 1);
+	TEST_CHECK_EQUAL(mock.getTransaction(0).reg, LP5562::REG_RESET);
+
+	// Reads that fail return false
+	uint8_t value;
+	mock.failNextTransactions(1);
+	TEST_CHECK(!ledDriver.readRegisters(LP5562::REG_ENABLE, &value, 1));
+}
+
+static void testWrongAddress() {
+	LP5562MockTransport mock(0x30);
+	LP5562 ledDriver(0x31, mock);
+
+	TEST_CHECK(!ledDriver.writeRegister(LP5562::REG_W_PWM, 1));
+	TEST_CHECK(!mock.getTransaction(0).success);
+}
+
+static void testAddressShorthand() {
+	// 0 - 3 means 0x30 - 0x33
+	LP5562MockTransport mock(0x31);
+	LP5562 ledDriver(1, mock);
+
+	TEST_CHECK(ledDriver.writeRegister(LP5562::REG_W_PWM, 1));
+	TEST_CHECK_EQUAL(mock.getTransaction(0).addr, 0x31);
+	TEST_CHECK(mock.getTransaction(0).success);
+}
+
+static void testBusCost() {
+	LP5562MockTransport mock;
+	LP5562 ledDriver(0x30, mock);
+
+	ledDriver.setRGB(1, 2, 3);
+	(void) ledDriver.readRegister(LP5562::REG_ENABLE);
+
+	LP5562MockTransport::BusCost cost = mock.getBusCost();
+	TEST_CHECK_EQUAL(cost.transactions, 2);
+	// Write: address, register, 3 data. Read: address, register, address, 1 data.
+	TEST_CHECK_EQUAL(cost.bytes, 5 + 4);
+	TEST_CHECK_EQUAL(cost.bits, (2 + 5 * 9) + (3 + 4 * 9));
+
+	TEST_CHECK_EQUAL(mock.getBusCost(1).transactions, 1);
+}
+
+static void testHostTime() {
+	// millis() and micros() count from the same starting point, whichever is called first
+	unsigned long us = micros();
+	delay(20);
+	unsigned long ms = millis();
+	unsigned long usAfter = micros();
+	TEST_CHECK(ms >= us / 1000);
+	TEST_CHECK(ms <= usAfter / 1000);
+	TEST_CHECK(ms >= 20);
+}
+
+int main() {
+	TEST_RUN(testRecordsWrites);
+	TEST_RUN(testRecordsReads);
+	TEST_RUN(testFailNextTransactions);
+	TEST_RUN(testWrongAddress);
+	TEST_RUN(testAddressShorthand);
+	TEST_RUN(testBusCost);
+	TEST_RUN(testHostTime);
+	return testResult();
+}
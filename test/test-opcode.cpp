@@ -0,0 +1,113 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Opcode, which must encode the same words as LP5562Program
+
+#include "LP5562-Test.h"
+
+/**
+ * @brief Instruction word that LP5562Program adds for a single command
+ */
+static uint16_t programWord(const LP5562Program &program) {
+	TEST_CHECK_EQUAL(program.getStepNum(), 1);
+	return program.getInstructions()[0];
+}
+
+static void testMatchesProgram() {
+	LP5562Program program;
+
+	program.clear();
+	program.addCommandRamp(true, 17, true, 100);
+	TEST_CHECK_EQUAL(LP5562Opcode::ramp(true, 17, true, 100), programWord(program));
+	TEST_CHECK_EQUAL((LP5562Opcode::Ramp<true, 17, true, 100>::value), programWord(program));
+
+	program.clear();
+	program.addCommandWait(false, 63);
+	TEST_CHECK_EQUAL(LP5562Opcode::wait(false, 63), programWord(program));
+	TEST_CHECK_EQUAL((LP5562Opcode::Wait<false, 63>::value), programWord(program));
+
+	program.clear();
+	program.addCommandSetPWM(200);
+	TEST_CHECK_EQUAL(LP5562Opcode::setPWM(200), programWord(program));
+	TEST_CHECK_EQUAL(LP5562Opcode::SetPWM<200>::value, programWord(program));
+
+	program.clear();
+	program.addCommandGoToStart();
+	TEST_CHECK_EQUAL(LP5562Opcode::goToStart(), programWord(program));
+	TEST_CHECK_EQUAL(LP5562Opcode::GoToStart::value, programWord(program));
+
+	program.clear();
+	program.addCommandBranch(40, 3);
+	TEST_CHECK_EQUAL(LP5562Opcode::branch(40, 3), programWord(program));
+	TEST_CHECK_EQUAL((LP5562Opcode::Branch<40, 3>::value), programWord(program));
+
+	program.clear();
+	program.addCommandEnd(true, false);
+	TEST_CHECK_EQUAL(LP5562Opcode::end(true, false), programWord(program));
+	TEST_CHECK_EQUAL((LP5562Opcode::End<true, false>::value), programWord(program));
+
+	program.clear();
+	program.addCommandTriggerSend(LP5562::MASK_ENGINE_2 | LP5562::MASK_ENGINE_3);
+	TEST_CHECK_EQUAL(LP5562Opcode::triggerSend(LP5562::MASK_ENGINE_2 | LP5562::MASK_ENGINE_3), programWord(program));
+	TEST_CHECK_EQUAL(LP5562Opcode::TriggerSend<LP5562::MASK_ENGINE_2 | LP5562::MASK_ENGINE_3>::value, programWord(program));
+
+	program.clear();
+	program.addCommandTriggerWait(LP5562::MASK_ENGINE_1);
+	TEST_CHECK_EQUAL(LP5562Opcode::triggerWait(LP5562::MASK_ENGINE_1), programWord(program));
+	TEST_CHECK_EQUAL(LP5562Opcode::TriggerWait<LP5562::MASK_ENGINE_1>::value, programWord(program));
+}
+
+static void testWaitMs() {
+	// 0.49 ms cycles up to 30 ms, rounded to the nearest cycle
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(1), LP5562Opcode::wait(false, 2));
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(30), LP5562Opcode::wait(false, 61));
+
+	// 15.6 ms cycles above that
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(500), LP5562Opcode::wait(true, 32));
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(984), LP5562Opcode::wait(true, 63));
+	TEST_CHECK_EQUAL(LP5562Opcode::WaitMs<500>::value, LP5562Opcode::wait(true, 32));
+
+	// Out of range is clamped, not wrapped into a different wait or a go to start
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(0), LP5562Opcode::wait(false, 1));
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(1000), LP5562Opcode::wait(true, 63));
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(1500), LP5562Opcode::wait(true, 63));
+	TEST_CHECK_EQUAL(LP5562Opcode::waitMs(100000), LP5562Opcode::wait(true, 63));
+}
+
+static void testSetProgramArray() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	static const uint16_t blinkProgram[] = {
+		LP5562Opcode::SetPWM<255>::value,
+		LP5562Opcode::WaitMs<500>::value,
+		LP5562Opcode::SetPWM<0>::value,
+		LP5562Opcode::WaitMs<500>::value
+	};
+	TEST_CHECK(chip.ledDriver.setProgram(1, blinkProgram, true));
+
+	// The same words as the equivalent LP5562Program
+	LP5562Program program;
+	program.addCommandSetPWM(255);
+	program.addCommandWait(true, 32);
+	program.addCommandSetPWM(0);
+	program.addCommandWait(true, 32);
+	for(size_t ii = 0; ii < 16; ii++) {
+		TEST_CHECK_EQUAL(chip.sim.getInstruction(1, ii), (ii < program.getStepNum()) ? program.getInstructions()[ii] : 0);
+	}
+
+	// 32 cycles of 15.625 ms = 500 ms on, then 500 ms off
+	chip.sim.advanceMillis(250);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+	chip.sim.advanceMillis(500);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+	chip.sim.advanceMillis(500);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+}
+
+int main() {
+	TEST_RUN(testMatchesProgram);
+	TEST_RUN(testWaitMs);
+	TEST_RUN(testSetProgramArray);
+	return testResult();
+}
@@ -0,0 +1,65 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Pager
+
+#include "LP5562-RK-Pager.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static const size_t NUM_SEGMENTS = 10;
+
+static void testPages() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	LP5562Program segments[NUM_SEGMENTS];
+	LP5562Pager pager(chip.ledDriver, 1);
+	for(size_t ii = 0; ii < NUM_SEGMENTS; ii++) {
+		makeSegment(segments[ii], (uint8_t)(10 * (ii + 1)), 100);
+		pager.addSegment(segments[ii]);
+	}
+	pager.withRepeat(false);
+	TEST_CHECK(!pager.hasError());
+	TEST_CHECK(pager.start());
+	TEST_CHECK(pager.getNumPages() >= 2);
+
+	// Every level shows, in order, even though they don't all fit in the engine at once
+	size_t nextLevel = 0;
+	for(size_t ms = 0; ms < 2000 && pager.isRunning(); ms += 5) {
+		chip.sim.advanceMillis(5);
+
+		uint8_t level = chip.sim.getOutput(LP5562Simulator::CHANNEL_R);
+		if (nextLevel < NUM_SEGMENTS && level == 10 * (nextLevel + 1)) {
+			nextLevel++;
+		}
+
+		uint8_t status;
+		TEST_CHECK(chip.ledDriver.getStatus(status));
+		TEST_CHECK(pager.handleStatus(status));
+	}
+	TEST_CHECK_EQUAL(nextLevel, NUM_SEGMENTS);
+	TEST_CHECK(!pager.isRunning());
+	TEST_CHECK_EQUAL(pager.getStats().pagesLoaded, pager.getNumPages());
+	TEST_CHECK_EQUAL(pager.getStats().errors, 0);
+	TEST_CHECK_EQUAL(chip.sim.getIgnoredProgramWrites(), 0);
+}
+
+static void testInvalidSegment() {
+	TestChip chip(false);
+
+	// Go to start is not allowed in a segment
+	LP5562Program program;
+	program.addCommandSetPWM(10);
+	program.addCommandGoToStart();
+
+	LP5562Pager pager(chip.ledDriver, 1);
+	pager.addSegment(program);
+	TEST_CHECK(pager.hasError());
+}
+
+int main() {
+	TEST_RUN(testPages);
+	TEST_RUN(testInvalidSegment);
+	return testResult();
+}
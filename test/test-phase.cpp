@@ -0,0 +1,166 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562PhaseScheduler. The scheduler uses the time on the computer, not simulator time.
+
+#include "LP5562-RK-Phase.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+#include <limits.h>
+
+static void testStartAtPhase() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	LP5562Program program;
+	makeBlink(program, 100, 20, 20);
+
+	// 30 ms in is the off half. It starts at the Set PWM of that half, a bit after 20 ms.
+	LP5562PhaseScheduler scheduler(chip.ledDriver, 1);
+	TEST_CHECK(scheduler.start(program, 30));
+	TEST_CHECK(scheduler.getStartPc() > 0);
+	TEST_CHECK_EQUAL(chip.sim.getEnginePC(1), scheduler.getStartPc());
+	chip.sim.advanceMillis(5);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+	uint64_t programMicros = scheduler.getProgramMicros();
+	TEST_CHECK(programMicros >= 20000 && programMicros < 40000);
+}
+
+static void testChangeAtLoopBoundary() {
+	TestChip chip;
+
+	LP5562Program first, second;
+	makeBlink(first, 100, 20, 20);
+	makeBlink(second, 200, 20, 20);
+
+	LP5562PhaseScheduler scheduler(chip.ledDriver, 1);
+	TEST_CHECK_EQUAL(scheduler.getMillisToChange(), ULONG_MAX);
+	TEST_CHECK(scheduler.start(first));
+	TEST_CHECK(scheduler.changeAtLoopBoundary(second));
+	TEST_CHECK(scheduler.isChangePending());
+	TEST_CHECK(scheduler.getMillisToChange() <= 40);
+
+	// Still the first program until the end of its loop
+	TEST_CHECK_EQUAL(chip.sim.getInstruction(1, 0), first.getInstructions()[0]);
+
+	unsigned long start = millis();
+	while(scheduler.isChangePending() && millis() - start < 500) {
+		scheduler.loop();
+		delay(1);
+	}
+	TEST_CHECK(!scheduler.isChangePending());
+	TEST_CHECK_EQUAL(chip.sim.getInstruction(1, 0), second.getInstructions()[0]);
+	TEST_CHECK(chip.sim.isEngineRunning(1));
+}
+
+static void testTriggersRejected() {
+	TestChip chip;
+
+	LP5562Program program;
+	program.addCommandTriggerWait(LP5562::MASK_ENGINE_2);
+	program.addCommandGoToStart();
+
+	LP5562PhaseScheduler scheduler(chip.ledDriver, 1);
+	TEST_CHECK(!scheduler.start(program));
+
+	// Nothing was started, so there's nothing to change at
+	LP5562Program blink;
+	makeBlink(blink, 1, 20, 20);
+	TEST_CHECK(!scheduler.changeAtLoopBoundary(blink));
+}
+
+/**
+ * @brief Count the reads of the program counter registers since the last clearTransactions()
+ */
+static size_t countPcReads(LP5562Simulator &sim) {
+	size_t count = 0;
+	for(size_t ii = 0; ii < sim.getNumTransactions(); ii++) {
+		if (sim.getTransaction(ii).isRead && sim.getTransaction(ii).reg == LP5562::REG_ENG1_PC) {
+			count++;
+		}
+	}
+	return count;
+}
+
+static void testReanchorSlowEngine() {
+	TestChip chip;
+
+	// Two 250 ms halves at different levels, so the step of the second half only comes right before the
+	// 20 ms off part, and the program counter read tells which loop the engine is in
+	LP5562Program first, second;
+	first.addCommandSetPWM(100);
+	first.addDelay(250);
+	first.addCommandSetPWM(50);
+	first.addDelay(250);
+	first.addCommandSetPWM(0);
+	first.addDelay(20);
+	first.addCommandGoToStart();
+	makeBlink(second, 200, 500, 20);
+
+	uint8_t offPc = 0;
+	for(uint8_t ii = 0; ii < first.getStepNum(); ii++) {
+		if (first.getInstructions()[ii] == LP5562Opcode::setPWM(0)) {
+			offPc = ii;
+		}
+	}
+	TEST_CHECK(offPc > 0);
+
+	LP5562PhaseScheduler scheduler(chip.ledDriver, 1);
+	TEST_CHECK(scheduler.start(first));
+	unsigned long start = micros();
+	TEST_CHECK(scheduler.changeAtLoopBoundary(second));
+	chip.sim.clearTransactions();
+
+	// The engine clock is 4% slow, so when the change is predicted it's still in the second half, about
+	// 20 ms behind. Reading the program counter shows that, and the change waits until the engine gets to
+	// the 20 ms off part.
+	uint64_t simTicks = 0;
+	uint8_t pcAtChange = 0;
+	while(scheduler.isChangePending() && micros() - start < 1000000) {
+		uint64_t ticks = LP5562SimEngines::microsToTicks((uint64_t)(micros() - start) * 96 / 100);
+		if (ticks > simTicks) {
+			chip.sim.advanceTicks(ticks - simTicks);
+			simTicks = ticks;
+		}
+		pcAtChange = chip.sim.getEnginePC(1);
+		scheduler.loop();
+		delay(1);
+	}
+	TEST_CHECK(!scheduler.isChangePending());
+	TEST_CHECK(pcAtChange > offPc);
+	TEST_CHECK_EQUAL(chip.sim.getInstruction(1, 0), second.getInstructions()[0]);
+
+	// One read for the change, not polling
+	TEST_CHECK_EQUAL(countPcReads(chip.sim), 1);
+}
+
+static void testUncertaintyLimit() {
+	TestChip chip;
+
+	LP5562Program first, second;
+	makeBlink(first, 100, 20, 20);
+	makeBlink(second, 200, 20, 20);
+
+	// 4% of 520 ms is more than half of the 40 ms period, so the boundary can't be predicted
+	LP5562PhaseScheduler scheduler(chip.ledDriver, 1);
+	TEST_CHECK(scheduler.start(first));
+	delay(520);
+	TEST_CHECK(scheduler.getUncertaintyMicros() > 20000);
+	TEST_CHECK(!scheduler.changeAtLoopBoundary(second));
+	TEST_CHECK(!scheduler.isChangePending());
+
+	// Starting over resets the time base
+	TEST_CHECK(scheduler.start(first));
+	TEST_CHECK(scheduler.getUncertaintyMicros() < 20000);
+	TEST_CHECK(scheduler.changeAtLoopBoundary(second));
+}
+
+int main() {
+	TEST_RUN(testStartAtPhase);
+	TEST_RUN(testChangeAtLoopBoundary);
+	TEST_RUN(testTriggersRejected);
+	TEST_RUN(testReanchorSlowEngine);
+	TEST_RUN(testUncertaintyLimit);
+	return testResult();
+}
@@ -0,0 +1,148 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of setProgram(), which only uploads the instruction words that changed
+
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+/**
+ * @brief Number of writes to program memory since the last clearTransactions()
+ */
+static size_t countProgramWrites(const LP5562Simulator &sim, size_t &numBytes) {
+	size_t count = 0;
+	numBytes = 0;
+	for(size_t ii = 0; ii < sim.getNumTransactions(); ii++) {
+		const LP5562MockTransport::Transaction &t = sim.getTransaction(ii);
+		if (!t.isRead && t.reg >= LP5562::REG_PROGRAM_1 && t.reg < LP5562::REG_LED_MAP) {
+			count++;
+			numBytes += t.numValues;
+		}
+	}
+	return count;
+}
+
+static void testOnlyChangedWordsWritten() {
+	TestChip chip;
+
+	LP5562Program program;
+	makeBlink(program, 255);
+
+	size_t numBytes;
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	TEST_CHECK(countProgramWrites(chip.sim, numBytes) >= 1);
+
+	// Same program: no program memory writes
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	TEST_CHECK_EQUAL(countProgramWrites(chip.sim, numBytes), 0);
+
+	// Only the first word differs
+	makeBlink(program, 128);
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	TEST_CHECK_EQUAL(countProgramWrites(chip.sim, numBytes), 1);
+	TEST_CHECK_EQUAL(numBytes, 2);
+	TEST_CHECK_EQUAL(chip.sim.getIgnoredProgramWrites(), 0);
+}
+
+static void testSameProgramRestarts() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	LP5562Program program;
+	makeBlink(program, 255);
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+
+	// In the off half
+	chip.sim.advanceMillis(300);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+
+	// Setting the same program again with startRunning starts it over, so it's on right away
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	chip.sim.advanceMillis(10);
+	TEST_CHECK(chip.sim.getEnginePC(1) <= 1);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+
+	chip.sim.advanceMillis(150);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+	chip.sim.advanceMillis(100);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+}
+
+static void testClearProgram() {
+	TestChip chip;
+
+	LP5562Program program;
+	makeBlink(program, 255);
+	TEST_CHECK(chip.ledDriver.setProgram(2, program, true));
+	TEST_CHECK(chip.sim.isEngineRunning(2));
+
+	TEST_CHECK(chip.ledDriver.clearProgram(2));
+	TEST_CHECK(!chip.sim.isEngineRunning(2));
+	TEST_CHECK_EQUAL(chip.sim.getInstruction(2, 0), 0);
+}
+
+static void testStartEngines() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	LP5562Program program;
+	makeBlink(program, 255);
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	TEST_CHECK(chip.ledDriver.setProgram(2, program, true));
+
+	chip.sim.advanceMillis(300);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+
+	// Only engine 1 starts over
+	TEST_CHECK(chip.ledDriver.startEngines(LP5562::MASK_ENGINE_1));
+	chip.sim.advanceMillis(10);
+	TEST_CHECK(chip.sim.isEngineRunning(1));
+	TEST_CHECK(chip.sim.isEngineRunning(2));
+	TEST_CHECK(chip.sim.getEnginePC(1) <= 1);
+	TEST_CHECK(chip.sim.getEnginePC(2) >= 2);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+
+	// Nothing to do
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.startEngines(0));
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 0);
+}
+
+static void testProgramAfterChipReset() {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	LP5562Program program;
+	makeBlink(program, 255);
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+
+	// Brownout: the chip goes back to its power-on defaults without this object knowing. Reading
+	// REG_ENABLE shows CHIP_EN cleared, so the program shadow is no longer trusted.
+	chip.sim.resetChip();
+	TEST_CHECK_EQUAL(chip.ledDriver.readRegister(LP5562::REG_ENABLE), 0);
+
+	TEST_CHECK(chip.ledDriver.writeRegister(LP5562::REG_ENABLE, LP5562::REG_ENABLE_CHIP_EN));
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	// The same program is written again
+	size_t numBytes;
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	TEST_CHECK(countProgramWrites(chip.sim, numBytes) >= 1);
+	TEST_CHECK_EQUAL(chip.sim.getInstruction(1, 0), program.getInstructions()[0]);
+
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+}
+
+int main() {
+	TEST_RUN(testOnlyChangedWordsWritten);
+	TEST_RUN(testSameProgramRestarts);
+	TEST_RUN(testClearProgram);
+	TEST_RUN(testStartEngines);
+	TEST_RUN(testProgramAfterChipReset);
+	return testResult();
+}
@@ -0,0 +1,200 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Program::addRamp(), solveRamp(), addRampSteps(), and setBreathe(), checked on the
+// simulator
+
+#include "LP5562-RK-Timing.h"
+#include "LP5562-Test.h"
+
+/**
+ * @brief Run a program that ends on engine 1 with red mapped to it, and get the red output changes
+ */
+static std::vector<LP5562Simulator::OutputChange> runRed(LP5562Program program, unsigned long ms) {
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	program.addCommandEnd(false, false);
+	chip.sim.clearOutputChanges();
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	chip.sim.advanceMillis(ms);
+	TEST_CHECK(!chip.sim.isEngineRunning(1));
+
+	return getChanges(chip.sim, LP5562Simulator::CHANNEL_R);
+}
+
+/**
+ * @brief Time the engine model takes to run a program to the end, in microseconds
+ */
+static int64_t getEndMicros(LP5562Program program) {
+	program.addCommandEnd(false, false);
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, program);
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(result.success);
+	TEST_CHECK_EQUAL(result.engines[0].behavior, LP5562TimingAnalyzer::BEHAVIOR_ENDS);
+	return (int64_t) LP5562SimEngines::ticksToMicros(result.engines[0].endTicks);
+}
+
+/**
+ * @brief Check that the changes go from fromLevel to toLevel one level at a time
+ *
+ * The output is 0 after reset, so setting fromLevel 0 is not a change and the first change is the
+ * first step.
+ */
+static void checkSteps(const std::vector<LP5562Simulator::OutputChange> &changes, uint8_t fromLevel, uint8_t toLevel) {
+	TEST_CHECK(!changes.empty());
+	if (changes.empty()) {
+		return;
+	}
+	int numSteps = (toLevel > fromLevel) ? toLevel - fromLevel : fromLevel - toLevel;
+	TEST_CHECK_EQUAL(changes.front().value, (fromLevel == 0) ? 1 : fromLevel);
+	TEST_CHECK_EQUAL(changes.back().value, toLevel);
+	TEST_CHECK_EQUAL(changes.size(), (fromLevel == 0) ? numSteps : numSteps + 1);
+
+	for(size_t ii = 1; ii < changes.size(); ii++) {
+		int diff = (int)changes[ii].value - (int)changes[ii - 1].value;
+		TEST_CHECK_EQUAL(diff, (toLevel > fromLevel) ? 1 : -1);
+	}
+}
+
+static void testSplitRamp() {
+	// 255 steps don't fit in one ramp instruction (127 at most)
+	LP5562Program program;
+	int32_t errorMicros = 0;
+	TEST_CHECK(program.addRamp(0, 255, 1000, 1000, &errorMicros));
+	TEST_CHECK(program.getStepNum() >= 3);
+	TEST_CHECK(errorMicros >= -1000 && errorMicros <= 1000);
+
+	// The last step is at the end of the ramp
+	std::vector<LP5562Simulator::OutputChange> changes = runRed(program, 1100);
+	checkSteps(changes, 0, 255);
+	int64_t lastMicros = (int64_t) LP5562SimEngines::ticksToMicros(changes.back().ticks);
+	TEST_CHECK(lastMicros >= 1000000 + errorMicros - 31 && lastMicros <= 1000000 + errorMicros + 31);
+	TEST_CHECK(lastMicros >= getEndMicros(program) - 31 && lastMicros <= getEndMicros(program));
+
+	// Down works the same way
+	program.clear();
+	TEST_CHECK(program.addRamp(200, 10, 750));
+	checkSteps(runRed(program, 800), 200, 10);
+}
+
+static void testInfeasible() {
+	// 255 steps in 100 ms is faster than one step per 0.49 ms cycle
+	LP5562Program program;
+	int32_t errorMicros = 12345;
+	TEST_CHECK(!program.addRamp(0, 255, 100, 1000, &errorMicros));
+	TEST_CHECK_EQUAL(program.getStepNum(), 0);
+	TEST_CHECK_EQUAL(errorMicros, 12345);
+
+	// Not enough room left in the program
+	for(size_t ii = 0; ii < 15; ii++) {
+		program.addCommandSetPWM((uint8_t) ii);
+	}
+	TEST_CHECK(!program.addRamp(0, 255, 1000));
+	TEST_CHECK_EQUAL(program.getStepNum(), 15);
+}
+
+static void testZeroSteps() {
+	// The same level at both ends holds it for the duration
+	LP5562Program program;
+	int32_t errorMicros = 0;
+	TEST_CHECK(program.addRamp(128, 128, 500, 1000, &errorMicros));
+	TEST_CHECK(errorMicros >= -1000 && errorMicros <= 1000);
+	TEST_CHECK_EQUAL(getEndMicros(program), 500000 + errorMicros);
+
+	std::vector<LP5562Simulator::OutputChange> changes = runRed(program, 600);
+	TEST_CHECK_EQUAL(changes.size(), 1);
+	TEST_CHECK_EQUAL(changes[0].value, 128);
+
+	// solveRamp() with 0 steps is the same as solveDelay()
+	LP5562Program::DelaySolution ramp, delay;
+	TEST_CHECK(LP5562Program::solveRamp(50000, 0, false, 3, ramp));
+	TEST_CHECK(LP5562Program::solveDelay(50000, 3, delay));
+	TEST_CHECK_EQUAL(ramp.numInstructions, delay.numInstructions);
+	TEST_CHECK_EQUAL(ramp.errorTicks, delay.errorTicks);
+	for(size_t ii = 0; ii < ramp.numInstructions; ii++) {
+		TEST_CHECK_EQUAL(ramp.instructions[ii], delay.instructions[ii]);
+	}
+}
+
+static void testTolerance() {
+	// 100 steps in 333 ms doesn't divide evenly into 0.49 ms cycles
+	LP5562Program loose, tight;
+	int32_t looseError = 0, tightError = 0;
+	TEST_CHECK(loose.addRamp(0, 100, 333, 5000, &looseError));
+	TEST_CHECK(tight.addRamp(0, 100, 333, 100, &tightError));
+
+	TEST_CHECK(looseError >= -5000 && looseError <= 5000);
+	TEST_CHECK(tightError >= -100 && tightError <= 100);
+
+	// A looser tolerance never needs more instructions
+	TEST_CHECK(loose.getStepNum() <= tight.getStepNum());
+
+	// errorMicros is the achieved time minus the requested time
+	int64_t looseEnd = getEndMicros(loose);
+	int64_t tightEnd = getEndMicros(tight);
+	TEST_CHECK(looseEnd >= 333000 + looseError - 31 && looseEnd <= 333000 + looseError + 31);
+	TEST_CHECK(tightEnd >= 333000 + tightError - 31 && tightEnd <= 333000 + tightError + 31);
+
+	checkSteps(runRed(tight, 400), 0, 100);
+
+	// solveRamp() reports the same error for the same instructions
+	LP5562Program::DelaySolution solution;
+	uint64_t ticks = (333ULL * LP5562SimEngines::TICKS_PER_SECOND + 500) / 1000;
+	TEST_CHECK(LP5562Program::solveRamp(ticks, 100, false, tight.getStepNum() - 1, solution));
+	TEST_CHECK_EQUAL(solution.numInstructions, tight.getStepNum() - 1);
+	TEST_CHECK_EQUAL(solution.errorTicks * 1000000 / LP5562SimEngines::TICKS_PER_SECOND, tightError);
+}
+
+static void testRampSteps() {
+	// 255 steps is 127 + 127 + 1
+	LP5562Program program;
+	program.addCommandSetPWM(0);
+	TEST_CHECK(program.addRampSteps(false, 2, false, 255));
+	TEST_CHECK_EQUAL(program.getStepNum(), 4);
+
+	std::vector<LP5562Simulator::OutputChange> changes = runRed(program, 600);
+	checkSteps(changes, 0, 255);
+	TEST_CHECK_EQUAL(changes.back().ticks, 255 * 32);
+}
+
+static void testBreatheFullRange() {
+	TestChip chip;
+	chip.sim.clearOutputChanges();
+
+	// 180 steps each way is more than one ramp instruction. 1 half ms = 16 ticks per step.
+	chip.ledDriver.setBreathe(true, false, false, 1, 20, 200);
+	chip.sim.advanceMillis(250);
+
+	std::vector<LP5562Simulator::OutputChange> red = getChanges(chip.sim, LP5562Simulator::CHANNEL_R);
+	TEST_CHECK(red.size() > 2 * 180);
+	if (red.size() <= 2 * 180) {
+		return;
+	}
+
+	// Up from 20 to 200, then down to 20, one level per step
+	TEST_CHECK_EQUAL(red[0].value, 20);
+	TEST_CHECK_EQUAL(red[0].ticks, 0);
+	TEST_CHECK_EQUAL(red[180].value, 200);
+	TEST_CHECK_EQUAL(red[180].ticks, 180 * 16);
+	TEST_CHECK_EQUAL(red[360].value, 20);
+	TEST_CHECK_EQUAL(red[360].ticks, 2 * 180 * 16);
+	for(size_t ii = 1; ii <= 360; ii++) {
+		int diff = (int)red[ii].value - (int)red[ii - 1].value;
+		TEST_CHECK_EQUAL(diff, (ii <= 180) ? 1 : -1);
+	}
+
+	TEST_CHECK(getChanges(chip.sim, LP5562Simulator::CHANNEL_G).empty());
+}
+
+int main() {
+	TEST_RUN(testSplitRamp);
+	TEST_RUN(testInfeasible);
+	TEST_RUN(testZeroSteps);
+	TEST_RUN(testTolerance);
+	TEST_RUN(testRampSteps);
+	TEST_RUN(testBreatheFullRange);
+	return testResult();
+}
@@ -0,0 +1,77 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of the register shadow (withShadowRegisters)
+
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testNoReadModifyWrite() {
+	TestChip chip(false);
+	chip.ledDriver.withShadowRegisters();
+	TEST_CHECK(chip.ledDriver.begin());
+
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+	TEST_CHECK(chip.ledDriver.setOpMode(1, LP5562::REG_ENGINE_RUN));
+
+	// Only writes, no reads
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 2);
+	for(size_t ii = 0; ii < chip.sim.getNumTransactions(); ii++) {
+		TEST_CHECK(!chip.sim.getTransaction(ii).isRead);
+	}
+	TEST_CHECK_EQUAL(chip.sim.getRegister(LP5562::REG_LED_MAP), LP5562::REG_LED_MAP_ENGINE_1 << 4);
+}
+
+static void testEndedEngineNotRestarted() {
+	TestChip chip(false);
+	chip.ledDriver.withShadowRegisters();
+	TEST_CHECK(chip.ledDriver.begin());
+
+	// Engine 1 turns red on for 100 ms, off, and ends without an interrupt
+	LP5562Program program;
+	program.addCommandSetPWM(255);
+	program.addDelay(100);
+	program.addCommandSetPWM(0);
+	program.addCommandEnd(false, false);
+	TEST_CHECK(chip.ledDriver.setProgram(1, program, true));
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+
+	chip.sim.advanceMillis(50);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+
+	chip.sim.advanceMillis(200);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+	TEST_CHECK(!chip.sim.isEngineRunning(1));
+
+	// Starting engine 2 must not put engine 1 back in run mode, even though the shadow of
+	// REG_ENABLE still has it running
+	TEST_CHECK(chip.ledDriver.setEnable(LP5562::MASK_ENGINE_2, LP5562::REG_ENABLE_RUN));
+	TEST_CHECK_EQUAL(chip.sim.getRegister(LP5562::REG_ENABLE) & 0b00110000, 0);
+
+	chip.sim.advanceMillis(50);
+	TEST_CHECK(!chip.sim.isEngineRunning(1));
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+}
+
+static void testResyncShadow() {
+	TestChip chip(false);
+	chip.ledDriver.withShadowRegisters();
+	TEST_CHECK(chip.ledDriver.begin());
+
+	// Changed behind the driver's back
+	chip.sim.setRegister(LP5562::REG_LED_MAP, 0x15);
+	TEST_CHECK(chip.ledDriver.resyncShadow());
+
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.setLedMappingW(LP5562::REG_LED_MAP_ENGINE_2));
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 1);
+	TEST_CHECK_EQUAL(chip.sim.getRegister(LP5562::REG_LED_MAP), 0x95);
+}
+
+int main() {
+	TEST_RUN(testNoReadModifyWrite);
+	TEST_RUN(testEndedEngineNotRestarted);
+	TEST_RUN(testResyncShadow);
+	return testResult();
+}
@@ -0,0 +1,157 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Waveform tests of the high-level LP5562 calls, run on LP5562Simulator
+
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+/**
+ * @brief Returns true if ticks is within 1 ms of ms
+ */
+static bool isNearMs(uint64_t ticks, double ms) {
+	double actualMs = (double)ticks * 1000.0 / LP5562SimEngines::TICKS_PER_SECOND;
+	return actualMs >= ms - 1.0 && actualMs <= ms + 1.0;
+}
+
+/**
+ * @brief Check that a channel alternates between onValue and 0, starting on at time 0
+ *
+ * Each on and off time must be within 1 ms of onMs and offMs. The delay encoding isn't always exact, so
+ * the error is not checked as it adds up over many periods.
+ */
+static void checkBlink(const LP5562Simulator &sim, uint8_t channel, uint8_t onValue, double onMs, double offMs, size_t minEdges) {
+	std::vector<LP5562Simulator::OutputChange> changes = getChanges(sim, channel);
+
+	TEST_CHECK(changes.size() >= minEdges);
+
+	for(size_t ii = 0; ii < changes.size(); ii++) {
+		bool on = (ii % 2) == 0;
+		TEST_CHECK_EQUAL(changes[ii].value, on ? onValue : 0);
+
+		if (ii == 0) {
+			TEST_CHECK_EQUAL(changes[ii].ticks, 0);
+		}
+		else
+		if (!isNearMs(changes[ii].ticks - changes[ii - 1].ticks, on ? offMs : onMs)) {
+			printf("channel %u edge %u at %u ticks, previous at %u\n", channel, (unsigned)ii, (unsigned)changes[ii].ticks, (unsigned)changes[ii - 1].ticks);
+			TEST_CHECK(false);
+		}
+	}
+}
+
+static void testSetBlink() {
+	TestChip chip;
+	chip.sim.clearOutputChanges();
+
+	chip.ledDriver.setBlink(255, 128, 0, 500, 500);
+	chip.sim.advanceMillis(3000);
+
+	// On at 0, 1000, 2000 and 3000 ms, off at 500, 1500, and 2500 ms
+	checkBlink(chip.sim, LP5562Simulator::CHANNEL_R, 255, 500, 500, 7);
+
+	// Green is triggered by red, so its edges are at the same times
+	checkBlink(chip.sim, LP5562Simulator::CHANNEL_G, 128, 500, 500, 7);
+
+	TEST_CHECK(getChanges(chip.sim, LP5562Simulator::CHANNEL_B).empty());
+	TEST_CHECK(getChanges(chip.sim, LP5562Simulator::CHANNEL_W).empty());
+}
+
+static void testSetBlink2() {
+	TestChip chip;
+	chip.sim.clearOutputChanges();
+
+	chip.ledDriver.setBlink2(255, 0, 0, 300, 0, 0, 255, 200);
+	chip.sim.advanceMillis(2000);
+
+	// Red for 300 ms, then blue for 200 ms
+	checkBlink(chip.sim, LP5562Simulator::CHANNEL_R, 255, 300, 200, 8);
+
+	std::vector<LP5562Simulator::OutputChange> blue = getChanges(chip.sim, LP5562Simulator::CHANNEL_B);
+	TEST_CHECK(blue.size() >= 8);
+	for(size_t ii = 0; ii < blue.size(); ii++) {
+		bool on = (ii % 2) == 0;
+		TEST_CHECK_EQUAL(blue[ii].value, on ? 255 : 0);
+		TEST_CHECK(isNearMs(blue[ii].ticks, 300 + (double)(ii / 2) * 500 + (on ? 0 : 200)));
+	}
+
+	TEST_CHECK(getChanges(chip.sim, LP5562Simulator::CHANNEL_G).empty());
+}
+
+static void testSetBreathe() {
+	TestChip chip;
+	chip.sim.clearOutputChanges();
+
+	// 2 half ms = 1 ms per step, 100 steps up and 100 down
+	chip.ledDriver.setBreathe(false, true, false, 2, 0, 100);
+	chip.sim.advanceMillis(500);
+
+	std::vector<LP5562Simulator::OutputChange> green = getChanges(chip.sim, LP5562Simulator::CHANNEL_G);
+	TEST_CHECK(!green.empty());
+
+	uint8_t maxValue = 0;
+	uint64_t maxTicks = 0;
+	uint64_t firstZeroTicks = 0;
+	for(size_t ii = 0; ii < green.size(); ii++) {
+		if (green[ii].value > maxValue) {
+			maxValue = green[ii].value;
+			maxTicks = green[ii].ticks;
+		}
+		if (maxValue == 100 && green[ii].value == 0 && firstZeroTicks == 0) {
+			firstZeroTicks = green[ii].ticks;
+		}
+	}
+	TEST_CHECK_EQUAL(maxValue, 100);
+
+	// A step is 32 ticks of the 32.768 kHz clock (0.977 ms)
+	TEST_CHECK_EQUAL(maxTicks, 100 * 32);
+	TEST_CHECK_EQUAL(firstZeroTicks, 2 * 100 * 32);
+
+	// Each step changes the value by 1
+	for(size_t ii = 1; ii < green.size(); ii++) {
+		int diff = (int)green[ii].value - (int)green[ii - 1].value;
+		TEST_CHECK(diff == 1 || diff == -1);
+	}
+
+	TEST_CHECK(getChanges(chip.sim, LP5562Simulator::CHANNEL_R).empty());
+	TEST_CHECK(getChanges(chip.sim, LP5562Simulator::CHANNEL_B).empty());
+}
+
+static void testSetIndicatorMode() {
+	TestChip chip;
+	chip.sim.clearOutputChanges();
+
+	chip.ledDriver.setIndicatorMode(500, 500, 100, 100, 20);
+	chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1);
+	chip.ledDriver.setLedMappingG(LP5562::REG_LED_MAP_ENGINE_2);
+	chip.ledDriver.setLedMappingB(LP5562::REG_LED_MAP_ENGINE_3);
+	chip.ledDriver.setLedMappingW(LP5562::REG_LED_MAP_DIRECT, 77);
+	chip.sim.advanceMillis(3000);
+
+	// Blink and fast blink
+	checkBlink(chip.sim, LP5562Simulator::CHANNEL_R, 255, 500, 500, 7);
+	checkBlink(chip.sim, LP5562Simulator::CHANNEL_G, 255, 100, 100, 30);
+
+	// Breathe reaches full brightness after 255 steps of 10 ms (320 ticks)
+	std::vector<LP5562Simulator::OutputChange> blue = getChanges(chip.sim, LP5562Simulator::CHANNEL_B);
+	TEST_CHECK(!blue.empty());
+	uint64_t fullTicks = 0;
+	for(size_t ii = 0; ii < blue.size(); ii++) {
+		if (blue[ii].value == 255) {
+			fullTicks = blue[ii].ticks;
+			break;
+		}
+	}
+	TEST_CHECK_EQUAL(fullTicks, 255 * 320);
+
+	// Direct
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_W), 77);
+}
+
+int main() {
+	TEST_RUN(testSetBlink);
+	TEST_RUN(testSetBlink2);
+	TEST_RUN(testSetBreathe);
+	TEST_RUN(testSetIndicatorMode);
+	return testResult();
+}
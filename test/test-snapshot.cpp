@@ -0,0 +1,110 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of snapshot() and restore()
+
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testRestoreToPoweredOffChip() {
+	TestChip chip(false);
+	TEST_CHECK(chip.ledDriver.withLEDCurrent(10.0).begin());
+	chip.ledDriver.setBlink(255, 0, 0, 200, 200);
+	chip.ledDriver.setW(77);
+	chip.sim.advanceMillis(50);
+
+	LP5562::Snapshot snap;
+	TEST_CHECK(chip.ledDriver.snapshot(snap));
+	TEST_CHECK(LP5562::isValidSnapshot(snap));
+
+	// The chip lost power, like in sleep with the LED supply off
+	LP5562Simulator sim2;
+	LP5562 ledDriver2(0x30, sim2);
+	TEST_CHECK(ledDriver2.restore(snap));
+
+	TEST_CHECK_EQUAL(sim2.getRegister(LP5562::REG_R_CURRENT), chip.sim.getRegister(LP5562::REG_R_CURRENT));
+	TEST_CHECK_EQUAL(sim2.getRegister(LP5562::REG_LED_MAP), chip.sim.getRegister(LP5562::REG_LED_MAP));
+	for(uint8_t reg = LP5562::REG_PROGRAM_1; reg < LP5562::REG_LED_MAP; reg++) {
+		TEST_CHECK_EQUAL(sim2.getRegister(reg), chip.sim.getRegister(reg));
+	}
+
+	// The blink keeps going
+	sim2.advanceMillis(10);
+	TEST_CHECK_EQUAL(sim2.getOutput(LP5562Simulator::CHANNEL_W), 77);
+	TEST_CHECK(sim2.isEngineRunning(1));
+	bool sawOn = false, sawOff = false;
+	for(size_t ii = 0; ii < 50; ii++) {
+		sim2.advanceMillis(10);
+		if (sim2.getOutput(LP5562Simulator::CHANNEL_R) == 255) {
+			sawOn = true;
+		}
+		if (sim2.getOutput(LP5562Simulator::CHANNEL_R) == 0) {
+			sawOff = true;
+		}
+	}
+	TEST_CHECK(sawOn && sawOff);
+}
+
+static void testRestoreAfterChipReset() {
+	TestChip chip;
+	chip.ledDriver.setBlink(255, 0, 0, 200, 200);
+
+	LP5562::Snapshot snap;
+	TEST_CHECK(chip.ledDriver.snapshot(snap));
+
+	// The chip lost power during sleep but this object didn't
+	chip.sim.resetChip();
+	TEST_CHECK(chip.ledDriver.restore(snap));
+	for(uint8_t reg = LP5562::REG_PROGRAM_1; reg < LP5562::REG_LED_MAP; reg++) {
+		TEST_CHECK_EQUAL(chip.sim.getRegister(reg), snap.program[reg - LP5562::REG_PROGRAM_1]);
+	}
+	TEST_CHECK(chip.sim.isEngineRunning(1));
+
+	// The chip kept its state, so nothing is written to program memory
+	chip.sim.clearTransactions();
+	TEST_CHECK(chip.ledDriver.restore(snap));
+	for(size_t ii = 0; ii < chip.sim.getNumTransactions(); ii++) {
+		const LP5562MockTransport::Transaction &t = chip.sim.getTransaction(ii);
+		TEST_CHECK(t.isRead || t.reg < LP5562::REG_PROGRAM_1 || t.reg >= LP5562::REG_LED_MAP);
+	}
+}
+
+static void testUnknownProgramRead() {
+	LP5562Simulator sim;
+	{
+		LP5562 ledDriver(0x30, sim);
+		TEST_CHECK(ledDriver.begin());
+		ledDriver.setBreathe(true, false, false, 20, 0, 255);
+	}
+
+	// A different object doesn't know the program, so it's read from the chip
+	LP5562 ledDriver(0x30, sim);
+	LP5562::Snapshot snap;
+	TEST_CHECK(ledDriver.snapshot(snap));
+	for(size_t ii = 0; ii < 32; ii++) {
+		TEST_CHECK_EQUAL(snap.program[ii], sim.getRegister((uint8_t)(LP5562::REG_PROGRAM_1 + ii)));
+	}
+	TEST_CHECK(sim.isEngineRunning(1));
+}
+
+static void testInvalidSnapshot() {
+	TestChip chip;
+	chip.ledDriver.setRGB(1, 2, 3);
+
+	LP5562::Snapshot snap;
+	TEST_CHECK(chip.ledDriver.snapshot(snap));
+	snap.control[LP5562::REG_R_PWM] ^= 0xff;
+	TEST_CHECK(!LP5562::isValidSnapshot(snap));
+
+	chip.sim.clearTransactions();
+	TEST_CHECK(!chip.ledDriver.restore(snap));
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 0);
+}
+
+int main() {
+	TEST_RUN(testRestoreToPoweredOffChip);
+	TEST_RUN(testRestoreAfterChipReset);
+	TEST_RUN(testUnknownProgramRead);
+	TEST_RUN(testInvalidSnapshot);
+	return testResult();
+}
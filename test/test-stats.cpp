@@ -0,0 +1,72 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562Stats. This file is compiled without LP5562_ENABLE_STATS and linked with the library
+// built with it.
+
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testCounts() {
+	LP5562Simulator sim;
+	LP5562Stats stats;
+	LP5562 ledDriver(0x30, sim);
+	ledDriver.withStats(&stats);
+	TEST_CHECK(ledDriver.getStats() == &stats);
+	TEST_CHECK(ledDriver.begin());
+
+	sim.clearTransactions();
+	ledDriver.setRGB(1, 2, 3);
+	ledDriver.setRGB(4, 5, 6);
+
+	const LP5562Stats::MethodStats &pwm = stats.getMethodStats(LP5562Stats::METHOD_SET_PWM);
+	TEST_CHECK_EQUAL(pwm.calls, 2);
+	TEST_CHECK_EQUAL(pwm.transactions, sim.getNumTransactions());
+	TEST_CHECK_EQUAL(pwm.bytes, 6);
+	TEST_CHECK_EQUAL(pwm.failures, 0);
+
+	// Failures are counted for methods that return void
+	sim.failNextTransactions(1);
+	ledDriver.setRGB(7, 8, 9);
+	TEST_CHECK_EQUAL(pwm.calls, 3);
+	TEST_CHECK_EQUAL(pwm.failures, 1);
+
+	stats.reset();
+	TEST_CHECK_EQUAL(pwm.calls, 0);
+}
+
+static void testNestedCallsCountedOnce() {
+	LP5562Simulator sim;
+	LP5562Stats stats;
+	LP5562 ledDriver(0x30, sim);
+	TEST_CHECK(ledDriver.withStats(&stats).begin());
+	stats.reset();
+
+	sim.clearTransactions();
+	ledDriver.setBlink(255, 0, 0, 500, 500);
+
+	// setBlink() calls setProgram(), setEnable(), etc. which are all counted for setBlink()
+	TEST_CHECK_EQUAL(stats.getMethodStats(LP5562Stats::METHOD_SET_BLINK).calls, 1);
+	TEST_CHECK_EQUAL(stats.getMethodStats(LP5562Stats::METHOD_SET_BLINK).transactions, sim.getNumTransactions());
+	TEST_CHECK_EQUAL(stats.getMethodStats(LP5562Stats::METHOD_SET_PROGRAM).calls, 0);
+	TEST_CHECK_EQUAL(stats.getMethodStats(LP5562Stats::METHOD_SET_ENABLE).calls, 0);
+	TEST_CHECK(strcmp(LP5562Stats::getMethodName(LP5562Stats::METHOD_SET_BLINK), "setBlink") == 0);
+}
+
+static void testDetached() {
+	LP5562Simulator sim;
+	LP5562Stats stats;
+	LP5562 ledDriver(0x30, sim);
+	TEST_CHECK(ledDriver.withStats(&stats).begin());
+	ledDriver.withStats(NULL);
+
+	ledDriver.setW(10);
+	TEST_CHECK_EQUAL(stats.getMethodStats(LP5562Stats::METHOD_SET_PWM).calls, 0);
+}
+
+int main() {
+	TEST_RUN(testCounts);
+	TEST_RUN(testNestedCallsCountedOnce);
+	TEST_RUN(testDetached);
+	return testResult();
+}
@@ -0,0 +1,78 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562ProgramSwapper
+
+#include "LP5562-RK-Swap.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testDoubleBuffered() {
+	TestChip chip;
+
+	LP5562Program first, second;
+	makeSegment(first, 100, 100);
+	makeSegment(second, 200, 100);
+
+	LP5562ProgramSwapper swapper(chip.ledDriver);
+	TEST_CHECK(swapper.swap(LP5562ProgramSwapper::CHANNEL_MASK_R | LP5562ProgramSwapper::CHANNEL_MASK_G, first));
+	TEST_CHECK(swapper.getLastSwap().doubleBuffered);
+	uint8_t firstEngine = swapper.getLastSwap().engine;
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 100);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_G), 100);
+
+	// The new program goes on another engine, and the old one is stopped once nothing uses it
+	TEST_CHECK(swapper.swap(LP5562ProgramSwapper::CHANNEL_MASK_R | LP5562ProgramSwapper::CHANNEL_MASK_G, second));
+	TEST_CHECK(swapper.getLastSwap().doubleBuffered);
+	TEST_CHECK(swapper.getLastSwap().engine != firstEngine);
+	TEST_CHECK(!chip.sim.isEngineRunning(firstEngine));
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 200);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_G), 200);
+
+	TEST_CHECK_EQUAL(swapper.getStats().swaps, 2);
+	TEST_CHECK_EQUAL(swapper.getStats().inPlace, 0);
+	TEST_CHECK_EQUAL(chip.sim.getIgnoredProgramWrites(), 0);
+}
+
+static void testInPlace() {
+	TestChip chip;
+
+	LP5562Program programs[4];
+	for(size_t ii = 0; ii < 4; ii++) {
+		makeSegment(programs[ii], (uint8_t)(10 * (ii + 1)), 100);
+	}
+
+	// One engine for each of R, G, and B, so there's no spare one
+	LP5562ProgramSwapper swapper(chip.ledDriver);
+	TEST_CHECK(swapper.swap(LP5562ProgramSwapper::CHANNEL_MASK_R, programs[0]));
+	TEST_CHECK(swapper.swap(LP5562ProgramSwapper::CHANNEL_MASK_G, programs[1]));
+	TEST_CHECK(swapper.swap(LP5562ProgramSwapper::CHANNEL_MASK_B, programs[2]));
+
+	TEST_CHECK(swapper.swap(LP5562ProgramSwapper::CHANNEL_MASK_R, programs[3]));
+	TEST_CHECK(!swapper.getLastSwap().doubleBuffered);
+	TEST_CHECK_EQUAL(swapper.getStats().inPlace, 1);
+
+	chip.sim.advanceMillis(10);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_R), 40);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_G), 20);
+	TEST_CHECK_EQUAL(chip.sim.getOutput(LP5562Simulator::CHANNEL_B), 30);
+}
+
+static void testInvalid() {
+	TestChip chip;
+
+	LP5562Program program;
+	makeSegment(program, 1, 100);
+
+	LP5562ProgramSwapper swapper(chip.ledDriver);
+	TEST_CHECK(!swapper.swap(0, program));
+}
+
+int main() {
+	TEST_RUN(testDoubleBuffered);
+	TEST_RUN(testInPlace);
+	TEST_RUN(testInvalid);
+	return testResult();
+}
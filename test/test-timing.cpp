@@ -0,0 +1,284 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562TimingAnalyzer
+
+#include "LP5562-RK-Timing.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+static void testPeriodic() {
+	LP5562Program program;
+	program.addCommandSetPWM(255);
+	program.addDelay(200);
+	program.addCommandSetPWM(0);
+	program.addDelay(200);
+	program.addCommandGoToStart();
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, program);
+
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(result.success);
+
+	const LP5562TimingAnalyzer::EngineTiming &timing = result.engines[0];
+	TEST_CHECK_EQUAL(timing.behavior, LP5562TimingAnalyzer::BEHAVIOR_PERIODIC);
+	TEST_CHECK(timing.hasLoopBoundary);
+
+	// 400 ms, within 1 ms
+	uint64_t periodMicros = LP5562SimEngines::ticksToMicros(timing.periodTicks);
+	TEST_CHECK(periodMicros >= 399000 && periodMicros <= 401000);
+
+	TEST_CHECK_EQUAL(result.engines[1].behavior, LP5562TimingAnalyzer::BEHAVIOR_NOT_RUNNING);
+}
+
+static void testEnds() {
+	LP5562Program program;
+	program.addCommandSetPWM(255);
+	program.addDelay(100);
+	program.addCommandEnd(true, true);
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(2, program);
+
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(result.success);
+
+	const LP5562TimingAnalyzer::EngineTiming &timing = result.engines[1];
+	TEST_CHECK_EQUAL(timing.behavior, LP5562TimingAnalyzer::BEHAVIOR_ENDS);
+
+	uint64_t endMicros = LP5562SimEngines::ticksToMicros(timing.endTicks);
+	TEST_CHECK(endMicros >= 99000 && endMicros <= 101000);
+}
+
+static void testExactPeriod() {
+	// Two 20 x 0.49 ms waits repeated 3 times by the branch, then 10 x 15.6 ms: 3 * 640 + 5120 ticks
+	static const uint16_t instructions[] = {
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(false, 20),
+		LP5562Opcode::setPWM(0),
+		LP5562Opcode::wait(false, 20),
+		LP5562Opcode::branch(3, 0),
+		LP5562Opcode::wait(true, 10)
+	};
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, instructions, sizeof(instructions) / sizeof(instructions[0]));
+
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(result.success);
+	TEST_CHECK_EQUAL(result.engines[0].behavior, LP5562TimingAnalyzer::BEHAVIOR_PERIODIC);
+	TEST_CHECK_EQUAL(result.engines[0].periodTicks, 7040);
+	TEST_CHECK_EQUAL(result.periodTicks, 7040);
+	TEST_CHECK(result.engines[0].hasLoopBoundary);
+	TEST_CHECK_EQUAL(result.engines[0].firstLoopTicks, 0);
+
+	// 7040 ticks is 214.84375 ms
+	TEST_CHECK_EQUAL(analyzer.getPeriodMicros(1), 214844);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryTicks(1, 0), 0);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryTicks(1, 1), 7040);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryTicks(1, 7040), 7040);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryTicks(1, 7041), 14080);
+
+	// Times in ms are rounded up, so the boundary is never before the returned time
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryMs(1, 0), 0);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryMs(1, 1), 215);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryMs(1, 214), 215);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryMs(1, 215), 430);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryMs(1, 100000), 100118);
+
+	// The same on the simulator: back to 255 at each loop boundary
+	TestChip chip;
+	TEST_CHECK(chip.ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+	chip.sim.clearOutputChanges();
+	TEST_CHECK(chip.ledDriver.setProgram(1, instructions, true));
+	chip.sim.advanceTicks(7040 * 2 + 1);
+
+	std::vector<LP5562Simulator::OutputChange> red = getChanges(chip.sim, LP5562Simulator::CHANNEL_R);
+	TEST_CHECK_EQUAL(red.size(), 2 * 6 + 1);
+	if (red.size() == 2 * 6 + 1) {
+		TEST_CHECK_EQUAL(red[6].ticks, 7040);
+		TEST_CHECK_EQUAL(red[6].value, 255);
+		TEST_CHECK_EQUAL(red[12].ticks, 2 * 7040);
+	}
+}
+
+static void testTriggerPair() {
+	// Engine 1 triggers engine 2 halfway through its 320 tick loop. Engine 2 turns on for 80 ticks
+	// and goes back to wait for the next trigger.
+	static const uint16_t engine1[] = {
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(false, 10),
+		LP5562Opcode::triggerSend(LP5562::MASK_ENGINE_2),
+		LP5562Opcode::setPWM(0),
+		LP5562Opcode::wait(false, 10)
+	};
+	static const uint16_t engine2[] = {
+		LP5562Opcode::triggerWait(LP5562::MASK_ENGINE_1),
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(false, 5),
+		LP5562Opcode::setPWM(0)
+	};
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, engine1, sizeof(engine1) / sizeof(engine1[0]));
+	analyzer.withProgram(2, engine2, sizeof(engine2) / sizeof(engine2[0]));
+
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(result.success);
+	for(size_t ii = 0; ii < 2; ii++) {
+		TEST_CHECK(result.engines[ii].synchronized);
+		TEST_CHECK_EQUAL(result.engines[ii].behavior, LP5562TimingAnalyzer::BEHAVIOR_PERIODIC);
+		TEST_CHECK_EQUAL(result.engines[ii].periodTicks, 320);
+		TEST_CHECK(result.engines[ii].hasLoopBoundary);
+	}
+	TEST_CHECK_EQUAL(result.engines[2].behavior, LP5562TimingAnalyzer::BEHAVIOR_NOT_RUNNING);
+	TEST_CHECK_EQUAL(result.periodTicks, 320);
+
+	// Engine 2 goes back to step 0 at 160 + 80 ticks, 80 ticks before engine 1 does
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryTicks(2, 1), 240);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryTicks(1, 1), 320);
+	TEST_CHECK_EQUAL(analyzer.getPhaseTicks(2, 1), 240);
+	TEST_CHECK_EQUAL(analyzer.getPhaseTicks(1, 2), 80);
+	TEST_CHECK_EQUAL(analyzer.getPhaseTicks(1, 1), 0);
+	TEST_CHECK_EQUAL(analyzer.getPhaseTicks(3, 1), -1);
+
+	// Engines that use triggers can't be started part way through
+	uint8_t pc;
+	uint64_t startTicks;
+	TEST_CHECK(!analyzer.getStartPoint(2, 100, pc, startTicks));
+}
+
+static void testDeadlock() {
+	// Engine 1 waits for engine 2 after 160 ticks, and engine 2 waits for engine 1 from the start
+	static const uint16_t engine1[] = {
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(false, 10),
+		LP5562Opcode::triggerWait(LP5562::MASK_ENGINE_2)
+	};
+	static const uint16_t engine2[] = {
+		LP5562Opcode::triggerWait(LP5562::MASK_ENGINE_1),
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(false, 10)
+	};
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, engine1, sizeof(engine1) / sizeof(engine1[0]));
+	analyzer.withProgram(2, engine2, sizeof(engine2) / sizeof(engine2[0]));
+
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(result.success);
+	TEST_CHECK_EQUAL(result.engines[0].behavior, LP5562TimingAnalyzer::BEHAVIOR_DEADLOCK);
+	TEST_CHECK_EQUAL(result.engines[0].endTicks, 160);
+	TEST_CHECK_EQUAL(result.engines[1].behavior, LP5562TimingAnalyzer::BEHAVIOR_DEADLOCK);
+	TEST_CHECK_EQUAL(result.engines[1].endTicks, 160);
+	TEST_CHECK_EQUAL(result.periodTicks, 0);
+	TEST_CHECK_EQUAL(analyzer.getPeriodMicros(1), 0);
+	TEST_CHECK_EQUAL(analyzer.getNextLoopBoundaryMs(1, 0), 0);
+}
+
+static void testZeroTimeLoop() {
+	// Nothing takes time, so any period would only come from the stalls of the engine model
+	LP5562Program program;
+	program.addCommandSetPWM(10);
+	program.addCommandSetPWM(20);
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, program);
+	const LP5562TimingAnalyzer::Result &result = analyzer.analyze();
+	TEST_CHECK(!result.success);
+	TEST_CHECK(result.error != NULL);
+	TEST_CHECK_EQUAL(analyzer.getPeriodMicros(1), 0);
+
+	// Also when the engine is synchronized with one that does take time
+	static const uint16_t engine2[] = {
+		LP5562Opcode::triggerSend(LP5562::MASK_ENGINE_3),
+		LP5562Opcode::setPWM(10)
+	};
+	static const uint16_t engine3[] = {
+		LP5562Opcode::triggerWait(LP5562::MASK_ENGINE_2),
+		LP5562Opcode::wait(false, 10)
+	};
+	analyzer.clearPrograms();
+	analyzer.withProgram(2, engine2, 2).withProgram(3, engine3, 2);
+	TEST_CHECK(!analyzer.analyze().success);
+
+	// A zero-time loop before the periodic part is fine
+	static const uint16_t engine1[] = {
+		LP5562Opcode::setPWM(10),
+		LP5562Opcode::branch(20, 0),
+		LP5562Opcode::wait(false, 10),
+		LP5562Opcode::branch(0, 2)
+	};
+	analyzer.clearPrograms();
+	analyzer.withProgram(1, engine1, 4);
+	TEST_CHECK(analyzer.analyze().success);
+	TEST_CHECK_EQUAL(analyzer.getResult().engines[0].behavior, LP5562TimingAnalyzer::BEHAVIOR_PERIODIC);
+	TEST_CHECK_EQUAL(analyzer.getResult().engines[0].periodTicks, 160);
+	TEST_CHECK(!analyzer.getResult().engines[0].hasLoopBoundary);
+}
+
+static void testStepInterval() {
+	// Steps 1 and 3 are the waits: 1 from 0 - 320 ticks, 3 from 320 - 640, 3 repeats, then step 5 for 5120
+	static const uint16_t instructions[] = {
+		LP5562Opcode::setPWM(255),
+		LP5562Opcode::wait(false, 20),
+		LP5562Opcode::setPWM(0),
+		LP5562Opcode::wait(false, 20),
+		LP5562Opcode::branch(3, 0),
+		LP5562Opcode::wait(true, 10)
+	};
+
+	LP5562TimingAnalyzer analyzer;
+	analyzer.withProgram(1, instructions, sizeof(instructions) / sizeof(instructions[0]));
+	TEST_CHECK(analyzer.analyze().success);
+
+	uint64_t fromTicks = 0, toTicks = 0;
+	TEST_CHECK(analyzer.getStepInterval(1, 100, 1, fromTicks, toTicks));
+	TEST_CHECK_EQUAL(fromTicks, 0);
+	TEST_CHECK_EQUAL(toTicks, 320);
+
+	// The nearest pass through the loop
+	TEST_CHECK(analyzer.getStepInterval(1, 1000, 3, fromTicks, toTicks));
+	TEST_CHECK_EQUAL(fromTicks, 960);
+	TEST_CHECK_EQUAL(toTicks, 1280);
+	TEST_CHECK(analyzer.getStepInterval(1, 1000, 1, fromTicks, toTicks));
+	TEST_CHECK_EQUAL(fromTicks, 640);
+	TEST_CHECK_EQUAL(toTicks, 960);
+	TEST_CHECK(analyzer.getStepInterval(1, 1200, 1, fromTicks, toTicks));
+	TEST_CHECK_EQUAL(fromTicks, 1280);
+	TEST_CHECK_EQUAL(toTicks, 1600);
+
+	// Many periods later, on either side of a loop boundary
+	TEST_CHECK(analyzer.getStepInterval(1, 100 * 7040 - 10, 5, fromTicks, toTicks));
+	TEST_CHECK_EQUAL(fromTicks, 100 * 7040 - 5120);
+	TEST_CHECK_EQUAL(toTicks, 100 * 7040);
+	TEST_CHECK(analyzer.getStepInterval(1, 100 * 7040 - 10, 1, fromTicks, toTicks));
+	TEST_CHECK_EQUAL(fromTicks, 100 * 7040);
+	TEST_CHECK_EQUAL(toTicks, 100 * 7040 + 320);
+
+	// Set PWM takes no time, and step 7 isn't in the program
+	TEST_CHECK(!analyzer.getStepInterval(1, 100, 0, fromTicks, toTicks));
+	TEST_CHECK(!analyzer.getStepInterval(1, 100, 7, fromTicks, toTicks));
+
+	// A program that ends is back at step 0 after the End
+	LP5562Program program;
+	makeOneShot(program, 100);
+	analyzer.clearPrograms();
+	analyzer.withProgram(2, program);
+	TEST_CHECK(analyzer.analyze().success);
+	TEST_CHECK(analyzer.getStepInterval(2, 1000000, 0, fromTicks, toTicks));
+	TEST_CHECK_EQUAL(fromTicks, analyzer.getResult().engines[1].endTicks);
+	TEST_CHECK_EQUAL(toTicks, UINT64_MAX);
+}
+
+int main() {
+	TEST_RUN(testPeriodic);
+	TEST_RUN(testEnds);
+	TEST_RUN(testExactPeriod);
+	TEST_RUN(testTriggerPair);
+	TEST_RUN(testDeadlock);
+	TEST_RUN(testZeroTimeLoop);
+	TEST_RUN(testStepInterval);
+	return testResult();
+}
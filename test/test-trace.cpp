@@ -0,0 +1,99 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of LP5562TraceTransport and LP5562TraceReplayer
+
+#include "LP5562-RK-Trace.h"
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+#include <string.h>
+
+static void testRecord() {
+	LP5562Simulator sim;
+	LP5562TraceTransport::Entry buffer[4];
+	LP5562TraceTransport trace(sim, buffer, 4);
+	LP5562 ledDriver(0x30, trace);
+
+	ledDriver.setRGB(1, 2, 3);
+	TEST_CHECK_EQUAL(trace.getNumEntries(), 1);
+
+	const LP5562TraceTransport::Entry *entry = trace.getEntry(0);
+	TEST_CHECK(entry != NULL);
+	TEST_CHECK_EQUAL(entry->addr, 0x30);
+	TEST_CHECK_EQUAL(entry->reg, LP5562::REG_B_PWM);
+	TEST_CHECK_EQUAL(entry->flags, LP5562TraceTransport::FLAG_SUCCESS);
+	TEST_CHECK_EQUAL(entry->numValues, 3);
+
+	char line[128];
+	LP5562TraceTransport::formatEntry(*entry, line, sizeof(line), false);
+	TEST_CHECK(strcmp(line, "W 30 reg=02 ok   03 02 01") == 0);
+
+	// A failed read is recorded too
+	sim.failNextTransactions(1);
+	uint8_t value;
+	TEST_CHECK(!ledDriver.readRegisters(LP5562::REG_ENABLE, &value, 1));
+	entry = trace.getEntry(1);
+	TEST_CHECK_EQUAL(entry->flags, LP5562TraceTransport::FLAG_READ);
+
+	// The oldest entries are overwritten when the buffer is full
+	for(uint8_t ii = 0; ii < 5; ii++) {
+		ledDriver.setW(ii);
+	}
+	TEST_CHECK_EQUAL(trace.getNumEntries(), 4);
+	TEST_CHECK_EQUAL(trace.getTotalRecorded(), 7);
+	TEST_CHECK_EQUAL(trace.getEntry(0)->values[0], 1);
+	TEST_CHECK_EQUAL(trace.getEntry(3)->values[0], 4);
+	TEST_CHECK(trace.getEntry(4) == NULL);
+}
+
+/**
+ * @brief Time callback for the replayer that advances the simulator
+ */
+static void advanceSim(uint32_t deltaMicros, void *context) {
+	LP5562Simulator *sim = (LP5562Simulator *)context;
+	sim->advanceTicks(LP5562SimEngines::microsToTicks(deltaMicros));
+}
+
+static void testReplay() {
+	LP5562Simulator sim;
+	LP5562TraceTransport::Entry buffer[64];
+	LP5562TraceTransport trace(sim, buffer, 64);
+	LP5562 ledDriver(0x30, trace);
+	TEST_CHECK(ledDriver.begin());
+	ledDriver.setBlink(0, 255, 0, 100, 100);
+	ledDriver.setW(12);
+	TEST_CHECK(trace.getTotalRecorded() <= 64);
+
+	uint8_t data[4096];
+	size_t size = trace.writeBinary(data, sizeof(data));
+	TEST_CHECK_EQUAL(size, trace.getBinarySize());
+
+	// Replaying into a new simulator puts it in the same state
+	LP5562Simulator sim2;
+	LP5562TraceReplayer replayer(data, size);
+	TEST_CHECK(replayer.isValid());
+	TEST_CHECK_EQUAL(replayer.getNumEntries(), trace.getNumEntries());
+	replayer.withTimeCallback(advanceSim, &sim2);
+	TEST_CHECK(replayer.replay(sim2));
+	TEST_CHECK_EQUAL(replayer.getFailures(), 0);
+	TEST_CHECK_EQUAL(replayer.getReadMismatches(), 0);
+
+	for(uint8_t reg = LP5562::REG_ENABLE; reg <= LP5562::REG_LED_MAP; reg++) {
+		if (reg >= LP5562::REG_ENG1_PC && reg <= LP5562::REG_RESET) {
+			continue;
+		}
+		TEST_CHECK_EQUAL(sim2.getRegister(reg), sim.getRegister(reg));
+	}
+	TEST_CHECK(sim2.isEngineRunning(1));
+
+	// Truncated trace
+	LP5562TraceReplayer truncated(data, size - 1);
+	TEST_CHECK(!truncated.replay(sim2));
+}
+
+int main() {
+	TEST_RUN(testRecord);
+	TEST_RUN(testReplay);
+	return testResult();
+}
@@ -0,0 +1,90 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of the checks made by the library built with ENABLE_PROGRAM_VALIDATION
+
+#include "LP5562-Test.h"
+
+static const uint16_t waitFor2[] = {
+	LP5562Opcode::triggerWait(LP5562::MASK_ENGINE_2),
+	LP5562Opcode::setPWM(255),
+	LP5562Opcode::wait(true, 32)
+};
+
+static const uint16_t sendTo1[] = {
+	LP5562Opcode::wait(true, 32),
+	LP5562Opcode::triggerSend(LP5562::MASK_ENGINE_1)
+};
+
+static const uint16_t blink[] = {
+	LP5562Opcode::setPWM(255),
+	LP5562Opcode::wait(true, 32),
+	LP5562Opcode::setPWM(0),
+	LP5562Opcode::wait(true, 32)
+};
+
+static void testSetProgram() {
+	TestChip chip;
+
+	// The branch is past the end of the program, so nothing is written
+	static const uint16_t outOfRange[] = {
+		LP5562Opcode::wait(true, 32),
+		LP5562Opcode::branch(2, 5)
+	};
+	chip.sim.clearTransactions();
+	TEST_CHECK(!chip.ledDriver.setProgram(1, outOfRange, false));
+	TEST_CHECK_EQUAL(chip.sim.getNumTransactions(), 0);
+
+	TEST_CHECK(chip.ledDriver.setProgram(1, blink, true));
+	TEST_CHECK(chip.sim.isEngineRunning(1));
+}
+
+static void testStartEngines() {
+	TestChip chip;
+
+	// Engine 2 doesn't send, so engine 1 would wait forever
+	TEST_CHECK(chip.ledDriver.setProgram(1, waitFor2, false));
+	TEST_CHECK(chip.ledDriver.setProgram(2, blink, false));
+	TEST_CHECK(!chip.ledDriver.startEngines(LP5562::MASK_ENGINE_1 | LP5562::MASK_ENGINE_2));
+	TEST_CHECK(!chip.sim.isEngineRunning(1));
+	TEST_CHECK(!chip.sim.isEngineRunning(2));
+
+	// Nor does it when started alone
+	TEST_CHECK(!chip.ledDriver.startEngines(LP5562::MASK_ENGINE_1));
+	TEST_CHECK(!chip.sim.isEngineRunning(1));
+
+	// With a program that sends, both start
+	TEST_CHECK(chip.ledDriver.setProgram(2, sendTo1, false));
+	TEST_CHECK(chip.ledDriver.startEngines(LP5562::MASK_ENGINE_1 | LP5562::MASK_ENGINE_2));
+	TEST_CHECK(chip.sim.isEngineRunning(1));
+	TEST_CHECK(chip.sim.isEngineRunning(2));
+	chip.sim.advanceMillis(600);
+	TEST_CHECK_EQUAL(chip.sim.getEnginePWM(1), 255);
+}
+
+static void testAlreadyRunning() {
+	TestChip chip;
+
+	// A send to an engine that isn't running never completes, so engine 2 can't be started alone
+	TEST_CHECK(!chip.ledDriver.setProgram(2, sendTo1, true));
+	TEST_CHECK(!chip.sim.isEngineRunning(2));
+
+	TEST_CHECK(chip.ledDriver.setProgram(1, waitFor2, false));
+	TEST_CHECK(chip.ledDriver.startEngines(LP5562::MASK_ENGINE_1 | LP5562::MASK_ENGINE_2));
+
+	// Engine 2 is already running, so engine 1 can be restarted on its own
+	TEST_CHECK(chip.ledDriver.setProgram(1, waitFor2, true));
+	TEST_CHECK(chip.sim.isEngineRunning(1));
+
+	// Once engine 2 is held, a program waiting for it can't be started
+	TEST_CHECK(chip.ledDriver.setEnable(LP5562::MASK_ENGINE_ALL, LP5562::REG_ENABLE_HOLD));
+	TEST_CHECK(!chip.ledDriver.setProgram(1, waitFor2, true));
+	TEST_CHECK(!chip.sim.isEngineRunning(1));
+}
+
+int main() {
+	TEST_RUN(testSetProgram);
+	TEST_RUN(testStartEngines);
+	TEST_RUN(testAlreadyRunning);
+	return testResult();
+}
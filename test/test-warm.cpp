@@ -0,0 +1,104 @@
+// Repository: https://github.com/rickkas7/LP5562-RK
+// License: MIT
+
+// Tests of withWarmStart()
+
+#include "LP5562-RK-Sim.h"
+#include "LP5562-Test.h"
+
+/**
+ * @brief Simulator that lets time pass after the first burst read starting at REG_ENABLE, like a
+ * thread switch in the middle of begin()
+ */
+class DelayedSimulator : public LP5562Simulator {
+public:
+	virtual bool readRegisters(uint8_t addr, uint8_t reg, uint8_t *values, size_t numValues) {
+		bool bResult = LP5562Simulator::readRegisters(addr, reg, values, numValues);
+		if (reg == LP5562::REG_ENABLE && numValues > 1 && delayMs) {
+			advanceMillis(delayMs);
+			delayMs = 0;
+		}
+		return bResult;
+	}
+
+	unsigned long delayMs = 0;
+};
+
+/**
+ * @brief Returns true if any write to REG_RESET was recorded
+ */
+static bool wasReset(const LP5562Simulator &sim) {
+	for(size_t ii = 0; ii < sim.getNumTransactions(); ii++) {
+		const LP5562MockTransport::Transaction &t = sim.getTransaction(ii);
+		if (!t.isRead && t.reg <= LP5562::REG_RESET && t.reg + t.numValues > LP5562::REG_RESET) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void testColdChip() {
+	TestChip chip(false);
+	TEST_CHECK(chip.ledDriver.withWarmStart().begin());
+	TEST_CHECK(!chip.ledDriver.getWarmStarted());
+	TEST_CHECK(wasReset(chip.sim));
+}
+
+static void testKeepsRunning() {
+	LP5562Simulator sim;
+	{
+		LP5562 ledDriver(0x30, sim);
+		TEST_CHECK(ledDriver.begin());
+		ledDriver.setBlink(255, 0, 0, 200, 200);
+	}
+	sim.advanceMillis(50);
+
+	// The MCU restarted
+	sim.clearTransactions();
+	LP5562 ledDriver(0x30, sim);
+	TEST_CHECK(ledDriver.withWarmStart().begin());
+	TEST_CHECK(ledDriver.getWarmStarted());
+	TEST_CHECK(!wasReset(sim));
+	TEST_CHECK(sim.isEngineRunning(1));
+	TEST_CHECK_EQUAL(sim.getOutput(LP5562Simulator::CHANNEL_R), 255);
+
+	// Same settings, so nothing is written
+	for(size_t ii = 0; ii < sim.getNumTransactions(); ii++) {
+		TEST_CHECK(sim.getTransaction(ii).isRead);
+	}
+}
+
+static void testEndedEngineNotRestarted() {
+	DelayedSimulator sim;
+	{
+		LP5562 ledDriver(0x30, sim);
+		TEST_CHECK(ledDriver.withUseLogarithmicMode(false).begin());
+
+		LP5562Program program;
+		program.addCommandSetPWM(255);
+		program.addDelay(100);
+		program.addCommandEnd(false, true);
+		TEST_CHECK(ledDriver.setLedMappingR(LP5562::REG_LED_MAP_ENGINE_1));
+		TEST_CHECK(ledDriver.setProgram(1, program, true));
+	}
+	sim.advanceMillis(50);
+	TEST_CHECK(sim.isEngineRunning(1));
+
+	// The engine ends after begin() read the enable register but before it changes LOG_EN
+	sim.delayMs = 100;
+	LP5562 ledDriver(0x30, sim);
+	TEST_CHECK(ledDriver.withWarmStart().begin());
+	TEST_CHECK(ledDriver.getWarmStarted());
+	TEST_CHECK((sim.getRegister(LP5562::REG_ENABLE) & LP5562::REG_ENABLE_LOG_EN) != 0);
+	TEST_CHECK(!sim.isEngineRunning(1));
+
+	sim.advanceMillis(50);
+	TEST_CHECK_EQUAL(sim.getOutput(LP5562Simulator::CHANNEL_R), 0);
+}
+
+int main() {
+	TEST_RUN(testColdChip);
+	TEST_RUN(testKeepsRunning);
+	TEST_RUN(testEndedEngineNotRestarted);
+	return testResult();
+}